@@ -0,0 +1,172 @@
+/*
+** Benchmark: the allocators of 'luaL_newstatex' (LUAL_ALLOCSYS, that is
+** 'realloc'/'free', and LUAL_ALLOCSLAB), with our allocation profile:
+** "raw" drives the allocator function directly with the sizes Lua asks
+** for (strings, tables, node and array vectors, closures, call infos,
+** and a few large buffers); "script" runs a Lua workload that builds,
+** updates and drops entity records. Each allocator runs in its own
+** process, so that the resident set sizes are its own: "peak" is the
+** maximum resident set, "after" the one left after a full collection
+** once the data is dropped.
+**
+** Build (from this directory, after building liblua.a in ../src):
+**   cc -O2 -I../src bench_alloc.c ../src/liblua.a -lm -lpthread -o bench_alloc
+** POSIX only (uses 'fork', 'getrusage' and /proc/self/statm).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+#define NLIVE	200000	/* live blocks in "raw" */
+#define NOPS	10000000	/* operations in "raw" */
+
+
+static unsigned long seed = 12345;
+
+static unsigned long rnd(void) {
+	seed = seed * 6364136223846793005ul + 1442695040888963407ul;
+	return seed >> 33;
+}
+
+
+/* block sizes, as seen from 'lua_Alloc' in our servers */
+static size_t blocksize(void) {
+	unsigned long r = rnd() % 1000;
+	if (r < 400)  /* short strings */
+		return 24 + 1 + rnd() % 40;
+	else if (r < 550)  /* tables */
+		return 56;
+	else if (r < 800)  /* node vectors of small tables */
+		return (size_t)24 << (rnd() % 5);
+	else if (r < 900)  /* closures, upvalues, call infos */
+		return 32 + 8 * (rnd() % 8);
+	else if (r < 990)  /* array parts, long strings */
+		return 64 + rnd() % 4096;
+	else if (r < 999)  /* buffers */
+		return 4096 + rnd() % 60000;
+	else  /* large arrays */
+		return 100000 + rnd() % 400000;
+}
+
+
+static void* blocks[NLIVE];
+static size_t sizes[NLIVE];
+
+
+static double raw(lua_State* L) {
+	void* ud;
+	lua_Alloc f = lua_getallocf(L, &ud);
+	clock_t t0 = clock();
+	long i;
+	for (i = 0; i < NLIVE; i++) {
+		sizes[i] = blocksize();
+		blocks[i] = f(ud, NULL, LUA_TTABLE, sizes[i]);
+		memset(blocks[i], 0, sizes[i] < 64 ? sizes[i] : 64);
+	}
+	for (i = 0; i < NOPS; i++) {
+		int k = (int)(rnd() % NLIVE);
+		if (rnd() % 8 == 0) {  /* grow or shrink, as vectors do */
+			size_t ns = (rnd() % 2 && sizes[k] < 65536) ? sizes[k] * 2
+			                                             : sizes[k] / 2 + 1;
+			blocks[k] = f(ud, blocks[k], sizes[k], ns);
+			sizes[k] = ns;
+		}
+		else {
+			f(ud, blocks[k], sizes[k], 0);
+			sizes[k] = blocksize();
+			blocks[k] = f(ud, NULL, LUA_TSTRING, sizes[k]);
+		}
+		*(char*)blocks[k] = 1;
+	}
+	for (i = 0; i < NLIVE; i++)
+		f(ud, blocks[i], sizes[i], 0);
+	return (double)(clock() - t0) / CLOCKS_PER_SEC;
+}
+
+
+static const char script[] =
+	"local names = {'orc', 'wolf', 'guard', 'merchant', 'bandit'}\n"
+	"local world = {}\n"
+	"for round = 1, 40 do\n"
+	"  for i = 1, 20000 do\n"
+	"    world[i] = {id = i, name = names[i % 5 + 1] .. i,\n"
+	"      pos = {x = i, y = round, z = 0}, hp = 100,\n"
+	"      buffs = {}, tag = 'zone' .. (i % 97)}\n"
+	"  end\n"
+	"  for i = 1, 20000 do\n"
+	"    local e = world[i]\n"
+	"    e.buffs[#e.buffs + 1] = {kind = 'haste', left = round}\n"
+	"    e.pos = {x = e.pos.x + 1, y = e.pos.y, z = e.pos.z}\n"
+	"    e.msg = string.format('%s at %d,%d', e.name, e.pos.x, e.pos.y)\n"
+	"  end\n"
+	"  for i = 1, 20000, 3 do world[i] = nil end\n"
+	"end\n"
+	"world = nil\n";
+
+
+static double runscript(lua_State* L) {
+	clock_t t0 = clock();
+	if (luaL_dostring(L, script) != LUA_OK) {
+		fprintf(stderr, "%s\n", lua_tostring(L, -1));
+		exit(1);
+	}
+	return (double)(clock() - t0) / CLOCKS_PER_SEC;
+}
+
+
+/* resident set size, in KB */
+static long currentrss(void) {
+	long pages = 0, rss = 0;
+	FILE* f = fopen("/proc/self/statm", "r");
+	if (f != NULL) {
+		if (fscanf(f, "%ld %ld", &pages, &rss) != 2)
+			rss = 0;
+		fclose(f);
+	}
+	return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+
+static long peakrss(void) {
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_maxrss;
+}
+
+
+static void run(const char* name, int alloc, int what) {
+	pid_t pid = fork();
+	if (pid == 0) {
+		lua_State* L = luaL_newstatex(alloc);
+		double t;
+		luaL_openlibs(L);
+		t = (what == 0) ? raw(L) : runscript(L);
+		lua_gc(L, LUA_GCCOLLECT);
+		printf("%-6s %-7s %7.3f s   peak %7ld KB   after %7ld KB\n",
+		       name, what == 0 ? "raw" : "script", t, peakrss(), currentrss());
+		fflush(stdout);
+		lua_close(L);
+		exit(0);
+	}
+	waitpid(pid, NULL, 0);
+}
+
+
+int main(void) {
+	int what;
+	for (what = 0; what < 2; what++) {
+		run("sys", LUAL_ALLOCSYS, what);
+		run("slab", LUAL_ALLOCSLAB, what);
+	}
+	return 0;
+}
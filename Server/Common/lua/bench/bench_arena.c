@@ -0,0 +1,103 @@
+/*
+** Benchmark: arena scopes ('lua_pusharena'/'lua_poparena') in
+** generational mode. A server keeps an old heap (the world) and handles
+** requests that build request-local data incrementally, keeping it
+** alive until the end of the request; one small result per request
+** escapes into a bounded cache. Each workload runs without and with a
+** scope around each request, in the same process order. "gc" is the
+** time spent in collections (from the collector telemetry), which is
+** less noisy than the total time; "minor"/"major" count collections
+** (major ones include full collections and cycles run while the
+** collector is temporarily incremental after bad major collections).
+**
+** Build (from this directory, after building liblua.a in ../src):
+**   cc -O2 -I../src bench_arena.c ../src/liblua.a -lm -lpthread -o bench_arena
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+static const char setup[] =
+	"local nworld, nitems = ...\n"
+	"world = {}\n"
+	"for i = 1, nworld do world[i] = {id = i, name = 'npc' .. i} end\n"
+	"local cache, first, last = {}, 1, 0\n"
+	"function handle(req)\n"
+	"  local items = {}\n"
+	"  for i = 1, nitems do\n"
+	"    local w = world[(req * 7919 + i) % nworld + 1]\n"
+	"    items[i] = {ref = w, score = i * req}\n"
+	"  end\n"
+	"  local best = items[1]\n"
+	"  for i = 2, #items do\n"
+	"    if items[i].score % 97 > best.score % 97 then best = items[i] end\n"
+	"  end\n"
+	"  last = last + 1; cache[last] = {key = best.ref.name}\n"
+	"  if last - first >= 2000 then cache[first] = nil; first = first + 1 end\n"
+	"end\n";
+
+
+static void run(int nworld, int nitems, int nrequests, int scoped) {
+	lua_State* L = luaL_newstate();
+	lua_GCStats st;
+	clock_t t0;
+	lua_Unsigned start, n, gctime = 0, minor = 0;
+	int i;
+	luaL_openlibs(L);
+	lua_gc(L, LUA_GCGEN, 0, 0);
+	if (luaL_loadstring(L, setup) != LUA_OK) {
+		fprintf(stderr, "%s\n", lua_tostring(L, -1));
+		exit(1);
+	}
+	lua_pushinteger(L, nworld);
+	lua_pushinteger(L, nitems);
+	lua_call(L, 2, 0);
+	lua_gc(L, LUA_GCCOLLECT);
+	lua_gc(L, LUA_GCSTATS, &st);
+	start = n = st.ncycles;
+	t0 = clock();
+	for (i = 0; i < nrequests; i++) {
+		if (scoped)
+			lua_pusharena(L);
+		lua_getglobal(L, "handle");
+		lua_pushinteger(L, i);
+		lua_call(L, 1, 0);
+		if (scoped)
+			lua_poparena(L);
+		lua_gc(L, LUA_GCSTATS, &st);
+		for (; n < st.ncycles; n++) {  /* new collections */
+			const lua_GCCycle* c = &st.cycles[n % LUA_GCNCYCLES];
+			minor += (c->kind == LUA_GCKMINOR);
+			gctime += c->propagate + c->atomic + c->sweep + c->finalize;
+		}
+	}
+	printf("  %-6s %7.3f s   gc %7.3f s   minor %5lu   major %4lu   heap %6d KB\n",
+	       scoped ? "scoped" : "plain", (double)(clock() - t0) / CLOCKS_PER_SEC,
+	       (double)gctime / 1e9, (unsigned long)minor,
+	       (unsigned long)(n - start - minor), lua_gc(L, LUA_GCCOUNT));
+	lua_close(L);
+}
+
+
+int main(void) {
+	static const int loads[][3] = {  /* world, items per request, requests */
+		{100000, 600, 20000},
+		{100000, 5000, 3000},
+		{100000, 20000, 800},
+		{300000, 50000, 300}
+	};
+	size_t k;
+	for (k = 0; k < sizeof(loads) / sizeof(loads[0]); k++) {
+		printf("world %d, %d items x %d requests\n",
+		       loads[k][0], loads[k][1], loads[k][2]);
+		run(loads[k][0], loads[k][1], loads[k][2], 0);
+		run(loads[k][0], loads[k][1], loads[k][2], 1);
+	}
+	return 0;
+}
@@ -0,0 +1,153 @@
+/*
+** Benchmark: time to spawn a ready-to-run state (say, one per session
+** or per request), built from scratch ('luaL_newstate', 'luaL_openlibs'
+** and loading the application code) and cloned from a template frozen
+** with 'lua_freeze' ('luaL_clone'). The application code is NMODS
+** generated modules, each a table of functions and some configuration
+** data, loaded through 'require'. Each spawned state runs a small
+** handler, so that clones are shown to be ready to use, and is closed;
+** times are averages per state and include the close. Before timing,
+** it checks which userdata a template may hold (see 'checkfreeze').
+**
+** Build (from this directory, after building liblua.a in ../src):
+**   cc -O2 -I../src bench_clone.c ../src/liblua.a -lm -lpthread -o bench_clone
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+#define NMODS	50
+#define ROUNDS	200
+
+
+static const char module[] =
+	"local M = {config = {}}\n"
+	"for i = 1, 40 do M.config['opt' .. i] = {value = i, name = 'opt' .. i} end\n"
+	"function M.handle(req) return req.n * 2 + #M.config end\n"
+	"function M.validate(req) return type(req.n) == 'number' end\n"
+	"function M.format(v) return string.format('%%s=%%d', '%s', v) end\n"
+	"return M\n";
+
+static const char handler[] =
+	"local req = {n = 21}\n"
+	"for i = 1, 5 do\n"
+	"  local m = require('mod' .. i)\n"
+	"  assert(m.validate(req) and m.handle(req) == 42)\n"
+	"end\n";
+
+
+/* 'package.preload' searcher for the generated modules */
+static int loadmod(lua_State* L) {
+	char code[sizeof(module) + 16];
+	const char* name = luaL_checkstring(L, 1);
+	snprintf(code, sizeof(code), module, name);
+	if (luaL_loadbuffer(L, code, strlen(code), name) != LUA_OK)
+		return lua_error(L);
+	lua_call(L, 0, 1);
+	return 1;
+}
+
+
+static void dostring(lua_State* L, const char* s) {
+	if (luaL_dostring(L, s) != LUA_OK) {
+		fprintf(stderr, "%s\n", lua_tostring(L, -1));
+		exit(1);
+	}
+}
+
+
+/* a state with the libraries and all modules loaded */
+static lua_State* build(void) {
+	lua_State* L = luaL_newstate();
+	char req[32];
+	int i;
+	luaL_openlibs(L);
+	luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+	for (i = 1; i <= NMODS; i++) {
+		snprintf(req, sizeof(req), "mod%d", i);
+		lua_pushcfunction(L, loadmod);
+		lua_setfield(L, -2, req);
+	}
+	lua_pop(L, 1);
+	for (i = 1; i <= NMODS; i++) {
+		snprintf(req, sizeof(req), "require 'mod%d'", i);
+		dostring(L, req);
+	}
+	return L;
+}
+
+
+/*
+** Clones get byte copies of the userdata of a template, so 'lua_freeze'
+** must refuse a string buffer (which owns its memory) and keep a
+** matcher from 'string.compileany' (which owns nothing).
+*/
+static void checkfreeze(void) {
+	lua_State* T = luaL_newstate();
+	lua_State* L;
+	luaL_openlibs(T);
+	dostring(T, "B = string.newbuffer(); B:append('hello')\n"
+		"M = string.compileany{'foo', 'bar'}\n");
+	if (lua_freeze(T) == LUA_OK) {
+		fprintf(stderr, "template with a string buffer was frozen\n");
+		exit(1);
+	}
+	lua_pop(T, 1);  /* error message */
+	dostring(T, "B = nil; collectgarbage()");
+	if (lua_freeze(T) != LUA_OK) {
+		fprintf(stderr, "%s\n", lua_tostring(T, -1));
+		exit(1);
+	}
+	L = luaL_clone(T);
+	dostring(L, "assert(M:find('xxbar') == 3)\n"
+		"B = string.newbuffer(); B:append('hello', 'world'); assert(#B == 10)\n");
+	lua_close(L);
+	lua_close(T);
+}
+
+
+static double now(void) {
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+
+int main(void) {
+	lua_State* T;
+	double t0, tbuild, tclone;
+	size_t kb;
+	int i;
+	checkfreeze();
+	t0 = now();
+	for (i = 0; i < ROUNDS; i++) {
+		lua_State* L = build();
+		dostring(L, handler);
+		lua_close(L);
+	}
+	tbuild = (now() - t0) / ROUNDS;
+	T = build();
+	kb = (size_t)lua_gc(T, LUA_GCCOUNT);
+	if (lua_freeze(T) != LUA_OK) {
+		fprintf(stderr, "%s\n", lua_tostring(T, -1));
+		return 1;
+	}
+	t0 = now();
+	for (i = 0; i < ROUNDS; i++) {
+		lua_State* L = luaL_clone(T);
+		dostring(L, handler);
+		lua_close(L);
+	}
+	tclone = (now() - t0) / ROUNDS;
+	lua_close(T);
+	printf("%d modules, template of %zu KB\n", NMODS, kb);
+	printf("  build  %9.1f us per state\n", tbuild * 1e6);
+	printf("  clone  %9.1f us per state  (%.1fx)\n", tclone * 1e6,
+	       tbuild / tclone);
+	return 0;
+}
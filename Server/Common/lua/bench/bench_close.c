@@ -0,0 +1,94 @@
+/*
+** Benchmark: time the thread running a state spends in collections
+** and in closing it, for the allocators of 'luaL_newstatex'
+** (LUAL_ALLOCSYS, LUAL_ALLOCSLAB and LUAL_ALLOCBGFREE), with a plain
+** 'lua_close' and with 'luaL_closeasync'. Each run builds an actor-like
+** heap (entity records with strings and small tables), then replaces
+** half of it and times a full collection ("gc") and the close
+** ("close"). Times are CPU times of the calling thread only, so that
+** work moved to the reaper does not count even on a machine with a
+** single core (where the wall-clock time would include it). A final
+** wait lets the reaper finish before the next run. The gains of
+** LUAL_ALLOCBGFREE in "gc" need a core free for the reaper: on a single
+** core its frees compete with the collector and make it slower.
+**
+** Build (from this directory, after building liblua.a in ../src):
+**   cc -O2 -I../src bench_close.c ../src/liblua.a -lm -lpthread -o bench_close
+** POSIX only (uses CLOCK_THREAD_CPUTIME_ID and 'nanosleep').
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+static const char build[] =
+	"local n = ...\n"
+	"ents = {}\n"
+	"for i = 1, n do\n"
+	"  ents[i] = {id = i, name = 'ent' .. i, pos = {x = i, y = -i},\n"
+	"             tags = {'a' .. i % 97, 'b' .. i % 89}}\n"
+	"end\n";
+
+static const char churn[] =
+	"for i = 1, #ents, 2 do\n"
+	"  ents[i] = {id = i, name = 'new' .. i, pos = {x = 0, y = 0}}\n"
+	"end\n";
+
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void dostring(lua_State* L, const char* s, int n) {
+	if (luaL_loadstring(L, s) != LUA_OK) {
+		fprintf(stderr, "%s\n", lua_tostring(L, -1));
+		exit(1);
+	}
+	lua_pushinteger(L, n);
+	lua_call(L, 1, 0);
+}
+
+
+static void run(const char* name, int alloc, int async, int n) {
+	lua_State* L = luaL_newstatex(alloc);
+	struct timespec pause = {1, 0};
+	double t0, tgc, tclose;
+	luaL_openlibs(L);
+	lua_gc(L, LUA_GCSTOP);
+	dostring(L, build, n);
+	lua_gc(L, LUA_GCCOLLECT);
+	dostring(L, churn, n);
+	t0 = now();
+	lua_gc(L, LUA_GCCOLLECT);
+	tgc = now() - t0;
+	t0 = now();
+	if (async)
+		luaL_closeasync(L);
+	else
+		lua_close(L);
+	tclose = now() - t0;
+	printf("  %-6s %-5s  gc %7.1f ms   close %7.1f ms\n", name,
+	       async ? "async" : "sync", tgc * 1e3, tclose * 1e3);
+	nanosleep(&pause, NULL);  /* let the reaper finish */
+}
+
+
+int main(int argc, char* argv[]) {
+	int n = (argc > 1) ? atoi(argv[1]) : 500000;
+	printf("%d entities\n", n);
+	run("sys", LUAL_ALLOCSYS, 0, n);
+	run("sys", LUAL_ALLOCSYS, 1, n);
+	run("slab", LUAL_ALLOCSLAB, 0, n);
+	run("slab", LUAL_ALLOCSLAB, 1, n);
+	run("bgfree", LUAL_ALLOCBGFREE, 0, n);
+	run("bgfree", LUAL_ALLOCBGFREE, 1, n);
+	return 0;
+}
@@ -0,0 +1,106 @@
+/*
+** Benchmark: big binary blobs as plain full userdata and as external
+** buffers ('lua_newbufferuv'). A state keeps a world of small objects
+** and a ring of the last RING blobs (say, replay chunks); each round
+** makes a new blob and some small garbage. "cycles" and "gc" are the
+** collections finished during the rounds and the time spent in them
+** (from the collector telemetry); "peak" is the largest amount of
+** memory in use, blobs included (from the accounting allocator).
+** External buffers run with a few values of 'extweight' (with a plain
+** userdata a blob counts with all its bytes), and then with the blob
+** leaving the ring released explicitly: dead blobs no longer wait for
+** a collection, so the peak stays low with a low weight too.
+**
+** Build (from this directory, after building liblua.a in ../src):
+**   cc -O2 -I../src bench_extbuf.c ../src/liblua.a -lm -lpthread -o bench_extbuf
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+#define RING	32	/* blobs kept alive */
+#define ROUNDS	5000
+
+
+static const char setup[] =
+	"world = {}\n"
+	"for i = 1, 300000 do world[i] = {id = i, name = 'npc' .. i} end\n"
+	"function garbage(n)\n"
+	"  local t = {}\n"
+	"  for i = 1, 50 do t[i] = {n, i} end\n"
+	"end\n";
+
+
+/* 'weight' < 0 means plain userdata */
+static void run(size_t blobsize, int weight, int release) {
+	lua_State* L = luaL_newstate();
+	const luaL_MemStats* ms = luaL_setmemlimit(L, 0);
+	lua_GCStats st;
+	lua_Unsigned n0, n, gctime = 0;
+	clock_t t0;
+	int i;
+	luaL_openlibs(L);
+	if (luaL_dostring(L, setup) != LUA_OK) {
+		fprintf(stderr, "%s\n", lua_tostring(L, -1));
+		exit(1);
+	}
+	if (weight >= 0)
+		lua_gc(L, LUA_GCSETEXTWEIGHT, weight);
+	lua_createtable(L, RING, 0);  /* the ring */
+	lua_gc(L, LUA_GCCOLLECT);
+	lua_gc(L, LUA_GCSTATS, &st);
+	n0 = n = st.ncycles;
+	t0 = clock();
+	for (i = 0; i < ROUNDS; i++) {
+		void* p;
+		if (release) {  /* release the blob leaving the ring */
+			lua_rawgeti(L, -1, i % RING + 1);
+			lua_releasebuffer(L, -1);
+			lua_pop(L, 1);
+		}
+		p = (weight < 0) ? lua_newuserdatauv(L, blobsize, 0)
+		                 : lua_newbufferuv(L, blobsize, 0);
+		memset(p, i, blobsize);
+		lua_rawseti(L, -2, i % RING + 1);
+		lua_getglobal(L, "garbage");
+		lua_pushinteger(L, i);
+		lua_call(L, 1, 0);
+		lua_gc(L, LUA_GCSTATS, &st);
+		for (; n < st.ncycles; n++) {  /* new collections */
+			const lua_GCCycle* c = &st.cycles[n % LUA_GCNCYCLES];
+			gctime += c->propagate + c->atomic + c->sweep + c->finalize;
+		}
+	}
+	if (weight < 0)
+		printf("  plain               ");
+	else
+		printf("  ext (%3d%%) %-8s ", weight, release ? "released" : "");
+	printf("%7.3f s   cycles %5lu   gc %7.3f s   peak %7zu KB\n",
+	       (double)(clock() - t0) / CLOCKS_PER_SEC, (unsigned long)(n - n0),
+	       (double)gctime / 1e9, ms->peak >> 10);
+	lua_close(L);
+}
+
+
+int main(void) {
+	static const size_t sizes[] = {16 << 10, 256 << 10, 1 << 20};
+	size_t k;
+	for (k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+		printf("blobs of %zu KB, %d rounds, %d kept\n",
+		       sizes[k] >> 10, ROUNDS, RING);
+		run(sizes[k], -1, 0);
+		run(sizes[k], 100, 0);
+		run(sizes[k], 10, 0);
+		run(sizes[k], 1, 0);
+		run(sizes[k], 10, 1);
+		run(sizes[k], 1, 1);
+	}
+	return 0;
+}
@@ -0,0 +1,121 @@
+/*
+** Benchmark: short-string interning throughput ('lua_pushlstring'),
+** for several distributions of string lengths. "hit" interns strings
+** that already exist (the common case when decoding known keys);
+** "new" interns strings seen for the first time.
+**
+** Build (from this directory, after building liblua.a in ../src):
+**   cc -O2 -I../src bench_intern.c ../src/liblua.a -lm -lpthread -o bench_intern
+** Compare with a build of ../src from before the change to 'luaS_hash'.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+#define NKEYS	100000
+#define NROUNDS	50
+#define MAXLEN	40	/* LUAI_MAXSHORTLEN */
+
+
+static unsigned long seed = 12345;
+
+static unsigned long rnd(void) {
+	seed = seed * 6364136223846793005ul + 1442695040888963407ul;
+	return seed >> 33;
+}
+
+
+/* length distributions: a fixed length, or uniform in [lo, hi] */
+static const struct { const char* name; int lo, hi; } dists[] = {
+	{"len 4", 4, 4},
+	{"len 8", 8, 8},
+	{"len 16", 16, 16},
+	{"len 32", 32, 32},
+	{"len 40", 40, 40},
+	{"1-12", 1, 12},
+	{"1-40", 1, 40}
+};
+
+
+static char keys[NKEYS][MAXLEN];
+static size_t lens[NKEYS];
+
+
+/* identifier-like keys, so that many of them share prefixes */
+static void makekeys(int lo, int hi) {
+	static const char chars[] =
+		"abcdefghijklmnopqrstuvwxyz_0123456789";
+	int i, j;
+	for (i = 0; i < NKEYS; i++) {
+		lens[i] = (size_t)(lo + (int)(rnd() % (unsigned long)(hi - lo + 1)));
+		for (j = 0; j < (int)lens[i]; j++)
+			keys[i][j] = chars[rnd() % (sizeof(chars) - 1)];
+	}
+}
+
+
+static double hits(lua_State* L) {
+	clock_t t0;
+	int r, i;
+	lua_createtable(L, NKEYS, 0);  /* keep all keys alive */
+	for (i = 0; i < NKEYS; i++) {
+		lua_pushlstring(L, keys[i], lens[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+	t0 = clock();
+	for (r = 0; r < NROUNDS; r++) {
+		for (i = 0; i < NKEYS; i++) {
+			lua_pushlstring(L, keys[i], lens[i]);
+			lua_pop(L, 1);
+		}
+	}
+	t0 = clock() - t0;
+	lua_pop(L, 1);
+	lua_gc(L, LUA_GCCOLLECT);
+	return (double)t0 / CLOCKS_PER_SEC;
+}
+
+
+static double news(lua_State* L) {
+	clock_t total = 0;
+	int r, i;
+	lua_gc(L, LUA_GCSTOP);  /* time interning, not collection */
+	for (r = 0; r < NROUNDS; r++) {
+		clock_t t0;
+		for (i = 0; i < NKEYS; i++)  /* new contents for this round */
+			keys[i][0] = (char)('A' + r % 26);
+		t0 = clock();
+		for (i = 0; i < NKEYS; i++) {
+			lua_pushlstring(L, keys[i], lens[i]);
+			lua_pop(L, 1);
+		}
+		total += clock() - t0;
+		lua_gc(L, LUA_GCCOLLECT);
+	}
+	lua_gc(L, LUA_GCRESTART);
+	return (double)total / CLOCKS_PER_SEC;
+}
+
+
+int main(void) {
+	lua_State* L = luaL_newstate();
+	int d;
+	for (d = 0; d < (int)(sizeof(dists) / sizeof(dists[0])); d++) {
+		double th, tn;
+		makekeys(dists[d].lo, dists[d].hi);
+		th = hits(L);
+		tn = news(L);
+		printf("%-7s hit %6.1f Mstr/s   new %6.1f Mstr/s\n", dists[d].name,
+		       (double)NKEYS * NROUNDS / th / 1e6,
+		       (double)NKEYS * NROUNDS / tn / 1e6);
+	}
+	lua_close(L);
+	return 0;
+}
@@ -0,0 +1,63 @@
+/*
+** Benchmark: calls/sec of a small C getter registered as a regular C
+** closure and as a leaf C closure ('lua_pushleafcclosure').
+**
+** Build (from this directory, after building liblua.a in ../src):
+**   cc -O2 -I../src bench_leafcall.c ../src/liblua.a -lm -lpthread -o bench_leafcall
+*/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+#define NCALLS	20000000
+
+
+static int getter(lua_State* L) {
+	lua_pushinteger(L, lua_tointeger(L, lua_upvalueindex(1)));
+	return 1;
+}
+
+
+static const char* const loop =
+"local get, n = ...\n"
+"local s = 0\n"
+"for i = 1, n do s = s + get() end\n"
+"return s\n";
+
+
+static double run(lua_State* L, int leaf) {
+	clock_t t0;
+	if (luaL_loadstring(L, loop) != LUA_OK)
+		return -1;
+	lua_pushinteger(L, 1);
+	if (leaf)
+		lua_pushleafcclosure(L, getter, 1, 1);
+	else
+		lua_pushcclosure(L, getter, 1);
+	lua_pushinteger(L, NCALLS);
+	t0 = clock();
+	if (lua_pcall(L, 2, 1, 0) != LUA_OK) {
+		fprintf(stderr, "%s\n", lua_tostring(L, -1));
+		return -1;
+	}
+	lua_pop(L, 1);
+	return (double)(clock() - t0) / CLOCKS_PER_SEC;
+}
+
+
+int main(void) {
+	lua_State* L = luaL_newstate();
+	double tc, tl;
+	luaL_openlibs(L);
+	tc = run(L, 0);
+	tl = run(L, 1);
+	printf("regular C closure: %.1f Mcalls/s\n", NCALLS / tc / 1e6);
+	printf("leaf C closure:    %.1f Mcalls/s\n", NCALLS / tl / 1e6);
+	lua_close(L);
+	return 0;
+}
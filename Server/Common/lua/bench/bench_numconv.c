@@ -0,0 +1,115 @@
+/*
+** Benchmark: number <-> string conversions ('lua_tolstring' on numbers,
+** 'lua_stringtonumber', and 'string.format' with "%d" and "%g"), with
+** values like the ones found in JSON and log output.
+**
+** Build (from this directory, after building liblua.a in ../src):
+**   cc -O2 -I../src bench_numconv.c ../src/liblua.a -lm -lpthread -o bench_numconv
+** Compare with a build of ../src from before the fast conversions in
+** lobject.c. Results must be identical; only the times should change.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+#define NVALS	1000
+#define NROUNDS	2000
+
+
+static unsigned long seed = 12345;
+
+static unsigned long rnd(void) {
+	seed = seed * 6364136223846793005ul + 1442695040888963407ul;
+	return seed >> 33;
+}
+
+
+static lua_Number flts[NVALS];
+static lua_Integer ints[NVALS];
+static char numerals[NVALS][32];
+
+
+static void makevalues(void) {
+	int i;
+	for (i = 0; i < NVALS; i++) {
+		/* prices, coordinates and the like: a few decimal places */
+		flts[i] = (lua_Number)((long)(rnd() % 2000000) - 1000000) / 1000;
+		ints[i] = (lua_Integer)rnd() * (lua_Integer)(rnd() % 1000);
+		snprintf(numerals[i], sizeof(numerals[i]), "%.14g", flts[i]);
+	}
+}
+
+
+static double tostr(lua_State* L, int isint) {
+	clock_t t0 = clock();
+	int r, i;
+	for (r = 0; r < NROUNDS; r++) {
+		for (i = 0; i < NVALS; i++) {
+			if (isint)
+				lua_pushinteger(L, ints[i]);
+			else
+				lua_pushnumber(L, flts[i]);
+			lua_tolstring(L, -1, NULL);
+			lua_pop(L, 1);
+		}
+	}
+	return (double)(clock() - t0) / CLOCKS_PER_SEC;
+}
+
+
+static double tonum(lua_State* L) {
+	clock_t t0 = clock();
+	int r, i;
+	for (r = 0; r < NROUNDS; r++) {
+		for (i = 0; i < NVALS; i++) {
+			lua_stringtonumber(L, numerals[i]);
+			lua_pop(L, 1);
+		}
+	}
+	return (double)(clock() - t0) / CLOCKS_PER_SEC;
+}
+
+
+static double format(lua_State* L) {
+	clock_t t0 = clock();
+	int r, i;
+	lua_getglobal(L, "string");
+	lua_getfield(L, -1, "format");
+	for (r = 0; r < NROUNDS; r++) {
+		for (i = 0; i < NVALS; i++) {
+			lua_pushvalue(L, -1);
+			lua_pushliteral(L, "id=%d x=%g");
+			lua_pushinteger(L, ints[i]);
+			lua_pushnumber(L, flts[i]);
+			lua_call(L, 3, 1);
+			lua_pop(L, 1);
+		}
+	}
+	lua_pop(L, 2);
+	return (double)(clock() - t0) / CLOCKS_PER_SEC;
+}
+
+
+static void report(const char* name, double t) {
+	printf("%-16s %7.1f Mconv/s\n", name, (double)NVALS * NROUNDS / t / 1e6);
+}
+
+
+int main(void) {
+	lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+	makevalues();
+	report("tostring int", tostr(L, 1));
+	report("tostring float", tostr(L, 0));
+	report("tonumber float", tonum(L));
+	report("format %d %g", format(L));
+	lua_close(L);
+	return 0;
+}
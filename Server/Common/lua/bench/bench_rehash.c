@@ -0,0 +1,44 @@
+/*
+** Benchmark: worst-case latency of a single insertion while a table
+** grows to NKEYS keys in its hash part, with incremental rehashing
+** (the default) and with it disabled.
+**
+** Build (from this directory, after building liblua.a in ../src):
+**   cc -O2 -I../src bench_rehash.c ../src/liblua.a -lm -lpthread -o bench_rehash
+** For the eager version, build ../src with
+** 'make MYCFLAGS=-DLUAI_MIGRATESTEP=0'.
+*/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+#define NKEYS	2000000
+
+
+int main(void) {
+	lua_State* L = luaL_newstate();
+	clock_t total = 0, worst = 0;
+	lua_Integer i;
+	lua_gc(L, LUA_GCSTOP);  /* measure only the table */
+	lua_newtable(L);
+	for (i = 1; i <= NKEYS; i++) {
+		clock_t t0, dt;
+		lua_pushinteger(L, i);
+		t0 = clock();
+		lua_rawseti(L, 1, i * 7919);  /* sparse keys go to the hash part */
+		dt = clock() - t0;
+		total += dt;
+		if (dt > worst)
+			worst = dt;
+	}
+	printf("%d insertions: total %.1f ms, worst single insertion %.3f ms\n",
+	       NKEYS, (double)total * 1000 / CLOCKS_PER_SEC,
+	       (double)worst * 1000 / CLOCKS_PER_SEC);
+	lua_close(L);
+	return 0;
+}
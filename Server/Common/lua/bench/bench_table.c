@@ -0,0 +1,118 @@
+/*
+** Benchmark: hash-part operations (get, set, miss, next) on tables
+** with string keys and with sparse integer keys. The layout of the hash
+** part is chosen at build time, so compare two builds of liblua.a, one
+** of them with LUA_USE_SWISSTABLE.
+**
+** Build (from this directory, after building liblua.a in ../src):
+**   cc -O2 -I../src bench_table.c ../src/liblua.a -lm -lpthread -o bench_table
+** For the other layout, add -DLUA_USE_SWISSTABLE both to this command
+** and to the build of ../src ('make MYCFLAGS=-DLUA_USE_SWISSTABLE').
+*/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+#define NKEYS	50000
+#define NOPS	20000000
+
+
+/*
+** Each chunk gets the table 't', its list of keys 'k', a list of keys
+** not in the table 'm', and the number of operations 'n'.
+*/
+static const char* const tests[][2] = {
+	{"get",
+	 "local t, k, m, n = ...\n"
+	 "local s, nk = 0, #k\n"
+	 "for i = 1, n do s = s + t[k[i % nk + 1]] end\n"
+	 "return s\n"},
+	{"set",
+	 "local t, k, m, n = ...\n"
+	 "local nk = #k\n"
+	 "for i = 1, n do t[k[i % nk + 1]] = i end\n"
+	 "return 0\n"},
+	{"miss",
+	 "local t, k, m, n = ...\n"
+	 "local s, nm = 0, #m\n"
+	 "for i = 1, n do if t[m[i % nm + 1]] then s = s + 1 end end\n"
+	 "return s\n"},
+	{"next",
+	 "local t, k, m, n = ...\n"
+	 "local s = 0\n"
+	 "for i = 1, n // #k do\n"
+	 "  for _, v in pairs(t) do s = s + v end\n"
+	 "end\n"
+	 "return s\n"},
+	{"insert",
+	 "local t, k, m, n = ...\n"
+	 "local nk = #k\n"
+	 "for i = 1, n // nk do\n"
+	 "  local u = {}\n"
+	 "  for j = 1, nk do u[k[j]] = j end\n"
+	 "end\n"
+	 "return 0\n"}
+};
+
+
+static const char* const setup[] = {
+	/* string keys */
+	"local nk = ...\n"
+	"local t, k, m = {}, {}, {}\n"
+	"for i = 1, nk do k[i] = 'key' .. i; t[k[i]] = i; m[i] = 'miss' .. i end\n"
+	"return t, k, m\n",
+	/* sparse integer keys */
+	"local nk = ...\n"
+	"local t, k, m = {}, {}, {}\n"
+	"for i = 1, nk do k[i] = i * 7919; t[k[i]] = i; m[i] = -i * 7919 end\n"
+	"return t, k, m\n"
+};
+
+
+static double run(lua_State* L, const char* chunk) {
+	clock_t t0;
+	if (luaL_loadstring(L, chunk) != LUA_OK)
+		return -1;
+	lua_pushvalue(L, 1);  /* table */
+	lua_pushvalue(L, 2);  /* keys */
+	lua_pushvalue(L, 3);  /* missing keys */
+	lua_pushinteger(L, NOPS);
+	t0 = clock();
+	if (lua_pcall(L, 4, 1, 0) != LUA_OK) {
+		fprintf(stderr, "%s\n", lua_tostring(L, -1));
+		return -1;
+	}
+	lua_pop(L, 1);
+	return (double)(clock() - t0) / CLOCKS_PER_SEC;
+}
+
+
+int main(void) {
+	lua_State* L = luaL_newstate();
+	int s, i;
+	luaL_openlibs(L);
+#if defined(LUA_USE_SWISSTABLE)
+	printf("hash part: control-byte groups\n");
+#else
+	printf("hash part: chained scatter table\n");
+#endif
+	for (s = 0; s < 2; s++) {
+		if (luaL_loadstring(L, setup[s]) != LUA_OK)
+			return 1;
+		lua_pushinteger(L, NKEYS);
+		lua_call(L, 1, 3);
+		for (i = 0; i < (int)(sizeof(tests) / sizeof(tests[0])); i++) {
+			double t = run(L, tests[i][1]);
+			printf("%-7s %-6s %6.1f Mops/s\n", s == 0 ? "string" : "int",
+			       tests[i][0], NOPS / t / 1e6);
+		}
+		lua_settop(L, 0);
+	}
+	lua_close(L);
+	return 0;
+}
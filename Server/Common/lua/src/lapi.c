@@ -17,12 +17,14 @@
 #include "lua.h"
 
 #include "lapi.h"
+#include "lclone.h"
 #include "ldebug.h"
 #include "ldo.h"
 #include "lfunc.h"
 #include "lgc.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lsnap.h"
 #include "lstate.h"
 #include "lstring.h"
 #include "ltable.h"
@@ -376,6 +378,29 @@ LUA_API size_t lua_stringtonumber(lua_State* L, const char* s) {
 }
 
 
+/*
+** Write the decimal representation of 'n' into 'buff', as LUA_INTEGER_FMT
+** would; return its length.
+*/
+LUA_API unsigned lua_fmtinteger(lua_State* L, lua_Integer n, char* buff) {
+	UNUSED(L);
+	return cast_uint(luaO_int2str(buff, n));
+}
+
+
+/*
+** Write 'n' into 'buff' as C's "%.<prec>g" would, or as LUA_NUMBER_FMT
+** would when 'prec' is negative; return its length. (Unlike 'tostring',
+** it does not add a ".0" to integral values.)
+*/
+LUA_API unsigned lua_fmtnumber(lua_State* L, lua_Number n, int prec,
+	char* buff) {
+	api_check(L, prec <= 20, "precision too large");
+	UNUSED(L);
+	return cast_uint(luaO_flt2str(buff, n, prec));
+}
+
+
 LUA_API lua_Number lua_tonumberx(lua_State* L, int idx, int* pisnum) {
 	lua_Number n = 0;
 	const TValue* o = index2value(L, idx);
@@ -446,7 +471,7 @@ LUA_API lua_CFunction lua_tocfunction(lua_State* L, int idx) {
 
 l_sinline void* touserdata(const TValue* o) {
 	switch (ttype(o)) {
-	case LUA_TUSERDATA: return getudatamem(uvalue(o));
+	case LUA_TUSERDATA: return getudatadata(uvalue(o));
 	case LUA_TLIGHTUSERDATA: return pvalue(o);
 	default: return NULL;
 	}
@@ -476,8 +501,10 @@ LUA_API const void* lua_topointer(lua_State* L, int idx) {
 	const TValue* o = index2value(L, idx);
 	switch (ttypetag(o)) {
 	case LUA_VLCF: return cast_voidp(cast_sizet(fvalue(o)));
-	case LUA_VUSERDATA: case LUA_VLIGHTUSERDATA:
-		return touserdata(o);
+	case LUA_VUSERDATA:  /* (the block, which external buffers keep) */
+		return getudatamem(uvalue(o));
+	case LUA_VLIGHTUSERDATA:
+		return pvalue(o);
 	default: {
 		if (iscollectable(o))
 			return gcvalue(o);
@@ -576,9 +603,15 @@ LUA_API const char* lua_pushfstring(lua_State* L, const char* fmt, ...) {
 }
 
 
-LUA_API void lua_pushcclosure(lua_State* L, lua_CFunction fn, int n) {
-	lua_lock(L);
-	if (n == 0) {
+/*
+** Pushes a C closure for 'fn' with the 'n' values on the top of the
+** stack as upvalues. 'nleafres' is 1 plus the number of results of a
+** leaf function, or 0 (see 'lua_pushleafcclosure'). Only a function
+** without upvalues that is not a leaf is pushed as a light C function.
+*/
+static void pushcclosure(lua_State* L, lua_CFunction fn, int n,
+	int nleafres) {
+	if (n == 0 && nleafres == 0) {
 		setfvalue(s2v(L->top.p), fn);
 		api_incr_top(L);
 	}
@@ -588,6 +621,7 @@ LUA_API void lua_pushcclosure(lua_State* L, lua_CFunction fn, int n) {
 		api_check(L, n <= MAXUPVAL, "upvalue index too large");
 		cl = luaF_newCclosure(L, n);
 		cl->f = fn;
+		cl->nleafres = cast_byte(nleafres);
 		L->top.p -= n;
 		while (n--) {
 			setobj2n(L, &cl->upvalue[n], s2v(L->top.p + n));
@@ -598,6 +632,29 @@ LUA_API void lua_pushcclosure(lua_State* L, lua_CFunction fn, int n) {
 		api_incr_top(L);
 		luaC_checkGC(L);
 	}
+}
+
+
+LUA_API void lua_pushcclosure(lua_State* L, lua_CFunction fn, int n) {
+	lua_lock(L);
+	pushcclosure(L, fn, n, 0);
+	lua_unlock(L);
+}
+
+
+/*
+** Push a "leaf" C closure: a function that always returns exactly
+** 'nresults' values, never yields and never uses to-be-closed
+** variables. Such functions are called through a shorter path (see
+** 'precallleaf' in ldo.c). The closure is always a full closure, even
+** without upvalues, as light C functions cannot carry the mark.
+*/
+LUA_API void lua_pushleafcclosure(lua_State* L, lua_CFunction fn, int n,
+	int nresults) {
+	lua_lock(L);
+	api_check(L, 0 <= nresults && nresults < LUA_MINSTACK,
+		"invalid number of results");
+	pushcclosure(L, fn, n, nresults + 1);
 	lua_unlock(L);
 }
 
@@ -930,6 +987,35 @@ LUA_API void lua_rawseti(lua_State* L, int idx, lua_Integer n) {
 }
 
 
+/*
+** Grow the table at 'idx' so that it can hold at least 'narr' array
+** elements and 'nrec' other elements without being rehashed. It never
+** shrinks the table.
+*/
+LUA_API void lua_reservetable(lua_State* L, int idx, int narr, int nrec) {
+	Table* t;
+	lua_lock(L);
+	api_check(L, narr >= 0 && nrec >= 0, "negative size");
+	t = gettable(L, idx);
+	luaH_reserve(L, t, cast_uint(narr), cast_uint(nrec));
+	luaC_checkGC(L);
+	lua_unlock(L);
+}
+
+
+/*
+** Remove all elements from the table at 'idx', keeping the space
+** allocated for them.
+*/
+LUA_API void lua_cleartable(lua_State* L, int idx) {
+	Table* t;
+	lua_lock(L);
+	t = gettable(L, idx);
+	luaH_clear(L, t);
+	lua_unlock(L);
+}
+
+
 LUA_API int lua_setmetatable(lua_State* L, int objindex) {
 	TValue* obj;
 	Table* mt;
@@ -1180,6 +1266,37 @@ LUA_API int lua_gc(lua_State* L, int what, ...) {
 			res = 1;  /* signal it */
 		break;
 	}
+	case LUA_GCBUDGET: {
+		int usec = va_arg(argp, int);
+		lu_byte oldstp = g->gcstp;
+		g->gcstp = 0;  /* allow GC to run (GCSTPGC must be zero here) */
+		res = luaC_budget(L, usec);
+		g->gcstp = oldstp;  /* restore previous state */
+		break;
+	}
+	case LUA_GCSTATS: {
+		lua_GCStats* st = va_arg(argp, lua_GCStats*);
+		*st = g->gctel.st;
+		break;
+	}
+	case LUA_GCPUSHARENA: {
+		res = cast_int(++g->narenas);
+		break;
+	}
+	case LUA_GCPOPARENA: {
+		res = luaC_poparena(L);
+		break;
+	}
+	case LUA_GCSETEXTWEIGHT: {
+		int data = va_arg(argp, int);
+		res = g->extweight;
+		luaM_setextweight(L, data);
+		break;
+	}
+	case LUA_GCEXTCOUNT: {
+		res = cast_int(g->extbytes >> 10);
+		break;
+	}
 	case LUA_GCSETPAUSE: {
 		int data = va_arg(argp, int);
 		res = getgcparam(g->gcpause);
@@ -1324,6 +1441,18 @@ LUA_API void lua_setallocf(lua_State* L, lua_Alloc f, void* ud) {
 }
 
 
+/*
+** Register 'f' as the standard 'select' function. Calls to it in the
+** forms select('#', ...) and select(n, ...) are then done directly by
+** the VM (see OP_SELECT), without copying the varargs.
+*/
+LUA_API void lua_setselectf(lua_State* L, lua_CFunction f) {
+	lua_lock(L);
+	G(L)->selectf = f;
+	lua_unlock(L);
+}
+
+
 void lua_setwarnf(lua_State* L, lua_WarnFunction f, void* ud) {
 	lua_lock(L);
 	G(L)->ud_warn = ud;
@@ -1353,6 +1482,57 @@ LUA_API void* lua_newuserdatauv(lua_State* L, size_t size, int nuvalue) {
 }
 
 
+/*
+** Creates an external buffer: a full userdata whose 'size' bytes of
+** data live outside the Lua heap, so that the collector neither sweeps
+** them nor, except by the 'extweight' percentage, paces itself by
+** them. The data can be released before the userdata is collected
+** (see 'lua_releasebuffer').
+*/
+LUA_API void* lua_newbufferuv(lua_State* L, size_t size, int nuvalue) {
+	Udata* u;
+	void* data = NULL;
+	lua_lock(L);
+	api_check(L, 0 <= nuvalue && nuvalue < USHRT_MAX, "invalid value");
+	u = luaS_newudata(L, sizeof(void*), nuvalue);
+	u->ext = 1;
+	u->len = 0;
+	extbuffer(u) = NULL;
+	setuvalue(L, s2v(L->top.p), u);
+	api_incr_top(L);  /* anchor it while allocating its data */
+	if (size > 0) {
+		data = luaM_extalloc(L, size);
+		extbuffer(u) = data;
+		u->len = size;
+	}
+	luaC_checkGC(L);
+	lua_unlock(L);
+	return data;
+}
+
+
+/*
+** Frees the data of the external buffer at index 'idx' (which then has
+** no data and length 0). Returns the number of bytes freed: 0 when the
+** value is not an external buffer or was already released.
+*/
+LUA_API size_t lua_releasebuffer(lua_State* L, int idx) {
+	const TValue* o;
+	size_t res = 0;
+	lua_lock(L);
+	o = index2value(L, idx);
+	if (ttisfulluserdata(o) && uvalue(o)->ext) {
+		Udata* u = uvalue(o);
+		res = u->len;
+		luaM_extfree(L, extbuffer(u), u->len);
+		extbuffer(u) = NULL;
+		u->len = 0;
+	}
+	lua_unlock(L);
+	return res;
+}
+
+
 
 static const char* aux_upvalue(TValue* fi, int n, TValue** val,
 	GCObject** owner) {
@@ -1461,3 +1641,173 @@ LUA_API void lua_upvaluejoin(lua_State* L, int fidx1, int n1,
 }
 
 
+
+
+/*
+** {======================================================
+** Profiler counters (only with LUA_USE_PROFILE)
+** =======================================================
+*/
+
+#if defined(LUA_USE_PROFILE)
+
+#include "lopnames.h"
+
+
+static void fillprofile(lua_Profile* pr, Proto* p) {
+	pr->source = (p->source) ? getstr(p->source) : "=?";
+	pr->linedefined = p->linedefined;
+	pr->lastlinedefined = p->lastlinedefined;
+	pr->calls = cast(lua_Unsigned, p->ncalls);
+	pr->instructions = cast(lua_Unsigned, p->ninstr);
+	pr->time = cast(lua_Unsigned, p->ntime);
+}
+
+
+LUA_API int lua_getprofile(lua_State* L, int funcindex, lua_Profile* pr) {
+	TValue* fi;
+	int res = 0;
+	lua_lock(L);
+	fi = index2value(L, funcindex);
+	if (ttisLclosure(fi)) {
+		fillprofile(pr, clLvalue(fi)->p);
+		res = 1;
+	}
+	lua_unlock(L);
+	return res;
+}
+
+
+/*
+** Return the number of executions of opcode 'op' and set '*name' to
+** its name; '*name' is NULL when 'op' is not a valid opcode.
+*/
+LUA_API lua_Unsigned lua_getopcount(lua_State* L, int op,
+	const char** name) {
+	if (op < 0 || op >= NUM_OPCODES) {
+		*name = NULL;
+		return 0;
+	}
+	*name = opnames[op];
+	return cast(lua_Unsigned, G(L)->opcount[op]);
+}
+
+
+typedef struct ProfWalk {
+	lua_ProfileWriter w;
+	void* ud;
+} ProfWalk;
+
+
+static void walklist(lua_State* L, GCObject* o, ProfWalk* pw) {
+	for (; o != NULL; o = o->next) {
+		if (o->tt == LUA_VPROTO && gco2p(o)->ncalls > 0) {
+			lua_Profile pr;
+			fillprofile(&pr, gco2p(o));
+			pw->w(L, &pr, pw->ud);
+		}
+	}
+}
+
+
+static void walkprofile(lua_State* L, void* ud) {
+	global_State* g = G(L);
+	walklist(L, g->allgc, cast(ProfWalk*, ud));
+	walklist(L, g->finobj, cast(ProfWalk*, ud));
+	walklist(L, g->tobefnz, cast(ProfWalk*, ud));
+}
+
+
+/*
+** Call 'w' for each live function prototype that was called at least
+** once. The collector is kept stopped during the walk (so that the
+** lists do not change under it); the writer may allocate and raise
+** errors.
+*/
+LUA_API void lua_walkprofile(lua_State* L, lua_ProfileWriter w, void* ud) {
+	global_State* g = G(L);
+	lu_byte oldstp = g->gcstp;
+	ProfWalk pw;
+	int status;
+	pw.w = w;
+	pw.ud = ud;
+	g->gcstp |= GCSTPUSR;  /* avoid GC steps during the walk */
+	status = luaD_rawrunprotected(L, walkprofile, &pw);
+	g->gcstp = oldstp;  /* restore previous state */
+	if (l_unlikely(status != LUA_OK))
+		luaD_throw(L, status);  /* propagate writer error */
+}
+
+
+static void resetlist(GCObject* o) {
+	for (; o != NULL; o = o->next) {
+		if (o->tt == LUA_VPROTO) {
+			Proto* p = gco2p(o);
+			p->ncalls = p->ninstr = p->ntime = 0;
+		}
+	}
+}
+
+
+LUA_API void lua_resetprofile(lua_State* L) {
+	global_State* g = G(L);
+	int i;
+	lua_lock(L);
+	resetlist(g->allgc);
+	resetlist(g->finobj);
+	resetlist(g->tobefnz);
+	for (i = 0; i < NUM_OPCODES; i++)
+		g->opcount[i] = 0;
+	lua_unlock(L);
+}
+
+#endif
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Heap profiler and snapshots
+** =======================================================
+*/
+
+LUA_API int lua_heapprofile(lua_State* L, size_t rate) {
+	int res;
+	lua_lock(L);
+	res = luaM_heapprofile(L, rate);
+	lua_unlock(L);
+	return res;
+}
+
+
+LUA_API void lua_walkheapprofile(lua_State* L, lua_HeapWriter w, void* ud) {
+	luaM_walkheap(L, w, ud);
+}
+
+
+LUA_API int lua_heapsnapshot(lua_State* L, lua_Writer writer, void* data) {
+	int status;
+	lua_lock(L);
+	status = luaN_snapshot(L, writer, data);
+	lua_unlock(L);
+	return status;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** Turns 'L' into a template for 'lua_clone'. After that, 'L' can only
+** be cloned and closed (after all its clones). Returns a status code
+** and, in case of errors, leaves an error message on the stack.
+*/
+LUA_API int lua_freeze(lua_State* L) {
+	int status;
+	lua_lock(L);
+	status = luaR_freeze(L);
+	lua_unlock(L);
+	return status;
+}
@@ -0,0 +1,720 @@
+/*
+** $Id: larraylib.c $
+** Typed arrays (packed int32, float32 and float64 elements)
+** See Copyright Notice in lua.h
+*/
+
+#define larraylib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+/*
+** A typed array is a full userdata holding a header followed by its
+** elements, packed. Elements are indexed from 1, like a sequence. Bulk
+** operations work in place over the whole array (and return it), and
+** use SSE2 where available. C code can get the element block with
+** 'luaL_toarray'/'luaL_checkarray' and work on it directly; the block
+** stays valid (and does not move) while the userdata is alive.
+*/
+
+#define ARRAYMT		"array"
+
+
+typedef struct TArray {
+	size_t n;  /* number of elements */
+	int type;  /* element type (LUA_ARRAY_*) */
+} TArray;
+
+
+/* elements start right after the header (16 bytes on 64-bit machines) */
+#define adata(a)	((void*)((a) + 1))
+#define ai32(a)		((int32_t*)adata(a))
+#define af32(a)		((float*)adata(a))
+#define af64(a)		((double*)adata(a))
+
+
+static const size_t elemsize[] = {sizeof(int32_t), sizeof(float),
+	sizeof(double)};
+
+static const char* const typenames[] = {"i32", "f32", "f64", NULL};
+
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ARRAY_SSE2
+#endif
+
+
+
+/*
+** {======================================================
+** Kernels
+** =======================================================
+*/
+
+/*
+** Floating-point kernels, for 'float' (4 lanes) and 'double' (2 lanes).
+** 'V' is the vector type, 'W' the number of lanes, and 'S' the suffix
+** of the SSE2 intrinsics. Sums accumulate in double precision.
+*/
+#if defined(ARRAY_SSE2)
+
+#define FKERNELS(T,N,V,W,S)  \
+static void N##_fill (T* a, size_t n, T x) {  \
+  size_t i = 0;  V vx = _mm_set1_##S(x);  \
+  for (; i + W <= n; i += W) _mm_storeu_##S(a + i, vx);  \
+  for (; i < n; i++) a[i] = x;  \
+}  \
+static void N##_adds (T* a, size_t n, T x) {  \
+  size_t i = 0;  V vx = _mm_set1_##S(x);  \
+  for (; i + W <= n; i += W)  \
+    _mm_storeu_##S(a + i, _mm_add_##S(_mm_loadu_##S(a + i), vx));  \
+  for (; i < n; i++) a[i] += x;  \
+}  \
+static void N##_addv (T* a, const T* b, size_t n) {  \
+  size_t i = 0;  \
+  for (; i + W <= n; i += W)  \
+    _mm_storeu_##S(a + i, _mm_add_##S(_mm_loadu_##S(a + i),  \
+                                      _mm_loadu_##S(b + i)));  \
+  for (; i < n; i++) a[i] += b[i];  \
+}  \
+static void N##_scale (T* a, size_t n, T x) {  \
+  size_t i = 0;  V vx = _mm_set1_##S(x);  \
+  for (; i + W <= n; i += W)  \
+    _mm_storeu_##S(a + i, _mm_mul_##S(_mm_loadu_##S(a + i), vx));  \
+  for (; i < n; i++) a[i] *= x;  \
+}  \
+static T N##_minmax (const T* a, size_t n, int max) {  \
+  size_t i = 1;  T m[W];  \
+  m[0] = a[0];  \
+  if (n >= W) {  \
+    V vm = _mm_loadu_##S(a);  \
+    for (i = W; i + W <= n; i += W) {  \
+      V v = _mm_loadu_##S(a + i);  \
+      vm = max ? _mm_max_##S(vm, v) : _mm_min_##S(vm, v);  \
+    }  \
+    _mm_storeu_##S(m, vm);  \
+    for (; i < n; i++) m[0] = max ? (a[i] > m[0] ? a[i] : m[0])  \
+                                  : (a[i] < m[0] ? a[i] : m[0]);  \
+    i = 1; n = W;  /* now reduce the lanes */  \
+    a = m;  \
+  }  \
+  for (; i < n; i++) m[0] = max ? (a[i] > m[0] ? a[i] : m[0])  \
+                                : (a[i] < m[0] ? a[i] : m[0]);  \
+  return m[0];  \
+}
+
+FKERNELS(float, f32, __m128, 4, ps)
+FKERNELS(double, f64, __m128d, 2, pd)
+
+static double f32_sum(const float* a, size_t n) {
+	size_t i = 0;
+	double s[2];
+	__m128d acc = _mm_setzero_pd();
+	for (; i + 4 <= n; i += 4) {
+		__m128 v = _mm_loadu_ps(a + i);
+		acc = _mm_add_pd(acc, _mm_cvtps_pd(v));
+		acc = _mm_add_pd(acc, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+	}
+	_mm_storeu_pd(s, acc);
+	s[0] += s[1];
+	for (; i < n; i++) s[0] += a[i];
+	return s[0];
+}
+
+static double f64_sum(const double* a, size_t n) {
+	size_t i = 0;
+	double s[2];
+	__m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+	for (; i + 4 <= n; i += 4) {
+		acc0 = _mm_add_pd(acc0, _mm_loadu_pd(a + i));
+		acc1 = _mm_add_pd(acc1, _mm_loadu_pd(a + i + 2));
+	}
+	_mm_storeu_pd(s, _mm_add_pd(acc0, acc1));
+	s[0] += s[1];
+	for (; i < n; i++) s[0] += a[i];
+	return s[0];
+}
+
+#else
+
+#define FKERNELS(T,N)  \
+static void N##_fill (T* a, size_t n, T x) {  \
+  size_t i; for (i = 0; i < n; i++) a[i] = x;  \
+}  \
+static void N##_adds (T* a, size_t n, T x) {  \
+  size_t i; for (i = 0; i < n; i++) a[i] += x;  \
+}  \
+static void N##_addv (T* a, const T* b, size_t n) {  \
+  size_t i; for (i = 0; i < n; i++) a[i] += b[i];  \
+}  \
+static void N##_scale (T* a, size_t n, T x) {  \
+  size_t i; for (i = 0; i < n; i++) a[i] *= x;  \
+}  \
+static T N##_minmax (const T* a, size_t n, int max) {  \
+  size_t i; T m = a[0];  \
+  for (i = 1; i < n; i++)  \
+    m = max ? (a[i] > m ? a[i] : m) : (a[i] < m ? a[i] : m);  \
+  return m;  \
+}  \
+static double N##_sum (const T* a, size_t n) {  \
+  size_t i; double s = 0;  \
+  for (i = 0; i < n; i++) s += a[i];  \
+  return s;  \
+}
+
+FKERNELS(float, f32)
+FKERNELS(double, f64)
+
+#endif
+
+
+/*
+** Integer kernels. Additions and scaling wrap around (they are done
+** over unsigned values); sums are exact, in a 64-bit accumulator.
+*/
+static void i32_fill(int32_t* a, size_t n, int32_t x) {
+	size_t i = 0;
+#if defined(ARRAY_SSE2)
+	__m128i vx = _mm_set1_epi32(x);
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_si128((__m128i*)(a + i), vx);
+#endif
+	for (; i < n; i++) a[i] = x;
+}
+
+
+static void i32_adds(int32_t* a, size_t n, int32_t x) {
+	size_t i = 0;
+#if defined(ARRAY_SSE2)
+	__m128i vx = _mm_set1_epi32(x);
+	for (; i + 4 <= n; i += 4) {
+		__m128i* p = (__m128i*)(a + i);
+		_mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), vx));
+	}
+#endif
+	for (; i < n; i++) a[i] = (int32_t)((uint32_t)a[i] + (uint32_t)x);
+}
+
+
+static void i32_addv(int32_t* a, const int32_t* b, size_t n) {
+	size_t i = 0;
+#if defined(ARRAY_SSE2)
+	for (; i + 4 <= n; i += 4) {
+		__m128i* p = (__m128i*)(a + i);
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+		_mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), vb));
+	}
+#endif
+	for (; i < n; i++) a[i] = (int32_t)((uint32_t)a[i] + (uint32_t)b[i]);
+}
+
+
+/* (SSE2 has no 32-bit multiplication; leave this one to the compiler) */
+static void i32_scale(int32_t* a, size_t n, int32_t x) {
+	size_t i;
+	for (i = 0; i < n; i++) a[i] = (int32_t)((uint32_t)a[i] * (uint32_t)x);
+}
+
+
+static int32_t i32_minmax(const int32_t* a, size_t n, int max) {
+	size_t i = 0;
+	int32_t m = a[0];
+#if defined(ARRAY_SSE2)
+	if (n >= 4) {
+		int32_t v[4];
+		__m128i vm = _mm_loadu_si128((const __m128i*)a);
+		for (i = 4; i + 4 <= n; i += 4) {
+			__m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+			/* select with a mask, as SSE2 has no 'min/max_epi32' */
+			__m128i gt = max ? _mm_cmpgt_epi32(x, vm) : _mm_cmpgt_epi32(vm, x);
+			vm = _mm_or_si128(_mm_and_si128(gt, x), _mm_andnot_si128(gt, vm));
+		}
+		_mm_storeu_si128((__m128i*)v, vm);
+		m = v[0];
+		m = max ? (v[1] > m ? v[1] : m) : (v[1] < m ? v[1] : m);
+		m = max ? (v[2] > m ? v[2] : m) : (v[2] < m ? v[2] : m);
+		m = max ? (v[3] > m ? v[3] : m) : (v[3] < m ? v[3] : m);
+	}
+#endif
+	for (; i < n; i++)
+		m = max ? (a[i] > m ? a[i] : m) : (a[i] < m ? a[i] : m);
+	return m;
+}
+
+
+static int64_t i32_sum(const int32_t* a, size_t n) {
+	size_t i;
+	int64_t s = 0;
+	for (i = 0; i < n; i++) s += a[i];
+	return s;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** C API
+** =======================================================
+*/
+
+static int arraymeta(lua_State* L);
+
+
+static TArray* toarray(lua_State* L, int idx) {
+	return (TArray*)luaL_testudata(L, idx, ARRAYMT);
+}
+
+
+static TArray* checkarray(lua_State* L, int idx) {
+	return (TArray*)luaL_checkudata(L, idx, ARRAYMT);
+}
+
+
+/*
+** Creates a new array with 'n' elements of type 'type', all zero, and
+** pushes it onto the stack. Returns its elements.
+*/
+LUALIB_API void* luaL_newarray(lua_State* L, int type, size_t n) {
+	TArray* a;
+	luaL_argcheck(L, 0 <= type && type <= LUA_ARRAY_F64, 2, "invalid type");
+	if (n > (~(size_t)0 - sizeof(TArray)) / elemsize[type])
+		luaL_error(L, "array size too large");
+	a = (TArray*)lua_newuserdatauv(L, sizeof(TArray) + n * elemsize[type], 0);
+	a->n = n;
+	a->type = type;
+	memset(adata(a), 0, n * elemsize[type]);  /* all bits zero is 0 and 0.0 */
+	arraymeta(L);
+	lua_setmetatable(L, -2);
+	return adata(a);
+}
+
+
+/*
+** If the value at 'idx' is a typed array, returns its elements and
+** sets '*type' and '*n' (when not NULL); otherwise returns NULL.
+*/
+LUALIB_API void* luaL_toarray(lua_State* L, int idx, int* type, size_t* n) {
+	TArray* a = toarray(L, idx);
+	if (a == NULL)
+		return NULL;
+	if (type) *type = a->type;
+	if (n) *n = a->n;
+	return adata(a);
+}
+
+
+/*
+** Checks whether argument 'arg' is a typed array with elements of type
+** 'type' and returns its elements (and its size in '*n', when not NULL).
+*/
+LUALIB_API void* luaL_checkarray(lua_State* L, int arg, int type,
+	size_t* n) {
+	TArray* a = toarray(L, arg);
+	if (a == NULL || a->type != type) {
+		const char* msg = lua_pushfstring(L, "array.%s expected, got %s",
+			typenames[type], a ? typenames[a->type] : luaL_typename(L, arg));
+		luaL_argerror(L, arg, msg);
+	}
+	if (n) *n = a->n;
+	return adata(a);
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Elements
+** =======================================================
+*/
+
+static void pushelem(lua_State* L, const TArray* a, size_t i) {
+	switch (a->type) {
+	case LUA_ARRAY_I32: lua_pushinteger(L, ai32(a)[i]); break;
+	case LUA_ARRAY_F32: lua_pushnumber(L, (lua_Number)af32(a)[i]); break;
+	default: lua_pushnumber(L, (lua_Number)af64(a)[i]); break;
+	}
+}
+
+
+static int32_t checki32(lua_State* L, int arg) {
+	lua_Integer v = luaL_checkinteger(L, arg);
+	luaL_argcheck(L, INT32_MIN <= v && v <= INT32_MAX, arg,
+		"value out of int32 range");
+	return (int32_t)v;
+}
+
+
+static void setelem(lua_State* L, TArray* a, size_t i, int arg) {
+	switch (a->type) {
+	case LUA_ARRAY_I32: ai32(a)[i] = checki32(L, arg); break;
+	case LUA_ARRAY_F32: af32(a)[i] = (float)luaL_checknumber(L, arg); break;
+	default: af64(a)[i] = (double)luaL_checknumber(L, arg); break;
+	}
+}
+
+
+/*
+** Converts the index at 'arg' to a 0-based position in 'a', or returns
+** 'a->n' if it is not a valid index.
+*/
+static size_t position(lua_State* L, const TArray* a, int arg) {
+	int isnum;
+	lua_Integer i = lua_tointegerx(L, arg, &isnum);
+	if (isnum && 1 <= i && (lua_Unsigned)i <= a->n)
+		return (size_t)(i - 1);
+	return a->n;
+}
+
+
+static int arr_index(lua_State* L) {
+	TArray* a = checkarray(L, 1);
+	if (lua_type(L, 2) == LUA_TSTRING) {  /* a method? */
+		lua_pushvalue(L, 2);
+		lua_rawget(L, lua_upvalueindex(1));
+		return 1;
+	}
+	else {
+		size_t i = position(L, a, 2);
+		if (i < a->n)
+			pushelem(L, a, i);
+		else
+			luaL_pushfail(L);  /* out of range */
+		return 1;
+	}
+}
+
+
+static int arr_newindex(lua_State* L) {
+	TArray* a = checkarray(L, 1);
+	size_t i = position(L, a, 2);
+	luaL_argcheck(L, i < a->n, 2, "index out of range");
+	setelem(L, a, i, 3);
+	return 0;
+}
+
+
+static int arr_len(lua_State* L) {
+	lua_pushinteger(L, (lua_Integer)checkarray(L, 1)->n);
+	return 1;
+}
+
+
+static int arr_tostring(lua_State* L) {
+	TArray* a = checkarray(L, 1);
+	lua_pushfstring(L, "array.%s(%I): %p", typenames[a->type],
+		(lua_Integer)a->n, (void*)a);
+	return 1;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Methods
+** =======================================================
+*/
+
+static int arr_type(lua_State* L) {
+	lua_pushstring(L, typenames[checkarray(L, 1)->type]);
+	return 1;
+}
+
+
+/* sets all elements of 'a' to the value at 'arg' */
+static void fillarray(lua_State* L, TArray* a, int arg) {
+	switch (a->type) {
+	case LUA_ARRAY_I32: i32_fill(ai32(a), a->n, checki32(L, arg)); break;
+	case LUA_ARRAY_F32: f32_fill(af32(a), a->n, (float)luaL_checknumber(L, arg)); break;
+	default: f64_fill(af64(a), a->n, luaL_checknumber(L, arg)); break;
+	}
+}
+
+
+/* a:fill(x) */
+static int arr_fill(lua_State* L) {
+	fillarray(L, checkarray(L, 1), 2);
+	lua_settop(L, 1);
+	return 1;
+}
+
+
+/* a:add(x), where 'x' is a number or an array of the same type and size */
+static int arr_add(lua_State* L) {
+	TArray* a = checkarray(L, 1);
+	TArray* b = toarray(L, 2);
+	if (b != NULL) {
+		luaL_argcheck(L, b->type == a->type && b->n == a->n, 2,
+			"arrays must have the same type and size");
+		switch (a->type) {
+		case LUA_ARRAY_I32: i32_addv(ai32(a), ai32(b), a->n); break;
+		case LUA_ARRAY_F32: f32_addv(af32(a), af32(b), a->n); break;
+		default: f64_addv(af64(a), af64(b), a->n); break;
+		}
+	}
+	else {
+		switch (a->type) {
+		case LUA_ARRAY_I32: i32_adds(ai32(a), a->n, checki32(L, 2)); break;
+		case LUA_ARRAY_F32: f32_adds(af32(a), a->n, (float)luaL_checknumber(L, 2)); break;
+		default: f64_adds(af64(a), a->n, luaL_checknumber(L, 2)); break;
+		}
+	}
+	lua_settop(L, 1);
+	return 1;
+}
+
+
+/* a:scale(x) */
+static int arr_scale(lua_State* L) {
+	TArray* a = checkarray(L, 1);
+	switch (a->type) {
+	case LUA_ARRAY_I32: i32_scale(ai32(a), a->n, checki32(L, 2)); break;
+	case LUA_ARRAY_F32: f32_scale(af32(a), a->n, (float)luaL_checknumber(L, 2)); break;
+	default: f64_scale(af64(a), a->n, luaL_checknumber(L, 2)); break;
+	}
+	lua_settop(L, 1);
+	return 1;
+}
+
+
+static int arr_sum(lua_State* L) {
+	TArray* a = checkarray(L, 1);
+	switch (a->type) {
+	case LUA_ARRAY_I32: lua_pushinteger(L, (lua_Integer)i32_sum(ai32(a), a->n)); break;
+	case LUA_ARRAY_F32: lua_pushnumber(L, (lua_Number)f32_sum(af32(a), a->n)); break;
+	default: lua_pushnumber(L, (lua_Number)f64_sum(af64(a), a->n)); break;
+	}
+	return 1;
+}
+
+
+/*
+** Minimum or maximum element ('fail' for an empty array). The result is
+** unspecified if the array has NaNs.
+*/
+static int minmax(lua_State* L, int max) {
+	TArray* a = checkarray(L, 1);
+	if (a->n == 0)
+		luaL_pushfail(L);
+	else switch (a->type) {
+	case LUA_ARRAY_I32:
+		lua_pushinteger(L, i32_minmax(ai32(a), a->n, max));
+		break;
+	case LUA_ARRAY_F32:
+		lua_pushnumber(L, (lua_Number)f32_minmax(af32(a), a->n, max));
+		break;
+	default:
+		lua_pushnumber(L, (lua_Number)f64_minmax(af64(a), a->n, max));
+		break;
+	}
+	return 1;
+}
+
+
+static int arr_min(lua_State* L) {
+	return minmax(L, 0);
+}
+
+
+static int arr_max(lua_State* L) {
+	return minmax(L, 1);
+}
+
+
+/*
+** a:gather(idx): new array of the type of 'a' with 'a[idx[k]]' for each
+** element 'k' of the array.i32 'idx'.
+*/
+static int arr_gather(lua_State* L) {
+	TArray* a = checkarray(L, 1);
+	size_t n, k;
+	const int32_t* idx = (const int32_t*)luaL_checkarray(L, 2,
+		LUA_ARRAY_I32, &n);
+	void* res = luaL_newarray(L, a->type, n);
+	size_t es = elemsize[a->type];
+	for (k = 0; k < n; k++) {
+		size_t i = (size_t)idx[k] - 1u;
+		if (i >= a->n)  /* also catches 'idx[k] <= 0' */
+			return luaL_error(L, "index %d out of range at position %I",
+				(int)idx[k], (lua_Integer)(k + 1));
+		memcpy((char*)res + k * es, (const char*)adata(a) + i * es, es);
+	}
+	return 1;
+}
+
+
+static int arr_copy(lua_State* L) {
+	TArray* a = checkarray(L, 1);
+	void* res = luaL_newarray(L, a->type, a->n);
+	memcpy(res, adata(a), a->n * elemsize[a->type]);
+	return 1;
+}
+
+
+static int arr_totable(lua_State* L) {
+	TArray* a = checkarray(L, 1);
+	size_t i;
+	luaL_argcheck(L, a->n <= INT_MAX, 1, "array too large");
+	lua_createtable(L, (int)a->n, 0);
+	for (i = 0; i < a->n; i++) {
+		pushelem(L, a, i);
+		lua_rawseti(L, -2, (lua_Integer)(i + 1));
+	}
+	return 1;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Constructors
+** =======================================================
+*/
+
+/*
+** Sets element 'i' of 'a' to the value on the top of the stack, which
+** is element 'i + 1' of the table at argument 1.
+*/
+static void settableelem(lua_State* L, TArray* a, size_t i) {
+	int ok;
+	if (a->type == LUA_ARRAY_I32) {
+		lua_Integer v = lua_tointegerx(L, -1, &ok);
+		ok = ok && INT32_MIN <= v && v <= INT32_MAX;
+		if (ok) ai32(a)[i] = (int32_t)v;
+	}
+	else {
+		lua_Number x = lua_tonumberx(L, -1, &ok);
+		if (ok && a->type == LUA_ARRAY_F32) af32(a)[i] = (float)x;
+		else if (ok) af64(a)[i] = (double)x;
+	}
+	if (!ok)
+		luaL_argerror(L, 1, lua_pushfstring(L, "invalid value (%s) at index %I",
+			luaL_typename(L, -1), (LUAI_UACINT)(i + 1)));
+}
+
+
+/*
+** array.T(n [, x]) creates an array with 'n' elements equal to 'x'
+** (default 0); array.T(t) creates an array with the elements of the
+** sequence 't'.
+*/
+static int newarray(lua_State* L, int type) {
+	if (lua_istable(L, 1)) {
+		lua_Integer n = luaL_len(L, 1);
+		TArray* a;
+		size_t i;
+		luaL_newarray(L, type, (size_t)(n > 0 ? n : 0));
+		a = (TArray*)lua_touserdata(L, -1);
+		for (i = 0; i < a->n; i++) {
+			lua_geti(L, 1, (lua_Integer)(i + 1));
+			settableelem(L, a, i);
+			lua_pop(L, 1);
+		}
+	}
+	else {
+		lua_Integer n = luaL_checkinteger(L, 1);
+		int hasx = !lua_isnoneornil(L, 2);
+		luaL_argcheck(L, n >= 0, 1, "invalid size");
+		luaL_newarray(L, type, (size_t)n);
+		if (hasx)  /* errors go to argument 2 of this call */
+			fillarray(L, (TArray*)lua_touserdata(L, -1), 2);
+	}
+	return 1;
+}
+
+
+static int arr_i32(lua_State* L) {
+	return newarray(L, LUA_ARRAY_I32);
+}
+
+
+static int arr_f32(lua_State* L) {
+	return newarray(L, LUA_ARRAY_F32);
+}
+
+
+static int arr_f64(lua_State* L) {
+	return newarray(L, LUA_ARRAY_F64);
+}
+
+/* }====================================================== */
+
+
+static const luaL_Reg arr_methods[] = {
+	{"type", arr_type},
+	{"fill", arr_fill},
+	{"add", arr_add},
+	{"scale", arr_scale},
+	{"sum", arr_sum},
+	{"min", arr_min},
+	{"max", arr_max},
+	{"gather", arr_gather},
+	{"copy", arr_copy},
+	{"totable", arr_totable},
+	{NULL, NULL}
+};
+
+
+static const luaL_Reg arr_metameth[] = {
+	{"__newindex", arr_newindex},
+	{"__len", arr_len},
+	{"__tostring", arr_tostring},
+	{"__index", NULL},  /* place holder */
+	{NULL, NULL}
+};
+
+
+/*
+** Pushes the metatable for arrays, creating it if needed (C code can
+** create arrays before the library is opened).
+*/
+static int arraymeta(lua_State* L) {
+	if (luaL_newmetatable(L, ARRAYMT)) {  /* new metatable? */
+		luaL_setfuncs(L, arr_metameth, 0);
+		luaL_newlibtable(L, arr_methods);
+		luaL_setfuncs(L, arr_methods, 0);
+		lua_pushcclosure(L, arr_index, 1);  /* methods are its upvalue */
+		lua_setfield(L, -2, "__index");
+		lua_pushboolean(L, 1);
+		lua_setfield(L, -2, "__copy");  /* elements are inline ('lua_freeze') */
+	}
+	return 1;
+}
+
+
+static const luaL_Reg array_funcs[] = {
+	{"i32", arr_i32},
+	{"f32", arr_f32},
+	{"f64", arr_f64},
+	{NULL, NULL}
+};
+
+
+LUAMOD_API int luaopen_array(lua_State* L) {
+	luaL_newlib(L, array_funcs);
+	arraymeta(L);
+	lua_pop(L, 1);
+	return 1;
+}
+
@@ -7,6 +7,11 @@
 #define lauxlib_c
 #define LUA_LIB
 
+/* 'MAP_ANONYMOUS', for the slab allocator */
+#if defined(LUA_USE_LINUX) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
 #include "lprefix.h"
 
 
@@ -1034,6 +1039,726 @@ static void* l_alloc(void* ud, void* ptr, size_t osize, size_t nsize) {
 }
 
 
+/*
+** {======================================================
+** Slab allocator
+** =======================================================
+*/
+
+/*
+** Blocks up to SLAB_MAXSMALL bytes are served from per-class free
+** lists, in pages of SLAB_PAGESIZE bytes aligned to their size: the
+** page of a block is found by masking its address, so small blocks
+** need no header. Larger blocks come from 'malloc' and, from
+** SLAB_MINMAP bytes on, straight from the system, so that they go
+** back to it as soon as they are freed; these larger blocks have a
+** header telling where they came from. Lua always tells the size of
+** the block it frees or resizes, which tells whether it is small;
+** the few larger blocks that had to stay where they were when a shrink
+** to a small size could not move them are kept in a list.
+**
+** Each state family (a main thread and its coroutines) has its own
+** heap; like the state itself, it needs no locks. The heap frees
+** itself when its last block is freed (that is, by 'lua_close') or
+** when its first allocation fails (that is, when 'lua_newstate' fails).
+*/
+
+#if defined(LUA_USE_POSIX)
+#include <sys/mman.h>
+#elif defined(_WIN32)
+#include <malloc.h>
+#endif
+
+
+#if !defined(SLAB_PAGESIZE)
+#define SLAB_PAGESIZE	(64 * 1024)
+#endif
+
+#define SLAB_GRAIN	16	/* size step between classes */
+#define SLAB_MAXSMALL	512	/* largest block served by a slab */
+#define SLAB_NCLASSES	(SLAB_MAXSMALL / SLAB_GRAIN)
+
+/* class of a small block of size 'n' (> 0), and size of class 'c' */
+#define slabclass(n)	(((n) - 1) / SLAB_GRAIN)
+#define classsize(c)	(((size_t)(c) + 1) * SLAB_GRAIN)
+
+#define issmall(n)	((n) <= SLAB_MAXSMALL)
+
+
+typedef struct SlabPage {
+	struct SlabPage* next;  /* links in the list of pages with free blocks */
+	struct SlabPage* prev;
+	void* free;  /* free blocks of this page */
+	char* fresh;  /* first block never used */
+	char* limit;  /* end of the last block */
+	void* raw;  /* allocation holding the page */
+	unsigned nused;  /* blocks in use */
+	unsigned short cls;  /* class of the blocks */
+	unsigned short inlist;  /* true if in its class' list */
+} SlabPage;
+
+/* offset of the first block in a page */
+#define PAGEHDR	((sizeof(SlabPage) + SLAB_GRAIN - 1) & ~(size_t)(SLAB_GRAIN - 1))
+
+#define pageof(b)	((SlabPage*)((size_t)(b) & ~(size_t)(SLAB_PAGESIZE - 1)))
+
+
+typedef struct SlabHeap {
+	SlabPage* avail[SLAB_NCLASSES];  /* pages with free blocks, per class */
+	SlabPage* spare;  /* an empty page kept for reuse */
+	void* kept;  /* larger blocks that Lua sees as small ones */
+	size_t nblocks;  /* blocks in use, of all sizes */
+} SlabHeap;
+
+
+static SlabPage* syspage(void) {
+	void* raw;
+	SlabPage* pg;
+#if defined(LUA_USE_POSIX)
+	if (posix_memalign(&raw, SLAB_PAGESIZE, SLAB_PAGESIZE) != 0)
+		return NULL;
+	pg = (SlabPage*)raw;
+#elif defined(_WIN32)
+	if ((raw = _aligned_malloc(SLAB_PAGESIZE, SLAB_PAGESIZE)) == NULL)
+		return NULL;
+	pg = (SlabPage*)raw;
+#else  /* no aligned allocation in C89; align by hand */
+	raw = malloc(2 * SLAB_PAGESIZE);
+	if (raw == NULL)
+		return NULL;
+	pg = pageof((char*)raw + SLAB_PAGESIZE - 1);
+#endif
+	pg->raw = raw;
+	return pg;
+}
+
+
+static void syspagefree(SlabPage* pg) {
+#if defined(_WIN32) && !defined(LUA_USE_POSIX)
+	_aligned_free(pg->raw);
+#else
+	free(pg->raw);
+#endif
+}
+
+
+static void freepage(SlabHeap* h, SlabPage* pg) {
+	if (h->spare == NULL)
+		h->spare = pg;
+	else
+		syspagefree(pg);
+}
+
+
+static void linkpage(SlabHeap* h, SlabPage* pg) {
+	SlabPage** list = &h->avail[pg->cls];
+	pg->prev = NULL;
+	pg->next = *list;
+	if (*list)
+		(*list)->prev = pg;
+	*list = pg;
+	pg->inlist = 1;
+}
+
+
+static void unlinkpage(SlabHeap* h, SlabPage* pg) {
+	if (pg->prev)
+		pg->prev->next = pg->next;
+	else
+		h->avail[pg->cls] = pg->next;
+	if (pg->next)
+		pg->next->prev = pg->prev;
+	pg->inlist = 0;
+}
+
+
+static SlabPage* newpage(SlabHeap* h, int c) {
+	SlabPage* pg = h->spare;
+	size_t sz = classsize(c);
+	if (pg != NULL)
+		h->spare = NULL;
+	else if ((pg = syspage()) == NULL)
+		return NULL;
+	pg->free = NULL;
+	pg->fresh = (char*)pg + PAGEHDR;
+	pg->limit = pg->fresh + (SLAB_PAGESIZE - PAGEHDR) / sz * sz;
+	pg->nused = 0;
+	pg->cls = (unsigned short)c;
+	linkpage(h, pg);
+	return pg;
+}
+
+
+static void* smallalloc(SlabHeap* h, size_t n) {
+	int c = (int)slabclass(n);
+	SlabPage* pg = h->avail[c];
+	void* b;
+	if (pg == NULL && (pg = newpage(h, c)) == NULL)
+		return NULL;
+	if (pg->free != NULL) {
+		b = pg->free;
+		pg->free = *(void**)b;
+	}
+	else {
+		b = pg->fresh;
+		pg->fresh += classsize(c);
+	}
+	pg->nused++;
+	if (pg->free == NULL && pg->fresh == pg->limit)  /* page is full? */
+		unlinkpage(h, pg);
+	return b;
+}
+
+
+static void smallfree(SlabHeap* h, void* b) {
+	SlabPage* pg = pageof(b);
+	*(void**)b = pg->free;
+	pg->free = b;
+	if (--pg->nused == 0) {  /* page is empty? */
+		if (pg->inlist)
+			unlinkpage(h, pg);
+		freepage(h, pg);
+	}
+	else if (!pg->inlist)  /* page was full? */
+		linkpage(h, pg);
+}
+
+
+/*
+** Blocks too large for a slab carry a header with the size of their
+** mapping (0 for a 'malloc' block) and a link in the list of kept
+** blocks. Blocks of SLAB_MINMAP bytes or more are mapped straight from
+** the system.
+*/
+typedef struct LargeHdr {
+	size_t mapsize;  /* size of the mapping; 0 if from 'malloc' */
+	void* kept;  /* next kept block */
+} LargeHdr;
+
+#define BIGHDR	((sizeof(LargeHdr) + SLAB_GRAIN - 1) & ~(size_t)(SLAB_GRAIN - 1))
+
+#define hdrof(b)	((LargeHdr*)((char*)(b) - BIGHDR))
+
+#if defined(LUA_USE_POSIX) && defined(MAP_ANONYMOUS)
+
+#if !defined(SLAB_MINMAP)
+#define SLAB_MINMAP	(128 * 1024)
+#endif
+
+#define isbig(n)	((n) >= SLAB_MINMAP)
+
+static void* bigalloc(size_t n) {
+	size_t sz = n + BIGHDR;
+	char* p;
+	if (sz < n)  /* overflow? */
+		return NULL;
+	p = (char*)mmap(NULL, sz, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == (char*)MAP_FAILED)
+		return NULL;
+	((LargeHdr*)p)->mapsize = sz;
+	return p + BIGHDR;
+}
+
+#define bigfree(h)	munmap((h), (h)->mapsize)
+
+#else
+
+#define isbig(n)	0
+#define bigalloc(n)	NULL
+#define bigfree(h)	((void)0)
+
+#endif
+
+
+static void* midalloc(size_t n) {
+	size_t sz = n + BIGHDR;
+	char* p;
+	if (sz < n || (p = (char*)malloc(sz)) == NULL)
+		return NULL;
+	((LargeHdr*)p)->mapsize = 0;
+	return p + BIGHDR;
+}
+
+
+static void largefree(void* b) {
+	LargeHdr* hd = hdrof(b);
+	if (hd->mapsize != 0)
+		bigfree(hd);
+	else
+		free(hd);
+}
+
+
+/* remembers that larger block 'b' now has a small size for Lua */
+static void keepblock(SlabHeap* h, void* b) {
+	hdrof(b)->kept = h->kept;
+	h->kept = b;
+}
+
+
+/*
+** Removes block 'b', of a small size for Lua, from the list of kept
+** blocks; returns false if it is not there (that is, 'b' is really a
+** small block).
+*/
+static int unkeepblock(SlabHeap* h, void* b) {
+	void** p;
+	for (p = &h->kept; *p != NULL; p = &hdrof(*p)->kept) {
+		if (*p == b) {
+			*p = hdrof(b)->kept;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+static int iskept(SlabHeap* h, void* b) {
+	void* k;
+	for (k = h->kept; k != NULL; k = hdrof(k)->kept) {
+		if (k == b)
+			return 1;
+	}
+	return 0;
+}
+
+
+static void* slabnew(SlabHeap* h, size_t n) {
+	if (issmall(n))
+		return smallalloc(h, n);
+	else if (isbig(n))
+		return bigalloc(n);
+	else
+		return midalloc(n);
+}
+
+
+static void slabfree(SlabHeap* h, void* b, size_t n) {
+	if (issmall(n) && (h->kept == NULL || !unkeepblock(h, b)))
+		smallfree(h, b);
+	else
+		largefree(b);
+}
+
+
+/*
+** Resizes block 'b' in place when it can: a small block whose class
+** fits the new size, a 'malloc' block staying in 'malloc', or a mapped
+** block whose mapping is large enough and not more than twice as large
+** as needed. (Kept blocks always move.) Returns NULL if the block must
+** move.
+*/
+static void* slabresize(SlabHeap* h, void* b, size_t osize, size_t nsize) {
+	if (issmall(osize)) {
+		if (issmall(nsize) && (h->kept == NULL || !iskept(h, b)) &&
+			slabclass(nsize) == pageof(b)->cls)
+			return b;
+	}
+	else if (hdrof(b)->mapsize != 0) {
+		size_t sz = hdrof(b)->mapsize - BIGHDR;
+		if (isbig(nsize) && nsize <= sz && nsize > sz / 2)
+			return b;
+	}
+	else if (!issmall(nsize) && !isbig(nsize)) {
+		char* p = (char*)realloc(hdrof(b), nsize + BIGHDR);
+		return (p == NULL) ? NULL : p + BIGHDR;
+	}
+	return NULL;
+}
+
+
+/* all pages but the spare one are gone when no block is in use */
+static void freeheap(SlabHeap* h) {
+	if (h->spare != NULL)
+		syspagefree(h->spare);
+	free(h);
+}
+
+
+static void* l_slaballoc(void* ud, void* ptr, size_t osize, size_t nsize) {
+	SlabHeap* h = (SlabHeap*)ud;
+	void* nb;
+	if (ptr == NULL) {  /* new block? ('osize' is its type) */
+		if (nsize == 0)
+			return NULL;
+		nb = slabnew(h, nsize);
+		if (nb != NULL)
+			h->nblocks++;
+		else if (h->nblocks == 0)  /* 'lua_newstate' failing? */
+			freeheap(h);
+		return nb;
+	}
+	else if (nsize == 0) {  /* free block */
+		slabfree(h, ptr, osize);
+		if (--h->nblocks == 0)  /* was the last one ('lua_close')? */
+			freeheap(h);
+		return NULL;
+	}
+	else if ((nb = slabresize(h, ptr, osize, nsize)) != NULL)
+		return nb;
+	else if ((nb = slabnew(h, nsize)) != NULL) {  /* move the block */
+		memcpy(nb, ptr, (osize < nsize) ? osize : nsize);
+		slabfree(h, ptr, osize);
+		return nb;
+	}
+	else if (nsize > osize)
+		return NULL;
+	else {  /* a shrinking block can always stay where it is */
+		if (!issmall(osize) && issmall(nsize))
+			keepblock(h, ptr);  /* its size no longer tells what it is */
+		return ptr;
+	}
+}
+
+
+static SlabHeap* newslabheap(void) {
+	SlabHeap* h = (SlabHeap*)malloc(sizeof(SlabHeap));
+	if (h != NULL)
+		memset(h, 0, sizeof(SlabHeap));
+	return h;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Memory accounting
+** =======================================================
+*/
+
+/*
+** The accounting allocator wraps the allocator of a state, counting
+** the bytes in use and refusing any growth beyond the limit; Lua then
+** collects garbage and, if that is not enough, raises a memory error
+** (LUA_ERRMEM) in the code asking for memory. Shrinking and freeing
+** never fail. The wrapper is allocated by the wrapped allocator and
+** frees itself after the block of the main thread, the last one freed
+** by 'lua_close'.
+*/
+
+typedef struct MemAcct {
+	luaL_MemStats st;
+	lua_Alloc f;  /* wrapped allocator */
+	void* ud;
+	void* mainblock;  /* block holding the main thread */
+} MemAcct;
+
+
+static void* l_memalloc(void* ud, void* ptr, size_t osize, size_t nsize) {
+	MemAcct* m = (MemAcct*)ud;
+	void* nb;
+	if (ptr == NULL)
+		osize = 0;  /* 'osize' is the type of a new block */
+	if (nsize > osize && m->st.limit != 0 &&  /* growing under a limit? */
+		(m->st.inuse > m->st.limit ||
+			nsize - osize > m->st.limit - m->st.inuse)) {
+		m->st.nrefused++;
+		return NULL;
+	}
+	nb = (*m->f)(m->ud, ptr, osize, nsize);
+	if (nb == NULL && nsize > 0)
+		return NULL;
+	if (ptr == NULL)
+		m->st.nalloc++;
+	/* blocks from before the accounting may take it below zero */
+	m->st.inuse = (m->st.inuse >= osize) ? m->st.inuse - osize : 0;
+	m->st.inuse += nsize;
+	if (m->st.inuse > m->st.peak)
+		m->st.peak = m->st.inuse;
+	if (ptr == m->mainblock && nsize == 0)  /* state is gone? */
+		(*m->f)(m->ud, m, sizeof(MemAcct), 0);
+	return nb;
+}
+
+
+LUALIB_API const luaL_MemStats* luaL_memstats(lua_State* L) {
+	void* ud;
+	if (lua_getallocf(L, &ud) == l_memalloc)
+		return &((MemAcct*)ud)->st;
+	else
+		return NULL;
+}
+
+
+/*
+** Sets the memory limit of a state (0 for none), installing the
+** accounting allocator if needed; it should be installed right after
+** creating the state, so that all blocks are allocated through it.
+** Returns NULL when there is no memory for the accounting.
+*/
+LUALIB_API const luaL_MemStats* luaL_setmemlimit(lua_State* L,
+	size_t limit) {
+	void* ud;
+	lua_Alloc f = lua_getallocf(L, &ud);
+	MemAcct* m;
+	if (f == l_memalloc)
+		m = (MemAcct*)ud;
+	else {
+		lua_State* mainth;
+		int kb = lua_gc(L, LUA_GCCOUNT);  /* -1 inside a finalizer */
+		m = (MemAcct*)(*f)(ud, NULL, 0, sizeof(MemAcct));
+		if (m == NULL)
+			return NULL;
+		lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+		mainth = lua_tothread(L, -1);
+		lua_pop(L, 1);
+		memset(&m->st, 0, sizeof(m->st));
+		if (kb >= 0)
+			m->st.inuse = (size_t)kb * 1024 + (size_t)lua_gc(L, LUA_GCCOUNTB);
+		m->st.peak = m->st.inuse;
+		m->f = f;
+		m->ud = ud;
+		m->mainblock = lua_getextraspace(mainth);
+		lua_setallocf(L, l_memalloc, m);
+	}
+	m->st.limit = limit;
+	return &m->st;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Background reaper
+** =======================================================
+*/
+
+/*
+** The reaper is a thread, shared by all states of the process, that
+** does memory work handed to it: it closes states shut down by
+** 'luaL_closeasync' and frees the blocks that states using the
+** LUAL_ALLOCBGFREE allocator free, which come in batches of REAP_BATCH
+** blocks (so that its lock is taken once per batch). It starts with
+** the first job. Without threads (or if it cannot start), jobs are
+** done right away by the thread that hands them.
+*/
+
+#if !defined(REAP_BATCH)
+#define REAP_BATCH	1024
+#endif
+
+typedef struct ReapJob {
+	struct ReapJob* next;
+	lua_State* L;  /* state to close (NULL for a batch of blocks) */
+} ReapJob;
+
+typedef struct ReapBatch {
+	ReapJob j;  /* must be the first field */
+	size_t n;  /* number of blocks */
+	void* blocks[REAP_BATCH];
+} ReapBatch;
+
+
+static void freebatch(ReapBatch* rb) {
+	size_t i;
+	for (i = 0; i < rb->n; i++)
+		free(rb->blocks[i]);
+	rb->n = 0;
+}
+
+
+static void dojob(ReapJob* j) {
+	if (j->L != NULL)
+		lua_close(j->L);
+	else
+		freebatch((ReapBatch*)j);
+	free(j);
+}
+
+
+#if !defined(LUAL_NOREAPER) && (defined(LUA_USE_POSIX) || defined(_WIN32))
+
+#if defined(LUA_USE_POSIX)
+
+#include <pthread.h>
+
+static pthread_mutex_t reaplock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reapcond = PTHREAD_COND_INITIALIZER;
+
+#define lockreaper()	pthread_mutex_lock(&reaplock)
+#define unlockreaper()	pthread_mutex_unlock(&reaplock)
+#define waitreaper()	pthread_cond_wait(&reapcond, &reaplock)
+#define wakereaper()	pthread_cond_signal(&reapcond)
+
+#define REAPMAIN	static void* reapmain(void* ud)
+#define REAPRETURN	return NULL
+
+#else  /* Windows (Vista or later) */
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <process.h>
+
+static SRWLOCK reaplock = SRWLOCK_INIT;
+static CONDITION_VARIABLE reapcond = CONDITION_VARIABLE_INIT;
+
+#define lockreaper()	AcquireSRWLockExclusive(&reaplock)
+#define unlockreaper()	ReleaseSRWLockExclusive(&reaplock)
+#define waitreaper()  \
+  SleepConditionVariableSRW(&reapcond, &reaplock, INFINITE, 0)
+#define wakereaper()	WakeConditionVariable(&reapcond)
+
+#define REAPMAIN	static unsigned __stdcall reapmain(void* ud)
+#define REAPRETURN	return 0
+
+#endif
+
+
+static ReapJob* reapfirst = NULL;  /* queue of jobs */
+static ReapJob** reaplast = &reapfirst;
+static int reaperstate = 0;  /* 0: not started; 1: running; -1: failed */
+
+
+REAPMAIN {
+	(void)ud;
+	for (;;) {
+		ReapJob* j;
+		lockreaper();
+		while (reapfirst == NULL)
+			waitreaper();
+		j = reapfirst;
+		if ((reapfirst = j->next) == NULL)
+			reaplast = &reapfirst;
+		unlockreaper();
+		dojob(j);
+	}
+	REAPRETURN;
+}
+
+
+static int startreaper(void) {
+#if defined(LUA_USE_POSIX)
+	pthread_t t;
+	pthread_attr_t attr;
+	int ok;
+	if (pthread_attr_init(&attr) != 0)
+		return 0;
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	ok = (pthread_create(&t, &attr, reapmain, NULL) == 0);
+	pthread_attr_destroy(&attr);
+	return ok;
+#else
+	uintptr_t t = _beginthreadex(NULL, 0, reapmain, NULL, 0, NULL);
+	if (t == 0)
+		return 0;
+	CloseHandle((HANDLE)t);
+	return 1;
+#endif
+}
+
+
+/* hands job 'j' to the reaper, or does it if there is no reaper */
+static void reap(ReapJob* j) {
+	int queued = 0;
+	lockreaper();
+	if (reaperstate == 0)
+		reaperstate = startreaper() ? 1 : -1;
+	if (reaperstate == 1) {
+		j->next = NULL;
+		*reaplast = j;
+		reaplast = &j->next;
+		wakereaper();
+		queued = 1;
+	}
+	unlockreaper();
+	if (!queued)
+		dojob(j);
+}
+
+#else  /* no threads */
+
+#define reap(j)		dojob(j)
+
+#endif
+
+
+/*
+** The LUAL_ALLOCBGFREE allocator is the system one with its frees done
+** by the reaper, which takes most of the cost of collector sweeps and
+** of 'lua_close' off the thread running the state. (The system
+** allocator must allow blocks to be freed by another thread.) Like the
+** slab allocator, it counts its blocks, to free itself with the last
+** one or when the first allocation fails.
+*/
+
+typedef struct BgFree {
+	ReapBatch* batch;  /* blocks freed but not handed yet (or NULL) */
+	size_t nblocks;  /* blocks in use */
+} BgFree;
+
+
+static void bgflush(BgFree* b) {
+	if (b->batch != NULL) {
+		reap(&b->batch->j);
+		b->batch = NULL;
+	}
+}
+
+
+static void* l_bgalloc(void* ud, void* ptr, size_t osize, size_t nsize) {
+	BgFree* b = (BgFree*)ud;
+	(void)osize;  /* not used */
+	if (nsize != 0) {
+		void* nb = realloc(ptr, nsize);
+		if (nb == NULL && b->batch != NULL) {  /* free pending blocks now */
+			freebatch(b->batch);
+			nb = realloc(ptr, nsize);
+		}
+		if (ptr == NULL) {
+			if (nb != NULL)
+				b->nblocks++;
+			else if (b->nblocks == 0)  /* 'lua_newstate' failing? */
+				free(b);
+		}
+		return nb;
+	}
+	else if (ptr == NULL)
+		return NULL;
+	if (b->batch == NULL &&
+		(b->batch = (ReapBatch*)malloc(sizeof(ReapBatch))) != NULL) {
+		b->batch->j.L = NULL;
+		b->batch->n = 0;
+	}
+	if (b->batch == NULL)  /* no memory for a batch? */
+		free(ptr);  /* free the block here */
+	else {
+		b->batch->blocks[b->batch->n++] = ptr;
+		if (b->batch->n == REAP_BATCH)
+			bgflush(b);
+	}
+	if (--b->nblocks == 0) {  /* was the last one ('lua_close')? */
+		bgflush(b);
+		free(b);
+	}
+	return NULL;
+}
+
+
+/*
+** Closes state 'L' in the background: does here the part of closing
+** that may run code (see 'lua_shutdown') and leaves the freeing of all
+** its memory to the reaper. The allocator of the state must allow being
+** called from another thread; the ones from 'luaL_newstatex' do.
+*/
+LUALIB_API void luaL_closeasync(lua_State* L) {
+	ReapJob* j = (ReapJob*)malloc(sizeof(ReapJob));
+	lua_shutdown(L);
+	if (j == NULL)  /* no memory for the job? */
+		lua_close(L);  /* close it here */
+	else {
+		j->L = L;
+		reap(j);
+	}
+}
+
+/* }====================================================== */
+
+
 /*
 ** Standard panic funcion just prints an error message. The test
 ** with 'lua_type' avoids possible memory errors in 'lua_tostring'.
@@ -1105,8 +1830,32 @@ static void warnfon(void* ud, const char* message, int tocont) {
 }
 
 
-LUALIB_API lua_State* luaL_newstate(void) {
-	lua_State* L = lua_newstate(l_alloc, NULL);
+/*
+** Creates a state with allocator 'alloc', as a clone of template 'T'
+** if it is not NULL.
+*/
+static lua_State* newstate(int alloc, lua_State* T) {
+	lua_Alloc f = l_alloc;
+	void* ud = NULL;
+	lua_State* L;
+	if (alloc == LUAL_ALLOCSLAB) {
+		SlabHeap* h = newslabheap();
+		if (h == NULL)
+			return NULL;
+		f = l_slaballoc;
+		ud = h;
+	}
+	else if (alloc == LUAL_ALLOCBGFREE) {
+		BgFree* b = (BgFree*)malloc(sizeof(BgFree));
+		if (b == NULL)
+			return NULL;
+		b->batch = NULL;
+		b->nblocks = 0;
+		f = l_bgalloc;
+		ud = b;
+	}
+	/* 'ud' is freed with the state */
+	L = (T == NULL) ? lua_newstate(f, ud) : lua_clone(T, f, ud);
 	if (l_likely(L)) {
 		lua_atpanic(L, &panic);
 		lua_setwarnf(L, warnfoff, L);  /* default is warnings off */
@@ -1115,6 +1864,26 @@ LUALIB_API lua_State* luaL_newstate(void) {
 }
 
 
+LUALIB_API lua_State* luaL_newstatex(int alloc) {
+	return newstate(alloc, NULL);
+}
+
+
+LUALIB_API lua_State* luaL_newstate(void) {
+	return luaL_newstatex(LUAL_DEFAULTALLOC);
+}
+
+
+LUALIB_API lua_State* luaL_clonex(lua_State* T, int alloc) {
+	return newstate(alloc, T);
+}
+
+
+LUALIB_API lua_State* luaL_clone(lua_State* T) {
+	return luaL_clonex(T, LUAL_DEFAULTALLOC);
+}
+
+
 LUALIB_API void luaL_checkversion_(lua_State* L, lua_Number ver, size_t sz) {
 	lua_Number v = lua_version(L);
 	if (sz != LUAL_NUMSIZES)  /* check numeric types */
@@ -23,6 +23,24 @@
 typedef struct luaL_Buffer luaL_Buffer;
 
 
+/* allocators for 'luaL_newstatex' */
+#define LUAL_ALLOCSYS	0	/* 'realloc' and 'free' */
+#define LUAL_ALLOCSLAB	1	/* size-class slab allocator */
+#define LUAL_ALLOCBGFREE	2	/* 'realloc', with frees in the background */
+
+/*
+** allocator used by 'luaL_newstate': the slab allocator needs aligned
+** allocation from the system to be worth its while
+*/
+#if !defined(LUAL_DEFAULTALLOC)
+#if defined(LUA_USE_POSIX) || defined(_WIN32)
+#define LUAL_DEFAULTALLOC	LUAL_ALLOCSLAB
+#else
+#define LUAL_DEFAULTALLOC	LUAL_ALLOCSYS
+#endif
+#endif
+
+
 /* extra error code for 'luaL_loadfilex' */
 #define LUA_ERRFILE     (LUA_ERRERR+1)
 
@@ -35,6 +53,10 @@ typedef struct luaL_Buffer luaL_Buffer;
 #define LUA_PRELOAD_TABLE	"_PRELOAD"
 
 
+/* key, in the registry, for the cache of compiled string patterns */
+#define LUA_PATCACHE_TABLE	"_PATCACHE"
+
+
 typedef struct luaL_Reg {
 	const char* name;
 	lua_CFunction func;
@@ -99,6 +121,10 @@ LUALIB_API int (luaL_loadbufferx)(lua_State* L, const char* buff, size_t sz,
 LUALIB_API int (luaL_loadstring)(lua_State* L, const char* s);
 
 LUALIB_API lua_State* (luaL_newstate)(void);
+LUALIB_API lua_State* (luaL_newstatex)(int alloc);
+LUALIB_API lua_State* (luaL_clone)(lua_State* T);
+LUALIB_API lua_State* (luaL_clonex)(lua_State* T, int alloc);
+LUALIB_API void (luaL_closeasync)(lua_State* L);
 
 LUALIB_API lua_Integer(luaL_len) (lua_State* L, int idx);
 
@@ -227,6 +253,34 @@ LUALIB_API char* (luaL_buffinitsize)(lua_State* L, luaL_Buffer* B, size_t sz);
 
 
 
+/*
+** {======================================================
+** Memory accounting
+** =======================================================
+*/
+
+/*
+** Counters kept by the accounting allocator of a state, installed by
+** 'luaL_setmemlimit'. 'luaL_memstats' returns them (or NULL for a state
+** without accounting); they stay valid, and are kept up to date, until
+** the state is closed.
+*/
+typedef struct luaL_MemStats {
+	size_t inuse;  /* bytes in use */
+	size_t peak;  /* largest value of 'inuse' */
+	size_t limit;  /* bytes allowed in use (0 means no limit) */
+	lua_Unsigned nalloc;  /* number of blocks allocated */
+	lua_Unsigned nrefused;  /* allocations refused by the limit */
+} luaL_MemStats;
+
+LUALIB_API const luaL_MemStats* (luaL_setmemlimit)(lua_State* L,
+	size_t limit);
+LUALIB_API const luaL_MemStats* (luaL_memstats)(lua_State* L);
+
+/* }====================================================== */
+
+
+
 /*
 ** {======================================================
 ** File handles for IO library
@@ -196,13 +196,69 @@ static int pushmode(lua_State* L, int oldmode) {
 */
 #define checkvalres(res) { if (res == -1) break; }
 
+
+static void setfieldus(lua_State* L, const char* k, lua_Unsigned ns) {
+	lua_pushnumber(L, (lua_Number)ns / 1000);  /* in microseconds */
+	lua_setfield(L, -2, k);
+}
+
+
+static void setfieldu(lua_State* L, const char* k, lua_Unsigned n) {
+	lua_pushinteger(L, (lua_Integer)n);
+	lua_setfield(L, -2, k);
+}
+
+
+/*
+** Push the collector telemetry as a table: 'ncycles', 'pauses' (the
+** histogram) and 'cycles' (the last collections, oldest first). Times
+** are in microseconds, sizes in bytes.
+*/
+static void pushgcstats(lua_State* L, const lua_GCStats* st) {
+	static const char* const kinds[] = { "incremental", "minor", "major",
+	  "full" };
+	lua_Unsigned first = (st->ncycles > LUA_GCNCYCLES)
+		? st->ncycles - LUA_GCNCYCLES : 0;
+	lua_Unsigned n;
+	int i;
+	lua_createtable(L, 0, 3);
+	setfieldu(L, "ncycles", st->ncycles);
+	lua_createtable(L, LUA_GCNPAUSES, 0);
+	for (i = 0; i < LUA_GCNPAUSES; i++) {
+		lua_pushinteger(L, (lua_Integer)st->pauses[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+	lua_setfield(L, -2, "pauses");
+	lua_createtable(L, (int)(st->ncycles - first), 0);
+	for (n = first; n < st->ncycles; n++) {
+		const lua_GCCycle* c = &st->cycles[n % LUA_GCNCYCLES];
+		lua_createtable(L, 0, 11);
+		lua_pushstring(L, kinds[c->kind]);
+		lua_setfield(L, -2, "kind");
+		setfieldu(L, "steps", (lua_Unsigned)c->steps);
+		setfieldus(L, "propagate", c->propagate);
+		setfieldus(L, "atomic", c->atomic);
+		setfieldus(L, "sweep", c->sweep);
+		setfieldus(L, "finalize", c->finalize);
+		setfieldus(L, "maxpause", c->maxpause);
+		setfieldu(L, "swept", c->swept);
+		setfieldu(L, "freed", c->freed);
+		setfieldu(L, "marked", (c->swept > c->freed) ? c->swept - c->freed : 0);
+		setfieldu(L, "finalized", c->finalized);
+		lua_rawseti(L, -2, (lua_Integer)(n - first + 1));
+	}
+	lua_setfield(L, -2, "cycles");
+}
+
 static int luaB_collectgarbage(lua_State* L) {
 	static const char* const opts[] = { "stop", "restart", "collect",
 	  "count", "step", "setpause", "setstepmul",
-	  "isrunning", "generational", "incremental", NULL };
+	  "isrunning", "generational", "incremental", "budget", "stats",
+	  "pusharena", "poparena", "setextweight", "extcount", NULL };
 	static const int optsnum[] = { LUA_GCSTOP, LUA_GCRESTART, LUA_GCCOLLECT,
 	  LUA_GCCOUNT, LUA_GCSTEP, LUA_GCSETPAUSE, LUA_GCSETSTEPMUL,
-	  LUA_GCISRUNNING, LUA_GCGEN, LUA_GCINC };
+	  LUA_GCISRUNNING, LUA_GCGEN, LUA_GCINC, LUA_GCBUDGET, LUA_GCSTATS,
+	  LUA_GCPUSHARENA, LUA_GCPOPARENA, LUA_GCSETEXTWEIGHT, LUA_GCEXTCOUNT };
 	int o = optsnum[luaL_checkoption(L, 1, "collect", opts)];
 	switch (o) {
 	case LUA_GCCOUNT: {
@@ -212,7 +268,8 @@ static int luaB_collectgarbage(lua_State* L) {
 		lua_pushnumber(L, (lua_Number)k + ((lua_Number)b / 1024));
 		return 1;
 	}
-	case LUA_GCSTEP: {
+	case LUA_GCSTEP:
+	case LUA_GCBUDGET: {
 		int step = (int)luaL_optinteger(L, 2, 0);
 		int res = lua_gc(L, o, step);
 		checkvalres(res);
@@ -220,19 +277,28 @@ static int luaB_collectgarbage(lua_State* L) {
 		return 1;
 	}
 	case LUA_GCSETPAUSE:
-	case LUA_GCSETSTEPMUL: {
+	case LUA_GCSETSTEPMUL:
+	case LUA_GCSETEXTWEIGHT: {
 		int p = (int)luaL_optinteger(L, 2, 0);
 		int previous = lua_gc(L, o, p);
 		checkvalres(previous);
 		lua_pushinteger(L, previous);
 		return 1;
 	}
-	case LUA_GCISRUNNING: {
+	case LUA_GCISRUNNING:
+	case LUA_GCPOPARENA: {
 		int res = lua_gc(L, o);
 		checkvalres(res);
 		lua_pushboolean(L, res);
 		return 1;
 	}
+	case LUA_GCSTATS: {
+		lua_GCStats st;
+		int res = lua_gc(L, o, &st);
+		checkvalres(res);
+		pushgcstats(L, &st);
+		return 1;
+	}
 	case LUA_GCGEN: {
 		int minormul = (int)luaL_optinteger(L, 2, 0);
 		int majormul = (int)luaL_optinteger(L, 3, 0);
@@ -538,6 +604,7 @@ LUAMOD_API int luaopen_base(lua_State* L) {
 	/* open lib into global table */
 	lua_pushglobaltable(L);
 	luaL_setfuncs(L, base_funcs, 0);
+	lua_setselectf(L, luaB_select);
 	/* set global _G */
 	lua_pushvalue(L, -1);
 	lua_setfield(L, -2, LUA_GNAME);
@@ -0,0 +1,571 @@
+/*
+** $Id: lclone.c $
+** State templates
+** See Copyright Notice in lua.h
+*/
+
+#define lclone_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+
+#include <string.h>
+
+#include "lua.h"
+
+#include "lclone.h"
+#include "ldebug.h"
+#include "ldo.h"
+#include "lfunc.h"
+#include "lgc.h"
+#include "lmem.h"
+#include "lobject.h"
+#include "lopcodes.h"
+#include "lstate.h"
+#include "lstring.h"
+#include "ltable.h"
+#include "ltm.h"
+
+
+/*
+** A template is a state frozen by 'lua_freeze' to be copied by
+** 'lua_clone'. Freezing runs a full collection and then lists, in a
+** breadth-first walk from the main thread, the registry and the
+** metatables of basic types, all live objects that a clone needs its
+** own copy of: tables, closures, upvalues and full userdata. Strings
+** and prototypes are not copied: clones share them with the template.
+** A clone looks for a string in the string table of the template
+** before creating it (see 'internshrstr'), so that each string still
+** has a single copy, and shared objects are marked black and old, so
+** that the collector of a clone never marks nor frees them (they are
+** not in its lists).
+**
+** A full userdata is copied byte for byte, so its bytes must not
+** point to memory or other resources it owns: the copy would share
+** them with the template. A userdata without a metatable is taken to
+** be plain data; one with a metatable is copied only if the metatable
+** has a field '__copy' that is true, or that is a function returning
+** true when called with the userdata (during 'lua_freeze'; it must not
+** change the state). Otherwise, 'lua_freeze' fails.
+**
+** Cloning creates the copies in the order of the list, where the main
+** thread of the template stands for the main thread of the clone, and
+** then translates their references through an index from objects to
+** their positions in the list. Hash parts are copied as they are, as
+** strings and numbers hash the same way in both states (a clone keeps
+** the seed of the template); only tables with keys hashed by their
+** addresses are rebuilt.
+**
+** A template cannot run anything after being frozen and must outlive
+** its clones. As cloning only reads it, clones can be created from
+** several OS threads at the same time. (With LUA_USE_PROFILE, the
+** counters of shared prototypes are updated by all clones without
+** synchronization.)
+*/
+
+
+/* copy of a table must be rebuilt (it has keys hashed by address) */
+#define CL_REHASH	1
+
+
+typedef struct TObj {
+	GCObject* o;
+	int flags;
+} TObj;
+
+
+typedef struct Template {
+	TObj* objs;  /* objects to copy ('objs[0]' is the main thread) */
+	int n;  /* number of objects in 'objs' */
+	int size;  /* size of 'objs' */
+	unsigned int* index;  /* 1 + position of each object (0 if empty) */
+	lu_byte lisize;  /* log2 of size of 'index' */
+} Template;
+
+
+#define MINLISIZE	6
+
+#define gnodelast(h)	gnode(h, cast_sizet(sizenode(h)))
+
+/* keys that must be translated (strings are shared) */
+#define keyisobject(n)  \
+	(keyiscollectable(n) && novariant(keytt(n)) != LUA_TSTRING)
+
+
+/*
+** {======================================================
+** Object index
+** =======================================================
+*/
+
+static unsigned int* findslot(const Template* T, const GCObject* o) {
+	unsigned int mask = (1u << T->lisize) - 1;
+	unsigned int i = ((point2uint(o) * 2654435769u) & 0xffffffffu) >>
+		(32 - T->lisize);
+	while (T->index[i] != 0 && T->objs[T->index[i] - 1].o != o)
+		i = (i + 1) & mask;
+	return &T->index[i];
+}
+
+
+static void rebuildindex(lua_State* L, Template* T, lu_byte lsize) {
+	unsigned int* old = T->index;
+	size_t oldsize = (old == NULL) ? 0 : (cast_sizet(1) << T->lisize);
+	size_t size = cast_sizet(1) << lsize;
+	int i;
+	T->index = luaM_newvector(L, size, unsigned int);
+	if (old != NULL)
+		luaM_freearray(L, old, oldsize);
+	T->lisize = lsize;
+	memset(T->index, 0, size * sizeof(unsigned int));
+	for (i = 0; i < T->n; i++)
+		*findslot(T, T->objs[i].o) = cast_uint(i) + 1;
+}
+
+
+/* position in the list of an object that must be there */
+static int position(const Template* T, const GCObject* o) {
+	unsigned int p = *findslot(T, o);
+	lua_assert(p != 0);
+	return cast_int(p) - 1;
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Freezing
+** =======================================================
+*/
+
+static void addobj(lua_State* L, Template* T, GCObject* o) {
+	unsigned int* slot;
+	if (o->tt == LUA_VSHRSTR || o->tt == LUA_VLNGSTR || o->tt == LUA_VPROTO)
+		return;  /* shared */
+	slot = findslot(T, o);
+	if (*slot != 0)
+		return;  /* already listed */
+	if (o->tt == LUA_VTHREAD && gco2th(o) != G(L)->mainthread)
+		luaG_runerror(L, "cannot freeze a state with coroutines");
+	luaM_growvector(L, T->objs, T->n, T->size, TObj, MAX_INT, "objects");
+	T->objs[T->n].o = o;
+	T->objs[T->n].flags = 0;
+	T->n++;
+	if (cast_sizet(T->n) * 2 > (cast_sizet(1) << T->lisize))  /* too full? */
+		rebuildindex(L, T, T->lisize + 1);
+	else
+		*slot = cast_uint(T->n);
+}
+
+
+#define addvalue(L,T,v)	\
+	(iscollectable(v) ? addobj(L, T, gcvalue(v)) : (void)0)
+
+/* 'obj2gco' cannot take NULL (it checks the tag of the object) */
+#define addobjref(L,T,p)  \
+	((p) != NULL ? addobj(L, T, obj2gco(p)) : (void)0)
+
+
+static void visittable(lua_State* L, Template* T, int i) {
+	Table* h = gco2t(T->objs[i].o);
+	unsigned int k, asize;
+	Node* n, * limit;
+	luaH_finishmigration(L, h);  /* copies need a single hash part */
+	asize = luaH_realasize(h);
+	addobjref(L, T, h->metatable);
+	for (k = 0; k < asize; k++)
+		addvalue(L, T, &h->array[k]);
+	limit = gnodelast(h);
+	for (n = gnode(h, 0); n < limit; n++) {
+		if (isempty(gval(n)))
+			continue;
+		if (keyisobject(n)) {
+			T->objs[i].flags |= CL_REHASH;
+			addobj(L, T, gckey(n));
+		}
+		addvalue(L, T, gval(n));
+	}
+}
+
+
+/* checks whether userdata 'u' can be copied byte for byte */
+static void checkudata(lua_State* L, Udata* u) {
+	const TValue* hook;
+	TValue v;
+	if (u->metatable == NULL)
+		return;  /* plain data */
+	hook = luaH_getshortstr(u->metatable, luaS_newliteral(L, "__copy"));
+	if (ttisfunction(hook)) {  /* ask it */
+		StkId func;
+		luaD_checkstack(L, 2);
+		func = L->top.p;
+		setobj2s(L, func, hook);
+		setuvalue(L, s2v(func + 1), u);
+		L->top.p = func + 2;
+		luaD_callnoyield(L, func, 1);
+		L->top.p = func;
+		if (!l_isfalse(s2v(func)))
+			return;
+	}
+	else if (!l_isfalse(hook))
+		return;
+	setuvalue(L, &v, u);  /* for its type name */
+	luaG_runerror(L, "cannot freeze a state with a %s that cannot be copied",
+		luaT_objtypename(L, &v));
+}
+
+
+static void visit(lua_State* L, Template* T, int i) {
+	GCObject* o = T->objs[i].o;
+	int k;
+	switch (o->tt) {
+	case LUA_VTABLE:
+		visittable(L, T, i);
+		break;
+	case LUA_VUSERDATA: {
+		Udata* u = gco2u(o);
+		checkudata(L, u);
+		addobjref(L, T, u->metatable);
+		for (k = 0; k < u->nuvalue; k++)
+			addvalue(L, T, &u->uv[k].uv);
+		break;
+	}
+	case LUA_VLCL: {
+		LClosure* cl = gco2lcl(o);
+		for (k = 0; k < cl->nupvalues; k++)
+			addobjref(L, T, cl->upvals[k]);
+		break;
+	}
+	case LUA_VCCL: {
+		CClosure* cl = gco2ccl(o);
+		for (k = 0; k < cl->nupvalues; k++)
+			addvalue(L, T, &cl->upvalue[k]);
+		break;
+	}
+	case LUA_VUPVAL:
+		lua_assert(!upisopen(gco2upv(o)));
+		addvalue(L, T, gco2upv(o)->v.p);
+		break;
+	case LUA_VTHREAD:  /* main thread: its stack is not copied */
+		break;
+	default: lua_assert(0);
+	}
+}
+
+
+/*
+** Undo the quickening of the instructions of a shared prototype and
+** stop it from being quickened again, as clones cannot rewrite code
+** that other clones may be running.
+*/
+static void unquicken(Proto* f) {
+	int i;
+	for (i = 0; i < f->sizecode; i++) {
+		OpCode op = GET_OPCODE(f->code[i]);
+		if (isquickop(op))
+			SET_OPCODE(f->code[i], luaP_baseop(op));
+	}
+	f->ndeopt = LUAI_MAXDEOPT;
+}
+
+
+/*
+** Prepare the strings and prototypes in list 'o' to be shared. (A
+** long string gets its hash now, as clones cannot write it.)
+*/
+static void sharelist(GCObject* o) {
+	for (; o != NULL; o = o->next) {
+		switch (o->tt) {
+		case LUA_VLNGSTR:
+			luaS_hashlongstr(gco2ts(o));
+			/* FALLTHROUGH */
+		case LUA_VSHRSTR:
+			break;
+		case LUA_VPROTO:
+			unquicken(gco2p(o));
+			break;
+		default:
+			continue;  /* not shared */
+		}
+		o->marked = cast_byte(bitmask(BLACKBIT) | G_OLD);
+	}
+}
+
+
+static void f_freeze(lua_State* L, void* ud) {
+	global_State* g = G(L);
+	Template* T = cast(Template*, ud);
+	int i;
+	if (L != g->mainthread || L->ci != &L->base_ci)
+		luaG_runerror(L, "state must be frozen from outside any call");
+	if (g->tmpl != NULL)
+		luaG_runerror(L, "state is already frozen");
+	if (g->sharedstrt != NULL)
+		luaG_runerror(L, "cannot freeze a cloned state");
+	if (g->narenas != 0)
+		luaG_runerror(L, "cannot freeze a state inside an arena scope");
+	luaC_fullgc(L, 0);
+	if (g->tobefnz != NULL)
+		luaG_runerror(L, "cannot freeze a state with pending finalizers");
+	rebuildindex(L, T, MINLISIZE);
+	addobj(L, T, obj2gco(L));  /* position 0 */
+	addvalue(L, T, &g->l_registry);
+	for (i = 0; i < LUA_NUMTYPES; i++)
+		addobjref(L, T, g->mt[i]);
+	for (i = 0; i < T->n; i++)  /* visit listed objects (list may grow) */
+		visit(L, T, i);
+	g->tmpl = luaM_new(L, Template);
+	*g->tmpl = *T;
+	/* from here on, nothing may fail */
+	sharelist(g->allgc);
+	sharelist(g->finobj);
+	sharelist(g->fixedgc);
+	g->gcstp = GCSTPGC;  /* the template never collects again */
+}
+
+
+static void freeplan(lua_State* L, Template* T) {
+	if (T->objs != NULL)
+		luaM_freearray(L, T->objs, cast_sizet(T->size));
+	if (T->index != NULL)
+		luaM_freearray(L, T->index, cast_sizet(1) << T->lisize);
+}
+
+
+/*
+** Turns state 'L' into a template. In case of errors, the error
+** message is on the top of the stack and 'L' is unchanged.
+*/
+int luaR_freeze(lua_State* L) {
+	Template T;
+	int status;
+	T.objs = NULL;
+	T.n = T.size = 0;
+	T.index = NULL;
+	T.lisize = 0;
+	status = luaD_pcall(L, f_freeze, &T, savestack(L, L->top.p), 0);
+	if (status != LUA_OK)
+		freeplan(L, &T);
+	return status;
+}
+
+
+void luaR_freetemplate(lua_State* L) {
+	global_State* g = G(L);
+	if (g->tmpl != NULL) {
+		freeplan(L, g->tmpl);
+		luaM_free(L, g->tmpl);
+		g->tmpl = NULL;
+	}
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Cloning
+** =======================================================
+*/
+
+#define copyof(T,c,o)	((c)[position(T, o)])
+
+/*
+** Values of the template are copied with a NULL state, as they are
+** not alive in the clone ('checkliveness' would use its colors).
+*/
+#define setobjT(o1,o2)	setobj(cast(lua_State*, NULL), o1, o2)
+
+
+/* translate value 'v' of a copy to the objects of the clone */
+static void fixvalue(const Template* T, GCObject** c, TValue* v) {
+	if (iscollectable(v) && !ttisstring(v))
+		val_(v).gc = copyof(T, c, gcvalue(v));
+}
+
+
+static GCObject* newcopy(lua_State* L, const TObj* to) {
+	GCObject* o = to->o;
+	switch (o->tt) {
+	case LUA_VTABLE: {
+		Table* h = gco2t(o);
+		Table* nh;
+		if (to->flags & CL_REHASH) {  /* keys go to new positions */
+			nh = luaH_new(L);
+			luaH_resize(L, nh, luaH_realasize(h), allocsizenode(h));
+		}
+		else
+			nh = luaH_copy(L, h);
+		return obj2gco(nh);
+	}
+	case LUA_VUSERDATA: {
+		Udata* u = gco2u(o);
+		Udata* nu;
+		if (!u->ext) {
+			nu = luaS_newudata(L, u->len, u->nuvalue);
+			memcpy(getudatamem(nu), getudatamem(u), u->len);
+		}
+		else {  /* external buffer gets its own copy of the data */
+			nu = luaS_newudata(L, sizeof(void*), u->nuvalue);
+			nu->ext = 1;
+			nu->len = 0;
+			extbuffer(nu) = NULL;
+			if (u->len > 0) {
+				void* data = luaM_extalloc(L, u->len);
+				memcpy(data, extbuffer(u), u->len);
+				extbuffer(nu) = data;
+				nu->len = u->len;
+			}
+		}
+		return obj2gco(nu);
+	}
+	case LUA_VLCL: {
+		LClosure* cl = gco2lcl(o);
+		LClosure* ncl = luaF_newLclosure(L, cl->nupvalues);
+		ncl->p = cl->p;  /* shared */
+		return obj2gco(ncl);
+	}
+	case LUA_VCCL: {
+		CClosure* cl = gco2ccl(o);
+		CClosure* ncl = luaF_newCclosure(L, cl->nupvalues);
+		ncl->f = cl->f;
+		ncl->nleafres = cl->nleafres;
+		return obj2gco(ncl);
+	}
+	case LUA_VUPVAL: {
+		GCObject* nc = luaC_newobj(L, LUA_VUPVAL, sizeof(UpVal));
+		UpVal* uv = gco2upv(nc);
+		uv->v.p = &uv->u.value;  /* closed */
+		setnilvalue(uv->v.p);
+		return nc;
+	}
+	default: lua_assert(0); return NULL;
+	}
+}
+
+
+static void fixtable(lua_State* L, const Template* T, GCObject** c,
+	const TObj* to, Table* nh) {
+	Table* h = gco2t(to->o);
+	unsigned int k, asize = luaH_realasize(h);
+	Node* n, * limit;
+	if (h->metatable != NULL)
+		nh->metatable = gco2t(copyof(T, c, obj2gco(h->metatable)));
+	if (to->flags & CL_REHASH) {
+		for (k = 0; k < asize; k++) {
+			setobjT(&nh->array[k], &h->array[k]);
+			fixvalue(T, c, &nh->array[k]);
+		}
+		limit = gnodelast(h);
+		for (n = gnode(h, 0); n < limit; n++) {
+			if (!isempty(gval(n))) {
+				TValue key, val;
+				getnodekey(cast(lua_State*, NULL), &key, n);
+				fixvalue(T, c, &key);
+				setobjT(&val, gval(n));
+				fixvalue(T, c, &val);
+				luaH_set(L, nh, &key, &val);
+			}
+		}
+		nh->flags = cast_byte((nh->flags & ~maskflags) | (h->flags & maskflags));
+		nh->lenhint = h->lenhint;
+	}
+	else {  /* a raw copy: translate its values in place */
+		for (k = 0; k < asize; k++)
+			fixvalue(T, c, &nh->array[k]);
+		limit = gnodelast(nh);
+		for (n = gnode(nh, 0); n < limit; n++) {
+			if (!isempty(gval(n)))
+				fixvalue(T, c, gval(n));
+			else if (keyisobject(n))
+				setdeadkey(n);  /* unused key of the template */
+		}
+	}
+}
+
+
+/* fill the references of copy 'nc' of object 'to->o' */
+static void fixcopy(lua_State* L, const Template* T, GCObject** c,
+	const TObj* to, GCObject* nc) {
+	GCObject* o = to->o;
+	int k;
+	switch (o->tt) {
+	case LUA_VTABLE:
+		fixtable(L, T, c, to, gco2t(nc));
+		break;
+	case LUA_VUSERDATA: {
+		Udata* u = gco2u(o);
+		Udata* nu = gco2u(nc);
+		if (u->metatable != NULL)
+			nu->metatable = gco2t(copyof(T, c, obj2gco(u->metatable)));
+		for (k = 0; k < u->nuvalue; k++) {
+			setobjT(&nu->uv[k].uv, &u->uv[k].uv);
+			fixvalue(T, c, &nu->uv[k].uv);
+		}
+		break;
+	}
+	case LUA_VLCL: {
+		LClosure* cl = gco2lcl(o);
+		LClosure* ncl = gco2lcl(nc);
+		for (k = 0; k < cl->nupvalues; k++) {
+			if (cl->upvals[k] != NULL)
+				ncl->upvals[k] = gco2upv(copyof(T, c, obj2gco(cl->upvals[k])));
+		}
+		break;
+	}
+	case LUA_VCCL: {
+		CClosure* cl = gco2ccl(o);
+		CClosure* ncl = gco2ccl(nc);
+		for (k = 0; k < cl->nupvalues; k++) {
+			setobjT(&ncl->upvalue[k], &cl->upvalue[k]);
+			fixvalue(T, c, &ncl->upvalue[k]);
+		}
+		break;
+	}
+	case LUA_VUPVAL: {
+		UpVal* nuv = gco2upv(nc);
+		setobjT(nuv->v.p, gco2upv(o)->v.p);
+		fixvalue(T, c, nuv->v.p);
+		break;
+	}
+	default: lua_assert(0);
+	}
+}
+
+
+/*
+** Copies into the new state 'L' (whose collector is stopped) all the
+** objects of template 'TL'. The vector with the copies lives in a
+** userdata on the stack, so that an error frees it with the state.
+** Finalizers of the template are not copied: the resources behind
+** its objects (open files, loaded C libraries) belong to the template.
+*/
+void luaR_clone(lua_State* L, lua_State* TL) {
+	global_State* tg = G(TL);
+	const Template* T = tg->tmpl;
+	global_State* g = G(L);
+	GCObject** c;
+	Udata* u;
+	int i;
+	lua_assert(T != NULL && !gcrunning(g));
+	u = luaS_newudata(L, cast_sizet(T->n) * sizeof(GCObject*), 0);
+	setuvalue(L, s2v(L->top.p), u);  /* anchor it */
+	L->top.p++;
+	c = cast(GCObject**, getudatamem(u));
+	c[0] = obj2gco(L);  /* the main thread */
+	for (i = 1; i < T->n; i++)
+		c[i] = newcopy(L, &T->objs[i]);
+	for (i = 1; i < T->n; i++)
+		fixcopy(L, T, c, &T->objs[i], c[i]);
+	setobjT(&g->l_registry, &tg->l_registry);
+	fixvalue(T, c, &g->l_registry);
+	for (i = 0; i < LUA_NUMTYPES; i++) {
+		if (tg->mt[i] != NULL)
+			g->mt[i] = gco2t(copyof(T, c, obj2gco(tg->mt[i])));
+	}
+	L->top.p--;  /* remove vector */
+}
+
+/* }====================================================== */
@@ -0,0 +1,17 @@
+/*
+** $Id: lclone.h $
+** State templates
+** See Copyright Notice in lua.h
+*/
+
+#ifndef lclone_h
+#define lclone_h
+
+#include "lstate.h"
+
+
+LUAI_FUNC int luaR_freeze(lua_State* L);
+LUAI_FUNC void luaR_clone(lua_State* L, lua_State* T);
+LUAI_FUNC void luaR_freetemplate(lua_State* L);
+
+#endif
@@ -107,6 +107,19 @@ int luaK_exp2const(FuncState* fs, const expdesc* e, TValue* v) {
 }
 
 
+/*
+** Like 'luaK_exp2const', but also accepts expressions already in the
+** constant table ('VK').
+*/
+static int exp2constval(FuncState* fs, const expdesc* e, TValue* v) {
+	if (e->k == VK && !hasjumps(e)) {
+		setobj(fs->ls->L, v, &fs->f->k[e->u.info]);
+		return 1;
+	}
+	return luaK_exp2const(fs, e, v);
+}
+
+
 /*
 ** Return the previous instruction of the current code. If there
 ** may be a jump target between the current instruction and the
@@ -375,6 +388,41 @@ static void removelastinstruction(FuncState* fs) {
 }
 
 
+/*
+** Save the current code position (see 'luaK_dropcode').
+*/
+void luaK_markcode(FuncState* fs, CodeMark* m) {
+	m->pc = fs->pc;
+	m->previousline = fs->previousline;
+	m->nabslineinfo = fs->nabslineinfo;
+	m->np = fs->np;
+	m->ndebugvars = fs->ndebugvars;
+	m->nups = fs->nups;
+	m->iwthabs = fs->iwthabs;
+}
+
+
+/*
+** Discard all code (with its line information, debug information of
+** its local variables, nested functions, and new upvalues) generated
+** after mark 'm'. The caller must ensure that no jump from outside
+** the discarded code goes into it, and vice versa. Constants are kept,
+** as the constant cache may refer to them.
+*/
+void luaK_dropcode(FuncState* fs, const CodeMark* m) {
+	lua_assert(m->pc <= fs->pc);
+	fs->pc = m->pc;
+	fs->previousline = m->previousline;
+	fs->nabslineinfo = m->nabslineinfo;
+	fs->np = m->np;
+	fs->ndebugvars = m->ndebugvars;
+	fs->nups = m->nups;
+	fs->iwthabs = m->iwthabs;
+	if (fs->lasttarget > fs->pc)
+		fs->lasttarget = fs->pc;
+}
+
+
 /*
 ** Emit instruction 'i', checking for array sizes and saving also its
 ** line information. Return 'i' position.
@@ -1354,6 +1402,84 @@ static int constfolding(FuncState* fs, int op, expdesc* e1,
 }
 
 
+/*
+** True if 'e' is a constant that can be an operand of a folded
+** concatenation: a string or (when coercions are on) a number.
+*/
+static int isconcatK(const expdesc* e) {
+	if (hasjumps(e))
+		return 0;
+	switch (e->k) {
+	case VKSTR: return 1;
+#if !defined(LUA_NOCVTN2S)
+	case VKINT: case VKFLT: return 1;
+#endif
+	default: return 0;
+	}
+}
+
+
+/*
+** Try to fold a concatenation of two constants; return 1 iff
+** successful. ('e1' gets the resulting string.) The operation uses
+** 'luaV_concat' itself, so that numbers are converted exactly as they
+** would be at run time.
+*/
+static int constconcat(FuncState* fs, expdesc* e1, const expdesc* e2) {
+	lua_State* L = fs->ls->L;
+	TValue v1, v2;
+	TString* ts;
+	if (!isconcatK(e1) || !isconcatK(e2))
+		return 0;
+	luaK_exp2const(fs, e1, &v1);
+	luaK_exp2const(fs, e2, &v2);
+	luaD_checkstack(L, 2);
+	setobj2s(L, L->top.p, &v1);
+	setobj2s(L, L->top.p + 1, &v2);
+	L->top.p += 2;
+	luaV_concat(L, 2);  /* result replaces the two operands */
+	ts = tsvalue(s2v(L->top.p - 1));
+	ts = luaX_newstring(fs->ls, getstr(ts), tsslen(ts));  /* anchor it */
+	L->top.p--;
+	e1->k = VKSTR;
+	e1->u.strval = ts;
+	return 1;
+}
+
+
+/*
+** Try to fold a comparison between two constants; return 1 iff
+** successful. ('e1' gets the boolean result.) Order comparisons are
+** only folded between numbers: between strings they depend on the
+** locale at run time, and mixed types raise errors.
+*/
+static int constcompare(FuncState* fs, BinOpr opr, expdesc* e1,
+	const expdesc* e2) {
+	TValue v1, v2;
+	int res;
+	if (!exp2constval(fs, e1, &v1) || !exp2constval(fs, e2, &v2))
+		return 0;
+	switch (opr) {
+	case OPR_EQ: res = luaV_rawequalobj(&v1, &v2); break;
+	case OPR_NE: res = !luaV_rawequalobj(&v1, &v2); break;
+	default: {
+		lua_State* L = fs->ls->L;
+		if (!ttisnumber(&v1) || !ttisnumber(&v2))
+			return 0;
+		switch (opr) {
+		case OPR_LT: res = luaV_lessthan(L, &v1, &v2); break;
+		case OPR_LE: res = luaV_lessequal(L, &v1, &v2); break;
+		case OPR_GT: res = luaV_lessthan(L, &v2, &v1); break;
+		case OPR_GE: res = luaV_lessequal(L, &v2, &v1); break;
+		default: lua_assert(0); return 0;
+		}
+	}
+	}
+	e1->k = (res) ? VTRUE : VFALSE;
+	return 1;
+}
+
+
 /*
 ** Convert a BinOpr to an OpCode  (ORDER OPR - ORDER OP)
 */
@@ -1621,6 +1747,12 @@ void luaK_prefix(FuncState* fs, UnOpr opr, expdesc* e, int line) {
 			break;
 		/* else */ /* FALLTHROUGH */
 	case OPR_LEN:
+		if (opr == OPR_LEN && e->k == VKSTR && !hasjumps(e)) {  /* '#' literal? */
+			lua_Integer l = cast(lua_Integer, tsslen(e->u.strval));
+			e->k = VKINT;  /* fold it */
+			e->u.ival = l;
+			break;
+		}
 		codeunexpval(fs, unopr2op(opr), e, line);
 		break;
 	case OPR_NOT: codenot(fs, e); break;
@@ -1645,7 +1777,10 @@ void luaK_infix(FuncState* fs, BinOpr op, expdesc* v) {
 		break;
 	}
 	case OPR_CONCAT: {
-		luaK_exp2nextreg(fs, v);  /* operand must be on the stack */
+		if (isconcatK(v))  /* constant? keep it, as it may be folded */
+			luaK_reserveregs(fs, 1);  /* but keep its place in the stack */
+		else
+			luaK_exp2nextreg(fs, v);  /* operand must be on the stack */
 		break;
 	}
 	case OPR_ADD: case OPR_SUB:
@@ -1667,16 +1802,39 @@ void luaK_infix(FuncState* fs, BinOpr op, expdesc* v) {
 	}
 	case OPR_LT: case OPR_LE:
 	case OPR_GT: case OPR_GE: {
-		int dummy, dummy2;
-		if (!isSCnumber(v, &dummy, &dummy2))
+		if (!tonumeral(v, NULL))
 			luaK_exp2anyreg(fs, v);
-		/* else keep numeral, which may be an immediate operand */
+		/* else keep numeral, which may be folded or used as an immediate
+		   operand */
 		break;
 	}
 	default: lua_assert(0);
 	}
 }
 
+/*
+** Put 'e2' in the stack and load constant 'e1' (kept by 'luaK_infix')
+** into the register reserved for it, just below 'e2'. If 'e2' ends in
+** a CONCAT, the load goes before that instruction, so that
+** 'codeconcat' can still merge both concatenations.
+*/
+static void loadconcatK(FuncState* fs, expdesc* e1, expdesc* e2) {
+	Instruction* ie2;
+	luaK_exp2nextreg(fs, e2);
+	ie2 = previousinstruction(fs);
+	if (GET_OPCODE(*ie2) == OP_CONCAT) {
+		Instruction concat = *ie2;
+		int line = fs->previousline;  /* line of the concatenation */
+		removelastinstruction(fs);
+		discharge2reg(fs, e1, e2->u.info - 1);
+		luaK_code(fs, concat);  /* put the concatenation back */
+		luaK_fixline(fs, line);
+	}
+	else
+		discharge2reg(fs, e1, e2->u.info - 1);
+}
+
+
 /*
 ** Create code for '(e1 .. e2)'.
 ** For '(e1 .. e2.1 .. e2.2)' (which is '(e1 .. (e2.1 .. e2.2))',
@@ -1707,6 +1865,8 @@ void luaK_posfix(FuncState* fs, BinOpr opr,
 	luaK_dischargevars(fs, e2);
 	if (foldbinop(opr) && constfolding(fs, opr + LUA_OPADD, e1, e2))
 		return;  /* done by folding */
+	if (opr >= OPR_EQ && opr <= OPR_GE && constcompare(fs, opr, e1, e2))
+		return;  /* comparison of constants */
 	switch (opr) {
 	case OPR_AND: {
 		lua_assert(e1->t == NO_JUMP);  /* list closed by 'luaK_infix' */
@@ -1721,7 +1881,15 @@ void luaK_posfix(FuncState* fs, BinOpr opr,
 		break;
 	}
 	case OPR_CONCAT: {  /* e1 .. e2 */
-		luaK_exp2nextreg(fs, e2);
+		if (isconcatK(e1)) {  /* constant kept by 'luaK_infix'? */
+			if (constconcat(fs, e1, e2)) {
+				fs->freereg--;  /* release the register reserved for 'e1' */
+				break;
+			}
+			loadconcatK(fs, e1, e2);
+		}
+		else
+			luaK_exp2nextreg(fs, e2);
 		codeconcat(fs, e1, e2, line);
 		break;
 	}
@@ -59,12 +59,30 @@ typedef enum UnOpr { OPR_MINUS, OPR_BNOT, OPR_NOT, OPR_LEN, OPR_NOUNOPR } UnOpr;
 
 #define luaK_jumpto(fs,t)	luaK_patchlist(fs, luaK_jump(fs), t)
 
+
+/*
+** Position in the code of a function, saved by 'luaK_markcode' so that
+** the code generated after it can be discarded by 'luaK_dropcode'
+** (used for unreachable blocks).
+*/
+typedef struct CodeMark {
+	int pc;
+	int previousline;
+	int nabslineinfo;
+	int np;
+	short ndebugvars;
+	lu_byte nups;
+	lu_byte iwthabs;
+} CodeMark;
+
 LUAI_FUNC int luaK_code(FuncState* fs, Instruction i);
 LUAI_FUNC int luaK_codeABx(FuncState* fs, OpCode o, int A, unsigned int Bx);
 LUAI_FUNC int luaK_codeABCk(FuncState* fs, OpCode o, int A,
 	int B, int C, int k);
 LUAI_FUNC int luaK_exp2const(FuncState* fs, const expdesc* e, TValue* v);
 LUAI_FUNC void luaK_fixline(FuncState* fs, int line);
+LUAI_FUNC void luaK_markcode(FuncState* fs, CodeMark* m);
+LUAI_FUNC void luaK_dropcode(FuncState* fs, const CodeMark* m);
 LUAI_FUNC void luaK_nil(FuncState* fs, int from, int n);
 LUAI_FUNC void luaK_reserveregs(FuncState* fs, int n);
 LUAI_FUNC void luaK_checkstack(FuncState* fs, int n);
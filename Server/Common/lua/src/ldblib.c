@@ -454,6 +454,145 @@ static int db_setcstacklimit(lua_State* L) {
 }
 
 
+/*
+** heapprofile([rate]): starts the heap profiler, sampling every 'rate'
+** bytes (512 KB by default), or changes its rate; a rate of 0 stops it
+** and discards its data.
+*/
+static int db_heapprofile(lua_State* L) {
+	lua_Integer rate = luaL_optinteger(L, 1, 512 * 1024);
+	luaL_argcheck(L, rate >= 0, 1, "negative rate");
+	lua_pushboolean(L, lua_heapprofile(L, (size_t)rate));
+	return 1;
+}
+
+
+typedef struct HeapDump {
+	luaL_Buffer b;
+	int alloc;  /* dump bytes allocated instead of bytes in use */
+} HeapDump;
+
+
+static void heapwriter(lua_State* L, const lua_HeapSite* s, void* ud) {
+	HeapDump* hd = (HeapDump*)ud;
+	lua_Unsigned n = hd->alloc ? s->allocated : s->inuse;
+	if (n > 0) {
+		char num[LUA_N2SBUFFSZ];
+		luaL_addstring(&hd->b, s->stack);
+		luaL_addchar(&hd->b, ' ');
+		luaL_addlstring(&hd->b, num, lua_fmtinteger(L, (lua_Integer)n, num));
+		luaL_addchar(&hd->b, '\n');
+	}
+}
+
+
+/*
+** heapdump(["inuse"|"alloc"]): returns the heap profile in folded-stack
+** format, one "frame;frame;...;[type] bytes" line per site, with the
+** bytes still in use (default) or all bytes allocated.
+*/
+static int db_heapdump(lua_State* L) {
+	static const char* const opts[] = {"inuse", "alloc", NULL};
+	HeapDump hd;
+	hd.alloc = luaL_checkoption(L, 1, "inuse", opts);
+	luaL_buffinit(L, &hd.b);
+	lua_walkheapprofile(L, heapwriter, &hd);
+	luaL_pushresult(&hd.b);
+	return 1;
+}
+
+
+static int snapwriter(lua_State* L, const void* b, size_t size, void* ud) {
+	(void)L;
+	return fwrite(b, 1, size, (FILE*)ud) != size;
+}
+
+
+/*
+** heapsnapshot(filename): writes a snapshot of all objects and their
+** references to file 'filename', for offline analysis (see lsnap.c).
+*/
+static int db_heapsnapshot(lua_State* L) {
+	const char* fname = luaL_checkstring(L, 1);
+	FILE* f = fopen(fname, "wb");
+	int status, err;
+	if (f == NULL)
+		return luaL_fileresult(L, 0, fname);
+	status = lua_heapsnapshot(L, snapwriter, f);
+	err = (fclose(f) != 0);
+	return luaL_fileresult(L, status == 0 && !err, fname);
+}
+
+
+#if defined(LUA_USE_PROFILE)
+
+static void pushprofile(lua_State* L, const lua_Profile* pr) {
+	lua_createtable(L, 0, 6);
+	lua_pushstring(L, pr->source);
+	lua_setfield(L, -2, "source");
+	lua_pushinteger(L, pr->linedefined);
+	lua_setfield(L, -2, "linedefined");
+	lua_pushinteger(L, pr->lastlinedefined);
+	lua_setfield(L, -2, "lastlinedefined");
+	lua_pushinteger(L, (lua_Integer)pr->calls);
+	lua_setfield(L, -2, "calls");
+	lua_pushinteger(L, (lua_Integer)pr->instructions);
+	lua_setfield(L, -2, "instructions");
+	lua_pushinteger(L, (lua_Integer)pr->time);
+	lua_setfield(L, -2, "time");
+}
+
+
+static void profwriter(lua_State* L, const lua_Profile* pr, void* ud) {
+	lua_Integer* n = (lua_Integer*)ud;
+	luaL_checkstack(L, 2, "too many profiled functions");
+	pushprofile(L, pr);
+	lua_rawseti(L, -2, ++(*n));  /* add it to 'functions' */
+}
+
+
+/*
+** getprofile([f]): with a function, returns its counters; otherwise,
+** returns a table with fields 'opcodes' (opcode name -> count) and
+** 'functions' (list of counters of all functions called so far).
+*/
+static int db_getprofile(lua_State* L) {
+	if (!lua_isnoneornil(L, 1)) {
+		lua_Profile pr;
+		luaL_argexpected(L, lua_getprofile(L, 1, &pr), 1, "Lua function");
+		pushprofile(L, &pr);
+	}
+	else {
+		const char* name;
+		lua_Integer n = 0;
+		int op;
+		lua_createtable(L, 0, 2);
+		lua_newtable(L);
+		for (op = 0; ; op++) {
+			lua_Unsigned count = lua_getopcount(L, op, &name);
+			if (name == NULL) break;
+			if (count > 0) {
+				lua_pushinteger(L, (lua_Integer)count);
+				lua_setfield(L, -2, name);
+			}
+		}
+		lua_setfield(L, -2, "opcodes");
+		lua_newtable(L);
+		lua_walkprofile(L, profwriter, &n);
+		lua_setfield(L, -2, "functions");
+	}
+	return 1;
+}
+
+
+static int db_resetprofile(lua_State* L) {
+	lua_resetprofile(L);
+	return 0;
+}
+
+#endif
+
+
 static const luaL_Reg dblib[] = {
   {"debug", db_debug},
   {"getuservalue", db_getuservalue},
@@ -472,6 +611,13 @@ static const luaL_Reg dblib[] = {
   {"setupvalue", db_setupvalue},
   {"traceback", db_traceback},
   {"setcstacklimit", db_setcstacklimit},
+  {"heapprofile", db_heapprofile},
+  {"heapdump", db_heapdump},
+  {"heapsnapshot", db_heapsnapshot},
+#if defined(LUA_USE_PROFILE)
+  {"getprofile", db_getprofile},
+  {"resetprofile", db_resetprofile},
+#endif
   {NULL, NULL}
 };
 
@@ -326,6 +326,16 @@ static const char* getfuncname(lua_State* L, CallInfo* ci, const char** name) {
 }
 
 
+/*
+** Name of the function running in 'ci' (NULL if unknown), for callers
+** that only need the name, such as the heap profiler.
+*/
+const char* luaG_funcname(lua_State* L, CallInfo* ci) {
+	const char* name = NULL;
+	return (getfuncname(L, ci, &name) != NULL) ? name : NULL;
+}
+
+
 static int auxgetinfo(lua_State* L, const char* what, lua_Debug* ar,
 	Closure* f, CallInfo* ci) {
 	int status = 1;
@@ -452,7 +462,8 @@ static int findsetreg(const Proto* p, int lastpc, int reg) {
 			break;
 		}
 		case OP_CALL:
-		case OP_TAILCALL: {  /* affect all registers above base */
+		case OP_TAILCALL:
+		case OP_SELECT: {  /* affect all registers above base */
 			change = (reg >= a);
 			break;
 		}
@@ -615,6 +626,7 @@ static const char* funcnamefromcode(lua_State* L, const Proto* p,
 	switch (GET_OPCODE(i)) {
 	case OP_CALL:
 	case OP_TAILCALL:
+	case OP_SELECT:
 		return getobjname(p, pc, GETARG_A(i), name);  /* get function name */
 	case OP_TFORCALL: {  /* for iterator */
 		*name = "for iterator";
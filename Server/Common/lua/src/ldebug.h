@@ -37,6 +37,7 @@
 
 
 LUAI_FUNC int luaG_getfuncline(const Proto* f, int pc);
+LUAI_FUNC const char* luaG_funcname(lua_State* L, CallInfo* ci);
 LUAI_FUNC const char* luaG_findlocal(lua_State* L, CallInfo* ci, int n,
 	StkId* pos);
 LUAI_FUNC l_noret luaG_typeerror(lua_State* L, const TValue* o,
@@ -534,6 +534,44 @@ l_sinline int precallC(lua_State* L, StkId func, int nresults,
 }
 
 
+/*
+** Call a leaf C function (see 'lua_pushleafcclosure'). It returns a
+** fixed number of results and cannot close variables, so results go
+** straight to their final place without 'luaD_poscall'. Only used
+** when there are no hooks; otherwise, 'precallC' does the job.
+*/
+l_sinline int precallleaf(lua_State* L, StkId func, int nresults,
+	CClosure* cl) {
+	int n = cl->nleafres - 1;  /* number of returns */
+	int i;
+	StkId firstresult;
+	CallInfo* ci;
+	checkstackGCp(L, LUA_MINSTACK, func);  /* ensure minimum stack size */
+	L->ci = ci = prepCallInfo(L, func, nresults, CIST_C,
+		L->top.p + LUA_MINSTACK);
+	lua_assert(ci->top.p <= L->stack_last.p);
+	lua_unlock(L);
+	i = (*cl->f)(L);  /* do the actual call */
+	lua_lock(L);
+	api_check(L, i == n, "leaf function returned a wrong number of results");
+	api_checknelems(L, n);
+	firstresult = L->top.p - n;
+	if (nresults == LUA_MULTRET)
+		nresults = n;  /* we want all results */
+	for (i = 0; i < n && i < nresults; i++)
+		setobjs2s(L, func + i, firstresult + i);
+	for (; i < nresults; i++)
+		setnilvalue(s2v(func + i));  /* complete missing results */
+	L->top.p = func + nresults;
+	L->ci = ci->previous;  /* back to caller */
+	return n;
+}
+
+
+/* true if 'cl' can be called through 'precallleaf' */
+#define isleafcall(L,cl)	((cl)->nleafres != 0 && !(L)->hookmask)
+
+
 /*
 ** Prepare a function for a tail call, building its call info on top
 ** of the current call info. 'narg1' is the number of arguments plus 1
@@ -544,8 +582,12 @@ int luaD_pretailcall(lua_State* L, CallInfo* ci, StkId func,
 	int narg1, int delta) {
 retry:
 	switch (ttypetag(s2v(func))) {
-	case LUA_VCCL:  /* C closure */
-		return precallC(L, func, LUA_MULTRET, clCvalue(s2v(func))->f);
+	case LUA_VCCL: {  /* C closure */
+		CClosure* cl = clCvalue(s2v(func));
+		if (isleafcall(L, cl))
+			return precallleaf(L, func, LUA_MULTRET, cl);
+		return precallC(L, func, LUA_MULTRET, cl->f);
+	}
 	case LUA_VLCF:  /* light C function */
 		return precallC(L, func, LUA_MULTRET, fvalue(s2v(func)));
 	case LUA_VLCL: {  /* Lua function */
@@ -554,6 +596,7 @@ retry:
 		int nfixparams = p->numparams;
 		int i;
 		checkstackGCp(L, fsize - delta, func);
+		luai_profret(ci_func(ci)->p, ci);  /* finish the replaced function */
 		ci->func.p -= delta;  /* restore 'func' (if vararg) */
 		for (i = 0; i < narg1; i++)  /* move down function and arguments */
 			setobjs2s(L, ci->func.p + i, func + i);
@@ -563,6 +606,7 @@ retry:
 		ci->top.p = func + 1 + fsize;  /* top for new function */
 		lua_assert(ci->top.p <= L->stack_last.p);
 		ci->u.l.savedpc = p->code;  /* starting point */
+		luai_profcall(p, ci);
 		ci->callstatus |= CIST_TAIL;
 		L->top.p = func + narg1;  /* set top */
 		return -1;
@@ -588,9 +632,14 @@ retry:
 CallInfo* luaD_precall(lua_State* L, StkId func, int nresults) {
 retry:
 	switch (ttypetag(s2v(func))) {
-	case LUA_VCCL:  /* C closure */
-		precallC(L, func, nresults, clCvalue(s2v(func))->f);
+	case LUA_VCCL: {  /* C closure */
+		CClosure* cl = clCvalue(s2v(func));
+		if (isleafcall(L, cl))
+			precallleaf(L, func, nresults, cl);
+		else
+			precallC(L, func, nresults, cl->f);
 		return NULL;
+	}
 	case LUA_VLCF:  /* light C function */
 		precallC(L, func, nresults, fvalue(s2v(func)));
 		return NULL;
@@ -603,6 +652,7 @@ retry:
 		checkstackGCp(L, fsize, func);
 		L->ci = ci = prepCallInfo(L, func, nresults, 0, func + 1 + fsize);
 		ci->u.l.savedpc = p->code;  /* starting point */
+		luai_profcall(p, ci);
 		for (; narg < nfixparams; narg++)
 			setnilvalue(s2v(L->top.p++));  /* complete missing arguments */
 		lua_assert(ci->top.p <= L->stack_last.p);
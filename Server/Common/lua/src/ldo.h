@@ -57,6 +57,22 @@
 	luaD_checkstackaux(L, (fsize), luaC_checkGC(L), (void)0)
 
 
+/*
+** Profiler hooks: 'luai_profcall' counts a call to a Lua function and
+** stamps its frame; 'luai_profret' charges the time elapsed since then
+** to the function prototype.
+*/
+#if defined(LUA_USE_PROFILE)
+#define luai_profcall(p,ci)  \
+	((p)->ncalls++, (ci)->u.l.proftime = luaE_clock())
+#define luai_profret(p,ci)  \
+	((p)->ntime += luaE_clock() - (ci)->u.l.proftime)
+#else
+#define luai_profcall(p,ci)	((void)0)
+#define luai_profret(p,ci)	((void)0)
+#endif
+
+
 /* type of protected functions, to be ran by 'runprotected' */
 typedef void (*Pfunc) (lua_State* L, void* ud);
 
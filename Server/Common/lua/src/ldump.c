@@ -16,6 +16,7 @@
 #include "lua.h"
 
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
 #include "lundump.h"
 
@@ -101,9 +102,26 @@ static void dumpString(DumpState* D, const TString* s) {
 }
 
 
+/*
+** Dump the code of a function, saving quickened instructions with
+** their generic opcodes. Runs of plain instructions are dumped as
+** whole blocks.
+*/
 static void dumpCode(DumpState* D, const Proto* f) {
+	int i;
+	int first = 0;  /* first instruction not dumped yet */
 	dumpInt(D, f->sizecode);
-	dumpVector(D, f->code, f->sizecode);
+	for (i = 0; i < f->sizecode; i++) {
+		Instruction inst = f->code[i];
+		OpCode op = GET_OPCODE(inst);
+		if (isquickop(op)) {
+			dumpVector(D, f->code + first, i - first);
+			SET_OPCODE(inst, luaP_baseop(op));
+			dumpVar(D, inst);
+			first = i + 1;
+		}
+	}
+	dumpVector(D, f->code + first, f->sizecode - first);
 }
 
 
@@ -28,6 +28,7 @@ CClosure* luaF_newCclosure(lua_State* L, int nupvals) {
 	GCObject* o = luaC_newobj(L, LUA_VCCL, sizeCclosure(nupvals));
 	CClosure* c = gco2ccl(o);
 	c->nupvalues = cast_byte(nupvals);
+	c->nleafres = 0;
 	return c;
 }
 
@@ -255,11 +256,15 @@ Proto* luaF_newproto(lua_State* L) {
 	f->numparams = 0;
 	f->is_vararg = 0;
 	f->maxstacksize = 0;
+	f->ndeopt = 0;
 	f->locvars = NULL;
 	f->sizelocvars = 0;
 	f->linedefined = 0;
 	f->lastlinedefined = 0;
 	f->source = NULL;
+#if defined(LUA_USE_PROFILE)
+	f->ncalls = f->ninstr = f->ntime = 0;
+#endif
 	return f;
 }
 
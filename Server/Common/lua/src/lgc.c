@@ -109,6 +109,107 @@ static lu_mem atomic(lua_State* L);
 static void entersweep(lua_State* L);
 
 
+/*
+** {======================================================
+** Telemetry
+** =======================================================
+*/
+
+/* phases timed by the telemetry */
+#define PHnone		0
+#define PHpropagate	1
+#define PHatomic	2
+#define PHsweep		3
+#define PHfinalize	4
+
+
+/* phase of collector state 'st' */
+static lu_byte statephase(lu_byte st) {
+	switch (st) {
+	case GCSpause: return PHnone;
+	case GCSpropagate: return PHpropagate;
+	case GCSenteratomic: return PHatomic;
+	case GCScallfin: return PHfinalize;
+	default: return PHsweep;
+	}
+}
+
+
+/*
+** Charge the time since the last charge to the phase being timed and
+** start timing 'phase'.
+*/
+static void telphase(global_State* g, lu_byte phase) {
+	GCTelemetry* t = &g->gctel;
+	lu_mem now = luaE_clock();
+	lu_mem dt = now - t->tlast;
+	switch (t->phase) {
+	case PHpropagate: t->cur.propagate += dt; break;
+	case PHatomic: t->cur.atomic += dt; break;
+	case PHsweep: t->cur.sweep += dt; break;
+	case PHfinalize: t->cur.finalize += dt; break;
+	default: break;  /* not collecting */
+	}
+	t->tlast = now;
+	t->phase = phase;
+}
+
+
+/* count the current step (up to 'now') in the current collection */
+static void telstep(GCTelemetry* t, lu_mem now) {
+	lu_mem dt = now - t->tstep;
+	t->cur.steps++;
+	if (dt > t->cur.maxpause)
+		t->cur.maxpause = dt;
+}
+
+
+/*
+** A collection of the given kind finished: store it in the ring
+*/
+static void telpush(global_State* g, int kind) {
+	GCTelemetry* t = &g->gctel;
+	telphase(g, PHnone);  /* charge pending time */
+	telstep(t, t->tlast);
+	t->pushed = 1;
+	t->cur.kind = kind;
+	t->st.cycles[t->st.ncycles++ % LUA_GCNCYCLES] = t->cur;
+	memset(&t->cur, 0, sizeof(t->cur));  /* next one; kind LUA_GCKINC */
+}
+
+
+/* a collector step starts */
+static void telbegin(global_State* g) {
+	GCTelemetry* t = &g->gctel;
+	t->tstep = t->tlast = luaE_clock();
+	t->phase = statephase(g->gcstate);
+	t->pushed = 0;
+}
+
+
+/*
+** A collector step ends. If 'hist', its duration goes to the pause
+** histogram: bucket 'i' counts durations in [2^i, 2^(i + 1)) usec.
+*/
+static void telend(global_State* g, int hist) {
+	GCTelemetry* t = &g->gctel;
+	telphase(g, statephase(g->gcstate));
+	if (!t->pushed)  /* not counted in a finished collection? */
+		telstep(t, t->tlast);
+	if (hist) {
+		lu_mem us = (t->tlast - t->tstep) / 1000;
+		int i = 0;
+		while (us >= 2 && i < LUA_GCNPAUSES - 1) {
+			us >>= 1;
+			i++;
+		}
+		t->st.pauses[i]++;
+	}
+}
+
+/* }====================================================== */
+
+
 /*
 ** {======================================================
 ** Generic functions
@@ -121,6 +222,12 @@ static void entersweep(lua_State* L);
 */
 #define gnodelast(h)	gnode(h, cast_sizet(sizenode(h)))
 
+/*
+** loop over the hash parts of table 'h': its own one and, while it is
+** being rehashed incrementally, the old one (which has no old part)
+*/
+#define forhashparts(p,h)	for (p = (h); p != NULL; p = p->oldhash)
+
 
 static GCObject** getgclist(GCObject* o) {
 	switch (o->tt) {
@@ -444,18 +551,21 @@ static void genlink(global_State* g, GCObject* o) {
 ** put it in 'weak' list, to be cleared.
 */
 static void traverseweakvalue(global_State* g, Table* h) {
-	Node* n, * limit = gnodelast(h);
+	Table* p;
 	/* if there is array part, assume it may have white values (it is not
 	   worth traversing it now just to check) */
 	int hasclears = (h->alimit > 0);
-	for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
-		if (isempty(gval(n)))  /* entry is empty? */
-			clearkey(n);  /* clear its key */
-		else {
-			lua_assert(!keyisnil(n));
-			markkey(g, n);
-			if (!hasclears && iscleared(g, gcvalueN(gval(n))))  /* a white value? */
-				hasclears = 1;  /* table will have to be cleared */
+	forhashparts(p, h) {  /* traverse hash part */
+		Node* n, * limit = gnodelast(p);
+		for (n = gnode(p, 0); n < limit; n++) {
+			if (isempty(gval(n)))  /* entry is empty? */
+				clearkey(n);  /* clear its key */
+			else {
+				lua_assert(!keyisnil(n));
+				markkey(g, n);
+				if (!hasclears && iscleared(g, gcvalueN(gval(n))))  /* a white value? */
+					hasclears = 1;  /* table will have to be cleared */
+			}
 		}
 	}
 	if (g->gcstate == GCSatomic && hasclears)
@@ -483,7 +593,7 @@ static int traverseephemeron(global_State* g, Table* h, int inv) {
 	int hasww = 0;  /* true if table has entry "white-key -> white-value" */
 	unsigned int i;
 	unsigned int asize = luaH_realasize(h);
-	unsigned int nsize = sizenode(h);
+	Table* p;
 	/* traverse array part */
 	for (i = 0; i < asize; i++) {
 		if (valiswhite(&h->array[i])) {
@@ -493,18 +603,21 @@ static int traverseephemeron(global_State* g, Table* h, int inv) {
 	}
 	/* traverse hash part; if 'inv', traverse descending
 	   (see 'convergeephemerons') */
-	for (i = 0; i < nsize; i++) {
-		Node* n = inv ? gnode(h, nsize - 1 - i) : gnode(h, i);
-		if (isempty(gval(n)))  /* entry is empty? */
-			clearkey(n);  /* clear its key */
-		else if (iscleared(g, gckeyN(n))) {  /* key is not marked (yet)? */
-			hasclears = 1;  /* table must be cleared */
-			if (valiswhite(gval(n)))  /* value not marked yet? */
-				hasww = 1;  /* white-white entry */
-		}
-		else if (valiswhite(gval(n))) {  /* value not marked yet? */
-			marked = 1;
-			reallymarkobject(g, gcvalue(gval(n)));  /* mark it now */
+	forhashparts(p, h) {
+		unsigned int nsize = sizenode(p);
+		for (i = 0; i < nsize; i++) {
+			Node* n = inv ? gnode(p, nsize - 1 - i) : gnode(p, i);
+			if (isempty(gval(n)))  /* entry is empty? */
+				clearkey(n);  /* clear its key */
+			else if (iscleared(g, gckeyN(n))) {  /* key is not marked (yet)? */
+				hasclears = 1;  /* table must be cleared */
+				if (valiswhite(gval(n)))  /* value not marked yet? */
+					hasww = 1;  /* white-white entry */
+			}
+			else if (valiswhite(gval(n))) {  /* value not marked yet? */
+				marked = 1;
+				reallymarkobject(g, gcvalue(gval(n)));  /* mark it now */
+			}
 		}
 	}
 	/* link table into proper list */
@@ -520,13 +633,9 @@ static int traverseephemeron(global_State* g, Table* h, int inv) {
 }
 
 
-static void traversestrongtable(global_State* g, Table* h) {
+static void traversestronghash(global_State* g, Table* h) {
 	Node* n, * limit = gnodelast(h);
-	unsigned int i;
-	unsigned int asize = luaH_realasize(h);
-	for (i = 0; i < asize; i++)  /* traverse array part */
-		markvalue(g, &h->array[i]);
-	for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
+	for (n = gnode(h, 0); n < limit; n++) {
 		if (isempty(gval(n)))  /* entry is empty? */
 			clearkey(n);  /* clear its key */
 		else {
@@ -535,6 +644,17 @@ static void traversestrongtable(global_State* g, Table* h) {
 			markvalue(g, gval(n));
 		}
 	}
+}
+
+
+static void traversestrongtable(global_State* g, Table* h) {
+	unsigned int i;
+	unsigned int asize = luaH_realasize(h);
+	for (i = 0; i < asize; i++)  /* traverse array part */
+		markvalue(g, &h->array[i]);
+	traversestronghash(g, h);  /* traverse hash part */
+	if (h->oldhash != NULL)  /* hash part being migrated? */
+		traversestronghash(g, h->oldhash);  /* traverse old part too */
 	genlink(g, obj2gco(h));
 }
 
@@ -558,6 +678,8 @@ static lu_mem traversetable(global_State* g, Table* h) {
 	}
 	else  /* not weak */
 		traversestrongtable(g, h);
+	if (h->oldhash != NULL)
+		return 1 + h->alimit + 2 * (allocsizenode(h) + sizenode(h->oldhash));
 	return 1 + h->alimit + 2 * allocsizenode(h);
 }
 
@@ -724,14 +846,16 @@ static void convergeephemerons(global_State* g) {
 */
 static void clearbykeys(global_State* g, GCObject* l) {
 	for (; l; l = gco2t(l)->gclist) {
-		Table* h = gco2t(l);
-		Node* limit = gnodelast(h);
-		Node* n;
-		for (n = gnode(h, 0); n < limit; n++) {
-			if (iscleared(g, gckeyN(n)))  /* unmarked key? */
-				setempty(gval(n));  /* remove entry */
-			if (isempty(gval(n)))  /* is entry empty? */
-				clearkey(n);  /* clear its key */
+		Table* p;
+		forhashparts(p, gco2t(l)) {
+			Node* limit = gnodelast(p);
+			Node* n;
+			for (n = gnode(p, 0); n < limit; n++) {
+				if (iscleared(g, gckeyN(n)))  /* unmarked key? */
+					setempty(gval(n));  /* remove entry */
+				if (isempty(gval(n)))  /* is entry empty? */
+					clearkey(n);  /* clear its key */
+			}
 		}
 	}
 }
@@ -744,7 +868,7 @@ static void clearbykeys(global_State* g, GCObject* l) {
 static void clearbyvalues(global_State* g, GCObject* l, GCObject* f) {
 	for (; l != f; l = gco2t(l)->gclist) {
 		Table* h = gco2t(l);
-		Node* n, * limit = gnodelast(h);
+		Table* p;
 		unsigned int i;
 		unsigned int asize = luaH_realasize(h);
 		for (i = 0; i < asize; i++) {
@@ -752,11 +876,14 @@ static void clearbyvalues(global_State* g, GCObject* l, GCObject* f) {
 			if (iscleared(g, gcvalueN(o)))  /* value was collected? */
 				setempty(o);  /* remove entry */
 		}
-		for (n = gnode(h, 0); n < limit; n++) {
-			if (iscleared(g, gcvalueN(gval(n))))  /* unmarked value? */
-				setempty(gval(n));  /* remove entry */
-			if (isempty(gval(n)))  /* is entry empty? */
-				clearkey(n);  /* clear its key */
+		forhashparts(p, h) {
+			Node* n, * limit = gnodelast(p);
+			for (n = gnode(p, 0); n < limit; n++) {
+				if (iscleared(g, gcvalueN(gval(n))))  /* unmarked value? */
+					setempty(gval(n));  /* remove entry */
+				if (isempty(gval(n)))  /* is entry empty? */
+					clearkey(n);  /* clear its key */
+			}
 		}
 	}
 }
@@ -795,7 +922,9 @@ static void freeobj(lua_State* L, GCObject* o) {
 		break;
 	case LUA_VUSERDATA: {
 		Udata* u = gco2u(o);
-		luaM_freemem(L, o, sizeudata(u->nuvalue, u->len));
+		if (u->ext)  /* external buffer? */
+			luaM_extfree(L, extbuffer(u), u->len);
+		luaM_freemem(L, o, udatasize(u));
 		break;
 	}
 	case LUA_VSHRSTR: {
@@ -920,6 +1049,7 @@ static void GCTM(lua_State* L) {
 		setobj2s(L, L->top.p++, tm);  /* push finalizer... */
 		setobj2s(L, L->top.p++, &v);  /* ... and its argument */
 		L->ci->callstatus |= CIST_FIN;  /* will run a finalizer */
+		g->gctel.cur.finalized++;
 		status = luaD_pcall(L, dothecall, NULL, savestack(L, L->top.p - 2), 0);
 		L->ci->callstatus &= ~CIST_FIN;  /* not running a finalizer anymore */
 		L->allowhook = oldah;  /* restore hooks */
@@ -1070,6 +1200,18 @@ static void setpause(global_State* g) {
 }
 
 
+/*
+** Sets the pause for a state whose objects were all created at once
+** (see 'f_cloneopen'), as if a collection had just found all of them
+** alive.
+*/
+void luaC_setpause(lua_State* L) {
+	global_State* g = G(L);
+	g->GCestimate = gettotalbytes(g);
+	setpause(g);
+}
+
+
 /*
 ** Sweep a list of objects to enter generational mode.  Deletes dead
 ** objects and turns the non dead to old. All non-dead threads---which
@@ -1236,6 +1378,7 @@ static void markold(global_State* g, GCObject* from, GCObject* to) {
 */
 static void finishgencycle(lua_State* L, global_State* g) {
 	correctgraylists(g);
+	g->arenadefer = 0;
 	checkSizes(L, g);
 	g->gcstate = GCSpropagate;  /* skip restart */
 	if (!g->gcemergency)
@@ -1258,10 +1401,13 @@ static void youngcollection(lua_State* L, global_State* g) {
 	}
 	markold(g, g->finobj, g->finobjrold);
 	markold(g, g->tobefnz, NULL);
+	telphase(g, PHatomic);
 	atomic(L);
 
 	/* sweep nursery and get a pointer to its last live element */
 	g->gcstate = GCSswpallgc;
+	telphase(g, PHsweep);
+	g->gctel.cur.swept = gettotalbytes(g);
 	psurvival = sweepgen(L, g, &g->allgc, g->survival, &g->firstold1);
 	/* sweep 'survival' */
 	sweepgen(L, g, psurvival, g->old1, &g->firstold1);
@@ -1279,7 +1425,10 @@ static void youngcollection(lua_State* L, global_State* g) {
 	g->finobjsur = g->finobj;  /* all news are survivals */
 
 	sweepgen(L, g, &g->tobefnz, NULL, &dummy);
+	g->gctel.cur.freed = g->gctel.cur.swept - gettotalbytes(g);
+	telphase(g, PHfinalize);
 	finishgencycle(L, g);
+	telpush(g, LUA_GCKMINOR);
 }
 
 
@@ -1293,6 +1442,8 @@ static void atomic2gen(lua_State* L, global_State* g) {
 	cleargraylists(g);
 	/* sweep all elements making them old */
 	g->gcstate = GCSswpallgc;
+	telphase(g, PHsweep);
+	g->gctel.cur.swept = gettotalbytes(g);
 	sweep2old(L, &g->allgc);
 	/* everything alive now is old */
 	g->reallyold = g->old1 = g->survival = g->allgc;
@@ -1307,6 +1458,8 @@ static void atomic2gen(lua_State* L, global_State* g) {
 	g->gckind = KGC_GEN;
 	g->lastatomic = 0;
 	g->GCestimate = gettotalbytes(g);  /* base for memory control */
+	g->gctel.cur.freed = g->gctel.cur.swept - g->GCestimate;
+	telphase(g, PHfinalize);
 	finishgencycle(L, g);
 }
 
@@ -1330,6 +1483,7 @@ static lu_mem entergen(lua_State* L, global_State* g) {
 	lu_mem numobjs;
 	luaC_runtilstate(L, bitmask(GCSpause));  /* prepare to start a new cycle */
 	luaC_runtilstate(L, bitmask(GCSpropagate));  /* start new cycle */
+	telphase(g, PHatomic);
 	numobjs = atomic(L);  /* propagates all and then do the atomic stuff */
 	atomic2gen(L, g);
 	setminordebt(g);  /* set debt assuming next cycle will be minor */
@@ -1360,8 +1514,12 @@ static void enterinc(global_State* g) {
 void luaC_changemode(lua_State* L, int newmode) {
 	global_State* g = G(L);
 	if (newmode != g->gckind) {
-		if (newmode == KGC_GEN)  /* entering generational mode? */
+		if (newmode == KGC_GEN) {  /* entering generational mode? */
+			telbegin(g);
 			entergen(L, g);
+			telpush(g, LUA_GCKMAJOR);
+			telend(g, 1);
+		}
 		else
 			enterinc(g);  /* entering incremental mode */
 	}
@@ -1405,10 +1563,13 @@ static void stepgenfull(lua_State* L, global_State* g) {
 	if (g->gckind == KGC_GEN)  /* still in generational mode? */
 		enterinc(g);  /* enter incremental mode */
 	luaC_runtilstate(L, bitmask(GCSpropagate));  /* start new cycle */
+	g->gctel.cur.kind = LUA_GCKMAJOR;
+	telphase(g, PHatomic);
 	newatomic = atomic(L);  /* mark everybody */
 	if (newatomic < lastatomic + (lastatomic >> 3)) {  /* good collection? */
 		atomic2gen(L, g);  /* return to generational mode */
 		setminordebt(g);
+		telpush(g, LUA_GCKMAJOR);
 	}
 	else {  /* another bad collection; stay in incremental mode */
 		g->GCestimate = gettotalbytes(g);  /* first estimate */
@@ -1440,6 +1601,7 @@ static void stepgenfull(lua_State* L, global_State* g) {
 ** in that case, do a minor collection.
 */
 static void genstep(lua_State* L, global_State* g) {
+	lu_mem t0 = luaE_clock();
 	if (g->lastatomic != 0)  /* last collection was a bad one? */
 		stepgenfull(L, g);  /* do a full step */
 	else {
@@ -1447,6 +1609,7 @@ static void genstep(lua_State* L, global_State* g) {
 		lu_mem majorinc = (majorbase / 100) * getgcparam(g->genmajormul);
 		if (g->GCdebt > 0 && gettotalbytes(g) > majorbase + majorinc) {
 			lu_mem numobjs = fullgen(L, g);  /* do a major collection */
+			telpush(g, LUA_GCKMAJOR);
 			if (gettotalbytes(g) < majorbase + (majorinc / 2)) {
 				/* collected at least half of memory growth since last major
 				   collection; keep doing minor collections. */
@@ -1463,6 +1626,7 @@ static void genstep(lua_State* L, global_State* g) {
 			g->GCestimate = majorbase;  /* preserve base value */
 		}
 	}
+	g->gcgentime = luaE_clock() - t0;
 	lua_assert(isdecGCmodegen(g));
 }
 
@@ -1481,13 +1645,17 @@ static void genstep(lua_State* L, global_State* g) {
 ** The call to 'sweeptolive' makes the pointer point to an object
 ** inside the list (instead of to the header), so that the real sweep do
 ** not need to skip objects created between "now" and the start of the
-** real sweep.
+** real sweep. As 'sweeptolive' already frees dead objects, the heap
+** size for the telemetry is taken before it.
 */
 static void entersweep(lua_State* L) {
 	global_State* g = G(L);
+	lu_mem before = gettotalbytes(g);
 	g->gcstate = GCSswpallgc;
 	lua_assert(g->sweepgc == NULL);
 	g->sweepgc = sweeptolive(L, &g->allgc);
+	g->gctel.cur.swept = before;
+	g->gctel.cur.freed += before - gettotalbytes(g);
 }
 
 
@@ -1505,16 +1673,26 @@ static void deletelist(lua_State* L, GCObject* p, GCObject* limit) {
 
 
 /*
-** Call all finalizers of the objects in the given Lua state, and
-** then free all objects, except for the main thread.
+** Call all finalizers of the objects in the given Lua state. After
+** that, no other finalizer is ever called.
 */
-void luaC_freeallobjects(lua_State* L) {
+void luaC_finalizeall(lua_State* L) {
 	global_State* g = G(L);
 	g->gcstp = GCSTPCLS;  /* no extra finalizers after here */
 	luaC_changemode(L, KGC_INC);
 	separatetobefnz(g, 1);  /* separate all objects with finalizers */
 	lua_assert(g->finobj == NULL);
 	callallpendingfinalizers(L);
+}
+
+
+/*
+** Free all objects, except for the main thread. (All finalizers must
+** have been called; see 'luaC_finalizeall'.)
+*/
+void luaC_freeallobjects(lua_State* L) {
+	global_State* g = G(L);
+	lua_assert(g->gcstp & GCSTPCLS);
 	deletelist(L, g->allgc, obj2gco(g->mainthread));
 	lua_assert(g->finobj == NULL);  /* no new finalizers */
 	deletelist(L, g->fixedgc, NULL);  /* collect fixed objects */
@@ -1572,6 +1750,7 @@ static int sweepstep(lua_State* L, global_State* g,
 		int count;
 		g->sweepgc = sweeplist(L, g->sweepgc, GCSWEEPMAX, &count);
 		g->GCestimate += g->GCdebt - olddebt;  /* update estimate */
+		g->gctel.cur.freed += olddebt - g->GCdebt;
 		return count;
 	}
 	else {  /* enter next state */
@@ -1585,7 +1764,10 @@ static int sweepstep(lua_State* L, global_State* g,
 static lu_mem singlestep(lua_State* L) {
 	global_State* g = G(L);
 	lu_mem work;
+	lu_byte phase = statephase(g->gcstate);
 	lua_assert(!g->gcstopem);  /* collector is not reentrant */
+	if (phase != g->gctel.phase)  /* entering a new phase? */
+		telphase(g, phase);
 	g->gcstopem = 1;  /* no emergency collections while collecting */
 	switch (g->gcstate) {
 	case GCSpause: {
@@ -1604,9 +1786,11 @@ static lu_mem singlestep(lua_State* L) {
 		break;
 	}
 	case GCSenteratomic: {
+		lu_mem t0 = luaE_clock();
 		work = atomic(L);  /* work is what was traversed by 'atomic' */
 		entersweep(L);
 		g->GCestimate = gettotalbytes(g);  /* first estimate */
+		g->gcatomictime = luaE_clock() - t0;
 		break;
 	}
 	case GCSswpallgc: {  /* sweep "regular" objects */
@@ -1634,6 +1818,7 @@ static lu_mem singlestep(lua_State* L) {
 		}
 		else {  /* emergency mode or no more finalizers */
 			g->gcstate = GCSpause;  /* finish collection */
+			telpush(g, g->gctel.cur.kind);
 			work = 0;
 		}
 		break;
@@ -1685,18 +1870,106 @@ static void incstep(lua_State* L, global_State* g) {
 /*
 ** Performs a basic GC step if collector is running. (If collector is
 ** not running, set a reasonable debt to avoid it being called at
-** every single check.)
+** every single check.) Inside an arena scope, the first step of a
+** generational collector is deferred, to the end of the scope or to
+** another allowance of allocation (see 'luaC_poparena').
 */
 void luaC_step(lua_State* L) {
 	global_State* g = G(L);
 	if (!gcrunning(g))  /* not running? */
 		luaE_setdebt(g, -2000);
+	else if (g->narenas > 0 && !g->arenadefer && g->gckind == KGC_GEN &&
+		g->GCdebt > 0) {
+		g->arenadefer = 1;
+		setminordebt(g);
+	}
 	else {
+		telbegin(g);
 		if (isdecGCmodegen(g))
 			genstep(L, g);
 		else
 			incstep(L, g);
+		telend(g, 1);
+	}
+}
+
+
+/*
+** True if at least half of the allocation that triggers the next
+** collection (a cycle in incremental mode, a minor collection in
+** generational mode) has been done. Budgeted steps do not start
+** collections before that, so that they do not collect continuously
+** while the program allocates little.
+*/
+static int halfdue(global_State* g) {
+	l_mem allowance;
+	if (isdecGCmodegen(g))  /* see 'setminordebt' */
+		allowance = cast(l_mem, (gettotalbytes(g) / 100)) * g->genminormul;
+	else {  /* see 'setpause' */
+		int pause = getgcparam(g->gcpause);
+		l_mem estimate = g->GCestimate / PAUSEADJ;
+		lua_assert(estimate > 0);
+		allowance = (pause < MAX_LMEM / estimate)
+			? estimate * pause - cast(l_mem, g->GCestimate)
+			: MAX_LMEM;
+	}
+	return g->GCdebt > -(allowance / 2);
+}
+
+
+/*
+** Do collector work for at most 'usec' microseconds (as measured by
+** 'luaE_clock'), returning 1 if that finished a cycle. In incremental
+** mode, it runs single steps until the budget is exhausted or the
+** cycle ends, starting a new cycle if the collector is paused and
+** the cycle is half due (see 'halfdue'); the
+** atomic step is not started when, judging by the last one, it would
+** not fit in what is left of the budget. The work done is credited to
+** the debt, so that allocation-driven steps are delayed accordingly.
+** In generational mode, a collection cannot be split; one is done only
+** if it is half due and the last one fit in the budget.
+*/
+int luaC_budget(lua_State* L, l_mem usec) {
+	global_State* g = G(L);
+	lu_mem budget = cast(lu_mem, usec) * 1000;  /* in nanoseconds */
+	lu_mem start = luaE_clock();
+	lu_mem elapsed = 0;
+	int done = 0;
+	if (usec <= 0)
+		return 0;
+	if (isdecGCmodegen(g)) {
+		if (g->gcgentime >= budget || !halfdue(g))
+			return 0;  /* too soon, or a collection would not fit */
+		telbegin(g);
+		genstep(L, g);
+		done = 1;
+	}
+	else {
+		int stepmul = (getgcparam(g->gcstepmul) | 1);  /* avoid division by 0 */
+		l_mem work = 0;
+		int nsteps = 0;
+		if (g->gcstate == GCSpause && !halfdue(g))
+			return 0;  /* too soon for a new cycle */
+		telbegin(g);
+		do {
+			if (g->gcstate == GCSenteratomic &&
+				(elapsed = luaE_clock() - start) + g->gcatomictime >= budget)
+				break;  /* atomic step would not fit */
+			work += singlestep(L);
+			if (g->gcstate == GCSpause) {  /* end of cycle? */
+				done = 1;
+				break;
+			}
+			if ((++nsteps & 7) == 0 || g->gcstate != GCSpropagate)
+				elapsed = luaE_clock() - start;  /* check clock now and then */
+		} while (elapsed < budget);
+		if (done)
+			setpause(g);
+		else
+			luaE_setdebt(g, g->GCdebt - (work / stepmul) * WORK2MEM);
 	}
+	telend(g, 0);
+	return done;
 }
 
 
@@ -1713,6 +1986,7 @@ static void fullinc(lua_State* L, global_State* g) {
 	/* finish any pending sweep phase to start a new cycle */
 	luaC_runtilstate(L, bitmask(GCSpause));
 	luaC_runtilstate(L, bitmask(GCSpropagate));  /* start new cycle */
+	g->gctel.cur.kind = LUA_GCKFULL;
 	g->gcstate = GCSenteratomic;  /* go straight to atomic phase */
 	luaC_runtilstate(L, bitmask(GCScallfin));  /* run up to finalizers */
 	/* estimate must be correct after a full GC cycle */
@@ -1731,13 +2005,59 @@ void luaC_fullgc(lua_State* L, int isemergency) {
 	global_State* g = G(L);
 	lua_assert(!g->gcemergency);
 	g->gcemergency = isemergency;  /* set flag */
+	telbegin(g);
 	if (g->gckind == KGC_INC)
 		fullinc(L, g);
-	else
+	else {
 		fullgen(L, g);
+		telpush(g, LUA_GCKFULL);
+	}
+	telend(g, 1);
 	g->gcemergency = 0;
 }
 
 /* }====================================================== */
 
 
+
+/*
+** {======================================================
+** Arena scopes
+** =======================================================
+*/
+
+
+/*
+** Arena scopes mark stretches of execution (typically requests) whose
+** objects are mostly temporaries. In generational mode, the collector
+** moves minor collections to the ends of scopes, where temporaries are
+** dead, instead of running them in the middle of a scope, where live
+** temporaries would survive and age into the old generation (and from
+** there into major collections). Objects that escape a scope, stored
+** into older objects, are caught by the generational barriers and
+** survive as any other. While a scope is open, one collection may be
+** deferred, so a scope may allocate up to twice the usual allowance;
+** closing the outermost scope then does the deferred collection.
+** (Collecting there also when a collection is only half due would
+** double the number of collections, for no gain.) Scopes are counted
+** for the whole state, so interleaved coroutines share them. In
+** incremental mode, they have no effect. Scopes must be balanced: an
+** error does not close the scopes opened before it (that would close
+** scopes of other coroutines, too), so a host that opens a scope must
+** pop it also when the code inside it fails. Returns 1 if it did a
+** collection.
+*/
+int luaC_poparena(lua_State* L) {
+	global_State* g = G(L);
+	if (g->narenas == 0 || --g->narenas > 0)
+		return 0;  /* no scope, or not the outermost one */
+	if (g->gckind != KGC_GEN || !gcrunning(g) || !g->arenadefer)
+		return 0;
+	telbegin(g);
+	genstep(L, g);
+	telend(g, 1);
+	return 1;
+}
+
+/* }====================================================== */
+
@@ -128,6 +128,9 @@
 /* wait memory to double before starting new cycle */
 #define LUAI_GCPAUSE    200
 
+/* percentage of the data of external buffers counted as GC debt */
+#define LUAI_GCEXTWEIGHT	10
+
 /*
 ** some gc parameters are stored divided by 4 to allow a maximum value
 ** up to 1023 in a 'lu_byte'.
@@ -186,8 +189,10 @@
 	iscollectable(v) ? luaC_objbarrierback(L, p, gcvalue(v)) : cast_void(0))
 
 LUAI_FUNC void luaC_fix(lua_State* L, GCObject* o);
+LUAI_FUNC void luaC_finalizeall(lua_State* L);
 LUAI_FUNC void luaC_freeallobjects(lua_State* L);
 LUAI_FUNC void luaC_step(lua_State* L);
+LUAI_FUNC int luaC_budget(lua_State* L, l_mem usec);
 LUAI_FUNC void luaC_runtilstate(lua_State* L, int statesmask);
 LUAI_FUNC void luaC_fullgc(lua_State* L, int isemergency);
 LUAI_FUNC GCObject* luaC_newobj(lua_State* L, int tt, size_t sz);
@@ -197,6 +202,8 @@ LUAI_FUNC void luaC_barrier_(lua_State* L, GCObject* o, GCObject* v);
 LUAI_FUNC void luaC_barrierback_(lua_State* L, GCObject* o);
 LUAI_FUNC void luaC_checkfinalizer(lua_State* L, GCObject* o, Table* mt);
 LUAI_FUNC void luaC_changemode(lua_State* L, int newmode);
+LUAI_FUNC void luaC_setpause(lua_State* L);
+LUAI_FUNC int luaC_poparena(lua_State* L);
 
 
 #endif
@@ -782,6 +782,19 @@ static const luaL_Reg meth[] = {
 };
 
 
+/*
+** A template ('lua_freeze') can keep the standard files and closed
+** files, which its clones cannot close; other files belong to it.
+*/
+static int io_noclose(lua_State* L);
+
+static int f_copy(lua_State* L) {
+	LStream* p = tolstream(L);
+	lua_pushboolean(L, isclosed(p) || p->closef == &io_noclose);
+	return 1;
+}
+
+
 /*
 ** metamethods for file handles
 */
@@ -790,6 +803,7 @@ static const luaL_Reg metameth[] = {
   {"__gc", f_gc},
   {"__close", f_gc},
   {"__tostring", f_tostring},
+  {"__copy", f_copy},
   {NULL, NULL}
 };
 
@@ -107,6 +107,15 @@ static const void* const disptab[NUM_OPCODES] = {
 && L_OP_CLOSURE,
 && L_OP_VARARG,
 && L_OP_VARARGPREP,
-&& L_OP_EXTRAARG
+&& L_OP_EXTRAARG,
+&& L_OP_SELECT,
+&& L_OP_ADDFF,
+&& L_OP_SUBFF,
+&& L_OP_MULFF,
+&& L_OP_DIVFF,
+&& L_OP_ADDKF,
+&& L_OP_SUBKF,
+&& L_OP_MULKF,
+&& L_OP_DIVKF
 
 };
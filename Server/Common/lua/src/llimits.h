@@ -192,6 +192,22 @@ typedef LUAI_UACINT l_uacInt;
 #define l_sinline	static l_inline
 
 
+/*
+** 'l_prefetch' hints that the memory at 'p' will be read soon. It
+** never faults, so 'p' may be NULL.
+*/
+#if !defined(l_prefetch)
+#if defined(__GNUC__) && !defined(LUA_NOBUILTIN)
+#define l_prefetch(p)	__builtin_prefetch(p)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define l_prefetch(p)	_mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+#define l_prefetch(p)	((void)(p))
+#endif
+#endif
+
+
 /*
 ** type for virtual-machine instructions;
 ** must be an unsigned with (at least) 4 bytes (see details in lopcodes.h)
@@ -256,6 +272,33 @@ typedef l_uint32 Instruction;
 #endif
 
 
+/*
+** Maximum number of times the instructions of a function can be
+** deoptimized (rewritten back from a quickened opcode to its generic
+** form) before the VM stops quickening that function. (Value must fit
+** in a byte; 0 disables quickening.)
+*/
+#if !defined(LUAI_MAXDEOPT)
+#define LUAI_MAXDEOPT		16
+#endif
+
+
+/*
+** Incremental rehash: when a table whose hash part has at least
+** LUAI_MINMIGRATE nodes grows, its old hash part is kept aside and each
+** later insertion of a new key moves LUAI_MIGRATESTEP old nodes into the
+** new part, instead of reinserting all of them at once. (A step of 0
+** disables incremental rehashing.)
+*/
+#if !defined(LUAI_MIGRATESTEP)
+#define LUAI_MIGRATESTEP	64
+#endif
+
+#if !defined(LUAI_MINMIGRATE)
+#define LUAI_MINMIGRATE		(1 << 15)
+#endif
+
+
 /*
 ** macros that are executed whenever program enters the Lua core
 ** ('lua_lock') and leaves the core ('lua_unlock')
@@ -11,6 +11,7 @@
 
 
 #include <stddef.h>
+#include <string.h>
 
 #include "lua.h"
 
@@ -20,6 +21,8 @@
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
+#include "lstring.h"
+#include "ltm.h"
 
 
 
@@ -78,6 +81,434 @@ static void* firsttry(global_State* g, void* block, size_t os, size_t ns) {
 
 
 
+/*
+** {==================================================================
+** Heap profiler
+** ===================================================================
+*/
+
+/*
+** The profiler counts the bytes allocated; when the count reaches a
+** random interval around the sampling rate, the allocation that did it
+** is sampled: the bytes counted since the previous sample are charged
+** to its site (the Lua stack plus the kind of block) and the block is
+** kept in a table of samples, keyed by address, until freed. With the
+** profiler off, the only cost is a test in each allocation and free.
+** The profiler's own memory comes straight from the allocator, so it
+** does not count as Lua memory.
+*/
+
+#if !defined(LUAI_HPMAXDEPTH)
+#define LUAI_HPMAXDEPTH	64	/* frames kept in a stack */
+#endif
+
+#define HPBUFFSIZE	(LUAI_HPMAXDEPTH * (LUA_IDSIZE + 16) + 32)
+
+
+typedef struct HPSite {
+	char* stack;
+	size_t len;
+	unsigned int hash;
+	int next;  /* next site in the same bucket (-1 ends) */
+	lua_Unsigned inuse, nlive, allocated, nsamples;
+} HPSite;
+
+
+typedef struct HPSample {
+	void* block;  /* NULL in empty slots */
+	size_t weight;  /* bytes charged to the site */
+	int site;
+} HPSample;
+
+
+typedef struct HeapProf {
+	size_t rate;  /* average interval between samples */
+	size_t next;  /* size of the current interval */
+	size_t count;  /* bytes allocated in the current interval */
+	unsigned int rnd;  /* state of the random generator */
+	lu_byte walking;  /* true while 'luaM_walkheap' runs */
+	HPSample* samples;  /* hash of sampled blocks (open addressing) */
+	size_t ssize, snum;  /* size and number of used slots in 'samples' */
+	HPSite* sites;
+	int nsites, sitesize;
+	int* buckets;  /* hash of sites, by stack */
+	int nbuckets;
+	global_State* g;
+} HeapProf;
+
+
+static void* hpmem(global_State* g, void* block, size_t os, size_t ns) {
+	return callfrealloc(g, block, os, ns);
+}
+
+
+static size_t hashptr(const void* p) {
+	unsigned int h = point2uint(p);
+	h ^= h >> 16;
+	h *= 0x45d9f3bu;
+	h ^= h >> 16;
+	return cast_sizet(h);
+}
+
+
+static void newinterval(HeapProf* hp) {
+	hp->rnd = hp->rnd * 1103515245u + 12345u;
+	/* uniform in [rate/2, 3*rate/2) */
+	hp->next = hp->rate / 2 + (size_t)((hp->rnd >> 8) % (hp->rate | 1));
+	hp->count = 0;
+}
+
+
+static HPSample* findsample(HeapProf* hp, void* block) {
+	size_t mask = hp->ssize - 1;
+	size_t i = hashptr(block) & mask;
+	while (hp->samples[i].block != NULL) {
+		if (hp->samples[i].block == block)
+			return &hp->samples[i];
+		i = (i + 1) & mask;
+	}
+	return NULL;
+}
+
+
+static void putsample(HeapProf* hp, void* block, size_t weight, int site) {
+	size_t mask = hp->ssize - 1;
+	size_t i = hashptr(block) & mask;
+	while (hp->samples[i].block != NULL)
+		i = (i + 1) & mask;
+	hp->samples[i].block = block;
+	hp->samples[i].weight = weight;
+	hp->samples[i].site = site;
+	hp->snum++;
+}
+
+
+/* remove slot 'i', shifting back the entries that probed past it */
+static void delsample(HeapProf* hp, size_t i) {
+	size_t mask = hp->ssize - 1;
+	size_t j = i;
+	for (;;) {
+		size_t k;
+		j = (j + 1) & mask;
+		if (hp->samples[j].block == NULL)
+			break;
+		k = hashptr(hp->samples[j].block) & mask;
+		if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+			continue;  /* entry 'j' is still reachable from its home */
+		hp->samples[i] = hp->samples[j];
+		i = j;
+	}
+	hp->samples[i].block = NULL;
+	hp->snum--;
+}
+
+
+static int growsamples(HeapProf* hp) {
+	size_t osize = hp->ssize;
+	size_t nsize = (osize == 0) ? 256 : 2 * osize;
+	HPSample* old = hp->samples;
+	HPSample* ns = (HPSample*)hpmem(hp->g, NULL, 0, nsize * sizeof(HPSample));
+	size_t i;
+	if (ns == NULL)
+		return 0;
+	memset(ns, 0, nsize * sizeof(HPSample));
+	hp->samples = ns;
+	hp->ssize = nsize;
+	hp->snum = 0;
+	for (i = 0; i < osize; i++) {
+		if (old[i].block != NULL)
+			putsample(hp, old[i].block, old[i].weight, old[i].site);
+	}
+	hpmem(hp->g, old, osize * sizeof(HPSample), 0);
+	return 1;
+}
+
+
+/* append 'n' bytes from 's' to the stack being built in 'buff' */
+static size_t addstack(char* buff, size_t len, const char* s, size_t n) {
+	if (len + n >= HPBUFFSIZE)
+		n = HPBUFFSIZE - 1 - len;
+	memcpy(buff + len, s, n);
+	return len + n;
+}
+
+
+/*
+** Folded stack of the allocation, outermost frame first: each Lua
+** frame is "name@source:currentline", each C frame is "name@[C]" (with
+** no "name@" when the name is unknown), and the last element is the
+** kind of the block ("[table]", "[string]", etc., or "[data]" for
+** arrays and other internal blocks).
+*/
+static size_t hpstack(lua_State* L, char* buff, int tag) {
+	CallInfo* frames[LUAI_HPMAXDEPTH];
+	CallInfo* ci;
+	size_t len = 0;
+	int n = 0;
+	for (ci = L->ci; ci != &L->base_ci; ci = ci->previous) {
+		if (n == LUAI_HPMAXDEPTH) {  /* too deep? */
+			len = addstack(buff, len, "...;", 4);
+			break;
+		}
+		frames[n++] = ci;
+	}
+	while (n-- > 0) {
+		const char* name;
+		ci = frames[n];
+		name = luaG_funcname(L, ci);
+		if (name != NULL) {
+			len = addstack(buff, len, name, strlen(name));
+			len = addstack(buff, len, "@", 1);
+		}
+		if (isLua(ci)) {
+			Proto* p = ci_func(ci)->p;
+			char id[LUA_IDSIZE];
+			char line[32];
+			int l = luaG_getfuncline(p, pcRel(ci->u.l.savedpc, p));
+			if (p->source)
+				luaO_chunkid(id, getstr(p->source), tsslen(p->source));
+			else
+				strcpy(id, "?");
+			len = addstack(buff, len, id, strlen(id));
+			line[0] = ':';
+			len = addstack(buff, len, line,
+				(l < 0) ? 1 : 1 + cast_sizet(luaO_int2str(line + 1, l)));
+		}
+		else
+			len = addstack(buff, len, "[C]", 3);
+		len = addstack(buff, len, ";", 1);
+	}
+	len = addstack(buff, len, "[", 1);
+	if (tag >= LUA_TSTRING && tag <= LUA_TPROTO) {
+		const char* name = ttypename(tag);
+		len = addstack(buff, len, name, strlen(name));
+	}
+	else
+		len = addstack(buff, len, "data", 4);
+	len = addstack(buff, len, "]", 1);
+	buff[len] = '\0';
+	return len;
+}
+
+
+/* index of the site with the given stack; -1 if out of memory */
+static int getsite(HeapProf* hp, const char* stack, size_t len) {
+	global_State* g = hp->g;
+	unsigned int h = luaS_hash(stack, len, 0);
+	HPSite* st;
+	int i;
+	if (hp->nbuckets > 0) {
+		for (i = hp->buckets[h & (hp->nbuckets - 1)]; i >= 0;
+			i = hp->sites[i].next) {
+			st = &hp->sites[i];
+			if (st->hash == h && st->len == len &&
+				memcmp(st->stack, stack, len) == 0)
+				return i;
+		}
+	}
+	if (hp->nsites == hp->sitesize) {  /* no room for a new site? */
+		int nsize = (hp->sitesize == 0) ? 64 : 2 * hp->sitesize;
+		int* nb = (int*)hpmem(g, NULL, 0, cast_sizet(nsize) * sizeof(int));
+		HPSite* ns;
+		if (nb == NULL)
+			return -1;
+		ns = (HPSite*)hpmem(g, hp->sites,
+			cast_sizet(hp->sitesize) * sizeof(HPSite),
+			cast_sizet(nsize) * sizeof(HPSite));
+		if (ns == NULL) {
+			hpmem(g, nb, cast_sizet(nsize) * sizeof(int), 0);
+			return -1;
+		}
+		hpmem(g, hp->buckets, cast_sizet(hp->nbuckets) * sizeof(int), 0);
+		hp->sites = ns;
+		hp->sitesize = hp->nbuckets = nsize;
+		hp->buckets = nb;
+		for (i = 0; i < nsize; i++)
+			nb[i] = -1;
+		for (i = 0; i < hp->nsites; i++) {  /* rehash old sites */
+			int b = cast_int(hp->sites[i].hash & cast_uint(nsize - 1));
+			hp->sites[i].next = nb[b];
+			nb[b] = i;
+		}
+	}
+	st = &hp->sites[hp->nsites];
+	st->stack = (char*)hpmem(g, NULL, 0, len + 1);
+	if (st->stack == NULL)
+		return -1;
+	memcpy(st->stack, stack, len + 1);
+	st->len = len;
+	st->hash = h;
+	st->inuse = st->nlive = st->allocated = st->nsamples = 0;
+	i = cast_int(h & cast_uint(hp->nbuckets - 1));
+	st->next = hp->buckets[i];
+	hp->buckets[i] = hp->nsites;
+	return hp->nsites++;
+}
+
+
+static void hpfree(HeapProf* hp, void* block) {
+	if (hp->snum > 0) {
+		HPSample* s = findsample(hp, block);
+		if (s != NULL) {
+			HPSite* st = &hp->sites[s->site];
+			st->inuse -= s->weight;
+			st->nlive--;
+			delsample(hp, cast_sizet(s - hp->samples));
+		}
+	}
+}
+
+
+/*
+** Count 'size' new bytes in 'block'; when they close the current
+** interval, sample the block.
+*/
+static void hpalloc(lua_State* L, void* block, size_t size, int tag) {
+	HeapProf* hp = G(L)->hprof;
+	char buff[HPBUFFSIZE];
+	size_t weight;
+	HPSample* s;
+	int site;
+	hp->count += size;
+	/* no samples while the stack is being moved ('luaD_reallocstack') */
+	if (l_likely(hp->count < hp->next) || hp->walking || G(L)->gcstopem)
+		return;
+	weight = hp->count;
+	newinterval(hp);
+	if (hp->snum >= hp->ssize / 2 && !growsamples(hp))
+		return;  /* no memory: drop the sample */
+	site = getsite(hp, buff, hpstack(L, buff, tag));
+	if (site < 0)
+		return;
+	s = findsample(hp, block);
+	if (s != NULL) {  /* sampled before (a growing vector)? */
+		HPSite* old = &hp->sites[s->site];
+		old->inuse -= s->weight;  /* move it to the new site */
+		old->nlive--;
+		s->weight += weight;
+		s->site = site;
+	}
+	else
+		putsample(hp, block, weight, site);
+	hp->sites[site].inuse += (s != NULL) ? s->weight : weight;
+	hp->sites[site].nlive++;
+	hp->sites[site].allocated += weight;
+	hp->sites[site].nsamples++;
+}
+
+
+static void hprealloc(lua_State* L, void* block, void* newblock,
+	size_t osize, size_t nsize) {
+	HeapProf* hp = G(L)->hprof;
+	if (block != NULL && newblock != block) {  /* block moved or freed? */
+		HPSample* s = (hp->snum > 0) ? findsample(hp, block) : NULL;
+		if (s != NULL) {
+			HPSample old = *s;
+			delsample(hp, cast_sizet(s - hp->samples));
+			if (newblock != NULL)  /* moved? */
+				putsample(hp, newblock, old.weight, old.site);
+			else {
+				hp->sites[old.site].inuse -= old.weight;
+				hp->sites[old.site].nlive--;
+			}
+		}
+	}
+	if (nsize > osize)
+		hpalloc(L, newblock, nsize - osize, 0);
+}
+
+
+static void freeprofiler(HeapProf* hp) {
+	global_State* g = hp->g;
+	int i;
+	for (i = 0; i < hp->nsites; i++)
+		hpmem(g, hp->sites[i].stack, hp->sites[i].len + 1, 0);
+	hpmem(g, hp->sites, cast_sizet(hp->sitesize) * sizeof(HPSite), 0);
+	hpmem(g, hp->buckets, cast_sizet(hp->nbuckets) * sizeof(int), 0);
+	hpmem(g, hp->samples, hp->ssize * sizeof(HPSample), 0);
+	hpmem(g, hp, sizeof(HeapProf), 0);
+}
+
+
+/*
+** Starts the profiler, or changes its rate, keeping what it has
+** collected; a rate of 0 stops it, discarding everything. Returns 0
+** if there is no memory to start it or if it is being walked.
+*/
+int luaM_heapprofile(lua_State* L, size_t rate) {
+	global_State* g = G(L);
+	HeapProf* hp = g->hprof;
+	if (hp != NULL && hp->walking)
+		return 0;
+	if (rate == 0) {
+		if (hp != NULL) {
+			g->hprof = NULL;
+			freeprofiler(hp);
+		}
+		return 1;
+	}
+	if (hp == NULL) {
+		hp = (HeapProf*)hpmem(g, NULL, 0, sizeof(HeapProf));
+		if (hp == NULL)
+			return 0;
+		memset(hp, 0, sizeof(HeapProf));
+		hp->g = g;
+		hp->rnd = g->seed;
+		g->hprof = hp;
+	}
+	hp->rate = rate;
+	newinterval(hp);
+	return 1;
+}
+
+
+typedef struct HeapWalk {
+	lua_HeapWriter w;
+	void* ud;
+} HeapWalk;
+
+
+static void walkheap(lua_State* L, void* ud) {
+	HeapProf* hp = G(L)->hprof;
+	HeapWalk* hw = cast(HeapWalk*, ud);
+	int i;
+	for (i = 0; i < hp->nsites; i++) {
+		HPSite* st = &hp->sites[i];
+		lua_HeapSite hs;
+		hs.stack = st->stack;
+		hs.inuse = st->inuse;
+		hs.nlive = st->nlive;
+		hs.allocated = st->allocated;
+		hs.nsamples = st->nsamples;
+		hw->w(L, &hs, hw->ud);
+	}
+}
+
+
+/*
+** Calls 'w' for each allocation site. No samples are taken during the
+** walk (so that the sites do not change under it); the writer may
+** allocate and raise errors.
+*/
+void luaM_walkheap(lua_State* L, lua_HeapWriter w, void* ud) {
+	HeapProf* hp = G(L)->hprof;
+	HeapWalk hw;
+	int status;
+	if (hp == NULL || hp->walking)
+		return;
+	hw.w = w;
+	hw.ud = ud;
+	hp->walking = 1;
+	status = luaD_rawrunprotected(L, walkheap, &hw);
+	hp->walking = 0;
+	if (l_unlikely(status != LUA_OK))
+		luaD_throw(L, status);  /* propagate writer error */
+}
+
+/* }================================================================== */
+
+
+
 
 
 /*
@@ -150,6 +581,8 @@ l_noret luaM_toobig(lua_State* L) {
 void luaM_free_(lua_State* L, void* block, size_t osize) {
 	global_State* g = G(L);
 	lua_assert((osize == 0) == (block == NULL));
+	if (l_unlikely(g->hprof != NULL) && block != NULL)
+		hpfree(g->hprof, block);
 	callfrealloc(g, block, osize, 0);
 	g->GCdebt -= osize;
 }
@@ -184,6 +617,8 @@ void* luaM_realloc_(lua_State* L, void* block, size_t osize, size_t nsize) {
 			return NULL;  /* do not update 'GCdebt' */
 	}
 	lua_assert((nsize == 0) == (newblock == NULL));
+	if (l_unlikely(g->hprof != NULL))
+		hprealloc(L, block, newblock, osize, nsize);
 	g->GCdebt = (g->GCdebt + nsize) - osize;
 	return newblock;
 }
@@ -209,7 +644,71 @@ void* luaM_malloc_(lua_State* L, size_t size, int tag) {
 			if (newblock == NULL)
 				luaM_error(L);
 		}
+		if (l_unlikely(g->hprof != NULL))
+			hpalloc(L, newblock, size, tag);
 		g->GCdebt += size;
 		return newblock;
 	}
 }
+
+
+/*
+** {==================================================================
+** External memory
+** ===================================================================
+*/
+
+/*
+** Data of external buffers (see 'lua_newbufferuv') comes from the
+** allocation function too, but it is not part of the Lua heap: it is
+** not seen by the heap profiler and, as the collector never traverses
+** it, it counts as debt only by 'extweight' percent of its total size
+** 'extbytes'. (The weighted amount is always computed over the total,
+** so that it stays exact when blocks come and go or the weight
+** changes.)
+*/
+
+static l_mem extweighted(global_State* g, size_t n) {
+	return cast(l_mem, n / 100 * g->extweight + n % 100 * g->extweight / 100);
+}
+
+
+static void setextbytes(global_State* g, size_t n) {
+	g->GCdebt += extweighted(g, n) - extweighted(g, g->extbytes);
+	g->extbytes = n;
+}
+
+
+void* luaM_extalloc(lua_State* L, size_t size) {
+	global_State* g = G(L);
+	void* block = firsttry(g, NULL, LUA_TUSERDATA, size);
+	lua_assert(size > 0);
+	if (l_unlikely(block == NULL)) {
+		block = tryagain(L, NULL, LUA_TUSERDATA, size);
+		if (block == NULL)
+			luaM_error(L);
+	}
+	setextbytes(g, g->extbytes + size);
+	return block;
+}
+
+
+void luaM_extfree(lua_State* L, void* block, size_t size) {
+	global_State* g = G(L);
+	lua_assert((size == 0) == (block == NULL) && size <= g->extbytes);
+	if (block != NULL) {
+		callfrealloc(g, block, size, 0);
+		setextbytes(g, g->extbytes - size);
+	}
+}
+
+
+void luaM_setextweight(lua_State* L, int weight) {
+	global_State* g = G(L);
+	size_t n = g->extbytes;
+	setextbytes(g, 0);  /* take out the old weighted amount... */
+	g->extweight = cast_byte(weight < 0 ? 0 : weight > 100 ? 100 : weight);
+	setextbytes(g, n);  /* ...and put the new one */
+}
+
+/* }================================================================== */
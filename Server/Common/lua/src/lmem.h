@@ -89,5 +89,12 @@ LUAI_FUNC void* luaM_shrinkvector_(lua_State* L, void* block, int* nelem,
 	int final_n, int size_elem);
 LUAI_FUNC void* luaM_malloc_(lua_State* L, size_t size, int tag);
 
+LUAI_FUNC void* luaM_extalloc(lua_State* L, size_t size);
+LUAI_FUNC void luaM_extfree(lua_State* L, void* block, size_t size);
+LUAI_FUNC void luaM_setextweight(lua_State* L, int weight);
+
+LUAI_FUNC int luaM_heapprofile(lua_State* L, size_t rate);
+LUAI_FUNC void luaM_walkheap(lua_State* L, lua_HeapWriter w, void* ud);
+
 #endif
 
@@ -10,6 +10,7 @@
 #include "lprefix.h"
 
 
+#include <float.h>
 #include <locale.h>
 #include <math.h>
 #include <stdarg.h>
@@ -215,6 +216,101 @@ static lua_Number lua_strx2number(const char* s, char** endptr) {
 /* }====================================================== */
 
 
+/*
+** {==================================================================
+** Fast decimal conversions
+** ===================================================================
+*/
+
+/*
+** The float fast paths need doubles evaluated without extra precision
+** (so that each operation rounds exactly once) and a 'lua_Unsigned'
+** wide enough for 15 decimal digits.
+*/
+#if LUA_FLOAT_TYPE == LUA_FLOAT_DOUBLE && \
+    (!defined(FLT_EVAL_METHOD) || FLT_EVAL_METHOD == 0) && \
+    LUA_MAXINTEGER >= 999999999999999
+#define L_FASTFLT
+#endif
+
+
+#if defined(L_FASTFLT)
+
+/* powers of ten that are exact in a double */
+static const double l_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define MAXPOW10	22
+
+/* maximum number of significant digits handled by the fast paths */
+#define MAXFASTDIG	15
+
+
+/*
+** Convert a decimal numeral with at most MAXFASTDIG significant digits
+** and a decimal exponent of at most MAXPOW10 (in absolute value). Both
+** the significand and the power of ten are exact doubles, so the result
+** is one correctly rounded multiplication or division, as 'strtod'
+** would compute. Returns NULL for any other numeral (including those it
+** does not recognize), which is then left to 'strtod'.
+*/
+static const char* l_str2dfast(const char* s, lua_Number* result) {
+	lua_Number m = 0;  /* significand */
+	int nd = 0;  /* number of significant digits */
+	int e = 0;  /* decimal exponent */
+	int empty = 1;
+	int neg;
+	while (lisspace(cast_uchar(*s))) s++;  /* skip initial spaces */
+	neg = isneg(&s);
+	for (; *s == '0'; s++) empty = 0;  /* skip leading zeros */
+	for (; lisdigit(cast_uchar(*s)); s++) {
+		if (++nd > MAXFASTDIG) return NULL;
+		m = m * 10 + (*s - '0');
+		empty = 0;
+	}
+	if (*s == '.') {
+		s++;
+		if (nd == 0) {  /* skip leading zeros of the fraction */
+			for (; *s == '0'; s++) {
+				if (--e < -MAXPOW10) return NULL;
+				empty = 0;
+			}
+		}
+		for (; lisdigit(cast_uchar(*s)); s++) {
+			if (++nd > MAXFASTDIG) return NULL;
+			m = m * 10 + (*s - '0');
+			e--;
+			empty = 0;
+		}
+	}
+	if (empty) return NULL;
+	if (*s == 'e' || *s == 'E') {
+		int exp1 = 0;
+		int neg1;
+		s++;
+		neg1 = isneg(&s);
+		if (!lisdigit(cast_uchar(*s))) return NULL;
+		for (; lisdigit(cast_uchar(*s)); s++) {
+			if (exp1 < 10000)  /* avoid overflows; too large anyway */
+				exp1 = exp1 * 10 + (*s - '0');
+		}
+		e += (neg1) ? -exp1 : exp1;
+	}
+	while (lisspace(cast_uchar(*s))) s++;  /* skip trailing spaces */
+	if (*s != '\0') return NULL;
+	if (m == 0) e = 0;  /* zero with any exponent */
+	else if (e < -MAXPOW10 || e > MAXPOW10) return NULL;
+	m = (e >= 0) ? m * l_pow10[e] : m / l_pow10[-e];
+	*result = (neg) ? -m : m;
+	return s;
+}
+
+#endif
+/* }====================================================== */
+
+
 /* maximum length of a numeral to be converted to a number */
 #if !defined (L_MAXLENNUM)
 #define L_MAXLENNUM	200
@@ -250,7 +346,12 @@ static const char* l_str2dloc(const char* s, lua_Number* result, int mode) {
 */
 static const char* l_str2d(const char* s, lua_Number* result) {
 	const char* endptr;
-	const char* pmode = strpbrk(s, ".xXnN");  /* look for special chars */
+	const char* pmode;
+#if defined(L_FASTFLT)
+	if ((endptr = l_str2dfast(s, result)) != NULL)  /* common numeral? */
+		return endptr;
+#endif
+	pmode = strpbrk(s, ".xXnN");  /* look for special chars */
 	int mode = pmode ? ltolower(cast_uchar(*pmode)) : 0;
 	if (mode == 'n')  /* reject 'inf' and 'nan' */
 		return NULL;
@@ -349,6 +450,166 @@ int luaO_utf8esc(char* buff, unsigned long x) {
 #define MAXNUMBER2STR	44
 
 
+/* "00" to "99", for formatting two digits at a time */
+static const char l_digits2[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233"
+	"34353637383940414243444546474849505152535455565758596061626364656667"
+	"6869707172737475767778798081828384858687888990919293949596979899";
+
+
+/*
+** Write the decimal digits of 'u' backwards, ending just before 'p';
+** return the address of the first digit.
+*/
+static char* l_utoa(char* p, lua_Unsigned u) {
+	while (u >= 100) {
+		const char* d = l_digits2 + (u % 100) * 2;
+		u /= 100;
+		*--p = d[1];
+		*--p = d[0];
+	}
+	if (u >= 10) {
+		const char* d = l_digits2 + u * 2;
+		*--p = d[1];
+		*--p = d[0];
+	}
+	else
+		*--p = cast_char('0' + u);
+	return p;
+}
+
+
+/*
+** Convert an integer to a string, as LUA_INTEGER_FMT would.
+*/
+int luaO_int2str(char* buff, lua_Integer i) {
+	char temp[MAXNUMBER2STR];
+	char* end = temp + sizeof(temp);
+	char* p = l_utoa(end, (i < 0) ? 0u - l_castS2U(i) : l_castS2U(i));
+	int len;
+	if (i < 0)
+		*--p = '-';
+	len = cast_int(end - p);
+	memcpy(buff, p, len);
+	buff[len] = '\0';
+	return len;
+}
+
+
+#if defined(L_FASTFLT)
+
+/*
+** Convert a float to a string as "%.<prec>g" would, for 1 <= prec <=
+** MAXFASTDIG. 'y', which is |x| scaled by an exact power of ten to have
+** 'prec' digits before the point, is rounded only once, so it is at
+** most half an ulp away from the exact scaled value. When the fraction
+** of 'y' is farther than that from one half, rounding 'y' to an integer
+** gives the same digits as rounding the exact value. Returns -1 when
+** it cannot decide (ties, non-finite values, or exponents out of the
+** range of exact powers of ten), leaving the conversion to 'sprintf'.
+*/
+static int l_flt2str(char* buff, lua_Number x, int prec) {
+	char digs[MAXFASTDIG];
+	char* p = buff;
+	lua_Number ax = l_mathop(fabs)(x);
+	lua_Number y, fl;
+	lua_Unsigned d;
+	int ex, nd, i;
+	if (!(ax <= l_floatatt(MAX)))  /* inf or nan? */
+		return -1;
+	if (signbit(x))
+		*p++ = '-';
+	if (ax == 0) {
+		*p++ = '0';
+		*p = '\0';
+		return cast_int(p - buff);
+	}
+	(void)l_mathop(frexp)(ax, &ex);  /* 2^(ex - 1) <= ax < 2^ex */
+	ex = cast_int(l_floor((ex - 1) * 0.30102999566398120));  /* ~log10(ax) */
+	for (;;) {  /* scale 'ax' so that it has 'prec' integral digits */
+		int k = prec - 1 - ex;
+		if (k < -MAXPOW10 || k > MAXPOW10)
+			return -1;
+		y = (k >= 0) ? ax * l_pow10[k] : ax / l_pow10[-k];
+		if (y < l_pow10[prec]) break;
+		ex++;  /* estimate was one too low */
+	}
+	if (y < l_pow10[prec - 1])
+		return -1;
+	fl = l_floor(y);
+	if (l_mathop(fabs)((y - fl) - 0.5) <= y * l_floatatt(EPSILON))
+		return -1;  /* too close to a tie */
+	d = (lua_Unsigned)fl + ((y - fl) > 0.5);
+	if (d == (lua_Unsigned)l_pow10[prec]) {  /* rounding carried? */
+		d /= 10;
+		ex++;
+	}
+	l_utoa(digs + prec, d);  /* exactly 'prec' digits */
+	for (nd = prec; nd > 1 && digs[nd - 1] == '0'; nd--) ;  /* strip zeros */
+	if (ex < -4 || ex >= prec) {  /* exponential notation */
+		*p++ = digs[0];
+		if (nd > 1) {
+			*p++ = lua_getlocaledecpoint();
+			for (i = 1; i < nd; i++) *p++ = digs[i];
+		}
+		*p++ = 'e';
+		*p++ = (ex < 0) ? '-' : '+';
+		if (ex < 0) ex = -ex;
+		*p++ = cast_char('0' + ex / 10);  /* at least two digits */
+		*p++ = cast_char('0' + ex % 10);
+	}
+	else if (ex >= 0) {  /* integral part has 'ex' + 1 digits */
+		for (i = 0; i <= ex; i++) *p++ = digs[i];
+		if (nd > ex + 1) {
+			*p++ = lua_getlocaledecpoint();
+			for (; i < nd; i++) *p++ = digs[i];
+		}
+	}
+	else {  /* 0.000ddd */
+		*p++ = '0';
+		*p++ = lua_getlocaledecpoint();
+		for (i = ex + 1; i < 0; i++) *p++ = '0';
+		for (i = 0; i < nd; i++) *p++ = digs[i];
+	}
+	*p = '\0';
+	return cast_int(p - buff);
+}
+
+#endif
+
+
+/*
+** Convert a float to a string, as "%.<prec>g" would (or as
+** LUA_NUMBER_FMT would, if 'prec' is negative). 'prec' must be at most
+** 20, so that the result fits in MAXNUMBER2STR.
+*/
+int luaO_flt2str(char* buff, lua_Number x, int prec) {
+#if defined(L_FASTFLT)
+	int len;
+#if defined(LUA_NUMBER_PREC)
+	if (prec < 0)
+		prec = LUA_NUMBER_PREC;
+#endif
+	if (prec == 0)
+		prec = 1;  /* as in C */
+	if (prec > 0 && prec <= MAXFASTDIG &&
+		(len = l_flt2str(buff, x, prec)) >= 0)
+		return len;
+#endif
+	if (prec < 0)
+		return lua_number2str(buff, MAXNUMBER2STR, x);
+	else {
+		char form[8] = "%.";  /* "%.<prec>g" */
+		char* p = form + 2;
+		if (prec >= 10)
+			*p++ = cast_char('0' + prec / 10);
+		*p++ = cast_char('0' + prec % 10);
+		strcpy(p, LUA_NUMBER_FRMLEN "g");
+		return l_sprintf(buff, MAXNUMBER2STR, form, (LUAI_UACNUMBER)x);
+	}
+}
+
+
 /*
 ** Convert a number object to a string, adding it to a buffer
 */
@@ -356,9 +617,9 @@ static int tostringbuff(TValue* obj, char* buff) {
 	int len;
 	lua_assert(ttisnumber(obj));
 	if (ttisinteger(obj))
-		len = lua_integer2str(buff, MAXNUMBER2STR, ivalue(obj));
+		len = luaO_int2str(buff, ivalue(obj));
 	else {
-		len = lua_number2str(buff, MAXNUMBER2STR, fltvalue(obj));
+		len = luaO_flt2str(buff, fltvalue(obj), -1);
 		if (buff[strspn(buff, "-0123456789")] == '\0') {  /* looks like an int? */
 			buff[len++] = lua_getlocaledecpoint();
 			buff[len++] = '0';  /* adds '.0' to result */
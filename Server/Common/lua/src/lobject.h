@@ -459,6 +459,7 @@ typedef union UValue {
 typedef struct Udata {
 	CommonHeader;
 	unsigned short nuvalue;  /* number of user values */
+	lu_byte ext;  /* true for external buffers */
 	size_t len;  /* number of bytes */
 	struct Table* metatable;
 	GCObject* gclist;
@@ -478,6 +479,7 @@ typedef struct Udata {
 typedef struct Udata0 {
 	CommonHeader;
 	unsigned short nuvalue;  /* number of user values */
+	lu_byte ext;  /* true for external buffers */
 	size_t len;  /* number of bytes */
 	struct Table* metatable;
 	union { LUAI_MAXALIGN; } bindata;
@@ -495,6 +497,21 @@ typedef struct Udata0 {
 /* compute the size of a userdata */
 #define sizeudata(nuv,nb)	(udatamemoffset(nuv) + (nb))
 
+/*
+** External buffers are userdata whose data lives outside the Lua heap:
+** their memory area holds only a pointer to the data, and 'len' is the
+** size of the data (0 after being released).
+*/
+#define extbuffer(u)	(*cast(void**, getudatamem(u)))
+
+/* get the address of the data of a userdata */
+#define getudatadata(u)  \
+	((u)->ext ? extbuffer(u) : cast_voidp(getudatamem(u)))
+
+/* size of the block of a userdata */
+#define udatasize(u)  \
+	sizeudata((u)->nuvalue, (u)->ext ? sizeof(void*) : (u)->len)
+
 /* }================================================================== */
 
 
@@ -552,6 +569,7 @@ typedef struct Proto {
 	lu_byte numparams;  /* number of fixed (named) parameters */
 	lu_byte is_vararg;
 	lu_byte maxstacksize;  /* number of registers needed by this function */
+	lu_byte ndeopt;  /* number of deoptimized quickened instructions */
 	int sizeupvalues;  /* size of 'upvalues' */
 	int sizek;  /* size of 'k' */
 	int sizecode;
@@ -570,6 +588,11 @@ typedef struct Proto {
 	LocVar* locvars;  /* information about local variables (debug information) */
 	TString* source;  /* used for debug information */
 	GCObject* gclist;
+#if defined(LUA_USE_PROFILE)
+	lu_mem ncalls;  /* number of calls */
+	lu_mem ninstr;  /* number of instructions executed */
+	lu_mem ntime;  /* time spent in this function (and callees) */
+#endif
 } Proto;
 
 /* }================================================================== */
@@ -646,6 +669,7 @@ typedef struct UpVal {
 
 typedef struct CClosure {
 	ClosureHeader;
+	lu_byte nleafres;  /* 1 + number of results of a leaf function, or 0 */
 	lua_CFunction f;
 	TValue upvalue[1];  /* list of upvalues */
 } CClosure;
@@ -741,7 +765,13 @@ typedef struct Table {
 	unsigned int alimit;  /* "limit" of 'array' array */
 	TValue* array;  /* array part */
 	Node* node;
+#if defined(LUA_USE_SWISSTABLE)
+	int nfree;  /* number of free nodes left (-1 for the dummy node) */
+#else
 	Node* lastfree;  /* any free position is before this position */
+#endif
+	struct Table* oldhash;  /* hash part being migrated (see 'rehash') */
+	lua_Unsigned lenhint;  /* last boundary found in the hash part */
 	struct Table* metatable;
 	GCObject* gclist;
 } Table;
@@ -802,6 +832,8 @@ LUAI_FUNC void luaO_arith(lua_State* L, int op, const TValue* p1,
 	const TValue* p2, StkId res);
 LUAI_FUNC size_t luaO_str2num(const char* s, TValue* o);
 LUAI_FUNC int luaO_hexavalue(int c);
+LUAI_FUNC int luaO_int2str(char* buff, lua_Integer i);
+LUAI_FUNC int luaO_flt2str(char* buff, lua_Number x, int prec);
 LUAI_FUNC void luaO_tostring(lua_State* L, TValue* obj);
 LUAI_FUNC const char* luaO_pushvfstring(lua_State* L, const char* fmt,
 	va_list argp);
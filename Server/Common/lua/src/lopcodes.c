@@ -100,5 +100,26 @@ LUAI_DDEF const lu_byte luaP_opmodes[NUM_OPCODES] = {
 	 ,opmode(0, 1, 0, 0, 1, iABC)		/* OP_VARARG */
 	 ,opmode(0, 0, 1, 0, 1, iABC)		/* OP_VARARGPREP */
 	 ,opmode(0, 0, 0, 0, 0, iAx)		/* OP_EXTRAARG */
+	 ,opmode(0, 1, 0, 0, 1, iABC)		/* OP_SELECT */
+	 ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_ADDFF */
+	 ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_SUBFF */
+	 ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_MULFF */
+	 ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_DIVFF */
+	 ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_ADDKF */
+	 ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_SUBKF */
+	 ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_MULKF */
+	 ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_DIVKF */
+};
+
+
+LUAI_DDEF const lu_byte luaP_quickbase[NUM_OPCODES - OP_FIRSTQUICK] = {
+	 OP_ADD		/* OP_ADDFF */
+	,OP_SUB		/* OP_SUBFF */
+	,OP_MUL		/* OP_MULFF */
+	,OP_DIV		/* OP_DIVFF */
+	,OP_ADDK	/* OP_ADDKF */
+	,OP_SUBK	/* OP_SUBKF */
+	,OP_MULK	/* OP_MULKF */
+	,OP_DIVK	/* OP_DIVKF */
 };
 
@@ -306,11 +306,30 @@ typedef enum {
 
 	OP_VARARGPREP,/*A	(adjust vararg parameters)			*/
 
-	OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
+	OP_EXTRAARG,/*	Ax	extra (larger) argument for previous opcode	*/
+
+	OP_SELECT,/*	A B C	R[A], ... ,R[A+C-2] := R[A](B or '#', ...)	*/
+
+/* quickened opcodes: never generated by the compiler (see notes) */
+
+	OP_ADDFF,/*	A B C	R[A] := R[B] + R[C]  (floats)			*/
+	OP_SUBFF,/*	A B C	R[A] := R[B] - R[C]  (floats)			*/
+	OP_MULFF,/*	A B C	R[A] := R[B] * R[C]  (floats)			*/
+	OP_DIVFF,/*	A B C	R[A] := R[B] / R[C]  (floats)			*/
+
+	OP_ADDKF,/*	A B C	R[A] := R[B] + K[C]:float  (floats)		*/
+	OP_SUBKF,/*	A B C	R[A] := R[B] - K[C]:float  (floats)		*/
+	OP_MULKF,/*	A B C	R[A] := R[B] * K[C]:float  (floats)		*/
+	OP_DIVKF/*	A B C	R[A] := R[B] / K[C]:float  (floats)		*/
 } OpCode;
 
 
-#define NUM_OPCODES	((int)(OP_EXTRAARG) + 1)
+#define NUM_OPCODES	((int)(OP_DIVKF) + 1)
+
+/* first quickened opcode */
+#define OP_FIRSTQUICK	OP_ADDFF
+
+#define isquickop(o)	((o) >= OP_FIRSTQUICK)
 
 
 
@@ -365,6 +384,17 @@ typedef enum {
   original operand was a float. (It must be corrected in case of
   metamethods.)
 
+  (*) OP_SELECT is a call 'select(B, ...)' (or 'select('#', ...)' if
+  B == 0) to the function in R[A], with C as in OP_CALL. When R[A] is
+  the standard 'select', the VM takes the results directly from the
+  varargs; otherwise, it does a regular call.
+
+  (*) Quickened opcodes are type-specialized variants of arithmetic
+  opcodes. The VM rewrites an instruction in place into its variant
+  after seeing float operands, and rewrites it back (deoptimizes) when
+  the operands do not match. They are saved in precompiled chunks as
+  their generic opcode ('luaP_baseop').
+
 ===========================================================================*/
 
 
@@ -380,6 +410,12 @@ typedef enum {
 
 LUAI_DDEC(const lu_byte luaP_opmodes[NUM_OPCODES];)
 
+/* generic opcode of each quickened opcode */
+LUAI_DDEC(const lu_byte luaP_quickbase[NUM_OPCODES - OP_FIRSTQUICK];)
+
+#define luaP_baseop(o)  \
+	(isquickop(o) ? cast(OpCode, luaP_quickbase[(o) - OP_FIRSTQUICK]) : (o))
+
 #define getOpMode(m)	(cast(enum OpMode, luaP_opmodes[m] & 7))
 #define testAMode(m)	(luaP_opmodes[m] & (1 << 3))
 #define testTMode(m)	(luaP_opmodes[m] & (1 << 4))
@@ -96,6 +96,15 @@ static const char* const opnames[] = {
   "VARARG",
   "VARARGPREP",
   "EXTRAARG",
+  "SELECT",
+  "ADDFF",
+  "SUBFF",
+  "MULFF",
+  "DIVFF",
+  "ADDKF",
+  "SUBKF",
+  "MULKF",
+  "DIVKF",
   NULL
 };
 
@@ -386,7 +386,14 @@ static int os_setlocale(lua_State* L) {
 	   "numeric", "time", NULL };
 	const char* l = luaL_optstring(L, 1, NULL);
 	int op = luaL_checkoption(L, 2, "all", catnames);
-	lua_pushstring(L, setlocale(cat[op], l));
+	const char* res = setlocale(cat[op], l);
+	if (res != NULL && l != NULL && (cat[op] == LC_ALL || cat[op] == LC_CTYPE)) {
+		/* compiled patterns have their character classes resolved */
+		if (lua_getfield(L, LUA_REGISTRYINDEX, LUA_PATCACHE_TABLE) == LUA_TTABLE)
+			lua_cleartable(L, -1);
+		lua_pop(L, 1);
+	}
+	lua_pushstring(L, res);
 	return 1;
 }
 
@@ -1022,7 +1022,74 @@ static int explist(LexState* ls, expdesc* v) {
 }
 
 
-static void funcargs(LexState* ls, expdesc* f) {
+/*
+** Check whether 'e' is the global 'select'.
+*/
+static int isselect(FuncState* fs, const expdesc* e) {
+	if (e->k == VINDEXUP) {
+		TValue* key = &fs->f->k[e->u.ind.idx];
+		return (ttisshrstring(key) && strcmp(getstr(tsvalue(key)), "select") == 0);
+	}
+	return 0;
+}
+
+
+/*
+** Selector of a call to 'select' usable by OP_SELECT: 0 for the
+** constant '#', the index for a small positive integer constant, or -1
+** for anything else.
+*/
+static int selectarg(FuncState* fs, const expdesc* e) {
+	TValue k;
+	if (!luaK_exp2const(fs, e, &k))
+		return -1;
+	else if (ttisshrstring(&k) && strcmp(getstr(tsvalue(&k)), "#") == 0)
+		return 0;
+	else if (ttisinteger(&k) && 0 < ivalue(&k) && ivalue(&k) <= MAXARG_B)
+		return cast_int(ivalue(&k));
+	else
+		return -1;
+}
+
+
+/*
+** Parse the argument list of a call to 'select'. A call in the form
+** select(sel, ...), with 'sel' a constant accepted by 'selectarg', is
+** coded as an OP_SELECT, which does not copy the varargs, and the
+** function returns 1. Otherwise, the arguments are parsed as by
+** 'explist' and the function returns 0.
+*/
+static int selectargs(LexState* ls, expdesc* f, expdesc* args, int line) {
+	FuncState* fs = ls->fs;
+	int sel;
+	expr(ls, args);
+	sel = selectarg(fs, args);
+	if (sel >= 0 && ls->t.token == ',' && luaX_lookahead(ls) == TK_DOTS) {
+		luaX_next(ls);  /* skip ',' */
+		if (luaX_lookahead(ls) == ')') {  /* select(sel, ...) */
+			check_condition(ls, fs->f->is_vararg,
+				"cannot use '...' outside a vararg function");
+			luaX_next(ls);  /* skip '...' */
+			check_match(ls, ')', '(', line);
+			luaK_checkstack(fs, 1);  /* room for 'sel' in a regular call */
+			init_exp(f, VCALL, luaK_codeABC(fs, OP_SELECT, f->u.info, sel, 2));
+			luaK_fixline(fs, line);
+			return 1;
+		}
+		luaK_exp2nextreg(fs, args);
+		explist(ls, args);
+	}
+	else {
+		while (testnext(ls, ',')) {
+			luaK_exp2nextreg(fs, args);
+			expr(ls, args);
+		}
+	}
+	return 0;
+}
+
+
+static void funcargs(LexState* ls, expdesc* f, int selectcall) {
 	FuncState* fs = ls->fs;
 	expdesc args;
 	int base, nparams;
@@ -1032,6 +1099,12 @@ static void funcargs(LexState* ls, expdesc* f) {
 		luaX_next(ls);
 		if (ls->t.token == ')')  /* arg list is empty? */
 			args.k = VVOID;
+		else if (selectcall) {
+			if (selectargs(ls, f, &args, line))
+				return;  /* coded as an OP_SELECT */
+			if (hasmultret(args.k))
+				luaK_setmultret(fs, &args);
+		}
 		else {
 			explist(ls, &args);
 			if (hasmultret(args.k))
@@ -1123,12 +1196,13 @@ static void suffixedexp(LexState* ls, expdesc* v) {
 			luaX_next(ls);
 			codename(ls, &key);
 			luaK_self(fs, v, &key);
-			funcargs(ls, v);
+			funcargs(ls, v, 0);
 			break;
 		}
 		case '(': case TK_STRING: case '{': {  /* funcargs */
+			int sel = isselect(fs, v);
 			luaK_exp2nextreg(fs, v);
-			funcargs(ls, v);
+			funcargs(ls, v, sel);
 			break;
 		}
 		default: return;
@@ -1635,12 +1709,36 @@ static void forstat(LexState* ls, int line) {
 }
 
 
-static void test_then_block(LexState* ls, int* escapelist) {
+/*
+** Return 1 if condition 'e' is a constant that is always true, 0 if it
+** is a constant that is always false, and -1 if it is not a constant.
+*/
+static int constcond(FuncState* fs, expdesc* e) {
+	luaK_dischargevars(fs, e);  /* 'e' may be a compile-time constant */
+	if (e->t != NO_JUMP || e->f != NO_JUMP)
+		return -1;
+	switch (e->k) {
+	case VNIL: case VFALSE: return 0;
+	case VTRUE: case VK: case VKFLT: case VKINT: case VKSTR: return 1;
+	default: return -1;
+	}
+}
+
+
+/*
+** Returns true if the current 'if' part is always taken (its condition
+** is a true constant); then, the following parts are unreachable and
+** no jump over them is coded here (see 'deadparts'). A 'then' part
+** whose condition is always false has its code discarded, unless it
+** has gotos leaving it.
+*/
+static int test_then_block(LexState* ls, int* escapelist) {
 	/* test_then_block -> [IF | ELSEIF] cond THEN block */
 	BlockCnt bl;
 	FuncState* fs = ls->fs;
 	expdesc v;
 	int jf;  /* instruction to skip 'then' code (if condition is false) */
+	int cc;  /* constant condition? */
 	luaX_next(ls);  /* skip IF or ELSEIF */
 	expr(ls, &v);  /* read condition */
 	checknext(ls, TK_THEN);
@@ -1653,10 +1751,25 @@ static void test_then_block(LexState* ls, int* escapelist) {
 		while (testnext(ls, ';')) {}  /* skip semicolons */
 		if (block_follow(ls, 0)) {  /* jump is the entire block? */
 			leaveblock(fs);
-			return;  /* and that is it */
+			return 0;  /* and that is it */
 		}
 		else  /* must skip over 'then' part if condition is false */
 			jf = luaK_jump(fs);
+		cc = -1;
+	}
+	else if ((cc = constcond(fs, &v)) == 0) {  /* never taken? */
+		CodeMark m;
+		int ngt = ls->dyd->gt.n;
+		luaK_markcode(fs, &m);
+		jf = luaK_jump(fs);  /* skip 'then' part (if it must be kept) */
+		enterblock(fs, &bl, 0);
+		statlist(ls);  /* 'then' part */
+		leaveblock(fs);
+		if (ls->dyd->gt.n == ngt) {  /* no gotos leaving the block? */
+			luaK_dropcode(fs, &m);  /* remove the whole part */
+			return 0;
+		}
+		goto finish;
 	}
 	else {  /* regular case (not a break) */
 		luaK_goiftrue(ls->fs, &v);  /* skip over block if condition is false */
@@ -1665,10 +1778,40 @@ static void test_then_block(LexState* ls, int* escapelist) {
 	}
 	statlist(ls);  /* 'then' part */
 	leaveblock(fs);
+	if (cc == 1)  /* always taken? */
+		return 1;  /* following parts are dead */
+finish:
 	if (ls->t.token == TK_ELSE ||
 		ls->t.token == TK_ELSEIF)  /* followed by 'else'/'elseif'? */
 		luaK_concat(fs, escapelist, luaK_jump(fs));  /* must jump over it */
 	luaK_patchtohere(fs, jf);
+	return 0;
+}
+
+
+/*
+** Parse the parts of an 'if' statement following a part that is always
+** taken. They are unreachable, so their code is discarded, unless it
+** has gotos leaving it (e.g., a 'break'); in that case, it is kept and
+** skipped over by a jump.
+*/
+static void deadparts(LexState* ls, int* escapelist) {
+	FuncState* fs = ls->fs;
+	CodeMark m;
+	int ngt = ls->dyd->gt.n;
+	int deadlist;  /* exit list for the dead parts */
+	if (ls->t.token != TK_ELSEIF && ls->t.token != TK_ELSE)
+		return;  /* no other parts */
+	luaK_markcode(fs, &m);
+	deadlist = luaK_jump(fs);  /* jump over the dead parts */
+	while (ls->t.token == TK_ELSEIF)
+		test_then_block(ls, &deadlist);  /* ELSEIF cond THEN block */
+	if (testnext(ls, TK_ELSE))
+		block(ls);  /* 'else' part */
+	if (ls->dyd->gt.n == ngt)  /* no gotos leaving the dead parts? */
+		luaK_dropcode(fs, &m);  /* remove them all */
+	else
+		luaK_concat(fs, escapelist, deadlist);
 }
 
 
@@ -1676,10 +1819,12 @@ static void ifstat(LexState* ls, int line) {
 	/* ifstat -> IF cond THEN block {ELSEIF cond THEN block} [ELSE block] END */
 	FuncState* fs = ls->fs;
 	int escapelist = NO_JUMP;  /* exit list for finished parts */
-	test_then_block(ls, &escapelist);  /* IF cond THEN block */
-	while (ls->t.token == TK_ELSEIF)
-		test_then_block(ls, &escapelist);  /* ELSEIF cond THEN block */
-	if (testnext(ls, TK_ELSE))
+	int taken = test_then_block(ls, &escapelist);  /* IF cond THEN block */
+	while (!taken && ls->t.token == TK_ELSEIF)
+		taken = test_then_block(ls, &escapelist);  /* ELSEIF cond THEN block */
+	if (taken)  /* some part is always taken? */
+		deadparts(ls, &escapelist);  /* the remaining ones are unreachable */
+	else if (testnext(ls, TK_ELSE))
 		block(ls);  /* 'else' part */
 	check_match(ls, TK_END, TK_IF, line);
 	luaK_patchtohere(fs, escapelist);  /* patch escape list to 'if' end */
@@ -1822,7 +1967,8 @@ static void retstat(LexState* ls) {
 		nret = explist(ls, &e);  /* optional return values */
 		if (hasmultret(e.k)) {
 			luaK_setmultret(fs, &e);
-			if (e.k == VCALL && nret == 1 && !fs->bl->insidetbc) {  /* tail call? */
+			if (e.k == VCALL && nret == 1 && !fs->bl->insidetbc &&
+				GET_OPCODE(getinstruction(fs, &e)) == OP_CALL) {  /* tail call? */
 				SET_OPCODE(getinstruction(fs, &e), OP_TAILCALL);
 				lua_assert(GETARG_A(getinstruction(fs, &e)) == luaY_nvarstack(fs));
 			}
@@ -0,0 +1,369 @@
+/*
+** $Id: lsnap.c $
+** Heap snapshots
+** See Copyright Notice in lua.h
+*/
+
+#define lsnap_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+
+#include <string.h>
+
+#include "lua.h"
+
+#include "ldebug.h"
+#include "ldo.h"
+#include "lfunc.h"
+#include "lgc.h"
+#include "lobject.h"
+#include "lsnap.h"
+#include "lstate.h"
+#include "lstring.h"
+#include "ltable.h"
+#include "ltm.h"
+
+
+/*
+** A snapshot is written as a stream, in a single pass over the lists
+** of collectable objects, so it needs no memory besides a small output
+** buffer: it is a header followed by records, with all numbers encoded
+** as unsigned LEB128 and objects identified by their addresses.
+**
+** header: LUA_SNAPSIGNATURE, LUA_SNAPVERSION (byte), LUA_VERSION_NUM
+** 'O' object: variant tag (byte), id, size in bytes, extra fields
+**     (strings: length, then up to SNAPMAXSTR bytes of contents; protos:
+**     linedefined, source length and source; userdata: bytes in their
+**     external buffer, 0 if none), then its references,
+**     each a kind (byte, SNAPWEAK set for weak references), a label
+**     (index for SNAP_INDEX/SNAP_UPVAL/SNAP_STACK, id of the key string
+**     for SNAP_FIELD, 0 otherwise) and the id of the referenced object;
+**     a 0 byte ends the references.
+** 'R' root: kind (SNAPR_*), label (type for SNAPR_META), id
+** 'E' end: number of objects
+**
+** Objects are not filtered: tools find what is reachable from the
+** roots. The snapshot runs a full collection first, so that only live
+** objects remain in the lists. The snapshot of a clone also has the
+** strings and prototypes it shares with its template (see lclone.c),
+** which are in the lists of the template.
+*/
+
+#define SNAPMAXSTR	64	/* contents kept for each string */
+
+#define SNAPBUFFSIZE	4096
+
+#define gnodelast(h)	gnode(h, cast_sizet(sizenode(h)))
+
+
+typedef struct SnapState {
+	lua_State* L;
+	lua_Writer writer;
+	void* data;
+	int status;
+	size_t n;  /* bytes in 'buff' */
+	size_t nobjs;
+	lu_byte buff[SNAPBUFFSIZE];
+} SnapState;
+
+
+static void flush(SnapState* S) {
+	if (S->status == 0 && S->n > 0)
+		S->status = (*S->writer)(S->L, S->buff, S->n, S->data);
+	S->n = 0;
+}
+
+
+static void putblock(SnapState* S, const void* b, size_t size) {
+	const lu_byte* p = cast(const lu_byte*, b);
+	while (size > 0) {
+		size_t n = SNAPBUFFSIZE - S->n;
+		if (n == 0) {
+			flush(S);
+			n = SNAPBUFFSIZE;
+		}
+		if (n > size)
+			n = size;
+		memcpy(S->buff + S->n, p, n);
+		S->n += n;
+		p += n;
+		size -= n;
+	}
+}
+
+
+static void putbyte(SnapState* S, int b) {
+	if (S->n == SNAPBUFFSIZE)
+		flush(S);
+	S->buff[S->n++] = cast_byte(b);
+}
+
+
+static void putnum(SnapState* S, size_t x) {
+	do {
+		lu_byte b = cast_byte(x & 0x7f);
+		x >>= 7;
+		putbyte(S, (x != 0) ? (b | 0x80) : b);
+	} while (x != 0);
+}
+
+
+#define objid(o)	cast_sizet(cast(L_P2I, (o)))
+
+#define putid(S,o)	putnum(S, objid(o))
+
+
+static void putref(SnapState* S, int kind, size_t label, GCObject* o) {
+	putbyte(S, kind);
+	putnum(S, label);
+	putid(S, o);
+}
+
+
+#define putvalue(S,k,l,v)  \
+	(iscollectable(v) ? putref(S, k, l, gcvalue(v)) : (void)0)
+
+/* 'obj2gco' cannot take NULL (it checks the tag of the object) */
+#define putobjref(S,k,l,p)  \
+	((p) != NULL ? putref(S, k, l, obj2gco(p)) : (void)0)
+
+
+static void putnodes(SnapState* S, Table* h, int wk, int wv) {
+	Node* n, * limit = gnodelast(h);
+	for (n = gnode(h, 0); n < limit; n++) {
+		if (isempty(gval(n)))
+			continue;
+		if (keyisshrstr(n))  /* a field? */
+			putvalue(S, SNAP_FIELD | wv, objid(keystrval(n)),
+				gval(n));
+		else if (keyisinteger(n) && keyival(n) >= 0)
+			putvalue(S, SNAP_INDEX | wv, cast_sizet(keyival(n)), gval(n));
+		else
+			putvalue(S, SNAP_VALUE | wv, 0, gval(n));
+		if (keyiscollectable(n))
+			putref(S, SNAP_KEY | wk, 0, gckey(n));
+	}
+}
+
+
+static void puttable(SnapState* S, Table* h) {
+	const TValue* mode = gfasttm(G(S->L), h->metatable, TM_MODE);
+	int wk = 0, wv = 0;
+	unsigned int i, asize = luaH_realasize(h);
+	if (mode && ttisshrstring(mode)) {
+		if (strchr(getshrstr(tsvalue(mode)), 'k')) wk = SNAPWEAK;
+		if (strchr(getshrstr(tsvalue(mode)), 'v')) wv = SNAPWEAK;
+	}
+	putobjref(S, SNAP_META, 0, h->metatable);
+	for (i = 0; i < asize; i++)
+		putvalue(S, SNAP_INDEX | wv, cast_sizet(i) + 1, &h->array[i]);
+	putnodes(S, h, wk, wv);
+	if (h->oldhash != NULL)
+		putnodes(S, h->oldhash, wk, wv);
+}
+
+
+static void putproto(SnapState* S, Proto* f) {
+	int i;
+	putobjref(S, SNAP_OTHER, 0, f->source);
+	for (i = 0; i < f->sizek; i++)
+		putvalue(S, SNAP_OTHER, 0, &f->k[i]);
+	for (i = 0; i < f->sizeupvalues; i++)
+		putobjref(S, SNAP_OTHER, 0, f->upvalues[i].name);
+	for (i = 0; i < f->sizep; i++)
+		putobjref(S, SNAP_OTHER, 0, f->p[i]);
+	for (i = 0; i < f->sizelocvars; i++)
+		putobjref(S, SNAP_OTHER, 0, f->locvars[i].varname);
+}
+
+
+static void putthread(SnapState* S, lua_State* th) {
+	StkId o;
+	UpVal* uv;
+	if (th->stack.p == NULL)
+		return;  /* stack not completely built yet */
+	for (o = th->stack.p; o < th->top.p; o++)
+		putvalue(S, SNAP_STACK, cast_sizet(o - th->stack.p), s2v(o));
+	for (uv = th->openupval; uv != NULL; uv = uv->u.open.next)
+		putobjref(S, SNAP_OTHER, 0, uv);
+}
+
+
+static lu_mem protosize(Proto* f) {
+	return sizeof(Proto) + cast(lu_mem, f->sizecode) * sizeof(Instruction) +
+		cast(lu_mem, f->sizep) * sizeof(Proto*) +
+		cast(lu_mem, f->sizek) * sizeof(TValue) +
+		cast(lu_mem, f->sizelineinfo) * sizeof(ls_byte) +
+		cast(lu_mem, f->sizeabslineinfo) * sizeof(AbsLineInfo) +
+		cast(lu_mem, f->sizelocvars) * sizeof(LocVar) +
+		cast(lu_mem, f->sizeupvalues) * sizeof(Upvaldesc);
+}
+
+
+static void putobject(SnapState* S, GCObject* o) {
+	putbyte(S, 'O');
+	putbyte(S, o->tt);
+	putid(S, o);
+	switch (o->tt) {
+	case LUA_VSHRSTR: case LUA_VLNGSTR: {
+		TString* ts = gco2ts(o);
+		size_t len = tsslen(ts);
+		putnum(S, sizelstring(len));
+		putnum(S, len);
+		putblock(S, getstr(ts), (len < SNAPMAXSTR) ? len : SNAPMAXSTR);
+		break;
+	}
+	case LUA_VTABLE:
+		putnum(S, luaH_memsize(gco2t(o)));
+		puttable(S, gco2t(o));
+		break;
+	case LUA_VUSERDATA: {
+		Udata* u = gco2u(o);
+		int i;
+		putnum(S, udatasize(u));
+		putnum(S, u->ext ? u->len : 0);  /* data outside the heap */
+		putobjref(S, SNAP_META, 0, u->metatable);
+		for (i = 0; i < u->nuvalue; i++)
+			putvalue(S, SNAP_UPVAL, cast_sizet(i) + 1, &u->uv[i].uv);
+		break;
+	}
+	case LUA_VLCL: {
+		LClosure* cl = gco2lcl(o);
+		int i;
+		putnum(S, sizeLclosure(cl->nupvalues));
+		putobjref(S, SNAP_OTHER, 0, cl->p);
+		for (i = 0; i < cl->nupvalues; i++)
+			putobjref(S, SNAP_UPVAL, cast_sizet(i) + 1, cl->upvals[i]);
+		break;
+	}
+	case LUA_VCCL: {
+		CClosure* cl = gco2ccl(o);
+		int i;
+		putnum(S, sizeCclosure(cl->nupvalues));
+		for (i = 0; i < cl->nupvalues; i++)
+			putvalue(S, SNAP_UPVAL, cast_sizet(i) + 1, &cl->upvalue[i]);
+		break;
+	}
+	case LUA_VUPVAL:
+		putnum(S, sizeof(UpVal));
+		putvalue(S, SNAP_OTHER, 0, gco2upv(o)->v.p);
+		break;
+	case LUA_VPROTO: {
+		Proto* f = gco2p(o);
+		const char* src = (f->source) ? getstr(f->source) : "=?";
+		size_t len = (f->source) ? tsslen(f->source) : 2;
+		putnum(S, protosize(f));
+		putnum(S, cast_sizet(f->linedefined));
+		putnum(S, len);
+		putblock(S, src, len);
+		putproto(S, f);
+		break;
+	}
+	case LUA_VTHREAD: {
+		lua_State* th = gco2th(o);
+		putnum(S, LUA_EXTRASPACE + sizeof(lua_State) +
+			cast_sizet(stacksize(th) + EXTRA_STACK) * sizeof(StackValue) +
+			cast_sizet(th->nci) * sizeof(CallInfo));
+		putthread(S, th);
+		break;
+	}
+	default: lua_assert(0);
+	}
+	if (!(o->tt == LUA_VSHRSTR || o->tt == LUA_VLNGSTR))
+		putbyte(S, 0);  /* end of references */
+	S->nobjs++;
+}
+
+
+static void putlist(SnapState* S, GCObject* o) {
+	for (; o != NULL && S->status == 0; o = o->next)
+		putobject(S, o);
+}
+
+
+/* puts the objects of list 'o' of a template that its clones share */
+static void putshared(SnapState* S, GCObject* o) {
+	for (; o != NULL && S->status == 0; o = o->next) {
+		if (o->tt == LUA_VSHRSTR || o->tt == LUA_VLNGSTR || o->tt == LUA_VPROTO)
+			putobject(S, o);
+	}
+}
+
+
+static void putroot(SnapState* S, int kind, int label, GCObject* o) {
+	putbyte(S, 'R');
+	putbyte(S, kind);
+	putnum(S, cast_sizet(label));
+	putid(S, o);
+}
+
+
+static void snapshot(lua_State* L, void* ud) {
+	SnapState* S = cast(SnapState*, ud);
+	global_State* g = G(L);
+	GCObject* o;
+	int i;
+	putblock(S, LUA_SNAPSIGNATURE, sizeof(LUA_SNAPSIGNATURE) - 1);
+	putbyte(S, LUA_SNAPVERSION);
+	putnum(S, LUA_VERSION_NUM);
+	putroot(S, SNAPR_REGISTRY, 0, gcvalue(&g->l_registry));
+	putroot(S, SNAPR_THREAD, 0, obj2gco(g->mainthread));
+	for (i = 0; i < LUA_NUMTYPES; i++)
+		if (g->mt[i] != NULL)
+			putroot(S, SNAPR_META, i, obj2gco(g->mt[i]));
+	for (o = g->fixedgc; o != NULL; o = o->next)
+		putroot(S, SNAPR_FIXED, 0, o);
+	for (o = g->tobefnz; o != NULL; o = o->next)
+		putroot(S, SNAPR_FINALIZE, 0, o);
+	putobject(S, obj2gco(g->mainthread));  /* not in any list */
+	putlist(S, g->allgc);
+	putlist(S, g->finobj);
+	putlist(S, g->tobefnz);
+	putlist(S, g->fixedgc);
+	if (g->sharedfrom != NULL) {  /* a clone? */
+		global_State* tg = G(g->sharedfrom);
+		putshared(S, tg->allgc);
+		putshared(S, tg->finobj);
+		putshared(S, tg->fixedgc);
+	}
+	putbyte(S, 'E');
+	putnum(S, S->nobjs);
+	flush(S);
+}
+
+
+/*
+** Writes a snapshot of the heap through 'writer'. The collector is
+** kept stopped during the walk, so that the lists do not change under
+** it; the writer may allocate and raise errors. Returns the status
+** of the writer (0 if no errors).
+*/
+int luaN_snapshot(lua_State* L, lua_Writer writer, void* data) {
+	global_State* g = G(L);
+	lu_byte oldstp;
+	SnapState* S;
+	int status;
+	if (g->gcstp & GCSTPGC)  /* inside a finalizer? */
+		luaG_runerror(L, "cannot take a heap snapshot inside a finalizer");
+	luaC_fullgc(L, 0);  /* leave only live objects in the lists */
+	S = luaM_new(L, SnapState);
+	S->L = L;
+	S->writer = writer;
+	S->data = data;
+	S->status = 0;
+	S->n = S->nobjs = 0;
+	oldstp = g->gcstp;
+	g->gcstp |= GCSTPUSR;  /* avoid GC steps during the walk */
+	status = luaD_rawrunprotected(L, snapshot, S);
+	g->gcstp = oldstp;  /* restore previous state */
+	if (status == LUA_OK)
+		status = S->status;
+	else {
+		luaM_free(L, S);
+		luaD_throw(L, status);  /* propagate writer error */
+	}
+	luaM_free(L, S);
+	return status;
+}
@@ -0,0 +1,39 @@
+/*
+** $Id: lsnap.h $
+** Heap snapshots
+** See Copyright Notice in lua.h
+*/
+
+#ifndef lsnap_h
+#define lsnap_h
+
+#include "lua.h"
+
+
+/* format of heap snapshots (see lsnap.c) */
+#define LUA_SNAPSIGNATURE	"\x1bLsn"
+#define LUA_SNAPVERSION	2
+
+/* kinds of references */
+#define SNAP_INDEX	1	/* integer key or array slot (label: index) */
+#define SNAP_FIELD	2	/* value of a string key (label: key's id) */
+#define SNAP_VALUE	3	/* value of another key */
+#define SNAP_KEY	4	/* a key */
+#define SNAP_META	5	/* metatable */
+#define SNAP_UPVAL	6	/* upvalue or user value (label: index) */
+#define SNAP_STACK	7	/* stack slot of a thread (label: index) */
+#define SNAP_OTHER	8	/* anything else (prototypes, constants...) */
+
+#define SNAPWEAK	0x80	/* flag for weak references */
+
+/* kinds of roots */
+#define SNAPR_REGISTRY	1
+#define SNAPR_THREAD	2	/* main thread */
+#define SNAPR_META	3	/* metatable of a basic type (label: type) */
+#define SNAPR_FIXED	4	/* object never collected */
+#define SNAPR_FINALIZE	5	/* object waiting for its finalizer */
+
+
+LUAI_FUNC int luaN_snapshot(lua_State* L, lua_Writer writer, void* data);
+
+#endif
@@ -12,10 +12,12 @@
 
 #include <stddef.h>
 #include <string.h>
+#include <time.h>
 
 #include "lua.h"
 
 #include "lapi.h"
+#include "lclone.h"
 #include "ldebug.h"
 #include "ldo.h"
 #include "lfunc.h"
@@ -242,6 +244,33 @@ static void f_luaopen(lua_State* L, void* ud) {
 }
 
 
+/*
+** open parts of a state cloned from template 'ud' (see lclone.c). Its
+** strings, including tag-method names and reserved words, are those
+** of the template.
+*/
+static void f_cloneopen(lua_State* L, void* ud) {
+	global_State* g = G(L);
+	lua_State* T = cast(lua_State*, ud);
+	int i;
+	stack_init(L, L);  /* init stack */
+	g->sharedstrt = &G(T)->strt;
+	g->sharedfrom = T;
+	luaS_init(L);
+	for (i = 0; i < TM_N; i++)
+		g->tmname[i] = G(T)->tmname[i];
+	g->selectf = G(T)->selectf;
+	luaR_clone(L, T);  /* copy all other objects */
+	g->gcstp = 0;  /* allow gc */
+	setnilvalue(&g->nilvalue);  /* now state is complete */
+	if (isdecGCmodegen(G(T)))
+		luaC_changemode(L, KGC_GEN);
+	else
+		luaC_setpause(L);  /* do not start a cycle over the new copies */
+	luai_userstateopen(L);
+}
+
+
 /*
 ** preinitialize a thread with consistent values without allocating
 ** any memory (to avoid errors)
@@ -266,18 +295,34 @@ static void preinit_thread(lua_State* L, global_State* g) {
 }
 
 
-static void close_state(lua_State* L) {
+/*
+** First part of closing a state: everything that may run code. Sets
+** GCSTPCLS, which tells that it was done.
+*/
+static void shutdown_state(lua_State* L) {
 	global_State* g = G(L);
-	if (!completestate(g))  /* closing a partially built state? */
-		luaC_freeallobjects(L);  /* just collect its objects */
-	else {  /* closing a fully built state */
+	if (completestate(g)) {  /* closing a fully built state? */
 		L->ci = &L->base_ci;  /* unwind CallInfo list */
 		luaD_closeprotected(L, 1, LUA_OK);  /* close all upvalues */
-		luaC_freeallobjects(L);  /* collect all objects */
-		luai_userstateclose(L);
 	}
+	luaC_finalizeall(L);
+}
+
+
+/*
+** Second part: frees all memory, using only the allocation function.
+*/
+static void close_state(lua_State* L) {
+	global_State* g = G(L);
+	if (!(g->gcstp & GCSTPCLS))  /* not shut down yet? */
+		shutdown_state(L);
+	luaC_freeallobjects(L);  /* collect all objects */
+	if (completestate(g))
+		luai_userstateclose(L);
 	luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
 	freestack(L);
+	luaM_heapprofile(L, 0);  /* stop heap profiler */
+	luaR_freetemplate(L);
 	lua_assert(gettotalbytes(g) == sizeof(LG));
 	(*g->frealloc)(g->ud, fromstate(L), sizeof(LG), 0);  /* free main block */
 }
@@ -357,7 +402,10 @@ LUA_API int lua_resetthread(lua_State* L) {
 }
 
 
-LUA_API lua_State* lua_newstate(lua_Alloc f, void* ud) {
+/*
+** Creates a new state, which is a clone of 'T' if it is not NULL.
+*/
+static lua_State* newstate(lua_Alloc f, void* ud, lua_State* T) {
 	int i;
 	lua_State* L;
 	global_State* g;
@@ -377,16 +425,22 @@ LUA_API lua_State* lua_newstate(lua_Alloc f, void* ud) {
 	g->warnf = NULL;
 	g->ud_warn = NULL;
 	g->mainthread = L;
-	g->seed = luai_makeseed(L);
+	g->seed = (T == NULL) ? luai_makeseed(L) : G(T)->seed;
 	g->gcstp = GCSTPGC;  /* no GC while building state */
 	g->strt.size = g->strt.nuse = 0;
 	g->strt.hash = NULL;
+	g->sharedstrt = NULL;
+	g->sharedfrom = NULL;
+	g->tmpl = NULL;
 	setnilvalue(&g->l_registry);
 	g->panic = NULL;
+	g->selectf = NULL;
 	g->gcstate = GCSpause;
 	g->gckind = KGC_INC;
 	g->gcstopem = 0;
 	g->gcemergency = 0;
+	g->narenas = 0;
+	g->arenadefer = 0;
 	g->finobj = g->tobefnz = g->fixedgc = NULL;
 	g->firstold1 = g->survival = g->old1 = g->reallyold = NULL;
 	g->finobjsur = g->finobjold1 = g->finobjrold = NULL;
@@ -396,15 +450,33 @@ LUA_API lua_State* lua_newstate(lua_Alloc f, void* ud) {
 	g->twups = NULL;
 	g->totalbytes = sizeof(LG);
 	g->GCdebt = 0;
+	g->extbytes = 0;
 	g->lastatomic = 0;
+	g->gcatomictime = g->gcgentime = 0;
+	memset(&g->gctel, 0, sizeof(g->gctel));
+	g->hprof = NULL;
 	setivalue(&g->nilvalue, 0);  /* to signal that state is not yet built */
 	setgcparam(g->gcpause, LUAI_GCPAUSE);
 	setgcparam(g->gcstepmul, LUAI_GCMUL);
 	g->gcstepsize = LUAI_GCSTEPSIZE;
+	g->extweight = LUAI_GCEXTWEIGHT;
 	setgcparam(g->genmajormul, LUAI_GENMAJORMUL);
 	g->genminormul = LUAI_GENMINORMUL;
 	for (i = 0; i < LUA_NUMTAGS; i++) g->mt[i] = NULL;
-	if (luaD_rawrunprotected(L, f_luaopen, NULL) != LUA_OK) {
+#if defined(LUA_USE_PROFILE)
+	for (i = 0; i < NUM_OPCODES; i++) g->opcount[i] = 0;
+#endif
+	if (T != NULL) {  /* a clone keeps the collector parameters */
+		global_State* tg = G(T);
+		g->gcpause = tg->gcpause;
+		g->gcstepmul = tg->gcstepmul;
+		g->gcstepsize = tg->gcstepsize;
+		g->extweight = tg->extweight;
+		g->genmajormul = tg->genmajormul;
+		g->genminormul = tg->genminormul;
+	}
+	if (luaD_rawrunprotected(L, (T == NULL) ? f_luaopen : f_cloneopen,
+		T) != LUA_OK) {
 		/* memory allocation error: free partial state */
 		close_state(L);
 		L = NULL;
@@ -413,6 +485,38 @@ LUA_API lua_State* lua_newstate(lua_Alloc f, void* ud) {
 }
 
 
+LUA_API lua_State* lua_newstate(lua_Alloc f, void* ud) {
+	return newstate(f, ud, NULL);
+}
+
+
+/*
+** Creates a state with the same contents as template 'T', frozen by
+** 'lua_freeze', except for its stack; 'T' is only read, so this may be
+** called from any OS thread. Returns NULL if there is no memory.
+*/
+LUA_API lua_State* lua_clone(lua_State* T, lua_Alloc f, void* ud) {
+	api_check(T, G(T)->tmpl != NULL, "state is not a template");
+	return newstate(f, ud, T);
+}
+
+
+/*
+** Does the part of 'lua_close' that may run code: closes all pending
+** to-be-closed variables and calls all finalizers. After that, the only
+** valid call over the state is 'lua_close', which then only frees
+** memory; so, it may run in any OS thread, provided the allocation
+** function allows it.
+*/
+LUA_API void lua_shutdown(lua_State* L) {
+	lua_lock(L);
+	L = G(L)->mainthread;  /* only the main thread can be closed */
+	if (!(G(L)->gcstp & GCSTPCLS))
+		shutdown_state(L);
+	lua_unlock(L);
+}
+
+
 LUA_API void lua_close(lua_State* L) {
 	lua_lock(L);
 	L = G(L)->mainthread;  /* only the main thread can be closed */
@@ -420,6 +524,25 @@ LUA_API void lua_close(lua_State* L) {
 }
 
 
+/*
+** Monotonic clock in nanoseconds, for the profiler and for time-budgeted
+** collector steps. Falls back to 'clock' (processor time) when no better
+** source is known.
+*/
+lu_mem luaE_clock(void) {
+#if defined(LUA_USE_POSIX) && defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return cast(lu_mem, ts.tv_sec) * 1000000000u + cast(lu_mem, ts.tv_nsec);
+#elif defined(TIME_UTC)
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return cast(lu_mem, ts.tv_sec) * 1000000000u + cast(lu_mem, ts.tv_nsec);
+#else
+	return cast(lu_mem, clock()) * (1000000000u / CLOCKS_PER_SEC);
+#endif
+}
+
 void luaE_warning(lua_State* L, const char* msg, int tocont) {
 	lua_WarnFunction wf = G(L)->warnf;
 	if (wf != NULL)
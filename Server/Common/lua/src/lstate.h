@@ -18,6 +18,10 @@ typedef struct CallInfo CallInfo;
 #include "ltm.h"
 #include "lzio.h"
 
+#if defined(LUA_USE_PROFILE)
+#include "lopcodes.h"
+#endif
+
 
 /*
 ** Some notes about garbage-collected objects: All objects in Lua must
@@ -183,6 +187,9 @@ struct CallInfo {
 			const Instruction* savedpc;
 			volatile l_signalT trap;  /* function is tracing lines/counts */
 			int nextraargs;  /* # of extra arguments in vararg functions */
+#if defined(LUA_USE_PROFILE)
+			lu_mem proftime;  /* time when the function was called */
+#endif
 		} l;
 		struct {  /* only for C functions */
 			lua_KFunction k;  /* continuation in case of yields */
@@ -248,6 +255,21 @@ struct CallInfo {
 #define getoah(st)	((st) & CIST_OAH)
 
 
+/*
+** Collector telemetry: what 'lua_gc(L, LUA_GCSTATS)' reports, plus the
+** collection in progress. It is updated only at step boundaries and
+** phase changes, and never allocates.
+*/
+typedef struct GCTelemetry {
+	lua_GCStats st;
+	lua_GCCycle cur;  /* collection in progress */
+	lu_mem tstep;  /* when the current step started */
+	lu_mem tlast;  /* when 'phase' was last charged */
+	lu_byte phase;  /* phase being timed */
+	lu_byte pushed;  /* current step finished a collection? */
+} GCTelemetry;
+
+
 /*
 ** 'global state', shared by all threads of this state
 */
@@ -257,11 +279,20 @@ typedef struct global_State {
 	l_mem totalbytes;  /* number of bytes currently allocated - GCdebt */
 	l_mem GCdebt;  /* bytes allocated not yet compensated by the collector */
 	lu_mem GCestimate;  /* an estimate of the non-garbage memory in use */
+	size_t extbytes;  /* bytes of data in external buffers */
 	lu_mem lastatomic;  /* see function 'genstep' in file 'lgc.c' */
+	lu_mem gcatomictime;  /* duration (ns) of the last atomic step */
+	lu_mem gcgentime;  /* duration (ns) of the last generational step */
+	GCTelemetry gctel;  /* collector telemetry */
+	struct HeapProf* hprof;  /* heap profiler (NULL when off) */
 	stringtable strt;  /* hash table for strings */
+	const stringtable* sharedstrt;  /* strings of the template of a clone */
+	struct lua_State* sharedfrom;  /* template of a clone, or NULL */
+	struct Template* tmpl;  /* copy plan of a frozen state (see lclone.c) */
 	TValue l_registry;
 	TValue nilvalue;  /* a nil value */
 	unsigned int seed;  /* randomized seed for hashes */
+	unsigned int narenas;  /* open arena scopes (see 'luaC_poparena') */
 	lu_byte currentwhite;
 	lu_byte gcstate;  /* state of garbage collector */
 	lu_byte gckind;  /* kind of GC running */
@@ -270,9 +301,11 @@ typedef struct global_State {
 	lu_byte genmajormul;  /* control for major generational collections */
 	lu_byte gcstp;  /* control whether GC is running */
 	lu_byte gcemergency;  /* true if this is an emergency collection */
+	lu_byte arenadefer;  /* true if an arena scope deferred a collection */
 	lu_byte gcpause;  /* size of pause between successive GCs */
 	lu_byte gcstepmul;  /* GC "speed" */
 	lu_byte gcstepsize;  /* (log2 of) GC granularity */
+	lu_byte extweight;  /* percentage of 'extbytes' counted as debt */
 	GCObject* allgc;  /* list of all collectable objects */
 	GCObject** sweepgc;  /* current position of sweep in list */
 	GCObject* finobj;  /* list of collectable objects with finalizers */
@@ -293,6 +326,7 @@ typedef struct global_State {
 	GCObject* finobjrold;  /* list of really old objects with finalizers */
 	struct lua_State* twups;  /* list of threads with open upvalues */
 	lua_CFunction panic;  /* to be called in unprotected errors */
+	lua_CFunction selectf;  /* standard 'select' (see OP_SELECT) */
 	struct lua_State* mainthread;
 	TString* memerrmsg;  /* message for memory-allocation errors */
 	TString* tmname[TM_N];  /* array with tag-method names */
@@ -300,6 +334,9 @@ typedef struct global_State {
 	TString* strcache[STRCACHE_N][STRCACHE_M];  /* cache for strings in API */
 	lua_WarnFunction warnf;  /* warning function */
 	void* ud_warn;         /* auxiliary data to 'warnf' */
+#if defined(LUA_USE_PROFILE)
+	lu_mem opcount[NUM_OPCODES];  /* number of executions of each opcode */
+#endif
 } global_State;
 
 
@@ -402,6 +439,7 @@ LUAI_FUNC void luaE_incCstack(lua_State* L);
 LUAI_FUNC void luaE_warning(lua_State* L, const char* msg, int tocont);
 LUAI_FUNC void luaE_warnerror(lua_State* L, const char* where);
 LUAI_FUNC int luaE_resetthread(lua_State* L, int status);
+LUAI_FUNC lu_mem luaE_clock(void);
 
 
 #endif
@@ -40,6 +40,62 @@ int luaS_eqlngstr(TString* a, TString* b) {
 }
 
 
+/*
+** String hash. Where a 64-bit type is available, it reads the string
+** eight bytes at a time (through 'memcpy', so the reads need no
+** alignment and compile to plain loads), folding each word into the
+** state with a multiplication and a rotation. The last (partial) word
+** is read as a full word overlapping the previous one, and strings
+** shorter than a word take at most two overlapping loads, so the hash
+** never reads past the string. As before, all bytes enter the hash and
+** the state starts from the seed and the length, so the result is only
+** predictable by someone who knows the seed.
+*/
+#if defined(LLONG_MAX)
+
+typedef unsigned long long l_hashword;
+
+#define HASHK1	0x9e3779b97f4a7c15ull
+#define HASHK2	0xff51afd7ed558ccdull
+
+/* fold word 'w' into state 'h' (the rotation moves high bits down) */
+l_sinline l_hashword hashmix(l_hashword h, l_hashword w) {
+	h = (h ^ w) * HASHK1;
+	return h << 31 | h >> 33;
+}
+
+l_sinline l_hashword read8(const char* p) {
+	l_hashword w;
+	memcpy(&w, p, 8);
+	return w;
+}
+
+l_sinline l_hashword read4(const char* p) {
+	l_uint32 w;
+	memcpy(&w, p, 4);
+	return w;
+}
+
+unsigned int luaS_hash(const char* str, size_t l, unsigned int seed) {
+	l_hashword h = ((l_hashword)seed << 32 | seed) ^ (l * HASHK2);
+	if (l >= 8) {
+		const char* end = str + l - 8;  /* start of the last word */
+		for (; str < end; str += 8)
+			h = hashmix(h, read8(str));
+		h = hashmix(h, read8(end));
+	}
+	else if (l >= 4)  /* two (possibly overlapping) 4-byte reads */
+		h = hashmix(h, read4(str) << 32 | read4(str + l - 4));
+	else if (l > 0)  /* first, middle, and last bytes */
+		h = hashmix(h, (l_hashword)cast_byte(str[0]) << 16 |
+			(l_hashword)cast_byte(str[l >> 1]) << 8 | cast_byte(str[l - 1]));
+	h ^= h >> 32;  /* fold high bits into the low ones */
+	h *= HASHK2;
+	return cast_uint(h ^ (h >> 29));
+}
+
+#else
+
 unsigned int luaS_hash(const char* str, size_t l, unsigned int seed) {
 	unsigned int h = seed ^ cast_uint(l);
 	for (; l > 0; l--)
@@ -47,6 +103,8 @@ unsigned int luaS_hash(const char* str, size_t l, unsigned int seed) {
 	return h;
 }
 
+#endif
+
 
 unsigned int luaS_hashlongstr(TString* ts) {
 	lua_assert(ts->tt == LUA_VLNGSTR);
@@ -129,7 +187,8 @@ void luaS_init(lua_State* L) {
 	tb->size = MINSTRTABSIZE;
 	/* pre-create memory-error message */
 	g->memerrmsg = luaS_newliteral(L, MEMERRMSG);
-	luaC_fix(L, obj2gco(g->memerrmsg));  /* it should never be collected */
+	if (g->sharedstrt == NULL)  /* (shared strings are never collected) */
+		luaC_fix(L, obj2gco(g->memerrmsg));  /* it should never be collected */
 	for (i = 0; i < STRCACHE_N; i++)  /* fill cache with valid strings */
 		for (j = 0; j < STRCACHE_M; j++)
 			g->strcache[i][j] = g->memerrmsg;
@@ -194,13 +253,23 @@ static TString* internshrstr(lua_State* L, const char* str, size_t l) {
 	TString** list = &tb->hash[lmod(h, tb->size)];
 	lua_assert(str != NULL);  /* otherwise 'memcmp'/'memcpy' are undefined */
 	for (ts = *list; ts != NULL; ts = ts->u.hnext) {
-		if (l == ts->shrlen && (memcmp(str, getshrstr(ts), l * sizeof(char)) == 0)) {
+		l_prefetch(ts->u.hnext);  /* overlap the next miss with this compare */
+		if (ts->hash == h && l == ts->shrlen &&
+			(memcmp(str, getshrstr(ts), l * sizeof(char)) == 0)) {
 			/* found! */
 			if (isdead(g, ts))  /* dead (but not collected yet)? */
 				changewhite(ts);  /* resurrect it */
 			return ts;
 		}
 	}
+	if (g->sharedstrt != NULL) {  /* cloned state? look among shared ones */
+		const stringtable* stb = g->sharedstrt;
+		for (ts = stb->hash[lmod(h, stb->size)]; ts != NULL; ts = ts->u.hnext) {
+			if (ts->hash == h && l == ts->shrlen &&
+				(memcmp(str, getshrstr(ts), l * sizeof(char)) == 0))
+				return ts;  /* (shared strings are never dead) */
+		}
+	}
 	/* else must create a new string */
 	if (tb->nuse >= tb->size) {  /* need to grow string table? */
 		growstrtab(L, tb);
@@ -266,6 +335,7 @@ Udata* luaS_newudata(lua_State* L, size_t s, int nuvalue) {
 	u = gco2u(o);
 	u->len = s;
 	u->nuvalue = nuvalue;
+	u->ext = 0;
 	u->metatable = NULL;
 	for (i = 0; i < nuvalue; i++)
 		setnilvalue(&u->uv[i].uv);
@@ -362,6 +362,7 @@ typedef struct MatchState {
 	lua_State* L;
 	int matchdepth;  /* control for recursive depth (to avoid C stack overflow) */
 	unsigned char level;  /* total number of captures (finished or unfinished) */
+	const struct CPattern* cp;  /* compiled pattern, or NULL */
 	struct {
 		const char* init;
 		ptrdiff_t len;
@@ -670,12 +671,76 @@ init: /* using goto to optimize tail recursion */
 
 
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LSTR_SSE2
+
+/* index of the lowest bit set in (non-zero) mask 'm' */
+#if defined(__GNUC__)
+#define lowbit(m)	((size_t)__builtin_ctz(m))
+#else
+#include <intrin.h>
+static size_t lowbit(unsigned int m) {
+	unsigned long i;
+	_BitScanForward(&i, m);
+	return (size_t)i;
+}
+#endif
+
+#endif
+
+
+/*
+** Number of false candidates (first byte found, rest not matching)
+** after which 'lmemfind' stops using 'memchr' and switches to
+** 'simdfind', which filters candidates by their first and last bytes.
+** ('memchr' is hard to beat when the first byte is rare; repetitive
+** text makes it stop at every other byte.)
+*/
+#define MAXMISSES	8
+
+
+#if defined(LSTR_SSE2)
+
+/* search for 's2' in 's1', with 2 <= l2 <= l1 */
+static const char* simdfind(const char* s1, size_t l1,
+	const char* s2, size_t l2) {
+	const __m128i first = _mm_set1_epi8(s2[0]);
+	const __m128i last = _mm_set1_epi8(s2[l2 - 1]);
+	size_t n = l1 - l2 + 1;  /* number of candidate positions */
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {  /* 16 candidates at a time */
+		__m128i f = _mm_loadu_si128((const __m128i*)(s1 + i));
+		__m128i l = _mm_loadu_si128((const __m128i*)(s1 + i + l2 - 1));
+		unsigned int m = (unsigned int)_mm_movemask_epi8(
+			_mm_and_si128(_mm_cmpeq_epi8(f, first), _mm_cmpeq_epi8(l, last)));
+		for (; m != 0; m &= m - 1) {  /* for each candidate */
+			const char* c = s1 + i + lowbit(m);
+			if (memcmp(c + 1, s2 + 1, l2 - 2) == 0)
+				return c;
+		}
+	}
+	for (; i < n; i++) {  /* remaining candidates */
+		if (s1[i] == s2[0] && s1[i + l2 - 1] == s2[l2 - 1] &&
+			memcmp(s1 + i + 1, s2 + 1, l2 - 2) == 0)
+			return s1 + i;
+	}
+	return NULL;
+}
+
+#endif
+
+
 static const char* lmemfind(const char* s1, size_t l1,
 	const char* s2, size_t l2) {
 	if (l2 == 0) return s1;  /* empty strings are everywhere */
 	else if (l2 > l1) return NULL;  /* avoids a negative 'l1' */
 	else {
 		const char* init;  /* to search for a '*s2' inside 's1' */
+#if defined(LSTR_SSE2)
+		int misses = 0;
+#endif
 		l2--;  /* 1st char will be checked by 'memchr' */
 		l1 = l1 - l2;  /* 's2' cannot be found after that */
 		while (l1 > 0 && (init = (const char*)memchr(s1, *s2, l1)) != NULL) {
@@ -685,6 +750,10 @@ static const char* lmemfind(const char* s1, size_t l1,
 			else {  /* correct 'l1' and 's1' to try again */
 				l1 -= init - s1;
 				s1 = init;
+#if defined(LSTR_SSE2)
+				if (++misses == MAXMISSES && l2 > 0)  /* repetitive text? */
+					return (l1 > 0) ? simdfind(s1, l1 + l2, s2, l2 + 1) : NULL;
+#endif
 			}
 		}
 		return NULL;  /* not found */
@@ -692,6 +761,606 @@ static const char* lmemfind(const char* s1, size_t l1,
 }
 
 
+/*
+** The patterns of 'find', 'match', 'gmatch', and 'gsub' are compiled
+** on their second use into a list of items, with every character class
+** resolved into a set of 256 bits, and kept in a per-state cache keyed
+** by the pattern string. (The first use only leaves a mark in the
+** cache, so that patterns built on the fly do not pay for compiling;
+** patterns longer than LUAI_PATMAXLEN are never compiled.) 'cmatch'
+** runs a compiled pattern with the same backtracking algorithm as
+** 'match', item by item, so results and errors are the same; patterns
+** not compiled go through 'match'. (Malformed patterns are not
+** compiled: 'match' raises their errors when it reaches them.)
+** Classes depend on the locale, so a compiled pattern with classes
+** keeps the name of the LC_CTYPE locale it was compiled in, and is
+** compiled again if that changes.
+*/
+
+#if !defined(LUAI_PATCACHESIZE)
+#define LUAI_PATCACHESIZE	128
+#endif
+
+#if !defined(LUAI_PATMAXLEN)
+#define LUAI_PATMAXLEN	256
+#endif
+
+
+/* kinds of compiled items */
+#define PI_END		0	/* end of pattern */
+#define PI_ANY		1	/* any character */
+#define PI_CHAR		2	/* character 'c' */
+#define PI_SET		3	/* character in 'sets[set]' */
+#define PI_OPEN		4	/* '(' */
+#define PI_POSITION	5	/* '()' */
+#define PI_CLOSE	6	/* ')' */
+#define PI_EOS		7	/* '$' at the end of the pattern */
+#define PI_BALANCE	8	/* '%bxy' */
+#define PI_FRONTIER	9	/* '%f[set]' */
+#define PI_BACKREF	10	/* '%0'-'%9' */
+
+
+typedef struct PItem {
+	unsigned char op;
+	unsigned char rep;  /* suffix ('*', '+', '-', '?', or 0) */
+	unsigned char c, c2;  /* character, '%b' delimiters, or '%n' digit */
+	int set;  /* index of the set (PI_SET and PI_FRONTIER) */
+} PItem;
+
+
+typedef unsigned char CharSet[(UCHAR_MAX + 1) / 8];
+
+#define inset(st,c)	((st)[(c) >> 3] & (1u << ((c) & 7)))
+
+
+/*
+** A compiled pattern is followed, in the same block, by its items, its
+** sets, its literal prefix (with room for one byte per item), and the
+** LC_CTYPE locale of its sets. The header keeps only their counts, not
+** pointers, so that the block can be copied as is: its metatable says
+** so to 'lua_freeze' (which would otherwise take any userdata without
+** a metatable as plain data).
+*/
+typedef struct CPattern {
+	int nitems;  /* number of items (including the final PI_END) */
+	int nsets;  /* number of sets */
+	int nprefix;  /* length of the literal prefix */
+	int anchor;  /* pattern starts with '^' (not included in items) */
+	int haslocale;  /* true if the sets depend on the locale */
+} CPattern;
+
+#define cpitems(cp)	((const PItem*)((cp) + 1))
+#define cpsets(cp)	((const CharSet*)(cpitems(cp) + (cp)->nitems))
+#define cpprefix(cp)	((const char*)(cpsets(cp) + (cp)->nsets))
+#define cplocale(cp)	((cp)->haslocale ? cpprefix(cp) + (cp)->nitems : NULL)
+
+#define CPATTERN_TNAME	"_CPATTERN*"
+
+
+/* like 'classend', but returns NULL for a malformed class */
+static const char* cclassend(const char* p, const char* p_end) {
+	switch (*p++) {
+	case L_ESC: {
+		return (p == p_end) ? NULL : p + 1;
+	}
+	case '[': {
+		if (*p == '^') p++;
+		do {  /* look for a ']' */
+			if (p == p_end)
+				return NULL;
+			if (*(p++) == L_ESC && p < p_end)
+				p++;  /* skip escapes (e.g. '%]') */
+		} while (*p != ']');
+		return p + 1;
+	}
+	default: {
+		return p;
+	}
+	}
+}
+
+
+/*
+** Fills 'st' with the characters matched by the class 'p'..'ep' (as
+** 'singlematch' would match them) and returns its number of elements.
+*/
+static int makeset(CharSet st, const char* p, const char* ep) {
+	int c, n = 0;
+	memset(st, 0, sizeof(CharSet));
+	for (c = 0; c <= UCHAR_MAX; c++) {
+		int in;
+		switch (*p) {
+		case '.': in = 1; break;
+		case L_ESC: in = match_class(c, uchar(*(p + 1))); break;
+		case '[': in = matchbracketclass(c, p, ep - 1); break;
+		default: in = (uchar(*p) == c); break;
+		}
+		if (in) {
+			st[c >> 3] |= (unsigned char)(1u << (c & 7));
+			n++;
+		}
+	}
+	return n;
+}
+
+
+/*
+** Compiles the pattern 'p'..'p_end' into 'items', 'sets', and
+** 'prefix'. When 'items' is NULL, only counts (an upper bound of) the
+** items and sets it needs. Returns 0 if the pattern is malformed. The
+** parsing follows 'match', case by case.
+*/
+static int compile(const char* p, const char* p_end, PItem* items,
+	CharSet* sets, char* prefix, int* nitems, int* nsets, int* nprefix) {
+	int ni = 0, ns = 0, np = 0;
+	while (p != p_end) {
+		PItem it;
+		it.rep = it.c = it.c2 = 0;
+		it.set = 0;
+		switch (*p) {
+		case '(': {
+			if (*(p + 1) == ')') {
+				it.op = PI_POSITION; p += 2;
+			}
+			else {
+				it.op = PI_OPEN; p++;
+			}
+			break;
+		}
+		case ')': {
+			it.op = PI_CLOSE; p++;
+			break;
+		}
+		case '$': {
+			if ((p + 1) != p_end)  /* not the last char in pattern? */
+				goto dflt;
+			it.op = PI_EOS; p++;
+			break;
+		}
+		case L_ESC: {
+			switch (*(p + 1)) {
+			case 'b': {
+				if (p + 2 >= p_end - 1)
+					return 0;  /* missing arguments to '%b' */
+				it.op = PI_BALANCE;
+				it.c = uchar(*(p + 2)); it.c2 = uchar(*(p + 3));
+				p += 4;
+				break;
+			}
+			case 'f': {
+				const char* ep;
+				p += 2;
+				if (*p != '[' || (ep = cclassend(p, p_end)) == NULL)
+					return 0;
+				it.op = PI_FRONTIER;
+				it.set = ns++;
+				if (items != NULL) {
+					int c;
+					memset(sets[it.set], 0, sizeof(CharSet));
+					for (c = 0; c <= UCHAR_MAX; c++)
+						if (matchbracketclass(c, p, ep - 1))
+							sets[it.set][c >> 3] |= (unsigned char)(1u << (c & 7));
+				}
+				p = ep;
+				break;
+			}
+			case '0': case '1': case '2': case '3':
+			case '4': case '5': case '6': case '7':
+			case '8': case '9': {
+				it.op = PI_BACKREF;
+				it.c = uchar(*(p + 1));
+				p += 2;
+				break;
+			}
+			default: goto dflt;
+			}
+			break;
+		}
+		default: dflt: {  /* single-char class plus optional suffix */
+			const char* ep = cclassend(p, p_end);
+			if (ep == NULL)
+				return 0;
+			if (*ep == '*' || *ep == '+' || *ep == '-' || *ep == '?')
+				it.rep = uchar(*ep);
+			if (*p == '.')
+				it.op = PI_ANY;
+			else if (*p != '[' && !(*p == L_ESC && isalpha(uchar(*(p + 1))))) {
+				it.op = PI_CHAR;  /* a literal, maybe escaped */
+				it.c = uchar(*(ep - 1));
+			}
+			else if (items != NULL) {
+				int n = makeset(sets[ns], p, ep);
+				if (n == UCHAR_MAX + 1)
+					it.op = PI_ANY;
+				else if (n == 1) {
+					it.op = PI_CHAR;
+					while (!inset(sets[ns], it.c)) it.c++;
+				}
+				else {
+					it.op = PI_SET;
+					it.set = ns++;
+				}
+			}
+			else {
+				it.op = PI_SET;
+				ns++;
+			}
+			p = ep + (it.rep != 0);
+			break;
+		}
+		}
+		if (items != NULL) {
+			if (np == ni && it.op == PI_CHAR && it.rep == 0)
+				prefix[np++] = (char)it.c;  /* still a literal prefix */
+			items[ni] = it;
+		}
+		ni++;
+	}
+	if (items != NULL)
+		items[ni].op = PI_END;
+	*nitems = ni + 1;
+	*nsets = ns;
+	*nprefix = np;
+	return 1;
+}
+
+
+/* name of the current LC_CTYPE locale */
+static const char* ctypelocale(void) {
+	const char* loc = setlocale(LC_CTYPE, NULL);
+	return (loc != NULL) ? loc : "";
+}
+
+
+/*
+** Compiles the pattern at index 'arg' and pushes the result: a full
+** userdata holding a 'CPattern', its items, sets, prefix, and locale,
+** or false if the pattern is malformed.
+*/
+static void newcpattern(lua_State* L, int arg) {
+	size_t lp;
+	const char* p = lua_tolstring(L, arg, &lp);
+	const char* p_end = p + lp;
+	int anchor = (*p == '^');
+	int ni, ns, np;
+	p += anchor;
+	if (!compile(p, p_end, NULL, NULL, NULL, &ni, &ns, &np))
+		lua_pushboolean(L, 0);
+	else {
+		int hasclasses = (ns > 0);  /* (counted before resolving them) */
+		const char* loc = hasclasses ? ctypelocale() : "";
+		size_t lloc = strlen(loc) + 1;
+		CPattern* cp = (CPattern*)lua_newuserdatauv(L, sizeof(CPattern) +
+			ni * sizeof(PItem) + ns * sizeof(CharSet) + ni + lloc, 0);
+		luaL_setmetatable(L, CPATTERN_TNAME);
+		PItem* items = (PItem*)(cp + 1);
+		CharSet* sets = (CharSet*)(items + ni);
+		char* prefix = (char*)(sets + ns);
+		char* locale = prefix + ni;
+		memcpy(locale, loc, lloc);  /* copy it before it can change */
+		cp->nitems = ni;  /* layout of the block, as allocated */
+		cp->nsets = ns;
+		compile(p, p_end, items, sets, prefix, &ni, &ns, &np);
+		cp->nprefix = np;
+		cp->anchor = anchor;
+		cp->haslocale = hasclasses;
+	}
+}
+
+
+/* key for the number of entries in the cache */
+static const char patcountkey = 0;
+
+
+/*
+** Stores the value on the top of the stack in the cache, under the key
+** at index 'arg', leaving the value on the stack. The cache is the
+** first upvalue of the library functions; when full, it is simply
+** emptied.
+*/
+static void cacheput(lua_State* L, int arg) {
+	int cache = lua_upvalueindex(1);
+	lua_Integer n;
+	lua_rawgetp(L, cache, &patcountkey);
+	n = lua_tointeger(L, -1);
+	lua_pop(L, 1);
+	if (n >= LUAI_PATCACHESIZE) {  /* cache is full? */
+		lua_cleartable(L, cache);
+		n = 0;
+	}
+	lua_pushinteger(L, n + 1);
+	lua_rawsetp(L, cache, &patcountkey);
+	lua_pushvalue(L, arg);
+	lua_pushvalue(L, -2);
+	lua_rawset(L, cache);  /* cache[key] = value */
+}
+
+
+/*
+** Pushes the compiled form of the pattern at index 'arg' (a string)
+** and returns it; returns NULL (with a boolean pushed) if the pattern
+** is not compiled.
+*/
+static const CPattern* getcpattern(lua_State* L, int arg) {
+	int cache = lua_upvalueindex(1);
+	const CPattern* cp;
+	if (lua_rawlen(L, arg) > LUAI_PATMAXLEN) {  /* too long? */
+		lua_pushboolean(L, 0);
+		return NULL;
+	}
+	lua_pushvalue(L, arg);
+	switch (lua_rawget(L, cache)) {
+	case LUA_TNIL: {  /* first use? only mark it */
+		lua_pop(L, 1);
+		lua_pushboolean(L, 1);
+		cacheput(L, arg);
+		return NULL;
+	}
+	case LUA_TUSERDATA: {
+		cp = (const CPattern*)lua_touserdata(L, -1);
+		if (!cp->haslocale || strcmp(cplocale(cp), ctypelocale()) == 0)
+			return cp;
+		break;  /* locale changed; compile it again */
+	}
+	default: {  /* true for a second use, false if malformed */
+		if (!lua_toboolean(L, -1))
+			return NULL;
+		break;
+	}
+	}
+	lua_pop(L, 1);
+	newcpattern(L, arg);
+	lua_pushvalue(L, arg);
+	lua_pushvalue(L, -2);
+	lua_rawset(L, cache);  /* replace the entry */
+	return (const CPattern*)lua_touserdata(L, -1);  /* NULL for false */
+}
+
+
+/*
+** Returns the first position from 's' (up to 'e') where a match of 'cp'
+** can start, judging from the start of the pattern, or NULL if there is
+** none. Trying any position skipped here would fail at the first item,
+** with no other effects.
+*/
+static const char* firstpos(const CPattern* cp, const char* s,
+	const char* e) {
+	const PItem* it = cpitems(cp);
+	if (cp->nprefix > 1)
+		return lmemfind(s, e - s, cpprefix(cp), cp->nprefix);
+	switch (it->op) {
+	case PI_BALANCE:
+		return (const char*)memchr(s, it->c, e - s);
+	case PI_EOS:
+		return e;
+	case PI_ANY: case PI_CHAR: case PI_SET: {
+		if (it->rep == '*' || it->rep == '?' || it->rep == '-')
+			return s;  /* item can match the empty string */
+		else if (it->op == PI_CHAR)
+			return (const char*)memchr(s, it->c, e - s);
+		else if (it->op == PI_SET) {
+			const unsigned char* st = cpsets(cp)[it->set];
+			for (; s < e; s++)
+				if (inset(st, uchar(*s))) return s;
+			return NULL;
+		}
+		else
+			return (s < e) ? s : NULL;
+	}
+	default:
+		return s;
+	}
+}
+
+
+static const char* cmatch(MatchState* ms, const char* s, const PItem* it);
+
+
+static int csinglematch(MatchState* ms, const char* s, const PItem* it) {
+	if (s >= ms->src_end)
+		return 0;
+	else {
+		int c = uchar(*s);
+		switch (it->op) {
+		case PI_ANY: return 1;
+		case PI_CHAR: return (it->c == c);
+		default: return inset(cpsets(ms->cp)[it->set], c) != 0;
+		}
+	}
+}
+
+
+static const char* cmatchbalance(MatchState* ms, const char* s,
+	const PItem* it) {
+	if (uchar(*s) != it->c) return NULL;
+	else {
+		int b = it->c;
+		int e = it->c2;
+		int cont = 1;
+		while (++s < ms->src_end) {
+			if (uchar(*s) == e) {
+				if (--cont == 0) return s + 1;
+			}
+			else if (uchar(*s) == b) cont++;
+		}
+	}
+	return NULL;  /* string ends out of balance */
+}
+
+
+static const char* cmax_expand(MatchState* ms, const char* s,
+	const PItem* it) {
+	const PItem* next = it + 1;
+	ptrdiff_t i = 0;  /* counts maximum expand for item */
+	switch (it->op) {
+	case PI_ANY:
+		i = ms->src_end - s;
+		break;
+	case PI_CHAR:
+		while (s + i < ms->src_end && uchar(s[i]) == it->c) i++;
+		break;
+	default: {
+		const unsigned char* st = cpsets(ms->cp)[it->set];
+		while (s + i < ms->src_end && inset(st, uchar(s[i]))) i++;
+		break;
+	}
+	}
+	/* if the next item is a required character, try only where it is
+	   (a call at any other position would fail at once) */
+	if (next->op == PI_CHAR && (next->rep == 0 || next->rep == '+') &&
+		ms->matchdepth > 0) {
+		for (; i >= 0; i--) {
+			if (s + i < ms->src_end && uchar(s[i]) == next->c) {
+				const char* res = cmatch(ms, s + i, next);
+				if (res) return res;
+			}
+		}
+		return NULL;
+	}
+	/* keeps trying to match with the maximum repetitions */
+	while (i >= 0) {
+		const char* res = cmatch(ms, (s + i), next);
+		if (res) return res;
+		i--;  /* else didn't match; reduce 1 repetition to try again */
+	}
+	return NULL;
+}
+
+
+static const char* cmin_expand(MatchState* ms, const char* s,
+	const PItem* it) {
+	for (;;) {
+		const char* res = cmatch(ms, s, it + 1);
+		if (res != NULL)
+			return res;
+		else if (csinglematch(ms, s, it))
+			s++;  /* try with one more repetition */
+		else return NULL;
+	}
+}
+
+
+static const char* cstart_capture(MatchState* ms, const char* s,
+	const PItem* it, int what) {
+	const char* res;
+	int level = ms->level;
+	if (level >= LUA_MAXCAPTURES) luaL_error(ms->L, "too many captures");
+	ms->capture[level].init = s;
+	ms->capture[level].len = what;
+	ms->level = level + 1;
+	if ((res = cmatch(ms, s, it)) == NULL)  /* match failed? */
+		ms->level--;  /* undo capture */
+	return res;
+}
+
+
+static const char* cend_capture(MatchState* ms, const char* s,
+	const PItem* it) {
+	int l = capture_to_close(ms);
+	const char* res;
+	ms->capture[l].len = s - ms->capture[l].init;  /* close capture */
+	if ((res = cmatch(ms, s, it)) == NULL)  /* match failed? */
+		ms->capture[l].len = CAP_UNFINISHED;  /* undo capture */
+	return res;
+}
+
+
+static const char* cmatch(MatchState* ms, const char* s, const PItem* it) {
+	if (l_unlikely(ms->matchdepth-- == 0))
+		luaL_error(ms->L, "pattern too complex");
+init: /* using goto to optimize tail recursion */
+	switch (it->op) {
+	case PI_END: {  /* end of pattern */
+		break;
+	}
+	case PI_OPEN: {  /* start capture */
+		s = cstart_capture(ms, s, it + 1, CAP_UNFINISHED);
+		break;
+	}
+	case PI_POSITION: {  /* position capture */
+		s = cstart_capture(ms, s, it + 1, CAP_POSITION);
+		break;
+	}
+	case PI_CLOSE: {  /* end capture */
+		s = cend_capture(ms, s, it + 1);
+		break;
+	}
+	case PI_EOS: {  /* check end of string */
+		s = (s == ms->src_end) ? s : NULL;
+		break;
+	}
+	case PI_BALANCE: {
+		s = cmatchbalance(ms, s, it);
+		if (s != NULL) {
+			it++; goto init;
+		}
+		break;
+	}
+	case PI_FRONTIER: {
+		const unsigned char* st = cpsets(ms->cp)[it->set];
+		int previous = (s == ms->src_init) ? '\0' : uchar(*(s - 1));
+		if (!inset(st, previous) && inset(st, uchar(*s))) {
+			it++; goto init;
+		}
+		s = NULL;  /* match failed */
+		break;
+	}
+	case PI_BACKREF: {
+		s = match_capture(ms, s, it->c);
+		if (s != NULL) {
+			it++; goto init;
+		}
+		break;
+	}
+	default: {  /* single-char item plus optional suffix */
+		if (!csinglematch(ms, s, it)) {
+			if (it->rep == '*' || it->rep == '?' || it->rep == '-') {
+				it++; goto init;  /* accept empty */
+			}
+			else  /* '+' or no suffix */
+				s = NULL;  /* fail */
+		}
+		else {  /* matched once */
+			switch (it->rep) {
+			case '?': {
+				const char* res;
+				if ((res = cmatch(ms, s + 1, it + 1)) != NULL)
+					s = res;
+				else {
+					it++; goto init;
+				}
+				break;
+			}
+			case '+':  /* 1 or more repetitions */
+				s++;  /* 1 match already done */
+				/* FALLTHROUGH */
+			case '*':  /* 0 or more repetitions */
+				s = cmax_expand(ms, s, it);
+				break;
+			case '-':  /* 0 or more repetitions (minimum) */
+				s = cmin_expand(ms, s, it);
+				break;
+			default:  /* no suffix */
+				s++; it++; goto init;
+			}
+		}
+		break;
+	}
+	}
+	ms->matchdepth++;
+	return s;
+}
+
+
+/* try to match at 's', with the compiled pattern if there is one */
+static const char* domatch(MatchState* ms, const char* s, const char* p) {
+	if (ms->cp != NULL)
+		return cmatch(ms, s, cpitems(ms->cp));
+	else
+		return match(ms, s, p);
+}
+
+
 /*
 ** get information about the i-th capture. If there are no captures
 ** and 'i==0', return information about the whole match, which
@@ -761,6 +1430,7 @@ static void prepstate(MatchState* ms, lua_State* L,
 	ms->src_init = s;
 	ms->src_end = s + ls;
 	ms->p_end = p + lp;
+	ms->cp = NULL;
 }
 
 
@@ -793,14 +1463,19 @@ static int str_find_aux(lua_State* L, int find) {
 		MatchState ms;
 		const char* s1 = s + init;
 		int anchor = (*p == '^');
+		const CPattern* cp = getcpattern(L, 2);
 		if (anchor) {
 			p++; lp--;  /* skip anchor character */
 		}
 		prepstate(&ms, L, s, ls, p, lp);
+		ms.cp = cp;
 		do {
 			const char* res;
+			if (cp != NULL && !anchor &&
+				(s1 = firstpos(cp, s1, ms.src_end)) == NULL)
+				break;  /* no more places where a match can start */
 			reprepstate(&ms);
-			if ((res = match(&ms, s1, p)) != NULL) {
+			if ((res = domatch(&ms, s1, p)) != NULL) {
 				if (find) {
 					lua_pushinteger(L, (s1 - s) + 1);  /* start */
 					lua_pushinteger(L, res - s);   /* end */
@@ -826,7 +1501,373 @@ static int str_match(lua_State* L) {
 }
 
 
-/* state for 'gmatch' */
+/*
+** Multi-string search ('string.compileany' and 'string.findany'), with
+** an Aho-Corasick automaton built from a list of strings. Bytes are
+** mapped to classes (class 0 for bytes in no string). The automaton is
+** first built as a trie, with one state per distinct prefix; when the
+** trie is small enough, it becomes a complete table of transitions,
+** 'nclasses' per state. Otherwise it stays as the trie edges plus
+** failure links, with a complete table only for the root. A matcher
+** keeps offsets, not pointers, into its own data ('v').
+*/
+
+#define ACMATCHER_TNAME	"anymatcher"
+
+/* largest complete table of transitions, in entries */
+#if !defined(ACMAXDENSE)
+#define ACMAXDENSE	(1 << 18)
+#endif
+
+typedef struct ACMachine {
+	int nclasses;
+	int nstates;
+	int maxlen;  /* length of the longest string */
+	int dense;  /* true if 'delta' is a complete table */
+	size_t delta;  /* complete table, or the root's transitions */
+	size_t first;  /* edges of state 'st' are 'first[st]' to 'first[st+1]-1' */
+	size_t ecls;  /* class of each edge */
+	size_t etgt;  /* target of each edge */
+	size_t fail;  /* failure links */
+	size_t outlen;  /* length of longest string ending at each state, or 0 */
+	size_t outidx;  /* index in the list of that string */
+	unsigned char cls[UCHAR_MAX + 1];  /* class of each byte */
+	int v[1];  /* data */
+} ACMachine;
+
+#define acarr(ac,f)	((ac)->v + (ac)->f)
+
+
+/* trie under construction, with children kept as sibling lists */
+typedef struct ACTrie {
+	int* child;  /* first child of each state, or 0 */
+	int* sib;  /* next sibling of each state, or 0 */
+	int* label;  /* class of the edge into each state */
+	int* fail;
+	int* outlen;
+	int* outidx;
+	int* queue;  /* states in breadth-first order */
+	int root[UCHAR_MAX + 1];  /* children of the root, by class */
+} ACTrie;
+
+
+/* child of state 'st' (other than the root) by class 'c', or 0 */
+static int triechild(const ACTrie* t, int st, int c) {
+	int ch;
+	for (ch = t->child[st]; ch != 0; ch = t->sib[ch])
+		if (t->label[ch] == c) return ch;
+	return 0;
+}
+
+
+/* transition from trie state 'st' by class 'c', following failure links */
+static int triegoto(const ACTrie* t, int st, int c) {
+	for (;;) {
+		int ch;
+		if (st == 0)
+			return t->root[c];
+		if ((ch = triechild(t, st, c)) != 0)
+			return ch;
+		st = t->fail[st];
+	}
+}
+
+
+/*
+** Checks the list at index 'arg' and numbers the classes of its bytes;
+** returns the total length of its strings.
+*/
+static size_t acclasses(lua_State* L, int arg, unsigned char* cls,
+	int* nclasses, int* maxlen) {
+	lua_Integer n, i;
+	size_t total = 0, k;
+	int c;
+	luaL_checktype(L, arg, LUA_TTABLE);
+	n = (lua_Integer)lua_rawlen(L, arg);
+	memset(cls, 0, UCHAR_MAX + 1);
+	*maxlen = 0;
+	for (i = 1; i <= n; i++) {  /* check strings and collect their bytes */
+		size_t l = 0;
+		const char* w = NULL;
+		if (lua_rawgeti(L, arg, i) == LUA_TSTRING)
+			w = lua_tolstring(L, -1, &l);
+		if (l_unlikely(l == 0))
+			luaL_error(L, "non-empty string expected at index %I in list", i);
+		if (l_unlikely(l > (size_t)INT_MAX - 1 - total))
+			luaL_error(L, "list of strings too large");
+		total += l;
+		if ((int)l > *maxlen) *maxlen = (int)l;
+		for (k = 0; k < l; k++)
+			cls[uchar(w[k])] = 1;
+		lua_pop(L, 1);
+	}
+	*nclasses = 1;
+	for (c = 0; c <= UCHAR_MAX; c++)  /* number the classes */
+		if (cls[c]) cls[c] = (unsigned char)(*nclasses)++;
+	return total;
+}
+
+
+/*
+** Builds the trie for the list at index 'arg', in a scratch userdata
+** pushed on the stack, with its failure links and outputs; returns
+** the number of states.
+*/
+static int buildtrie(lua_State* L, int arg, ACTrie* t,
+	const unsigned char* cls, size_t total) {
+	lua_Integer n = (lua_Integer)lua_rawlen(L, arg);
+	lua_Integer i;
+	size_t k, nst = total + 1;  /* maximum number of states */
+	int ns = 1, head = 0, tail = 0, c;
+	if (l_unlikely(nst > MAXSIZE / sizeof(int) / 7))
+		luaL_error(L, "list of strings too large");
+	t->child = (int*)lua_newuserdatauv(L, nst * 7 * sizeof(int), 0);
+	t->sib = t->child + nst;
+	t->label = t->sib + nst;
+	t->fail = t->label + nst;
+	t->outlen = t->fail + nst;
+	t->outidx = t->outlen + nst;
+	t->queue = t->outidx + nst;
+	memset(t->root, 0, sizeof(t->root));
+	t->child[0] = t->outlen[0] = t->fail[0] = 0;
+	for (i = 1; i <= n; i++) {  /* build the trie */
+		size_t l;
+		const char* w;
+		int st = 0;
+		lua_rawgeti(L, arg, i);
+		w = lua_tolstring(L, -1, &l);
+		for (k = 0; k < l; k++) {
+			int cl = cls[uchar(w[k])];
+			int ch = (st == 0) ? t->root[cl] : triechild(t, st, cl);
+			if (ch == 0) {  /* new state */
+				ch = ns++;
+				t->child[ch] = t->outlen[ch] = 0;
+				t->label[ch] = cl;
+				if (st == 0)
+					t->root[cl] = ch;
+				else {
+					t->sib[ch] = t->child[st];
+					t->child[st] = ch;
+				}
+			}
+			st = ch;
+		}
+		if (t->outlen[st] == 0) {  /* first occurrence of this string? */
+			t->outlen[st] = (int)l;
+			t->outidx[st] = (int)i;
+		}
+		lua_pop(L, 1);
+	}
+	for (c = 0; c <= UCHAR_MAX; c++) {  /* children of the root */
+		int ch = t->root[c];
+		if (ch != 0) {
+			t->fail[ch] = 0;
+			t->queue[tail++] = ch;
+		}
+	}
+	while (head < tail) {  /* the other states, breadth first */
+		int st = t->queue[head++];
+		int ch;
+		for (ch = t->child[st]; ch != 0; ch = t->sib[ch]) {
+			int f = triegoto(t, t->fail[st], t->label[ch]);
+			t->fail[ch] = f;
+			if (t->outlen[ch] == 0) {  /* inherit longest suffix string */
+				t->outlen[ch] = t->outlen[f];
+				t->outidx[ch] = t->outidx[f];
+			}
+			t->queue[tail++] = ch;
+		}
+	}
+	return ns;
+}
+
+
+/* builds the matcher for the list at index 'arg' and pushes it */
+static ACMachine* newacmachine(lua_State* L, int arg) {
+	ACTrie t;
+	ACMachine* ac;
+	unsigned char cls[UCHAR_MAX + 1];
+	int nclasses, maxlen, ns, st, c;
+	size_t total = acclasses(L, arg, cls, &nclasses, &maxlen);
+	size_t sz;
+	int dense;
+	int* v;
+	ns = buildtrie(L, arg, &t, cls, total);
+	dense = ((size_t)ns * nclasses <= ACMAXDENSE);
+	if (dense)  /* complete table plus outputs */
+		sz = (size_t)ns * nclasses + 2 * (size_t)ns;
+	else  /* root table, edges, failure links, and outputs */
+		sz = nclasses + ((size_t)ns + 1) + 2 * (size_t)ns + 3 * (size_t)ns;
+	ac = (ACMachine*)lua_newuserdatauv(L, offsetof(ACMachine, v) +
+		sz * sizeof(int), 0);
+	ac->nclasses = nclasses;
+	ac->nstates = ns;
+	ac->maxlen = maxlen;
+	ac->dense = dense;
+	memcpy(ac->cls, cls, sizeof(cls));
+	ac->delta = 0;
+	if (dense) {
+		ac->outlen = (size_t)ns * nclasses;
+		ac->first = ac->ecls = ac->etgt = ac->fail = 0;  /* not used */
+	}
+	else {
+		ac->first = nclasses;
+		ac->ecls = ac->first + ns + 1;
+		ac->etgt = ac->ecls + ns;
+		ac->fail = ac->etgt + ns;
+		ac->outlen = ac->fail + ns;
+	}
+	ac->outidx = ac->outlen + ns;
+	v = ac->v;
+	for (c = 0; c < nclasses; c++)  /* the root */
+		v[ac->delta + c] = t.root[c];
+	if (dense) {
+		for (st = 0; st < ns - 1; st++) {  /* the others, breadth first */
+			int s = t.queue[st];
+			int* row = v + (size_t)s * nclasses;
+			int ch;
+			memcpy(row, v + (size_t)t.fail[s] * nclasses, nclasses * sizeof(int));
+			for (ch = t.child[s]; ch != 0; ch = t.sib[ch])
+				row[t.label[ch]] = ch;
+		}
+	}
+	else {
+		int ne = 0;
+		for (st = 0; st < ns; st++) {  /* edges of each state */
+			int ch;
+			v[ac->first + st] = ne;
+			if (st != 0) {
+				for (ch = t.child[st]; ch != 0; ch = t.sib[ch]) {
+					v[ac->ecls + ne] = t.label[ch];
+					v[ac->etgt + ne] = ch;
+					ne++;
+				}
+			}
+		}
+		v[ac->first + ns] = ne;
+		memcpy(v + ac->fail, t.fail, ns * sizeof(int));
+	}
+	memcpy(v + ac->outlen, t.outlen, ns * sizeof(int));
+	memcpy(v + ac->outidx, t.outidx, ns * sizeof(int));
+	lua_remove(L, -2);  /* remove the trie */
+	return ac;
+}
+
+
+/* transition from state 'st' by class 'c' */
+static int acstep(const ACMachine* ac, int st, int c) {
+	const int* v = ac->v;
+	if (ac->dense)
+		return v[ac->delta + (size_t)st * ac->nclasses + c];
+	for (;;) {
+		int e, ee;
+		if (st == 0)
+			return v[ac->delta + c];
+		for (e = v[ac->first + st], ee = v[ac->first + st + 1]; e < ee; e++)
+			if (v[ac->ecls + e] == c) return v[ac->etgt + e];
+		st = v[ac->fail + st];
+	}
+}
+
+
+/*
+** Pushes the results of the search with matcher 'ac' in the string at
+** index 'sarg', from the position at index 'iarg'.
+*/
+static int acfind(lua_State* L, const ACMachine* ac, int sarg, int iarg) {
+	size_t ls;
+	const char* s = luaL_checklstring(L, sarg, &ls);
+	size_t init = posrelatI(luaL_optinteger(L, iarg, 1), ls) - 1;
+	const int* root = acarr(ac, delta);
+	const int* outlen = acarr(ac, outlen);
+	size_t i, best = 0, bestend = 0;
+	int st = 0, bestidx = 0;
+	for (i = init; i < ls; i++) {
+		if (st == 0) {  /* at the root? skip bytes that start no string */
+			while (i < ls && root[ac->cls[uchar(s[i])]] == 0)
+				i++;
+			if (i == ls) break;
+		}
+		st = acstep(ac, st, ac->cls[uchar(s[i])]);
+		if (outlen[st] != 0) {  /* some string ends here? */
+			size_t start = i + 1 - outlen[st];
+			if (bestidx == 0 || start <= best) {  /* leftmost (or longer)? */
+				best = start; bestend = i; bestidx = acarr(ac, outidx)[st];
+			}
+		}
+		if (bestidx != 0 && i + 1 >= best + ac->maxlen)
+			break;  /* no later match can start at or before 'best' */
+	}
+	if (bestidx == 0) {
+		luaL_pushfail(L);  /* not found */
+		return 1;
+	}
+	lua_pushinteger(L, (lua_Integer)best + 1);
+	lua_pushinteger(L, (lua_Integer)bestend + 1);
+	lua_pushinteger(L, bestidx);
+	return 3;
+}
+
+
+/*
+** string.compileany(list): returns a matcher for the (non-empty)
+** strings in 'list', which may change afterwards without affecting it.
+*/
+static int str_compileany(lua_State* L) {
+	newacmachine(L, 1);
+	luaL_setmetatable(L, ACMATCHER_TNAME);
+	return 1;
+}
+
+
+/*
+** string.findany(s, list [, init]): finds the first occurrence in 's'
+** of any of the (non-empty) strings in 'list', as plain strings.
+** Returns its start, its end, and the index of the string in the list.
+** Among strings starting at the same position, the longest wins.
+** 'list' is a matcher from 'string.compileany' or a table; a table is
+** compiled anew on each call.
+*/
+static int str_findany(lua_State* L) {
+	const ACMachine* ac =
+		(const ACMachine*)luaL_testudata(L, 2, ACMATCHER_TNAME);
+	if (ac == NULL) {
+		if (l_unlikely(!lua_istable(L, 2)))
+			luaL_typeerror(L, 2, "table or matcher");
+		lua_settop(L, 3);  /* keep 'init' in its place */
+		ac = newacmachine(L, 2);
+	}
+	return acfind(L, ac, 1, 3);
+}
+
+
+/* matcher:find(s [, init]) */
+static int acm_find(lua_State* L) {
+	const ACMachine* ac =
+		(const ACMachine*)luaL_checkudata(L, 1, ACMATCHER_TNAME);
+	return acfind(L, ac, 2, 3);
+}
+
+
+static void createacmeta(lua_State* L) {
+	luaL_newmetatable(L, ACMATCHER_TNAME);  /* metatable for matchers */
+	lua_createtable(L, 0, 1);  /* method table */
+	lua_pushcfunction(L, acm_find);
+	lua_setfield(L, -2, "find");
+	lua_setfield(L, -2, "__index");  /* metatable.__index = method table */
+	lua_pushboolean(L, 1);
+	lua_setfield(L, -2, "__copy");  /* matchers own nothing ('lua_freeze') */
+	lua_pop(L, 1);  /* pop metatable */
+}
+
+
+/*
+** State for 'gmatch'. It points only into the strings kept by its
+** closure, which clones share with their template; the compiled pattern
+** (also in the closure) is taken again at each call.
+*/
+#define GMATCH_TNAME	"_GMATCH*"
+
 typedef struct GMatchState {
 	const char* src;  /* current position */
 	const char* p;  /* pattern */
@@ -836,13 +1877,21 @@ typedef struct GMatchState {
 
 
 static int gmatch_aux(lua_State* L) {
-	GMatchState* gm = (GMatchState*)lua_touserdata(L, lua_upvalueindex(3));
+	GMatchState* gm = (GMatchState*)lua_touserdata(L, lua_upvalueindex(4));
+	const CPattern* cp =
+		(const CPattern*)lua_touserdata(L, lua_upvalueindex(3));
 	const char* src;
 	gm->ms.L = L;
+	gm->ms.cp = NULL;
+	if (cp != NULL && !cp->anchor)  /* ('^' is not an anchor here) */
+		gm->ms.cp = cp;
 	for (src = gm->src; src <= gm->ms.src_end; src++) {
 		const char* e;
+		if (gm->ms.cp != NULL &&
+			(src = firstpos(gm->ms.cp, src, gm->ms.src_end)) == NULL)
+			break;  /* no more places where a match can start */
 		reprepstate(&gm->ms);
-		if ((e = match(&gm->ms, src, gm->p)) != NULL && e != gm->lastmatch) {
+		if ((e = domatch(&gm->ms, src, gm->p)) != NULL && e != gm->lastmatch) {
 			gm->src = gm->lastmatch = e;
 			return push_captures(&gm->ms, src, e);
 		}
@@ -858,12 +1907,14 @@ static int gmatch(lua_State* L) {
 	size_t init = posrelatI(luaL_optinteger(L, 3, 1), ls) - 1;
 	GMatchState* gm;
 	lua_settop(L, 2);  /* keep strings on closure to avoid being collected */
+	getcpattern(L, 2);  /* also kept on closure */
 	gm = (GMatchState*)lua_newuserdatauv(L, sizeof(GMatchState), 0);
+	luaL_setmetatable(L, GMATCH_TNAME);
 	if (init > ls)  /* start after string's end? */
 		init = ls + 1;  /* avoid overflows in 's + init' */
 	prepstate(&gm->ms, L, s, ls, p, lp);
 	gm->src = s + init; gm->p = p; gm->lastmatch = NULL;
-	lua_pushcclosure(L, gmatch_aux, 3);
+	lua_pushcclosure(L, gmatch_aux, 4);
 	return 1;
 }
 
@@ -949,20 +2000,30 @@ static int str_gsub(lua_State* L) {
 	int anchor = (*p == '^');
 	lua_Integer n = 0;  /* replacement count */
 	int changed = 0;  /* change flag */
+	const CPattern* cp;
 	MatchState ms;
 	luaL_Buffer b;
 	luaL_argexpected(L, tr == LUA_TNUMBER || tr == LUA_TSTRING ||
 		tr == LUA_TFUNCTION || tr == LUA_TTABLE, 3,
 		"string/function/table");
+	cp = getcpattern(L, 2);
 	luaL_buffinit(L, &b);
 	if (anchor) {
 		p++; lp--;  /* skip anchor character */
 	}
 	prepstate(&ms, L, src, srcl, p, lp);
+	ms.cp = cp;
 	while (n < max_s) {
 		const char* e;
+		if (cp != NULL && !anchor) {  /* copy what no match can replace */
+			const char* next = firstpos(cp, src, ms.src_end);
+			if (next == NULL)
+				next = ms.src_end;
+			luaL_addlstring(&b, src, next - src);
+			src = next;
+		}
 		reprepstate(&ms);  /* (re)prepare state for new match */
-		if ((e = match(&ms, src, p)) != NULL && e != lastmatch) {  /* match? */
+		if ((e = domatch(&ms, src, p)) != NULL && e != lastmatch) {  /* match? */
 			n++;
 			changed = add_value(&ms, &b, src, e, tr) | changed;
 			src = lastmatch = e;
@@ -1270,27 +2331,44 @@ static void addlenmod(char* form, const char* lenmod) {
 }
 
 
-static int str_format(lua_State* L) {
-	int top = lua_gettop(L);
-	int arg = 1;
+/*
+** Precision of a format "%g" or "%.<n>g" (without flags or width),
+** which 'lua_fmtnumber' can handle; -1 for any other format.
+*/
+static int gprecision(const char* form) {
+	const char* p = form + 1;
+	int prec = 6;  /* default precision */
+	if (*p == '.') {
+		prec = 0;
+		while (isdigit(uchar(*++p)))
+			prec = prec * 10 + (*p - '0');
+	}
+	return (p[0] == 'g' && p[1] == '\0' && prec <= 20) ? prec : -1;
+}
+
+
+/*
+** Add to buffer 'b' the result of formatting the values after index
+** 'arg' (up to 'top') with the format at index 'arg'. ('b' must be
+** initialized after 'top' was computed, as it uses a stack slot.)
+*/
+static void addformat(lua_State* L, luaL_Buffer* pb, int arg, int top) {
 	size_t sfl;
 	const char* strfrmt = luaL_checklstring(L, arg, &sfl);
 	const char* strfrmt_end = strfrmt + sfl;
 	const char* flags;
-	luaL_Buffer b;
-	luaL_buffinit(L, &b);
 	while (strfrmt < strfrmt_end) {
 		if (*strfrmt != L_ESC)
-			luaL_addchar(&b, *strfrmt++);
+			luaL_addchar(pb, *strfrmt++);
 		else if (*++strfrmt == L_ESC)
-			luaL_addchar(&b, *strfrmt++);  /* %% */
+			luaL_addchar(pb, *strfrmt++);  /* %% */
 		else { /* format item */
 			char form[MAX_FORMAT];  /* to store the format ('%...') */
 			int maxitem = MAX_ITEM;  /* maximum length for the result */
-			char* buff = luaL_prepbuffsize(&b, maxitem);  /* to put result */
+			char* buff = luaL_prepbuffsize(pb, maxitem);  /* to put result */
 			int nb = 0;  /* number of bytes in result */
 			if (++arg > top)
-				return luaL_argerror(L, arg, "no value");
+				luaL_argerror(L, arg, "no value");
 			strfrmt = getformat(L, strfrmt, form);
 			switch (*strfrmt++) {
 			case 'c': {
@@ -1309,8 +2387,12 @@ static int str_format(lua_State* L) {
 			intcase: {
 				lua_Integer n = luaL_checkinteger(L, arg);
 				checkformat(L, form, flags, 1);
-				addlenmod(form, LUA_INTEGER_FRMLEN);
-				nb = l_sprintf(buff, maxitem, form, (LUAI_UACINT)n);
+				if (form[2] == '\0' && (form[1] == 'd' || form[1] == 'i'))
+					nb = (int)lua_fmtinteger(L, n, buff);  /* plain '%d' */
+				else {
+					addlenmod(form, LUA_INTEGER_FRMLEN);
+					nb = l_sprintf(buff, maxitem, form, (LUAI_UACINT)n);
+				}
 				break;
 				}
 			case 'a': case 'A':
@@ -1321,13 +2403,18 @@ static int str_format(lua_State* L) {
 				break;
 			case 'f':
 				maxitem = MAX_ITEMF;  /* extra space for '%f' */
-				buff = luaL_prepbuffsize(&b, maxitem);
+				buff = luaL_prepbuffsize(pb, maxitem);
 				/* FALLTHROUGH */
 			case 'e': case 'E': case 'g': case 'G': {
 				lua_Number n = luaL_checknumber(L, arg);
+				int prec;
 				checkformat(L, form, L_FMTFLAGSF, 1);
-				addlenmod(form, LUA_NUMBER_FRMLEN);
-				nb = l_sprintf(buff, maxitem, form, (LUAI_UACNUMBER)n);
+				if ((prec = gprecision(form)) >= 0)  /* plain '%g'? */
+					nb = (int)lua_fmtnumber(L, n, prec, buff);
+				else {
+					addlenmod(form, LUA_NUMBER_FRMLEN);
+					nb = l_sprintf(buff, maxitem, form, (LUAI_UACNUMBER)n);
+				}
 				break;
 			}
 			case 'p': {
@@ -1342,21 +2429,21 @@ static int str_format(lua_State* L) {
 			}
 			case 'q': {
 				if (form[2] != '\0')  /* modifiers? */
-					return luaL_error(L, "specifier '%%q' cannot have modifiers");
-				addliteral(L, &b, arg);
+					luaL_error(L, "specifier '%%q' cannot have modifiers");
+				addliteral(L, pb, arg);
 				break;
 			}
 			case 's': {
 				size_t l;
 				const char* s = luaL_tolstring(L, arg, &l);
 				if (form[2] == '\0')  /* no modifiers? */
-					luaL_addvalue(&b);  /* keep entire string */
+					luaL_addvalue(pb);  /* keep entire string */
 				else {
 					luaL_argcheck(L, l == strlen(s), arg, "string contains zeros");
 					checkformat(L, form, L_FMTFLAGSC, 1);
 					if (strchr(form, '.') == NULL && l >= 100) {
 						/* no precision and string is too long to be formatted */
-						luaL_addvalue(&b);  /* keep entire string */
+						luaL_addvalue(pb);  /* keep entire string */
 					}
 					else {  /* format the string into 'buff' */
 						nb = l_sprintf(buff, maxitem, form, s);
@@ -1366,13 +2453,21 @@ static int str_format(lua_State* L) {
 				break;
 			}
 			default: {  /* also treat cases 'pnLlh' */
-				return luaL_error(L, "invalid conversion '%s' to 'format'", form);
+				luaL_error(L, "invalid conversion '%s' to 'format'", form);
 			}
 			}
 			lua_assert(nb < maxitem);
-			luaL_addsize(&b, nb);
+			luaL_addsize(pb, nb);
 		}
 	}
+}
+
+
+static int str_format(lua_State* L) {
+	int top = lua_gettop(L);
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	addformat(L, &b, 1, top);
 	luaL_pushresult(&b);
 	return 1;
 }
@@ -1380,6 +2475,232 @@ static int str_format(lua_State* L) {
 /* }====================================================== */
 
 
+/*
+** {======================================================
+** STRING BUFFERS
+** =======================================================
+*/
+
+#define STRBUF_TNAME	"strbuf"
+
+/* minimum capacity of a string buffer */
+#define STRBUF_MINSIZE	32
+
+
+/*
+** A string buffer keeps its storage until it is collected, so that
+** resetting and refilling it (e.g., once per tick) does not allocate.
+** The storage is a plain userdata, the buffer's user value, so that it
+** is part of the Lua heap (for the collector and the heap profiler) and
+** is collected with the buffer.
+*/
+typedef struct StrBuf {
+	char* p;  /* contents (not '\0'-terminated), in the user value */
+	size_t n;  /* number of bytes in use */
+	size_t size;  /* capacity */
+} StrBuf;
+
+
+#define checkstrbuf(L,i)	((StrBuf*)luaL_checkudata(L, i, STRBUF_TNAME))
+
+
+/*
+** Ensure space for 'extra' more bytes in buffer 'sb' (at index 1) and
+** return the address where they go.
+*/
+static char* sbprep(lua_State* L, StrBuf* sb, size_t extra) {
+	if (sb->size - sb->n < extra) {  /* not enough space? */
+		size_t newsize = (sb->size / 2) * 3;  /* buffer size * 1.5 */
+		char* np;
+		if (l_unlikely(MAXSIZE - extra < sb->n))  /* overflow in (n + extra)? */
+			luaL_error(L, "buffer too large");
+		if (newsize < sb->n + extra)  /* not big enough? */
+			newsize = sb->n + extra;
+		if (newsize < STRBUF_MINSIZE)
+			newsize = STRBUF_MINSIZE;
+		np = (char*)lua_newuserdatauv(L, newsize, 0);
+		if (sb->n > 0)
+			memcpy(np, sb->p, sb->n * sizeof(char));
+		lua_setiuservalue(L, 1, 1);  /* old storage is now garbage */
+		sb->p = np;
+		sb->size = newsize;
+	}
+	return sb->p + sb->n;
+}
+
+
+static void sbaddlstring(lua_State* L, StrBuf* sb, const char* s, size_t l) {
+	if (l > 0) {  /* avoid 'memcpy' when 's' can be NULL */
+		memcpy(sbprep(L, sb, l), s, l * sizeof(char));
+		sb->n += l;
+	}
+}
+
+
+/*
+** Add the value at index 'arg' to the buffer, with the same conversions
+** as the concatenation operator, but without creating strings for
+** numbers. Other string buffers are also accepted.
+*/
+static void sbaddvalue(lua_State* L, StrBuf* sb, int arg) {
+	switch (lua_type(L, arg)) {
+	case LUA_TSTRING: {
+		size_t l;
+		const char* s = lua_tolstring(L, arg, &l);
+		sbaddlstring(L, sb, s, l);
+		break;
+	}
+	case LUA_TNUMBER: {
+		char* p = sbprep(L, sb, LUA_N2SBUFFSZ);
+		unsigned len;
+		if (lua_isinteger(L, arg))
+			len = lua_fmtinteger(L, lua_tointeger(L, arg), p);
+		else {
+			len = lua_fmtnumber(L, lua_tonumber(L, arg), -1, p);
+			if (p[strspn(p, "-0123456789")] == '\0') {  /* looks like an int? */
+				p[len++] = lua_getlocaledecpoint();
+				p[len++] = '0';  /* adds '.0' to result, as 'tostring' */
+			}
+		}
+		sb->n += len;
+		break;
+	}
+	default: {
+		StrBuf* other = (StrBuf*)luaL_testudata(L, arg, STRBUF_TNAME);
+		if (other == NULL)
+			luaL_typeerror(L, arg, "string, number or buffer");
+		sbprep(L, sb, other->n);  /* may move 'other->p' if other == sb */
+		sbaddlstring(L, sb, other->p, other->n);
+		break;
+	}
+	}
+}
+
+
+static int str_newbuffer(lua_State* L) {
+	lua_Integer size = luaL_optinteger(L, 1, 0);
+	StrBuf* sb;
+	luaL_argcheck(L, 0 <= size && (lua_Unsigned)size <= MAXSIZE, 1,
+		"invalid size");
+	lua_settop(L, 0);  /* buffer goes to index 1, for 'sbprep' */
+	sb = (StrBuf*)lua_newuserdatauv(L, sizeof(StrBuf), 1);
+	sb->p = NULL;
+	sb->n = sb->size = 0;
+	luaL_setmetatable(L, STRBUF_TNAME);
+	if (size > 0)
+		sbprep(L, sb, (size_t)size);
+	return 1;
+}
+
+
+static int sb_append(lua_State* L) {
+	StrBuf* sb = checkstrbuf(L, 1);
+	int top = lua_gettop(L);
+	int arg;
+	for (arg = 2; arg <= top; arg++)
+		sbaddvalue(L, sb, arg);
+	lua_settop(L, 1);
+	return 1;  /* return buffer */
+}
+
+
+static int sb_appendf(lua_State* L) {
+	StrBuf* sb = checkstrbuf(L, 1);
+	int top = lua_gettop(L);
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);  /* format in the stack, usually */
+	addformat(L, &b, 2, top);
+	sbaddlstring(L, sb, luaL_buffaddr(&b), luaL_bufflen(&b));
+	lua_settop(L, 1);
+	return 1;  /* return buffer */
+}
+
+
+static int sb_rep(lua_State* L) {
+	StrBuf* sb = checkstrbuf(L, 1);
+	size_t l, lsep;
+	const char* s = luaL_checklstring(L, 2, &l);
+	lua_Integer n = luaL_checkinteger(L, 3);
+	const char* sep = luaL_optlstring(L, 4, "", &lsep);
+	if (n > 0) {
+		char* p;
+		if (l_unlikely(l + lsep < l || l + lsep > MAXSIZE / n))
+			return luaL_error(L, "resulting string too large");
+		p = sbprep(L, sb, (size_t)n * l + (size_t)(n - 1) * lsep);
+		while (n-- > 1) {  /* first n-1 copies (followed by separator) */
+			memcpy(p, s, l * sizeof(char)); p += l;
+			if (lsep > 0) {  /* empty 'memcpy' is not that cheap */
+				memcpy(p, sep, lsep * sizeof(char));
+				p += lsep;
+			}
+		}
+		memcpy(p, s, l * sizeof(char));  /* last copy */
+		sb->n = (size_t)(p + l - sb->p);
+	}
+	lua_settop(L, 1);
+	return 1;  /* return buffer */
+}
+
+
+static int sb_reset(lua_State* L) {
+	StrBuf* sb = checkstrbuf(L, 1);
+	sb->n = 0;  /* keep storage */
+	lua_settop(L, 1);
+	return 1;  /* return buffer */
+}
+
+
+static int sb_len(lua_State* L) {
+	StrBuf* sb = checkstrbuf(L, 1);
+	lua_pushinteger(L, (lua_Integer)sb->n);
+	return 1;
+}
+
+
+static int sb_tostring(lua_State* L) {
+	StrBuf* sb = checkstrbuf(L, 1);
+	lua_pushlstring(L, sb->p, sb->n);
+	return 1;
+}
+
+
+/*
+** methods for string buffers
+*/
+static const luaL_Reg sbmeth[] = {
+  {"append", sb_append},
+  {"appendf", sb_appendf},
+  {"rep", sb_rep},
+  {"reset", sb_reset},
+  {"len", sb_len},
+  {"tostring", sb_tostring},
+  {NULL, NULL}
+};
+
+
+/*
+** metamethods for string buffers
+*/
+static const luaL_Reg sbmetameth[] = {
+  {"__index", NULL},  /* placeholder */
+  {"__len", sb_len},
+  {"__tostring", sb_tostring},
+  {NULL, NULL}
+};
+
+
+static void createsbmeta(lua_State* L) {
+	luaL_newmetatable(L, STRBUF_TNAME);  /* metatable for string buffers */
+	luaL_setfuncs(L, sbmetameth, 0);  /* add metamethods to new metatable */
+	luaL_newlibtable(L, sbmeth);  /* create method table */
+	luaL_setfuncs(L, sbmeth, 0);  /* add methods to method table */
+	lua_setfield(L, -2, "__index");  /* metatable.__index = method table */
+	lua_pop(L, 1);  /* pop metatable */
+}
+
+/* }====================================================== */
+
+
 /*
 ** {======================================================
 ** PACK/UNPACK
@@ -1830,14 +3151,17 @@ static int str_unpack(lua_State* L) {
 static const luaL_Reg strlib[] = {
   {"byte", str_byte},
   {"char", str_char},
+  {"compileany", str_compileany},
   {"dump", str_dump},
   {"find", str_find},
+  {"findany", str_findany},
   {"format", str_format},
   {"gmatch", gmatch},
   {"gsub", str_gsub},
   {"len", str_len},
   {"lower", str_lower},
   {"match", str_match},
+  {"newbuffer", str_newbuffer},
   {"rep", str_rep},
   {"reverse", str_reverse},
   {"sub", str_sub},
@@ -1863,12 +3187,31 @@ static void createmetatable(lua_State* L) {
 }
 
 
+/*
+** Creates the metatable 'tname' for internal userdata that own nothing
+** and so can be copied by 'lua_freeze'.
+*/
+static void createplainmeta(lua_State* L, const char* tname) {
+	luaL_newmetatable(L, tname);
+	lua_pushboolean(L, 1);
+	lua_setfield(L, -2, "__copy");
+	lua_pop(L, 1);  /* pop metatable */
+}
+
+
 /*
 ** Open string library
 */
 LUAMOD_API int luaopen_string(lua_State* L) {
-	luaL_newlib(L, strlib);
+	luaL_newlibtable(L, strlib);
+	/* cache of compiled patterns, shared by all functions */
+	luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PATCACHE_TABLE);
+	luaL_setfuncs(L, strlib, 1);
 	createmetatable(L);
+	createsbmeta(L);
+	createacmeta(L);
+	createplainmeta(L, CPATTERN_TNAME);
+	createplainmeta(L, GMATCH_TNAME);
 	return 1;
 }
 
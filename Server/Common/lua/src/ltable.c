@@ -21,10 +21,18 @@
 ** in its main position (i.e. the 'original' position that its hash gives
 ** to it), then the colliding element is in its own main position.
 ** Hence even when the load factor reaches 100%, performance remains good.
+** With LUA_USE_SWISSTABLE, the hash part is instead an open-addressing
+** table: each node has a control byte, kept after the nodes, that is
+** either "empty" or holds 7 bits of the hash of the node's key. Searches
+** compare a whole group of control bytes at a time against the bits of
+** the key and only look at the nodes that match. A removed entry keeps
+** its control byte (so there are no tombstones) until a new key reuses
+** its node or the table is rehashed.
 */
 
 #include <math.h>
 #include <limits.h>
+#include <string.h>
 
 #include "lua.h"
 
@@ -88,6 +96,8 @@
 #define hashpointer(t,p)	hashmod(t, point2uint(p))
 
 
+#if !defined(LUA_USE_SWISSTABLE)
+
 #define dummynode		(&dummynode_)
 
 static const Node dummynode_ = {
@@ -95,6 +105,8 @@ static const Node dummynode_ = {
    LUA_VNIL, 0, {NULL}}  /* key type, next, and key value */
 };
 
+#endif
+
 
 static const TValue absentkey = { ABSTKEYCONSTANT };
 
@@ -105,6 +117,7 @@ static const TValue absentkey = { ABSTKEYCONSTANT };
 ** remainder, which is faster. Otherwise, use an unsigned-integer
 ** remainder, which uses all bits and ensures a non-negative result.
 */
+#if !defined(LUA_USE_SWISSTABLE)
 static Node* hashint(const Table* t, lua_Integer i) {
 	lua_Unsigned ui = l_castS2U(i);
 	if (ui <= cast_uint(INT_MAX))
@@ -112,6 +125,7 @@ static Node* hashint(const Table* t, lua_Integer i) {
 	else
 		return hashmod(t, ui);
 }
+#endif
 
 
 /*
@@ -144,6 +158,8 @@ static int l_hashfloat(lua_Number n) {
 #endif
 
 
+#if !defined(LUA_USE_SWISSTABLE)
+
 /*
 ** returns the 'main' position of an element in a table (that is,
 ** the index of its hash value).
@@ -192,6 +208,213 @@ l_sinline Node* mainpositionfromnode(const Table* t, Node* nd) {
 	return mainpositionTV(t, &key);
 }
 
+#else
+
+/*
+** {=============================================================
+** Open-addressing hash part
+** ==============================================================
+*/
+
+/* number of control bytes compared at once */
+#define GROUPSIZE	16
+
+/* control byte of an empty node (bytes of used nodes are below 0x80) */
+#define CTRLEMPTY	0x80
+
+/* control byte for a key with hash 'h' */
+#define hash2(h)	cast_byte(((h) >> 25) & 0x7f)
+
+/*
+** Control bytes of table 't'. They follow the nodes in the same block,
+** and the first GROUPSIZE - 1 of them are repeated after the last one
+** (all of them, repeatedly, when there are fewer nodes), so that a
+** group starting at any node can be read without wrapping around.
+*/
+#define gctrl(t)	cast(lu_byte*, gnode(t, sizenode(t)))
+
+/* size of a block with 'n' nodes and their control bytes */
+#define hashpartsize(n)	((n) * sizeof(Node) + (n) + (GROUPSIZE - 1))
+
+/* maximum number of keys in a hash part with 'n' nodes */
+#define maxkeys(n)	((n) - ((n) >> 3))
+
+
+#define dummynode		(&dummynode_.n)
+
+static const struct {
+	Node n;
+	lu_byte ctrl[GROUPSIZE];
+} dummynode_ = {
+  {{{NULL}, LUA_VEMPTY,  /* value's value and type */
+    LUA_VNIL, 0, {NULL}}},  /* key type, next, and key value */
+  {CTRLEMPTY, CTRLEMPTY, CTRLEMPTY, CTRLEMPTY,
+   CTRLEMPTY, CTRLEMPTY, CTRLEMPTY, CTRLEMPTY,
+   CTRLEMPTY, CTRLEMPTY, CTRLEMPTY, CTRLEMPTY,
+   CTRLEMPTY, CTRLEMPTY, CTRLEMPTY, CTRLEMPTY}
+};
+
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+#include <emmintrin.h>
+
+/* mask with the bits of the control bytes in group 'g' equal to 'c' */
+#define matchgroup(g,c)  \
+  cast_uint(_mm_movemask_epi8(_mm_cmpeq_epi8(  \
+    _mm_loadu_si128(cast(const __m128i*, (g))), _mm_set1_epi8(cast(char, (c))))))
+
+/* mask with the bits of the empty control bytes in group 'g' */
+#define matchempty(g)  \
+  cast_uint(_mm_movemask_epi8(_mm_loadu_si128(cast(const __m128i*, (g)))))
+
+#else
+
+static unsigned int matchgroup(const lu_byte* g, lu_byte c) {
+	unsigned int m = 0;
+	int i;
+	for (i = 0; i < GROUPSIZE; i++)
+		m |= cast_uint(g[i] == c) << i;
+	return m;
+}
+
+#define matchempty(g)	matchgroup(g, CTRLEMPTY)
+
+#endif
+
+
+/* index of the lowest bit set in (non-zero) mask 'm' */
+#if defined(__GNUC__)
+#define lowbit(m)	cast_uint(__builtin_ctz(m))
+#elif defined(_MSC_VER)
+#include <intrin.h>
+static unsigned int lowbit(unsigned int m) {
+	unsigned long i;
+	_BitScanForward(&i, m);
+	return cast_uint(i);
+}
+#else
+static unsigned int lowbit(unsigned int m) {
+	unsigned int i = 0;
+	while (!(m & 1u)) { m >>= 1; i++; }
+	return i;
+}
+#endif
+
+
+/*
+** Mix the bits of a raw hash value, so that both the node position
+** (low bits) and the control byte (high bits) depend on all of them.
+** (Raw hashes of pointers have their low bits always zero, and raw
+** hashes of small integers have their high bits always zero.)
+*/
+l_sinline unsigned int mixhash(unsigned int h) {
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	return h;
+}
+
+
+l_sinline unsigned int hashinteger(lua_Integer i) {
+	lua_Unsigned ui = l_castS2U(i);
+	return mixhash(cast_uint(ui ^ (ui >> (sizeof(ui) * CHAR_BIT / 2))));
+}
+
+
+static unsigned int hashkey(const TValue* key) {
+	switch (ttypetag(key)) {
+	case LUA_VNUMINT:
+		return hashinteger(ivalue(key));
+	case LUA_VNUMFLT:
+		return mixhash(cast_uint(l_hashfloat(fltvalue(key))));
+	case LUA_VSHRSTR:
+		return mixhash(tsvalue(key)->hash);
+	case LUA_VLNGSTR:
+		return mixhash(luaS_hashlongstr(tsvalue(key)));
+	case LUA_VFALSE:
+		return mixhash(0);
+	case LUA_VTRUE:
+		return mixhash(1);
+	case LUA_VLIGHTUSERDATA:
+		return mixhash(point2uint(pvalue(key)));
+	case LUA_VLCF:
+		return mixhash(point2uint(fvalue(key)));
+	default:
+		return mixhash(point2uint(gcvalue(key)));
+	}
+}
+
+
+/*
+** Search the hash part of table 't' for a key with hash 'h', returning
+** the value of the node 'n' for which 'eq' is true, or 'absentkey'.
+** Groups are probed in a triangular sequence (start, start + 16,
+** start + 48, ...), which visits every node of a table whose size is a
+** power of 2 within 'size / 16' probes. A group with an empty node ends
+** the search, as an insertion would have used that node.
+*/
+#define searchhash(t,h,eq) {  \
+  lu_byte *ctrl_ = gctrl(t);  \
+  unsigned int mask_ = cast_uint(sizenode(t)) - 1u;  \
+  unsigned int pos_ = (h) & mask_;  \
+  unsigned int step_ = 0;  \
+  for (;;) {  \
+    unsigned int m_ = matchgroup(ctrl_ + pos_, hash2(h));  \
+    while (m_ != 0) {  \
+      Node *n = gnode(t, (pos_ + lowbit(m_)) & mask_);  \
+      if (eq) return gval(n);  \
+      m_ &= m_ - 1u;  \
+    }  \
+    if (matchempty(ctrl_ + pos_) != 0 || (step_ += GROUPSIZE) > mask_)  \
+      return &absentkey;  \
+    pos_ = (pos_ + step_) & mask_;  \
+  }}
+
+
+/*
+** Take a node for a new key with hash 'h', setting its control byte
+** (and the repeated copies of that byte). The node is the first one in
+** the key's probe sequence that is either empty or holds a removed
+** entry (empty value). Reusing removed entries keeps a new key ahead of
+** any dead copy of itself left by the collector, so that 'luaH_next'
+** (which also matches dead keys) finds the live one first.
+*/
+static Node* getfreepos(Table* t, unsigned int h) {
+	lu_byte* ctrl = gctrl(t);
+	unsigned int size = cast_uint(sizenode(t));
+	unsigned int mask = size - 1u;
+	unsigned int pos = h & mask;
+	unsigned int step = 0;
+	unsigned int idx, i;
+	lua_assert(t->nfree > 0);
+	for (;;) {
+		unsigned int m = matchempty(ctrl + pos);
+		unsigned int lim = (m != 0) ? lowbit(m) : GROUPSIZE;
+		for (i = 0; i < lim; i++) {  /* removed entry before first empty? */
+			idx = (pos + i) & mask;
+			if (isempty(gval(gnode(t, idx))))
+				goto found;
+		}
+		if (m != 0) {  /* take the empty node */
+			idx = (pos + lim) & mask;
+			t->nfree--;
+			goto found;
+		}
+		step += GROUPSIZE;
+		pos = (pos + step) & mask;
+	}
+ found:
+	for (i = idx; i < size + (GROUPSIZE - 1); i += size)
+		ctrl[i] = hash2(h);
+	return gnode(t, idx);
+}
+
+/* }============================================================= */
+
+#endif
+
 
 /*
 ** Check whether key 'k1' is equal to the key in node 'n2'. This
@@ -297,6 +520,10 @@ static unsigned int setlimittosize(Table* t) {
 ** See explanation about 'deadok' in function 'equalkey'.
 */
 static const TValue* getgeneric(Table* t, const TValue* key, int deadok) {
+#if defined(LUA_USE_SWISSTABLE)
+	unsigned int h = hashkey(key);
+	searchhash(t, h, equalkey(key, n, deadok));
+#else
 	Node* n = mainpositionTV(t, key);
 	for (;;) {  /* check whether 'key' is somewhere in the chain */
 		if (equalkey(key, n, deadok))
@@ -308,6 +535,7 @@ static const TValue* getgeneric(Table* t, const TValue* key, int deadok) {
 			n += nx;
 		}
 	}
+#endif
 }
 
 
@@ -337,6 +565,15 @@ static unsigned int findindex(lua_State* L, Table* t, TValue* key,
 		return i;  /* yes; that's the index */
 	else {
 		const TValue* n = getgeneric(t, key, 1);
+		if (isabstkey(n) && t->oldhash != NULL) {  /* not migrated yet? */
+			Table* ot = t->oldhash;
+			n = getgeneric(ot, key, 1);
+			if (l_unlikely(isabstkey(n)))
+				luaG_runerror(L, "invalid key to 'next'");  /* key not found */
+			i = cast_int(nodefromval(n) - gnode(ot, 0));
+			/* old hash elements are numbered after the new hash ones */
+			return (i + 1) + asize + sizenode(t);
+		}
 		if (l_unlikely(isabstkey(n)))
 			luaG_runerror(L, "invalid key to 'next'");  /* key not found */
 		i = cast_int(nodefromval(n) - gnode(t, 0));  /* key index in hash table */
@@ -346,6 +583,23 @@ static unsigned int findindex(lua_State* L, Table* t, TValue* key,
 }
 
 
+/*
+** Find the first non-empty entry in the hash part of 't' from index 'i'
+** on and put its key and value in 'key' and 'key + 1'.
+*/
+static int nextinhash(lua_State* L, Table* t, unsigned int i, StkId key) {
+	for (; cast_int(i) < sizenode(t); i++) {
+		if (!isempty(gval(gnode(t, i)))) {  /* a non-empty entry? */
+			Node* n = gnode(t, i);
+			getnodekey(L, s2v(key), n);
+			setobj2s(L, key + 1, gval(n));
+			return 1;
+		}
+	}
+	return 0;  /* no more elements */
+}
+
+
 int luaH_next(lua_State* L, Table* t, StkId key) {
 	unsigned int asize = luaH_realasize(t);
 	unsigned int i = findindex(L, t, s2v(key), asize);  /* find original key */
@@ -356,21 +610,25 @@ int luaH_next(lua_State* L, Table* t, StkId key) {
 			return 1;
 		}
 	}
-	for (i -= asize; cast_int(i) < sizenode(t); i++) {  /* hash part */
-		if (!isempty(gval(gnode(t, i)))) {  /* a non-empty entry? */
-			Node* n = gnode(t, i);
-			getnodekey(L, s2v(key), n);
-			setobj2s(L, key + 1, gval(n));
-			return 1;
-		}
+	i -= asize;
+	if (nextinhash(L, t, i, key))  /* hash part */
+		return 1;
+	else if (t->oldhash != NULL) {  /* then the part being migrated */
+		unsigned int nsize = cast_uint(sizenode(t));
+		return nextinhash(L, t->oldhash, (i < nsize) ? 0 : i - nsize, key);
 	}
 	return 0;  /* no more elements */
 }
 
 
 static void freehash(lua_State* L, Table* t) {
-	if (!isdummy(t))
+	if (!isdummy(t)) {
+#if defined(LUA_USE_SWISSTABLE)
+		luaM_freemem(L, t->node, hashpartsize(cast_sizet(sizenode(t))));
+#else
 		luaM_freearray(L, t->node, cast_sizet(sizenode(t)));
+#endif
+	}
 }
 
 
@@ -477,6 +735,66 @@ static int numusehash(const Table* t, unsigned int* nums, unsigned int* pna) {
 ** comparison ensures that the shift in the second one does not
 ** overflow.
 */
+#if defined(LUA_USE_SWISSTABLE)
+
+/*
+** Empties all nodes of a (non-dummy) hash part.
+*/
+static void clearhash(Table* t) {
+	unsigned int i;
+	unsigned int size = cast_uint(sizenode(t));
+	for (i = 0; i < size; i++) {
+		Node* n = gnode(t, i);
+		setnilkey(n);
+		setempty(gval(n));
+	}
+	memset(gctrl(t), CTRLEMPTY, size + (GROUPSIZE - 1));
+	t->nfree = cast_int(maxkeys(size));
+}
+
+
+/*
+** Creates the block for the hash part of a table with room for 'size'
+** keys, or reuses the dummy node if size is zero. (See the comment
+** below for the overflow check.)
+*/
+static void setnodevector(lua_State* L, Table* t, unsigned int size) {
+	if (size == 0) {  /* no elements to hash part? */
+		t->node = cast(Node*, dummynode);  /* use common 'dummynode' */
+		t->lsizenode = 0;
+		t->nfree = -1;  /* signal that it is using dummy node */
+	}
+	else {
+		int lsize = luaO_ceillog2(size);
+		if (maxkeys(cast_uint(twoto(lsize))) < size)  /* too full? */
+			lsize++;
+		if (lsize > MAXHBITS || (1u << lsize) > MAXHSIZE)
+			luaG_runerror(L, "table overflow");
+		size = twoto(lsize);
+		t->node = cast(Node*, luaM_malloc_(L, hashpartsize(cast_sizet(size)), 0));
+		t->lsizenode = cast_byte(lsize);
+		clearhash(t);
+	}
+}
+
+#else
+
+/*
+** Empties all nodes of a (non-dummy) hash part.
+*/
+static void clearhash(Table* t) {
+	int i;
+	int size = sizenode(t);
+	for (i = 0; i < size; i++) {
+		Node* n = gnode(t, i);
+		gnext(n) = 0;
+		setnilkey(n);
+		setempty(gval(n));
+	}
+	t->lastfree = gnode(t, size);  /* all positions are free */
+}
+
+
 static void setnodevector(lua_State* L, Table* t, unsigned int size) {
 	if (size == 0) {  /* no elements to hash part? */
 		t->node = cast(Node*, dummynode);  /* use common 'dummynode' */
@@ -484,23 +802,18 @@ static void setnodevector(lua_State* L, Table* t, unsigned int size) {
 		t->lastfree = NULL;  /* signal that it is using dummy node */
 	}
 	else {
-		int i;
 		int lsize = luaO_ceillog2(size);
 		if (lsize > MAXHBITS || (1u << lsize) > MAXHSIZE)
 			luaG_runerror(L, "table overflow");
 		size = twoto(lsize);
 		t->node = luaM_newvector(L, size, Node);
-		for (i = 0; i < cast_int(size); i++) {
-			Node* n = gnode(t, i);
-			gnext(n) = 0;
-			setnilkey(n);
-			setempty(gval(n));
-		}
 		t->lsizenode = cast_byte(lsize);
-		t->lastfree = gnode(t, size);  /* all positions are free */
+		clearhash(t);
 	}
 }
 
+#endif
+
 
 /*
 ** (Re)insert all elements from the hash part of 'ot' into table 't'.
@@ -527,16 +840,126 @@ static void reinsert(lua_State* L, Table* ot, Table* t) {
 static void exchangehashpart(Table* t1, Table* t2) {
 	lu_byte lsizenode = t1->lsizenode;
 	Node* node = t1->node;
+#if defined(LUA_USE_SWISSTABLE)
+	int nfree = t1->nfree;
+	t1->nfree = t2->nfree;
+	t2->nfree = nfree;
+#else
 	Node* lastfree = t1->lastfree;
+	t1->lastfree = t2->lastfree;
+	t2->lastfree = lastfree;
+#endif
 	t1->lsizenode = t2->lsizenode;
 	t1->node = t2->node;
-	t1->lastfree = t2->lastfree;
 	t2->lsizenode = lsizenode;
 	t2->node = node;
-	t2->lastfree = lastfree;
 }
 
 
+/*
+** Incremental rehash. When a table with a large hash part grows,
+** 'rehash' gives it a new hash part but keeps the old one aside, as a
+** table without array part inside a 'Migration'. Each later insertion
+** of a new key moves the next LUAI_MIGRATESTEP nodes of the old part
+** into the new one; searches that miss in the new part try the old one.
+** Moved entries get dead keys, so that they cannot be found (nor
+** assigned) in the old part any more. Only insertions move entries,
+** because a traversal may assign to existing fields but not add new
+** ones. The new part has room for all old keys plus all new keys that
+** can be inserted until the migration ends, so moving entries never
+** triggers another rehash. Only tables without a metatable start a
+** migration, but one may get a metatable (even a weak one) while being
+** migrated: the collector also traverses and clears the old part.
+** (Finishing the migration there would move entries under a running
+** traversal.)
+*/
+typedef struct Migration {
+	Table part;  /* old hash part */
+	unsigned int next;  /* index of the next node to be moved */
+} Migration;
+
+
+#define migration(t)	cast(Migration*, (t)->oldhash)
+
+
+/*
+** Move up to 'n' nodes from the old hash part of 't' into its new part,
+** freeing the old part after its last node.
+*/
+static void migrate(lua_State* L, Table* t, unsigned int n) {
+	Migration* m = migration(t);
+	Table* ot = &m->part;
+	unsigned int size = cast_uint(sizenode(ot));
+	t->oldhash = NULL;  /* keys must go into the new part */
+	for (; n > 0 && m->next < size; n--) {
+		Node* old = gnode(ot, m->next++);
+		if (!isempty(gval(old))) {
+			/* doesn't need barrier/invalidate cache, as entry was
+			   already present in the table */
+			TValue k;
+			getnodekey(L, &k, old);
+			luaH_set(L, t, &k, gval(old));
+			setempty(gval(old));
+		}
+		if (!keyisnil(old))
+			setdeadkey(old);  /* entry is no longer in the old part */
+	}
+	if (m->next < size)
+		t->oldhash = ot;  /* migration continues */
+	else {
+		freehash(L, ot);
+		luaM_free(L, m);
+	}
+}
+
+
+void luaH_finishmigration(lua_State* L, Table* t) {
+	if (t->oldhash != NULL)
+		migrate(L, t, cast_uint(sizenode(t->oldhash)));
+}
+
+
+#if LUAI_MIGRATESTEP > 0
+
+/*
+** Give table 't' a new hash part for 'nhsize' keys and start migrating
+** its current hash part into it. (See 'luaH_resize' about allocation
+** errors.)
+*/
+static void startmigration(lua_State* L, Table* t, unsigned int nhsize) {
+	unsigned int osize = cast_uint(sizenode(t));
+	Table newt;  /* to keep the new hash part */
+	Migration* m;
+	/* room for new keys inserted while old nodes are being moved */
+	setnodevector(L, &newt, nhsize + osize / LUAI_MIGRATESTEP + 1);
+	m = cast(Migration*, luaM_realloc_(L, NULL, 0, sizeof(Migration)));
+	if (l_unlikely(m == NULL)) {  /* allocation failed? */
+		freehash(L, &newt);  /* release new hash part */
+		luaM_error(L);  /* raise error (with table unchanged) */
+	}
+	exchangehashpart(t, &newt);  /* 't' has the new hash ('newt' has the old) */
+	m->part = newt;
+	m->part.flags = 0;
+	m->part.alimit = 0;  /* old part has no array part */
+	m->part.array = NULL;
+	m->part.oldhash = NULL;
+	m->part.metatable = NULL;
+	m->next = 0;
+	t->oldhash = &m->part;
+}
+
+
+/*
+** Tells whether 't', whose array part is not going to change, can have
+** its hash part migrated incrementally.
+*/
+#define canmigrate(t)  \
+  ((t)->metatable == NULL && (t)->oldhash == NULL && !isdummy(t) &&  \
+   sizenode(t) >= LUAI_MINMIGRATE)
+
+#endif
+
+
 /*
 ** Resize table 't' for the new given sizes. Both allocations (for
 ** the hash part and for the array part) can fail, which creates some
@@ -548,14 +971,17 @@ static void exchangehashpart(Table* t1, Table* t2) {
 ** raises the allocation error. Otherwise, it sets the new hash part
 ** into the table, initializes the new part of the array (if any) with
 ** nils and reinserts the elements of the old hash back into the new
-** parts of the table.
+** parts of the table. (A pending migration of the hash part is
+** finished first.)
 */
 void luaH_resize(lua_State* L, Table* t, unsigned int newasize,
 	unsigned int nhsize) {
 	unsigned int i;
 	Table newt;  /* to keep the new hash part */
-	unsigned int oldasize = setlimittosize(t);
+	unsigned int oldasize;
 	TValue* newarray;
+	luaH_finishmigration(L, t);
+	oldasize = setlimittosize(t);
 	/* create new hash part with appropriate size into 'newt' */
 	setnodevector(L, &newt, nhsize);
 	if (newasize < oldasize) {  /* will array shrink? */
@@ -587,9 +1013,26 @@ void luaH_resize(lua_State* L, Table* t, unsigned int newasize,
 }
 
 
+/* number of keys the hash part of 't' can hold */
+#if defined(LUA_USE_SWISSTABLE)
+#define hashcapacity(t)	(isdummy(t) ? 0u : cast_uint(maxkeys(sizenode(t))))
+#else
+#define hashcapacity(t)	cast_uint(allocsizenode(t))
+#endif
+
+
 void luaH_resizearray(lua_State* L, Table* t, unsigned int nasize) {
-	int nsize = allocsizenode(t);
-	luaH_resize(L, t, nasize, nsize);
+	luaH_resize(L, t, nasize, hashcapacity(t));
+}
+
+
+void luaH_reserve(lua_State* L, Table* t, unsigned int nasize,
+	unsigned int nhsize) {
+	unsigned int asize = luaH_realasize(t);
+	unsigned int hsize = hashcapacity(t);
+	if (nasize > asize || nhsize > hsize)  /* must grow some part? */
+		luaH_resize(L, t, (nasize > asize) ? nasize : asize,
+			(nhsize > hsize) ? nhsize : hsize);
 }
 
 /*
@@ -606,12 +1049,20 @@ static void rehash(lua_State* L, Table* t, const TValue* ek) {
 	na = numusearray(t, nums);  /* count keys in array part */
 	totaluse = na;  /* all those keys are integer keys */
 	totaluse += numusehash(t, nums, &na);  /* count keys in hash part */
+	if (t->oldhash != NULL)  /* count keys not migrated yet */
+		totaluse += numusehash(t->oldhash, nums, &na);
 	/* count extra key */
 	if (ttisinteger(ek))
 		na += countint(ivalue(ek), nums);
 	totaluse++;
 	/* compute new size for array part */
 	asize = computesizes(nums, &na);
+#if LUAI_MIGRATESTEP > 0
+	if (asize == luaH_realasize(t) && canmigrate(t)) {
+		startmigration(L, t, totaluse - na);  /* only hash part changes */
+		return;
+	}
+#endif
 	/* resize the table to new computed sizes */
 	luaH_resize(L, t, asize, totaluse - na);
 }
@@ -630,18 +1081,106 @@ Table* luaH_new(lua_State* L) {
 	t->flags = cast_byte(maskflags);  /* table has no metamethod fields */
 	t->array = NULL;
 	t->alimit = 0;
+	t->oldhash = NULL;
+	t->lenhint = 0;
 	setnodevector(L, t, 0);
 	return t;
 }
 
 
+/*
+** Frees the old hash part of a table in the middle of a migration.
+*/
+static void freeoldhash(lua_State* L, Table* t) {
+	freehash(L, t->oldhash);
+	luaM_free(L, migration(t));
+	t->oldhash = NULL;
+}
+
+
+/*
+** Removes all entries of table 't', keeping the sizes of its parts. (As
+** with any removal of keys, a traversal of 't' cannot continue after
+** that.)
+*/
+void luaH_clear(lua_State* L, Table* t) {
+	unsigned int i;
+	unsigned int asize = setlimittosize(t);
+	if (t->oldhash != NULL)  /* its keys are gone too */
+		freeoldhash(L, t);
+	for (i = 0; i < asize; i++)
+		setempty(&t->array[i]);
+	if (!isdummy(t))
+		clearhash(t);
+}
+
+
 void luaH_free(lua_State* L, Table* t) {
+	if (t->oldhash != NULL)  /* in the middle of a migration? */
+		freeoldhash(L, t);
 	freehash(L, t);
 	luaM_freearray(L, t->array, luaH_realasize(t));
 	luaM_free(L, t);
 }
 
 
+static lu_mem hashbytes(const Table* t) {
+	if (isdummy(t))
+		return 0;
+#if defined(LUA_USE_SWISSTABLE)
+	return cast(lu_mem, hashpartsize(cast_sizet(sizenode(t))));
+#else
+	return cast(lu_mem, sizenode(t)) * sizeof(Node);
+#endif
+}
+
+
+/*
+** Creates a table with parts of the same sizes as those of 't' (which
+** cannot be in the middle of a migration) and a raw copy of their
+** contents (used by 'lua_clone'). As keys keep their positions, the
+** caller may change values but not keys hashed by their addresses.
+*/
+Table* luaH_copy(lua_State* L, const Table* t) {
+	Table* nt = luaH_new(L);
+	unsigned int asize = luaH_realasize(t);
+	lua_assert(t->oldhash == NULL);
+	if (asize > 0) {
+		nt->array = luaM_newvector(L, asize, TValue);
+		memcpy(nt->array, t->array, asize * sizeof(TValue));
+	}
+	nt->alimit = t->alimit;  /* (with its flags, gives size 'asize') */
+	nt->flags = t->flags;
+	nt->lenhint = t->lenhint;
+	if (!isdummy(t)) {
+		size_t hsize = cast_sizet(hashbytes(t));
+		Node* node = cast(Node*, luaM_malloc_(L, hsize, 0));
+		memcpy(node, t->node, hsize);
+		nt->node = node;
+		nt->lsizenode = t->lsizenode;
+#if defined(LUA_USE_SWISSTABLE)
+		nt->nfree = t->nfree;
+#else
+		nt->lastfree = node + (t->lastfree - t->node);
+#endif
+	}
+	return nt;
+}
+
+
+/*
+** Number of bytes allocated for table 't' and its parts.
+*/
+lu_mem luaH_memsize(const Table* t) {
+	lu_mem sz = sizeof(Table) + hashbytes(t) +
+		cast(lu_mem, luaH_realasize(t)) * sizeof(TValue);
+	if (t->oldhash != NULL)
+		sz += sizeof(Migration) + hashbytes(t->oldhash);
+	return sz;
+}
+
+
+#if !defined(LUA_USE_SWISSTABLE)
 static Node* getfreepos(Table* t) {
 	if (!isdummy(t)) {
 		while (t->lastfree > t->node) {
@@ -652,6 +1191,7 @@ static Node* getfreepos(Table* t) {
 	}
 	return NULL;  /* could not find a free place */
 }
+#endif
 
 
 
@@ -660,7 +1200,9 @@ static Node* getfreepos(Table* t) {
 ** position is free. If not, check whether colliding node is in its main
 ** position or not: if it is not, move colliding node to an empty place and
 ** put new key in its main position; otherwise (colliding node is in its main
-** position), new key goes to an empty position.
+** position), new key goes to an empty position. (With LUA_USE_SWISSTABLE,
+** the new key simply goes to the first free or removed node in its probe
+** sequence.)
 */
 static void luaH_newkey(lua_State* L, Table* t, const TValue* key,
 	TValue* value) {
@@ -680,6 +1222,17 @@ static void luaH_newkey(lua_State* L, Table* t, const TValue* key,
 	}
 	if (ttisnil(value))
 		return;  /* do not insert nil values */
+	if (t->oldhash != NULL)  /* being rehashed incrementally? */
+		migrate(L, t, LUAI_MIGRATESTEP);
+#if defined(LUA_USE_SWISSTABLE)
+	if (t->nfree <= 0) {  /* no free node (or dummy node)? */
+		rehash(L, t, key);  /* grow table */
+		/* whatever called 'newkey' takes care of TM cache */
+		luaH_set(L, t, key, value);  /* insert key into grown table */
+		return;
+	}
+	mp = getfreepos(t, hashkey(key));
+#else
 	mp = mainpositionTV(t, key);
 	if (!isempty(gval(mp)) || isdummy(t)) {  /* main position is taken? */
 		Node* othern;
@@ -713,6 +1266,7 @@ static void luaH_newkey(lua_State* L, Table* t, const TValue* key,
 			mp = f;
 		}
 	}
+#endif
 	setnodekey(L, mp, key);
 	luaC_barrierback(L, obj2gco(t), key);
 	lua_assert(isempty(gval(mp)));
@@ -742,6 +1296,26 @@ static void luaH_newkey(lua_State* L, Table* t, const TValue* key,
 ** If key is 0 or negative, 'res' will have its higher bit on, so that
 ** if cannot be smaller than alimit.
 */
+l_sinline const TValue* searchint(Table* t, lua_Integer key) {
+#if defined(LUA_USE_SWISSTABLE)
+	unsigned int h = hashinteger(key);
+	searchhash(t, h, keyisinteger(n) && keyival(n) == key);
+#else
+	Node* n = hashint(t, key);
+	for (;;) {  /* check whether 'key' is somewhere in the chain */
+		if (keyisinteger(n) && keyival(n) == key)
+			return gval(n);  /* that's it */
+		else {
+			int nx = gnext(n);
+			if (nx == 0) break;
+			n += nx;
+		}
+	}
+	return &absentkey;
+#endif
+}
+
+
 const TValue* luaH_getint(Table* t, lua_Integer key) {
 	lua_Unsigned alimit = t->alimit;
 	if (l_castS2U(key) - 1u < alimit)  /* 'key' in [1, t->alimit]? */
@@ -752,17 +1326,10 @@ const TValue* luaH_getint(Table* t, lua_Integer key) {
 		return &t->array[key - 1];
 	}
 	else {  /* key is not in the array part; check the hash */
-		Node* n = hashint(t, key);
-		for (;;) {  /* check whether 'key' is somewhere in the chain */
-			if (keyisinteger(n) && keyival(n) == key)
-				return gval(n);  /* that's it */
-			else {
-				int nx = gnext(n);
-				if (nx == 0) break;
-				n += nx;
-			}
-		}
-		return &absentkey;
+		const TValue* res = searchint(t, key);
+		if (l_unlikely(t->oldhash != NULL) && isabstkey(res))
+			res = searchint(t->oldhash, key);  /* not migrated yet? */
+		return res;
 	}
 }
 
@@ -770,7 +1337,12 @@ const TValue* luaH_getint(Table* t, lua_Integer key) {
 /*
 ** search function for short strings
 */
-const TValue* luaH_getshortstr(Table* t, TString* key) {
+l_sinline const TValue* searchshortstr(Table* t, TString* key) {
+#if defined(LUA_USE_SWISSTABLE)
+	unsigned int h = mixhash(key->hash);
+	lua_assert(key->tt == LUA_VSHRSTR);
+	searchhash(t, h, keyisshrstr(n) && eqshrstr(keystrval(n), key));
+#else
 	Node* n = hashstr(t, key);
 	lua_assert(key->tt == LUA_VSHRSTR);
 	for (;;) {  /* check whether 'key' is somewhere in the chain */
@@ -783,6 +1355,26 @@ const TValue* luaH_getshortstr(Table* t, TString* key) {
 			n += nx;
 		}
 	}
+#endif
+}
+
+
+const TValue* luaH_getshortstr(Table* t, TString* key) {
+	const TValue* res = searchshortstr(t, key);
+	if (l_unlikely(t->oldhash != NULL) && isabstkey(res))
+		res = searchshortstr(t->oldhash, key);  /* not migrated yet? */
+	return res;
+}
+
+
+/*
+** generic search in both hash parts of a table
+*/
+static const TValue* searchgeneric(Table* t, const TValue* key) {
+	const TValue* res = getgeneric(t, key, 0);
+	if (l_unlikely(t->oldhash != NULL) && isabstkey(res))
+		res = getgeneric(t->oldhash, key, 0);  /* not migrated yet? */
+	return res;
 }
 
 
@@ -792,7 +1384,7 @@ const TValue* luaH_getstr(Table* t, TString* key) {
 	else {  /* for long strings, use generic case */
 		TValue ko;
 		setsvalue(cast(lua_State*, NULL), &ko, key);
-		return getgeneric(t, &ko, 0);
+		return searchgeneric(t, &ko);
 	}
 }
 
@@ -812,7 +1404,7 @@ const TValue* luaH_get(Table* t, const TValue* key) {
 		/* else... */
 	}  /* FALLTHROUGH */
 	default:
-		return getgeneric(t, key, 0);
+		return searchgeneric(t, key);
 	}
 }
 
@@ -892,6 +1484,30 @@ static lua_Unsigned hash_search(Table* t, lua_Unsigned j) {
 }
 
 
+/*
+** Check whether 'lenhint', the last boundary found in the hash part of
+** 't', or one of its neighbors (after an element was added to or
+** removed from the end of the sequence) is a boundary. The caller
+** ensures that 'limit + 1' is present. Returns 0 if none of them is.
+*/
+#define ispresent(t,i)	(!isempty(luaH_getint(t, l_castU2S(i))))
+
+static lua_Unsigned checklenhint(Table* t, lua_Unsigned limit) {
+	lua_Unsigned h = t->lenhint;
+	if (h <= limit || h >= l_castS2U(LUA_MAXINTEGER) - 1u)
+		return 0;  /* hint is useless */
+	if (ispresent(t, h)) {
+		if (!ispresent(t, h + 1))
+			return h;  /* still a boundary */
+		else if (!ispresent(t, h + 2))
+			return h + 1;  /* an element was added at the end */
+	}
+	else if (h - 1u > limit && ispresent(t, h - 1u))
+		return h - 1u;  /* last element was removed */
+	return 0;
+}
+
+
 static unsigned int binsearch(const TValue* array, unsigned int i,
 	unsigned int j) {
 	while (j - i > 1u) {  /* binary search */
@@ -930,7 +1546,10 @@ static unsigned int binsearch(const TValue* array, unsigned int i,
 ** (3) The last case is when there are no elements in the array part
 ** (limit == 0) or its last element (the new limit) is present.
 ** In this case, must check the hash part. If there is no hash part
-** or 'limit+1' is absent, 'limit' is a boundary.  Otherwise, call
+** or 'limit+1' is absent, 'limit' is a boundary.  Otherwise, try the
+** boundary found by the previous search in the hash part ('lenhint'),
+** so that sequences that spill into the hash part and only change at
+** their end have constant-time lengths; if that fails, call
 ** 'hash_search' to find a boundary in the hash part of the table.
 ** (In those cases, the boundary is not inside the array part, and
 ** therefore cannot be used as a new limit.)
@@ -978,8 +1597,13 @@ lua_Unsigned luaH_getn(Table* t) {
 		(limit == 0 || !isempty(&t->array[limit - 1])));
 	if (isdummy(t) || isempty(luaH_getint(t, cast(lua_Integer, limit + 1))))
 		return limit;  /* 'limit + 1' is absent */
-	else  /* 'limit + 1' is also present */
-		return hash_search(t, limit);
+	else {  /* 'limit + 1' is also present */
+		lua_Unsigned n = checklenhint(t, limit);
+		if (n == 0)  /* hint did not work? */
+			n = hash_search(t, limit);
+		t->lenhint = n;
+		return n;
+	}
 }
 
 
@@ -989,7 +1613,11 @@ lua_Unsigned luaH_getn(Table* t) {
 /* export these functions for the test library */
 
 Node* luaH_mainposition(const Table* t, const TValue* key) {
+#if defined(LUA_USE_SWISSTABLE)
+	return gnode(t, hashkey(key) & cast_uint(sizenode(t) - 1));
+#else
 	return mainpositionTV(t, key);
+#endif
 }
 
 #endif
@@ -24,7 +24,11 @@
 
 
 /* true when 't' is using 'dummynode' as its hash part */
+#if defined(LUA_USE_SWISSTABLE)
+#define isdummy(t)		((t)->nfree < 0)
+#else
 #define isdummy(t)		((t)->lastfree == NULL)
+#endif
 
 
 /* allocated size for hash nodes */
@@ -49,7 +53,13 @@ LUAI_FUNC Table* luaH_new(lua_State* L);
 LUAI_FUNC void luaH_resize(lua_State* L, Table* t, unsigned int nasize,
 	unsigned int nhsize);
 LUAI_FUNC void luaH_resizearray(lua_State* L, Table* t, unsigned int nasize);
+LUAI_FUNC void luaH_reserve(lua_State* L, Table* t, unsigned int nasize,
+	unsigned int nhsize);
+LUAI_FUNC void luaH_clear(lua_State* L, Table* t);
+LUAI_FUNC void luaH_finishmigration(lua_State* L, Table* t);
 LUAI_FUNC void luaH_free(lua_State* L, Table* t);
+LUAI_FUNC Table* luaH_copy(lua_State* L, const Table* t);
+LUAI_FUNC lu_mem luaH_memsize(const Table* t);
 LUAI_FUNC int luaH_next(lua_State* L, Table* t, StkId key);
 LUAI_FUNC lua_Unsigned luaH_getn(Table* t);
 LUAI_FUNC unsigned int luaH_realasize(const Table* t);
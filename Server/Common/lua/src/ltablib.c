@@ -211,6 +211,49 @@ static int tunpack(lua_State* L) {
 
 
 
+/*
+** {======================================================
+** Capacity
+** =======================================================
+*/
+
+/* get an optional size argument, which must fit in an 'int' */
+static int optsize(lua_State* L, int arg) {
+	lua_Integer n = luaL_optinteger(L, arg, 0);
+	luaL_argcheck(L, 0 <= n && n <= INT_MAX, arg, "size out of range");
+	return (int)n;
+}
+
+
+static int tnew(lua_State* L) {
+	int narr = optsize(L, 1);
+	int nrec = optsize(L, 2);
+	lua_createtable(L, narr, nrec);
+	return 1;
+}
+
+
+static int treserve(lua_State* L) {
+	int narr, nrec;
+	luaL_checktype(L, 1, LUA_TTABLE);
+	narr = optsize(L, 2);
+	nrec = optsize(L, 3);
+	lua_reservetable(L, 1, narr, nrec);
+	lua_settop(L, 1);
+	return 1;  /* return table */
+}
+
+
+static int tclear(lua_State* L) {
+	luaL_checktype(L, 1, LUA_TTABLE);
+	lua_cleartable(L, 1);
+	return 0;
+}
+
+/* }====================================================== */
+
+
+
 /*
 ** {======================================================
 ** Quicksort
@@ -419,6 +462,9 @@ static const luaL_Reg tab_funcs[] = {
   {"remove", tremove},
   {"move", tmove},
   {"sort", sort},
+  {"new", tnew},
+  {"reserve", treserve},
+  {"clear", tclear},
   {NULL, NULL}
 };
 
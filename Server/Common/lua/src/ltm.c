@@ -255,9 +255,14 @@ void luaT_adjustvarargs(lua_State* L, int nfixparams, CallInfo* ci,
 }
 
 
-void luaT_getvarargs(lua_State* L, CallInfo* ci, StkId where, int wanted) {
+/*
+** Copy the extra arguments, except the first 'skip' ones, to 'where'.
+*/
+void luaT_getvarargs(lua_State* L, CallInfo* ci, StkId where, int skip,
+	int wanted) {
 	int i;
-	int nextra = ci->u.l.nextraargs;
+	int nextra = ci->u.l.nextraargs - skip;
+	if (nextra < 0) nextra = 0;
 	if (wanted < 0) {
 		wanted = nextra;  /* get all extra arguments available */
 		checkstackGCp(L, nextra, where);  /* ensure stack space */
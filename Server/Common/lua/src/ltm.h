@@ -97,7 +97,7 @@ LUAI_FUNC int luaT_callorderiTM(lua_State* L, const TValue* p1, int v2,
 LUAI_FUNC void luaT_adjustvarargs(lua_State* L, int nfixparams,
 	struct CallInfo* ci, const Proto* p);
 LUAI_FUNC void luaT_getvarargs(lua_State* L, struct CallInfo* ci,
-	StkId where, int wanted);
+	StkId where, int skip, int wanted);
 
 
 #endif
@@ -162,6 +162,9 @@ extern const char lua_ident[];
 */
 LUA_API lua_State* (lua_newstate)(lua_Alloc f, void* ud);
 LUA_API void       (lua_close)(lua_State* L);
+LUA_API void       (lua_shutdown)(lua_State* L);
+LUA_API int        (lua_freeze)(lua_State* L);
+LUA_API lua_State* (lua_clone)(lua_State* T, lua_Alloc f, void* ud);
 LUA_API lua_State* (lua_newthread)(lua_State* L);
 LUA_API int        (lua_closethread)(lua_State* L, lua_State* from);
 LUA_API int        (lua_resetthread)(lua_State* L);  /* Deprecated! */
@@ -250,6 +253,8 @@ LUA_API const char* (lua_pushvfstring)(lua_State* L, const char* fmt,
 	va_list argp);
 LUA_API const char* (lua_pushfstring)(lua_State* L, const char* fmt, ...);
 LUA_API void  (lua_pushcclosure)(lua_State* L, lua_CFunction fn, int n);
+LUA_API void  (lua_pushleafcclosure)(lua_State* L, lua_CFunction fn, int n,
+	int nresults);
 LUA_API void  (lua_pushboolean)(lua_State* L, int b);
 LUA_API void  (lua_pushlightuserdata)(lua_State* L, void* p);
 LUA_API int   (lua_pushthread)(lua_State* L);
@@ -268,6 +273,7 @@ LUA_API int (lua_rawgetp)(lua_State* L, int idx, const void* p);
 
 LUA_API void  (lua_createtable)(lua_State* L, int narr, int nrec);
 LUA_API void* (lua_newuserdatauv)(lua_State* L, size_t sz, int nuvalue);
+LUA_API void* (lua_newbufferuv)(lua_State* L, size_t sz, int nuvalue);
 LUA_API int   (lua_getmetatable)(lua_State* L, int objindex);
 LUA_API int  (lua_getiuservalue)(lua_State* L, int idx, int n);
 
@@ -284,6 +290,8 @@ LUA_API void  (lua_rawseti)(lua_State* L, int idx, lua_Integer n);
 LUA_API void  (lua_rawsetp)(lua_State* L, int idx, const void* p);
 LUA_API int   (lua_setmetatable)(lua_State* L, int objindex);
 LUA_API int   (lua_setiuservalue)(lua_State* L, int idx, int n);
+LUA_API void  (lua_reservetable)(lua_State* L, int idx, int narr, int nrec);
+LUA_API void  (lua_cleartable)(lua_State* L, int idx);
 
 
 /*
@@ -338,10 +346,54 @@ LUA_API void (lua_warning)(lua_State* L, const char* msg, int tocont);
 #define LUA_GCISRUNNING		9
 #define LUA_GCGEN		10
 #define LUA_GCINC		11
+#define LUA_GCBUDGET		12
+#define LUA_GCSTATS		13
+#define LUA_GCPUSHARENA		14
+#define LUA_GCPOPARENA		15
+#define LUA_GCSETEXTWEIGHT	16
+#define LUA_GCEXTCOUNT		17
 
 LUA_API int (lua_gc)(lua_State* L, int what, ...);
 
 
+/*
+** Collector telemetry, copied by 'lua_gc(L, LUA_GCSTATS, lua_GCStats *st)'
+*/
+
+/* kinds of collections */
+#define LUA_GCKINC	0	/* incremental cycle */
+#define LUA_GCKMINOR	1	/* minor (young) generational collection */
+#define LUA_GCKMAJOR	2	/* major generational collection */
+#define LUA_GCKFULL	3	/* full collection (explicit or emergency) */
+
+#define LUA_GCNCYCLES	32	/* number of collections kept */
+#define LUA_GCNPAUSES	20	/* number of buckets in the pause histogram */
+
+typedef struct lua_GCCycle {
+	int kind;  /* LUA_GCK* */
+	int steps;  /* number of collector steps that did its work */
+	lua_Unsigned propagate;  /* nanoseconds spent in each phase... */
+	lua_Unsigned atomic;
+	lua_Unsigned sweep;
+	lua_Unsigned finalize;
+	lua_Unsigned maxpause;  /* ...and in its longest step */
+	lua_Unsigned swept;  /* bytes in use when sweeping started */
+	lua_Unsigned freed;  /* bytes freed by the sweep */
+	lua_Unsigned finalized;  /* number of finalizers called */
+} lua_GCCycle;
+
+typedef struct lua_GCStats {
+	lua_Unsigned ncycles;  /* number of collections finished so far */
+	/* collector steps (not including budgeted ones) by duration: bucket
+	   'i' counts steps that took less than 2^(i+1) microseconds (and not
+	   less than 2^i, for 'i' > 0); the last bucket counts longer ones */
+	lua_Unsigned pauses[LUA_GCNPAUSES];
+	/* last collections, in a ring: the one finished after 'n' others is
+	   in 'cycles[n % LUA_GCNCYCLES]' */
+	lua_GCCycle cycles[LUA_GCNCYCLES];
+} lua_GCStats;
+
+
 /*
 ** miscellaneous functions
 */
@@ -355,12 +407,22 @@ LUA_API void  (lua_len)(lua_State* L, int idx);
 
 LUA_API size_t(lua_stringtonumber) (lua_State* L, const char* s);
 
+/* minimum size of the buffers for 'lua_fmtinteger'/'lua_fmtnumber' */
+#define LUA_N2SBUFFSZ	64
+
+LUA_API unsigned (lua_fmtinteger) (lua_State* L, lua_Integer n, char* buff);
+LUA_API unsigned (lua_fmtnumber) (lua_State* L, lua_Number n, int prec,
+                                  char* buff);
+
 LUA_API lua_Alloc(lua_getallocf) (lua_State* L, void** ud);
 LUA_API void      (lua_setallocf)(lua_State* L, lua_Alloc f, void* ud);
+LUA_API void      (lua_setselectf)(lua_State* L, lua_CFunction f);
 
 LUA_API void (lua_toclose)(lua_State* L, int idx);
 LUA_API void (lua_closeslot)(lua_State* L, int idx);
 
+LUA_API size_t (lua_releasebuffer)(lua_State* L, int idx);
+
 
 /*
 ** {==============================================================
@@ -377,9 +439,13 @@ LUA_API void (lua_closeslot)(lua_State* L, int idx);
 
 #define lua_newtable(L)		lua_createtable(L, 0, 0)
 
+#define lua_pusharena(L)	((void)lua_gc(L, LUA_GCPUSHARENA))
+#define lua_poparena(L)		lua_gc(L, LUA_GCPOPARENA)
+
 #define lua_register(L,n,f) (lua_pushcfunction(L, (f)), lua_setglobal(L, (n)))
 
 #define lua_pushcfunction(L,f)	lua_pushcclosure(L, (f), 0)
+#define lua_pushleafcfunction(L,f,r)	lua_pushleafcclosure(L, (f), 0, (r))
 
 #define lua_isfunction(L,n)	(lua_type(L, (n)) == LUA_TFUNCTION)
 #define lua_istable(L,n)	(lua_type(L, (n)) == LUA_TTABLE)
@@ -472,6 +538,54 @@ LUA_API int (lua_gethookcount)(lua_State* L);
 
 LUA_API int (lua_setcstacklimit)(lua_State* L, unsigned int limit);
 
+/*
+** Heap profiler: samples one allocation every 'rate' bytes (on average)
+** and charges the bytes allocated since the previous sample to the Lua
+** stack of the allocation, until the sampled block is freed.
+*/
+typedef struct lua_HeapSite {
+	const char* stack;  /* folded stack: "outer;...;inner;[type]" */
+	lua_Unsigned inuse;  /* bytes still in use (estimate) */
+	lua_Unsigned nlive;  /* samples still in use */
+	lua_Unsigned allocated;  /* bytes allocated (estimate) */
+	lua_Unsigned nsamples;  /* samples taken */
+} lua_HeapSite;
+
+/* Functions to be called by the heap-profile walker */
+typedef void (*lua_HeapWriter) (lua_State* L, const lua_HeapSite* s,
+	void* ud);
+
+LUA_API int (lua_heapprofile)(lua_State* L, size_t rate);
+LUA_API void (lua_walkheapprofile)(lua_State* L, lua_HeapWriter w, void* ud);
+
+/* Snapshot of all objects and their references, for offline analysis */
+LUA_API int (lua_heapsnapshot)(lua_State* L, lua_Writer writer, void* data);
+
+#if defined(LUA_USE_PROFILE)
+
+typedef struct lua_Profile lua_Profile;
+
+/* Functions to be called by the profile walker */
+typedef void (*lua_ProfileWriter) (lua_State* L, const lua_Profile* pr,
+	void* ud);
+
+LUA_API int (lua_getprofile)(lua_State* L, int funcindex, lua_Profile* pr);
+LUA_API lua_Unsigned(lua_getopcount) (lua_State* L, int op,
+	const char** name);
+LUA_API void (lua_walkprofile)(lua_State* L, lua_ProfileWriter w, void* ud);
+LUA_API void (lua_resetprofile)(lua_State* L);
+
+struct lua_Profile {
+	const char* source;
+	int linedefined;
+	int lastlinedefined;
+	lua_Unsigned calls;  /* number of calls */
+	lua_Unsigned instructions;  /* number of instructions executed */
+	lua_Unsigned time;  /* time spent in nanoseconds (callees included) */
+};
+
+#endif
+
 struct lua_Debug {
 	int event;
 	const char* name;	/* (n) */
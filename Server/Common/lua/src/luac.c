@@ -650,6 +650,25 @@ static void PrintCode(const Proto* f)
 		case OP_EXTRAARG:
 			printf("%d", ax);
 			break;
+		case OP_SELECT:
+			printf("%d %d %d", a, b, c);
+			printf(COMMENT);
+			if (b == 0) printf("'#' "); else printf("from %d ", b);
+			if (c == 0) printf("all out"); else printf("%d out", c - 1);
+			break;
+		case OP_ADDFF:
+		case OP_SUBFF:
+		case OP_MULFF:
+		case OP_DIVFF:
+			printf("%d %d %d", a, b, c);
+			break;
+		case OP_ADDKF:
+		case OP_SUBKF:
+		case OP_MULKF:
+		case OP_DIVKF:
+			printf("%d %d %d", a, b, c);
+			printf(COMMENT); PrintConstant(f, c);
+			break;
 #if 0
 		default:
 			printf("%d %d %d", a, b, c);
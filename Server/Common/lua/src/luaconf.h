@@ -406,6 +406,8 @@
 ** by prefixing it with one of FLT/DBL/LDBL.
 @@ LUA_NUMBER_FRMLEN is the length modifier for writing floats.
 @@ LUA_NUMBER_FMT is the format for writing floats.
+@@ LUA_NUMBER_PREC is the precision of LUA_NUMBER_FMT, when that is a
+** "%.<n>g" format; it enables the fast float formatting in lobject.c.
 @@ lua_number2str converts a float to a string.
 @@ l_mathop allows the addition of an 'l' or 'f' to all math operations.
 @@ l_floor takes the floor of a float.
@@ -478,6 +480,7 @@
 
 #define LUA_NUMBER_FRMLEN	""
 #define LUA_NUMBER_FMT		"%.14g"
+#define LUA_NUMBER_PREC		14
 
 #define l_mathop(op)		op
 
@@ -727,6 +730,24 @@
 #define luai_apicheck(l,e)	assert(e)
 #endif
 
+
+/*
+@@ LUA_USE_PROFILE turns on execution counters for each function
+** prototype (calls, instructions, time) and for each opcode. They are
+** read with 'lua_getprofile'/'debug.getprofile'. Without it, the
+** interpreter has no profiling code at all.
+*/
+/* #define LUA_USE_PROFILE */
+
+
+/*
+@@ LUA_USE_SWISSTABLE replaces the chained scatter table used for the
+** hash part of tables with an open-addressing table whose slots are
+** probed in groups of 16 control bytes (using SSE2 when available).
+** Traversal order and the semantics of 'next' and '#' are unchanged.
+*/
+/* #define LUA_USE_SWISSTABLE */
+
 /* }================================================================== */
 
 
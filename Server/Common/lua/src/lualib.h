@@ -35,6 +35,9 @@ LUAMOD_API int (luaopen_string)(lua_State* L);
 #define LUA_UTF8LIBNAME	"utf8"
 LUAMOD_API int (luaopen_utf8)(lua_State* L);
 
+#define LUA_ARRAYLIBNAME	"array"
+LUAMOD_API int (luaopen_array)(lua_State* L);
+
 #define LUA_MATHLIBNAME	"math"
 LUAMOD_API int (luaopen_math)(lua_State* L);
 
@@ -45,6 +48,18 @@ LUAMOD_API int (luaopen_debug)(lua_State* L);
 LUAMOD_API int (luaopen_package)(lua_State* L);
 
 
+/* element types of typed arrays */
+#define LUA_ARRAY_I32	0
+#define LUA_ARRAY_F32	1
+#define LUA_ARRAY_F64	2
+
+LUALIB_API void* (luaL_newarray)(lua_State* L, int type, size_t n);
+LUALIB_API void* (luaL_toarray)(lua_State* L, int idx, int* type,
+	size_t* n);
+LUALIB_API void* (luaL_checkarray)(lua_State* L, int arg, int type,
+	size_t* n);
+
+
 /* open all previous libraries */
 LUALIB_API void (luaL_openlibs)(lua_State* L);
 
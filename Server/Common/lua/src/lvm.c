@@ -868,7 +868,7 @@ void luaV_finishOp(lua_State* L) {
 	}
 	default: {
 		/* only these other opcodes can yield */
-		lua_assert(op == OP_TFORCALL || op == OP_CALL ||
+		lua_assert(op == OP_TFORCALL || op == OP_CALL || op == OP_SELECT ||
 			op == OP_TAILCALL || op == OP_SETTABUP || op == OP_SETTABLE ||
 			op == OP_SETI || op == OP_SETFIELD);
 		break;
@@ -978,6 +978,130 @@ void luaV_finishOp(lua_State* L) {
   op_arith_aux(L, v1, v2, iop, fop); }
 
 
+/*
+** {==================================================================
+** Quickening of float arithmetic
+**
+** A generic arithmetic instruction that finds two float operands
+** rewrites itself in place into its float-only variant (e.g., OP_ADD
+** into OP_ADDFF), which checks just the two float tags. When a
+** variant finds other operands, it rewrites itself back into the
+** generic opcode ('deoptimizes') and runs the generic operation. A
+** function whose instructions were deoptimized LUAI_MAXDEOPT times is
+** not quickened anymore, so polymorphic code settles on the generic
+** opcodes.
+** ===================================================================
+*/
+
+/* current instruction (as a modifiable lvalue) */
+#define curinstr()	(cl->p->code[pcRel(pc, cl->p)])
+
+#define quicken(qop)  \
+  { if (cl->p->ndeopt < LUAI_MAXDEOPT) SET_OPCODE(curinstr(), qop); }
+
+#define deoptimize() {  \
+  SET_OPCODE(curinstr(), luaP_baseop(GET_OPCODE(i)));  \
+  if (cl->p->ndeopt < LUAI_MAXDEOPT) cl->p->ndeopt++; }
+
+
+/*
+** Generic arithmetic operations over integers and floats that are
+** quickened into 'qop' when both operands are floats.
+*/
+#define op_arithq_aux(L,v1,v2,iop,fop,qop) {  \
+  StkId ra = RA(i); \
+  if (ttisinteger(v1) && ttisinteger(v2)) {  \
+    lua_Integer i1 = ivalue(v1); lua_Integer i2 = ivalue(v2);  \
+    pc++; setivalue(s2v(ra), iop(L, i1, i2));  \
+  }  \
+  else {  \
+    if (ttisfloat(v1) && ttisfloat(v2)) quicken(qop);  \
+    op_arithf_aux(L, v1, v2, fop);  \
+  }}
+
+#define op_arithq(L,iop,fop,qop) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  op_arithq_aux(L, v1, v2, iop, fop, qop); }
+
+#define op_arithKq(L,iop,fop,qop) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = KC(i); lua_assert(ttisnumber(v2));  \
+  op_arithq_aux(L, v1, v2, iop, fop, qop); }
+
+
+/*
+** Generic float operations (division) that are quickened into 'qop'
+** when both operands are floats.
+*/
+#define op_arithfq_aux(L,v1,v2,fop,qop) {  \
+  StkId ra = RA(i); \
+  if (ttisfloat(v1) && ttisfloat(v2)) quicken(qop);  \
+  op_arithf_aux(L, v1, v2, fop); }
+
+#define op_arithfq(L,fop,qop) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  op_arithfq_aux(L, v1, v2, fop, qop); }
+
+#define op_arithfKq(L,fop,qop) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = KC(i); lua_assert(ttisnumber(v2));  \
+  op_arithfq_aux(L, v1, v2, fop, qop); }
+
+
+/*
+** Quickened variants of operations over integers and floats.
+*/
+#define op_arithFF_aux(L,v1,v2,iop,fop) {  \
+  if (l_likely(ttisfloat(v1) && ttisfloat(v2))) {  \
+    StkId ra = RA(i); \
+    lua_Number n1 = fltvalue(v1); lua_Number n2 = fltvalue(v2);  \
+    pc++; setfltvalue(s2v(ra), fop(L, n1, n2));  \
+  }  \
+  else {  \
+    deoptimize();  \
+    op_arith_aux(L, v1, v2, iop, fop);  \
+  }}
+
+#define op_arithFF(L,iop,fop) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  op_arithFF_aux(L, v1, v2, iop, fop); }
+
+#define op_arithKF(L,iop,fop) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = KC(i); lua_assert(ttisnumber(v2));  \
+  op_arithFF_aux(L, v1, v2, iop, fop); }
+
+
+/*
+** Quickened variants of float operations (division).
+*/
+#define op_arithfFF_aux(L,v1,v2,fop) {  \
+  StkId ra = RA(i); \
+  if (l_likely(ttisfloat(v1) && ttisfloat(v2))) {  \
+    lua_Number n1 = fltvalue(v1); lua_Number n2 = fltvalue(v2);  \
+    pc++; setfltvalue(s2v(ra), fop(L, n1, n2));  \
+  }  \
+  else {  \
+    deoptimize();  \
+    op_arithf_aux(L, v1, v2, fop);  \
+  }}
+
+#define op_arithfFF(L,fop) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  op_arithfFF_aux(L, v1, v2, fop); }
+
+#define op_arithfKF(L,fop) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = KC(i); lua_assert(ttisnumber(v2));  \
+  op_arithfFF_aux(L, v1, v2, fop); }
+
+/* }================================================================== */
+
+
 /*
 ** Bitwise operations with constant operand.
 */
@@ -1134,6 +1258,15 @@ void luaV_finishOp(lua_State* L) {
            luai_threadyield(L); }
 
 
+/* count an executed instruction (only when profiling) */
+#if defined(LUA_USE_PROFILE)
+#define luai_profinstr(L,p,i)  \
+	((p)->ninstr++, G(L)->opcount[GET_OPCODE(i)]++)
+#else
+#define luai_profinstr(L,p,i)	((void)0)
+#endif
+
+
 /* fetch an instruction and prepare its execution */
 #define vmfetch()	{ \
   if (l_unlikely(trap)) {  /* stack reallocation or hooks? */ \
@@ -1141,6 +1274,7 @@ void luaV_finishOp(lua_State* L) {
     updatebase(ci);  /* correct stack */ \
   } \
   i = *(pc++); \
+  luai_profinstr(L, cl->p, i); \
 }
 
 #define vmdispatch(o)	switch(o)
@@ -1396,15 +1530,15 @@ returning:  /* trap already set */
 				vmbreak;
 			}
 			vmcase(OP_ADDK) {
-				op_arithK(L, l_addi, luai_numadd);
+				op_arithKq(L, l_addi, luai_numadd, OP_ADDKF);
 				vmbreak;
 			}
 			vmcase(OP_SUBK) {
-				op_arithK(L, l_subi, luai_numsub);
+				op_arithKq(L, l_subi, luai_numsub, OP_SUBKF);
 				vmbreak;
 			}
 			vmcase(OP_MULK) {
-				op_arithK(L, l_muli, luai_nummul);
+				op_arithKq(L, l_muli, luai_nummul, OP_MULKF);
 				vmbreak;
 			}
 			vmcase(OP_MODK) {
@@ -1417,7 +1551,7 @@ returning:  /* trap already set */
 				vmbreak;
 			}
 			vmcase(OP_DIVK) {
-				op_arithfK(L, luai_numdiv);
+				op_arithfKq(L, luai_numdiv, OP_DIVKF);
 				vmbreak;
 			}
 			vmcase(OP_IDIVK) {
@@ -1458,15 +1592,15 @@ returning:  /* trap already set */
 				vmbreak;
 			}
 			vmcase(OP_ADD) {
-				op_arith(L, l_addi, luai_numadd);
+				op_arithq(L, l_addi, luai_numadd, OP_ADDFF);
 				vmbreak;
 			}
 			vmcase(OP_SUB) {
-				op_arith(L, l_subi, luai_numsub);
+				op_arithq(L, l_subi, luai_numsub, OP_SUBFF);
 				vmbreak;
 			}
 			vmcase(OP_MUL) {
-				op_arith(L, l_muli, luai_nummul);
+				op_arithq(L, l_muli, luai_nummul, OP_MULFF);
 				vmbreak;
 			}
 			vmcase(OP_MOD) {
@@ -1479,7 +1613,7 @@ returning:  /* trap already set */
 				vmbreak;
 			}
 			vmcase(OP_DIV) {  /* float division (always with floats) */
-				op_arithf(L, luai_numdiv);
+				op_arithfq(L, luai_numdiv, OP_DIVFF);
 				vmbreak;
 			}
 			vmcase(OP_IDIV) {  /* floor division */
@@ -1513,7 +1647,8 @@ returning:  /* trap already set */
 				TValue* rb = vRB(i);
 				TMS tm = (TMS)GETARG_C(i);
 				StkId result = RA(pi);
-				lua_assert(OP_ADD <= GET_OPCODE(pi) && GET_OPCODE(pi) <= OP_SHR);
+				lua_assert(OP_ADD <= luaP_baseop(GET_OPCODE(pi)) &&
+				           luaP_baseop(GET_OPCODE(pi)) <= OP_SHR);
 				Protect(luaT_trybinTM(L, s2v(ra), rb, result, tm));
 				vmbreak;
 			}
@@ -1774,6 +1909,7 @@ returning:  /* trap already set */
 					}
 				}
 			ret:  /* return from a Lua function */
+				luai_profret(cl->p, ci);
 				if (ci->callstatus & CIST_FRESH)
 					return;  /* end this frame */
 				else {
@@ -1878,7 +2014,7 @@ returning:  /* trap already set */
 			vmcase(OP_VARARG) {
 				StkId ra = RA(i);
 				int n = GETARG_C(i) - 1;  /* required results */
-				Protect(luaT_getvarargs(L, ci, ra, n));
+				Protect(luaT_getvarargs(L, ci, ra, 0, n));
 				vmbreak;
 			}
 			vmcase(OP_VARARGPREP) {
@@ -1894,6 +2030,74 @@ returning:  /* trap already set */
 				lua_assert(0);
 				vmbreak;
 			}
+			vmcase(OP_SELECT) {
+				StkId ra = RA(i);
+				int b = GETARG_B(i);  /* index, or 0 for '#' */
+				int nresults = GETARG_C(i) - 1;
+				if (ttislcf(s2v(ra)) && fvalue(s2v(ra)) == G(L)->selectf &&
+					!L->hookmask) {  /* standard 'select'? */
+					if (b == 0) {  /* select('#', ...) */
+						int j;
+						setivalue(s2v(ra), ci->u.l.nextraargs);
+						if (nresults < 0)
+							L->top.p = ra + 1;  /* next instruction will need top */
+						for (j = 1; j < nresults; j++)
+							setnilvalue(s2v(ra + j));
+					}
+					else  /* select(b, ...) */
+						Protect(luaT_getvarargs(L, ci, ra, b - 1, nresults));
+				}
+				else {  /* regular call */
+					CallInfo* newci;
+					Protect(luaT_getvarargs(L, ci, ra + 2, 0, -1));  /* sets top */
+					ra = RA(i);
+					if (b == 0) {
+						setsvalue2s(L, ra + 1, luaS_newliteral(L, "#"));
+					}
+					else {
+						setivalue(s2v(ra + 1), b);
+					}
+					if ((newci = luaD_precall(L, ra, nresults)) == NULL)
+						updatetrap(ci);  /* C call; nothing else to be done */
+					else {  /* Lua call: run function in this same C frame */
+						ci = newci;
+						goto startfunc;
+					}
+				}
+				vmbreak;
+			}
+			vmcase(OP_ADDFF) {
+				op_arithFF(L, l_addi, luai_numadd);
+				vmbreak;
+			}
+			vmcase(OP_SUBFF) {
+				op_arithFF(L, l_subi, luai_numsub);
+				vmbreak;
+			}
+			vmcase(OP_MULFF) {
+				op_arithFF(L, l_muli, luai_nummul);
+				vmbreak;
+			}
+			vmcase(OP_DIVFF) {
+				op_arithfFF(L, luai_numdiv);
+				vmbreak;
+			}
+			vmcase(OP_ADDKF) {
+				op_arithKF(L, l_addi, luai_numadd);
+				vmbreak;
+			}
+			vmcase(OP_SUBKF) {
+				op_arithKF(L, l_subi, luai_numsub);
+				vmbreak;
+			}
+			vmcase(OP_MULKF) {
+				op_arithKF(L, l_muli, luai_nummul);
+				vmbreak;
+			}
+			vmcase(OP_DIVKF) {
+				op_arithfKF(L, luai_numdiv);
+				vmbreak;
+			}
 		}
 	}
 }
@@ -0,0 +1,232 @@
+/*
+** Regression checks for the changes to the interpreter and its
+** libraries. Each check runs a chunk in a fresh state (with the
+** standard libraries) and fails on any error; checks that need the
+** C API are C functions. Prints the name of each check and exits with
+** status 1 at the first failure.
+**
+** Build (from this directory, after building liblua.a in ../src):
+**   cc -O2 -I../src regress.c ../src/liblua.a -lm -lpthread -o regress
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+typedef struct Check {
+	const char* name;
+	const char* chunk;  /* Lua code, or NULL */
+	void (*f)(void);  /* C check, or NULL */
+} Check;
+
+
+static void fail(const char* name, const char* msg) {
+	fprintf(stderr, "%s: %s\n", name, msg);
+	exit(1);
+}
+
+
+static lua_State* newstate(void) {
+	lua_State* L = luaL_newstate();
+	if (L == NULL)
+		fail("newstate", "not enough memory");
+	luaL_openlibs(L);
+	return L;
+}
+
+
+static void dochunk(const char* name, const char* chunk) {
+	lua_State* L = newstate();
+	if (luaL_loadbuffer(L, chunk, strlen(chunk), name) != LUA_OK ||
+		lua_pcall(L, 0, 0, 0) != LUA_OK)
+		fail(name, lua_tostring(L, -1));
+	lua_close(L);
+}
+
+
+/*
+** {======================================================
+** Checks
+** =======================================================
+*/
+
+/* constant folding: only '#' folds over a string literal */
+static const char fold[] =
+	"assert(-\"10\" == -10 and math.type(-\"10\") == 'integer')\n"
+	"assert(- \"1.5\" == -1.5)\n"
+	"assert(#\"hello\" == 5)\n"
+	"assert(not pcall(load('return ~\"3\"')))\n"
+	"assert(select(2, pcall(load('return ~\"3\"'))):find('bitwise'))\n";
+
+
+/*
+** a table getting a metatable while its hash part is being migrated:
+** a 'next' traversal across it sees every key once, and a weak mode
+** set then clears both parts
+*/
+static const char migration[] =
+	"local t = {}\n"
+	"for i = 1, 65540 do t[i + 0.5] = i end\n"
+	"local seen, dup, n = {}, 0, 0\n"
+	"local k = next(t)\n"
+	"while k do\n"
+	"  n = n + 1\n"
+	"  if n == 30000 then setmetatable(t, {}) end\n"
+	"  if seen[k] then dup = dup + 1 end\n"
+	"  seen[k] = true\n"
+	"  k = next(t, k)\n"
+	"end\n"
+	"assert(dup == 0 and n == 65540)\n"
+	"for _, mode in ipairs{'k', 'v', 'kv'} do\n"
+	"  local w, keep = {}, {}\n"
+	"  for i = 1, 65540 do\n"
+	"    local o = {}\n"
+	"    w[o] = {}\n"
+	"    if i % 2 == 0 then keep[#keep + 1] = o end\n"
+	"  end\n"
+	"  setmetatable(w, {__mode = mode})\n"
+	"  collectgarbage(); collectgarbage()\n"
+	"  local c = 0\n"
+	"  for _ in pairs(w) do c = c + 1 end\n"
+	"  assert(c == (mode == 'k' and #keep or 0), mode)\n"
+	"end\n";
+
+
+/* the telemetry counts the bytes freed when the sweep starts, too */
+static const char gcfreed[] =
+	"collectgarbage(); collectgarbage()\n"
+	"local t = {}\n"
+	"for i = 1, 200000 do t[i] = {i} end\n"
+	"local before = collectgarbage('count') * 1024\n"
+	"t = nil\n"
+	"collectgarbage()\n"
+	"local dropped = before - collectgarbage('count') * 1024\n"
+	"local st = collectgarbage('stats')\n"
+	"local c = st.cycles[#st.cycles]\n"
+	"assert(dropped > 20e6)\n"
+	"assert(math.abs(c.freed - dropped) < dropped / 20, c.freed)\n"
+	"assert(c.swept >= c.freed)\n";
+
+
+/*
+** an error in a coroutine does not close arena scopes: those of
+** another coroutine stay open while the failing one pops its own
+*/
+static const char arenas[] =
+	"local co = coroutine.wrap(function()\n"
+	"  collectgarbage('pusharena')\n"
+	"  pcall(function()\n"
+	"    coroutine.yield()\n"
+	"    collectgarbage('pusharena')\n"
+	"    error('x')\n"
+	"  end)\n"
+	"  collectgarbage('poparena')\n"
+	"  collectgarbage('poparena')\n"
+	"end)\n"
+	"co()\n"
+	"assert(collectgarbage('pusharena') == 2)\n"
+	"co()\n"
+	"assert(collectgarbage('pusharena') == 2)\n"
+	"collectgarbage('poparena'); collectgarbage('poparena')\n"
+	"assert(collectgarbage('pusharena') == 1)\n";
+
+
+/* the storage of string buffers is part of the Lua heap */
+static const char strbuf[] =
+	"collectgarbage(); collectgarbage('stop')\n"
+	"local c0 = collectgarbage('count')\n"
+	"debug.heapprofile(4096)\n"
+	"local b = string.newbuffer()\n"
+	"local function fill() b:rep('x', 4 * 1024 * 1024) end\n"
+	"fill()\n"
+	"assert(collectgarbage('count') - c0 >= 4096)\n"
+	"assert(debug.heapdump():find('fill@[^\\n]*;rep@%[C%];%[userdata%] %d+'))\n"
+	"b:reset():append('ab', 1, 2.5, b)\n"
+	"assert(b:tostring() == 'ab12.5ab12.5')\n"
+	"debug.heapprofile(0)\n"
+	"collectgarbage('restart')\n"
+	"b = nil\n"
+	"collectgarbage(); collectgarbage()\n"
+	"assert(collectgarbage('count') - c0 < 64)\n";
+
+
+/*
+** compiled patterns (in the pattern cache and in a running 'gmatch')
+** are copied by 'lua_freeze' and work in the clones
+*/
+static const char patclone_template[] =
+	"for _ = 1, 2 do\n"
+	"  assert(string.find('key = value42', '^(%a+)%s*=%s*(%w+)$'))\n"
+	"  assert(string.find('xx hello world', 'hello [a-z]+') == 4)\n"
+	"end\n"
+	"it = string.gmatch('a1 b2 c3 d4', '(%a)(%d)')\n"
+	"assert(it() == 'a')\n";
+
+static const char patclone_clone[] =
+	"local _, _, k, v = string.find('key = value42', '^(%a+)%s*=%s*(%w+)$')\n"
+	"assert(k == 'key' and v == 'value42')\n"
+	"assert(string.find('xx hello world', 'hello [a-z]+') == 4)\n"
+	"local l, n = it()\n"
+	"assert(l == 'b' and n == '2')\n"
+	"assert(it() == 'c' and it() == 'd' and it() == nil)\n";
+
+static void patclone(void) {
+	lua_State* T = newstate();
+	int i;
+	if (luaL_dostring(T, patclone_template) != LUA_OK ||
+		lua_freeze(T) != LUA_OK)
+		fail("patclone", lua_tostring(T, -1));
+	for (i = 0; i < 2; i++) {
+		lua_State* L = luaL_clone(T);
+		if (L == NULL)
+			fail("patclone", "cannot clone");
+		if (luaL_dostring(L, patclone_clone) != LUA_OK)
+			fail("patclone", lua_tostring(L, -1));
+		lua_close(L);
+	}
+	lua_close(T);
+}
+
+
+/* a bad fill value for 'array.T(n, x)' is reported as argument 2 */
+static const char arrayfill[] =
+	"for _, t in ipairs{'i32', 'f32', 'f64'} do\n"
+	"  local ok, msg = pcall(array[t], 3, 'x')\n"
+	"  assert(not ok and msg:find(\"#2 to 'array.\" .. t .. \"'\", 1, true))\n"
+	"  assert(array[t](3, 7)[3] == 7)\n"
+	"end\n"
+	"local ok, msg = pcall(array.i32, 3, 2^40)\n"
+	"assert(not ok and msg:find('#2', 1, true) and msg:find('int32'))\n";
+
+
+static const Check checks[] = {
+	{"fold", fold, NULL},
+	{"migration", migration, NULL},
+	{"gcfreed", gcfreed, NULL},
+	{"arenas", arenas, NULL},
+	{"strbuf", strbuf, NULL},
+	{"patclone", NULL, patclone},
+	{"arrayfill", arrayfill, NULL},
+	{NULL, NULL, NULL}
+};
+
+/* }====================================================== */
+
+
+int main(void) {
+	const Check* c;
+	for (c = checks; c->name != NULL; c++) {
+		printf("%s\n", c->name);
+		if (c->chunk != NULL)
+			dochunk(c->name, c->chunk);
+		if (c->f != NULL)
+			c->f();
+	}
+	printf("all checks passed\n");
+	return 0;
+}
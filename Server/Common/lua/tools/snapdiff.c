@@ -0,0 +1,789 @@
+/*
+** snapdiff: reads heap snapshots written by 'lua_heapsnapshot' (or
+** 'debug.heapsnapshot') and reports what retains memory. With one
+** snapshot, it lists the objects that retain the most memory; with two,
+** it lists the objects of the first one that retain the most memory
+** allocated after it (the usual shape of a leak: an old table in some
+** registry that keeps growing).
+**
+** Retained sizes come from the dominator tree of the object graph: an
+** object retains what can be reached only through it. Weak references
+** do not retain (values in weak-key tables are taken as strong). An
+** object of the second snapshot is new if the first one has no object
+** of the same type at the same address, so a new object reusing the
+** address of a dead one counts as old.
+**
+** Bytes in external buffers (see 'lua_newbufferuv') are not part of the
+** heap: they are counted apart, but they also make an object retain
+** memory.
+**
+** For each reported object, the output shows its type, what it retains,
+** a path from a root to it, and a few of the references that lead to
+** what it retains. Reported objects are the deepest ones: an object is
+** skipped when one of the objects it dominates holds 90% of its amount.
+**
+** Build (from this directory):
+**   cc -O2 -I../src snapdiff.c -o snapdiff
+** Usage:
+**   snapdiff [-n count] [old.snap] new.snap
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lsnap.h"
+
+
+#define NONE	(~0u)
+
+#define ROOTEDGE	0	/* kind of the references from the virtual root */
+
+#define MAXPATH	64	/* steps of a path shown in full */
+
+
+typedef struct Obj {
+	size_t id;
+	size_t size;
+	size_t retained;  /* bytes dominated, its own included */
+	size_t weight;  /* bytes dominated in counted objects */
+	size_t ncounted;  /* counted objects dominated */
+	size_t external;  /* external bytes dominated in counted objects */
+	size_t maxchild;  /* largest 'amount' of an eligible dominated object */
+	size_t extra;  /* string length, line where a prototype starts, or
+	                  bytes in the external buffer of a userdata */
+	const unsigned char* data;  /* string contents or prototype source */
+	unsigned datalen;
+	unsigned firstedge, nedges;
+	unsigned idom;  /* immediate dominator */
+	unsigned parent, parentedge;  /* how the shortest path reaches it */
+	unsigned po;  /* postorder number (NONE if not reachable) */
+	int tag;
+	int isnew;
+} Obj;
+
+typedef struct Edge {
+	size_t label;
+	size_t target;  /* id; after loading, index of the object (or NONE) */
+	int kind;
+} Edge;
+
+typedef struct Snap {
+	const char* name;
+	unsigned char* buff;
+	size_t size, pos;
+	Obj* objs;
+	size_t nobjs, sobjs;  /* last object is the virtual root */
+	Edge* edges;
+	size_t nedges, sedges;
+	unsigned* hash;  /* id -> index + 1 (0 for empty slots) */
+	size_t hsize;
+	unsigned* order;  /* reachable objects in postorder */
+	size_t norder;
+} Snap;
+
+
+static void fatal(const char* name, const char* msg) {
+	fprintf(stderr, "snapdiff: %s: %s\n", name, msg);
+	exit(1);
+}
+
+
+static void* xalloc(size_t n, size_t size) {
+	void* p = calloc(n + 1, size);
+	if (p == NULL)
+		fatal("snapdiff", "not enough memory");
+	return p;
+}
+
+
+static void* grow(void* block, size_t* size, size_t n, size_t elem) {
+	if (n >= *size) {
+		*size = (*size == 0) ? 1024 : 2 * *size;
+		block = realloc(block, *size * elem);
+		if (block == NULL)
+			fatal("snapdiff", "not enough memory");
+	}
+	return block;
+}
+
+
+/*
+** {======================================================
+** Reading
+** =======================================================
+*/
+
+#define basetype(t)	((t) & 0x0f)
+#define isstring(t)	(basetype(t) == LUA_TSTRING)
+#define isproto(t)	((t) == LUA_NUMTYPES + 1)
+#define isudata(t)	(basetype(t) == LUA_TUSERDATA)
+
+
+static int getbyte(Snap* S) {
+	if (S->pos >= S->size)
+		fatal(S->name, "truncated snapshot");
+	return S->buff[S->pos++];
+}
+
+
+static size_t getnum(Snap* S) {
+	size_t x = 0;
+	int shift = 0, b;
+	do {
+		b = getbyte(S);
+		x |= (size_t)(b & 0x7f) << shift;
+		shift += 7;
+	} while (b & 0x80);
+	return x;
+}
+
+
+static const unsigned char* getblock(Snap* S, size_t n) {
+	const unsigned char* p = S->buff + S->pos;
+	if (n > S->size - S->pos)
+		fatal(S->name, "truncated snapshot");
+	S->pos += n;
+	return p;
+}
+
+
+static Obj* newobj(Snap* S, int tag) {
+	Obj* o;
+	S->objs = (Obj*)grow(S->objs, &S->sobjs, S->nobjs, sizeof(Obj));
+	o = &S->objs[S->nobjs++];
+	memset(o, 0, sizeof(Obj));
+	o->tag = tag;
+	o->firstedge = (unsigned)S->nedges;
+	o->idom = o->parent = o->po = NONE;
+	return o;
+}
+
+
+static void newedge(Snap* S, Obj* o, int kind, size_t label, size_t id) {
+	Edge* e;
+	S->edges = (Edge*)grow(S->edges, &S->sedges, S->nedges, sizeof(Edge));
+	e = &S->edges[S->nedges++];
+	e->kind = kind;
+	e->label = label;
+	e->target = id;
+	o->nedges++;
+}
+
+
+static void readobject(Snap* S) {
+	Obj* o = newobj(S, getbyte(S));
+	int kind;
+	o->id = getnum(S);
+	o->size = getnum(S);
+	if (isstring(o->tag)) {
+		o->extra = getnum(S);
+		o->datalen = (unsigned)(o->extra < 64 ? o->extra : 64);
+		o->data = getblock(S, o->datalen);
+		return;  /* strings have no references */
+	}
+	if (isproto(o->tag)) {
+		o->extra = getnum(S);
+		o->datalen = (unsigned)getnum(S);
+		o->data = getblock(S, o->datalen);
+	}
+	else if (isudata(o->tag))
+		o->extra = getnum(S);
+	while ((kind = getbyte(S)) != 0) {
+		size_t label = getnum(S);
+		newedge(S, o, kind, label, getnum(S));
+	}
+}
+
+
+static size_t hashid(size_t id) {
+	id ^= id >> 17;
+	id *= (size_t)0x9e3779b97f4a7c15ull;
+	return id ^ (id >> 29);
+}
+
+
+static unsigned findobj(const Snap* S, size_t id) {
+	size_t i = hashid(id) & (S->hsize - 1);
+	while (S->hash[i] != 0) {
+		if (S->objs[S->hash[i] - 1].id == id)
+			return S->hash[i] - 1;
+		i = (i + 1) & (S->hsize - 1);
+	}
+	return NONE;
+}
+
+
+/*
+** Builds the index of the objects by id and replaces the ids in all
+** references by indices. References to objects not in the snapshot
+** (which should not happen) become NONE.
+*/
+static void resolve(Snap* S) {
+	size_t i;
+	S->hsize = 1024;
+	while (S->hsize < 2 * S->nobjs)
+		S->hsize *= 2;
+	S->hash = (unsigned*)xalloc(S->hsize, sizeof(unsigned));
+	for (i = 0; i < S->nobjs - 1; i++) {  /* skip the virtual root */
+		size_t j = hashid(S->objs[i].id) & (S->hsize - 1);
+		while (S->hash[j] != 0)
+			j = (j + 1) & (S->hsize - 1);
+		S->hash[j] = (unsigned)i + 1;
+	}
+	for (i = 0; i < S->nedges; i++)
+		S->edges[i].target = findobj(S, S->edges[i].target);
+}
+
+
+/*
+** Roots become references from a virtual object, added after all the
+** others, with kind ROOTEDGE and label 'kind * 256 + label'.
+*/
+static void readsnap(Snap* S, const char* name) {
+	FILE* f = fopen(name, "rb");
+	size_t sig = sizeof(LUA_SNAPSIGNATURE) - 1;
+	size_t nroots = 0, sroots = 0, i;
+	Edge* roots = NULL;
+	Obj* root;
+	memset(S, 0, sizeof(Snap));
+	S->name = name;
+	if (f == NULL || fseek(f, 0, SEEK_END) != 0)
+		fatal(name, "cannot open");
+	S->size = (size_t)ftell(f);
+	rewind(f);
+	S->buff = (unsigned char*)xalloc(S->size, 1);
+	if (fread(S->buff, 1, S->size, f) != S->size)
+		fatal(name, "cannot read");
+	fclose(f);
+	if (S->size < sig || memcmp(S->buff, LUA_SNAPSIGNATURE, sig) != 0)
+		fatal(name, "not a heap snapshot");
+	S->pos = sig;
+	if (getbyte(S) != LUA_SNAPVERSION)
+		fatal(name, "unknown snapshot version");
+	getnum(S);  /* Lua version */
+	for (;;) {
+		int c = getbyte(S);
+		if (c == 'O')
+			readobject(S);
+		else if (c == 'R') {
+			Edge* r;
+			roots = (Edge*)grow(roots, &sroots, nroots, sizeof(Edge));
+			r = &roots[nroots++];
+			r->kind = ROOTEDGE;
+			r->label = (size_t)getbyte(S) * 256;
+			r->label += getnum(S);
+			r->target = getnum(S);
+		}
+		else if (c == 'E') {
+			if (getnum(S) != S->nobjs)
+				fatal(name, "wrong number of objects");
+			break;
+		}
+		else
+			fatal(name, "bad record");
+	}
+	root = newobj(S, -1);
+	for (i = 0; i < nroots; i++)
+		newedge(S, root, ROOTEDGE, roots[i].label, roots[i].target);
+	free(roots);
+	resolve(S);
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Dominators
+** =======================================================
+*/
+
+#define rootof(S)	((unsigned)(S)->nobjs - 1)
+
+#define isstrong(e)	(!((e)->kind & SNAPWEAK) && (e)->target != NONE)
+
+/* bytes that count for reports: in the heap and in external buffers */
+#define amount(o)	((o)->weight + (o)->external)
+
+
+/*
+** Depth-first search from the virtual root along strong references,
+** numbering the reachable objects in postorder.
+*/
+static void search(Snap* S) {
+	size_t top = 0;
+	unsigned* stack = (unsigned*)xalloc(S->nobjs, sizeof(unsigned));
+	unsigned* next = (unsigned*)xalloc(S->nobjs, sizeof(unsigned));
+	char* seen = (char*)xalloc(S->nobjs, 1);
+	S->order = (unsigned*)xalloc(S->nobjs, sizeof(unsigned));
+	S->norder = 0;
+	seen[rootof(S)] = 1;
+	stack[top++] = rootof(S);
+	while (top > 0) {
+		unsigned u = stack[top - 1];
+		Obj* o = &S->objs[u];
+		if (next[u] < o->nedges) {
+			const Edge* e = &S->edges[o->firstedge + next[u]++];
+			if (isstrong(e) && !seen[e->target]) {
+				seen[e->target] = 1;
+				stack[top++] = (unsigned)e->target;
+			}
+		}
+		else {
+			o->po = (unsigned)S->norder;
+			S->order[S->norder++] = u;
+			top--;
+		}
+	}
+	free(stack);
+	free(next);
+	free(seen);
+}
+
+
+/*
+** Breadth-first search from the virtual root, keeping for each object
+** the reference that reached it first: following them back gives the
+** shortest paths, the ones shown in reports.
+*/
+static void paths(Snap* S) {
+	unsigned* queue = (unsigned*)xalloc(S->nobjs, sizeof(unsigned));
+	size_t head = 0, tail = 0;
+	S->objs[rootof(S)].parent = rootof(S);
+	queue[tail++] = rootof(S);
+	while (head < tail) {
+		unsigned u = queue[head++], k;
+		const Obj* o = &S->objs[u];
+		for (k = 0; k < o->nedges; k++) {
+			const Edge* e = &S->edges[o->firstedge + k];
+			if (isstrong(e) && S->objs[e->target].parent == NONE) {
+				S->objs[e->target].parent = u;
+				S->objs[e->target].parentedge = o->firstedge + k;
+				queue[tail++] = (unsigned)e->target;
+			}
+		}
+	}
+	free(queue);
+}
+
+
+static unsigned intersect(const Obj* objs, unsigned a, unsigned b) {
+	while (a != b) {
+		while (objs[a].po < objs[b].po) a = objs[a].idom;
+		while (objs[b].po < objs[a].po) b = objs[b].idom;
+	}
+	return a;
+}
+
+
+/*
+** Immediate dominators, with the iterative algorithm of Cooper, Harvey
+** and Kennedy over the predecessors of each reachable object.
+*/
+static void dominators(Snap* S) {
+	Obj* objs = S->objs;
+	unsigned* start = (unsigned*)xalloc(S->nobjs + 1, sizeof(unsigned));
+	unsigned* preds;
+	size_t i;
+	int changed = 1;
+	for (i = 0; i < S->norder; i++) {  /* count predecessors */
+		unsigned u = S->order[i], k;
+		for (k = 0; k < objs[u].nedges; k++) {
+			const Edge* e = &S->edges[objs[u].firstedge + k];
+			if (isstrong(e))
+				start[e->target + 1]++;
+		}
+	}
+	for (i = 0; i < S->nobjs; i++)
+		start[i + 1] += start[i];
+	preds = (unsigned*)xalloc(start[S->nobjs], sizeof(unsigned));
+	for (i = 0; i < S->norder; i++) {  /* fill them */
+		unsigned u = S->order[i], k;
+		for (k = 0; k < objs[u].nedges; k++) {
+			const Edge* e = &S->edges[objs[u].firstedge + k];
+			if (isstrong(e))
+				preds[--start[e->target + 1]] = u;
+		}
+	}
+	/* predecessors of 'v' are now in [start[v + 1], start[v + 2]) */
+	objs[rootof(S)].idom = rootof(S);
+	while (changed) {
+		changed = 0;
+		for (i = S->norder - 1; i-- > 0; ) {  /* reverse postorder */
+			unsigned v = S->order[i], k, nidom = NONE;
+			for (k = start[v + 1]; k < start[v + 2]; k++) {
+				unsigned p = preds[k];
+				if (objs[p].idom == NONE)
+					continue;  /* not processed yet */
+				nidom = (nidom == NONE) ? p : intersect(objs, p, nidom);
+			}
+			if (objs[v].idom != nidom) {
+				objs[v].idom = nidom;
+				changed = 1;
+			}
+		}
+	}
+	free(start);
+	free(preds);
+}
+
+
+/*
+** Accumulates sizes up the dominator tree (dominated objects come
+** first in postorder). 'eligible' objects are the ones that may be
+** reported.
+*/
+static void retain(Snap* S, int diff) {
+	size_t i;
+	for (i = 0; i < S->norder; i++) {
+		Obj* o = &S->objs[S->order[i]];
+		o->retained += o->size;
+		if (!diff || o->isnew) {
+			o->weight += o->size;
+			if (isudata(o->tag))
+				o->external += o->extra;
+			o->ncounted++;
+		}
+	}
+	for (i = 0; i + 1 < S->norder; i++) {  /* all but the virtual root */
+		Obj* o = &S->objs[S->order[i]];
+		Obj* d = &S->objs[o->idom];
+		d->retained += o->retained;
+		d->weight += o->weight;
+		d->external += o->external;
+		d->ncounted += o->ncounted;
+		if ((!diff || !o->isnew) && amount(o) > d->maxchild)
+			d->maxchild = amount(o);
+	}
+}
+
+
+static void analyze(Snap* S, int diff) {
+	search(S);
+	paths(S);
+	dominators(S);
+	retain(S, diff);
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Reports
+** =======================================================
+*/
+
+static const char* const typenames[] = {
+	"nil", "boolean", "userdata", "number", "string", "table",
+	"function", "userdata", "thread", "upvalue", "proto", "external"
+};
+
+
+static const char* typename(int tag) {
+	if (tag < 0)
+		return "root";
+	return (basetype(tag) <= LUA_NUMTYPES + 1) ? typenames[basetype(tag)]
+	                                           : "?";
+}
+
+
+static void printstring(const Obj* o) {
+	unsigned i;
+	putchar('"');
+	for (i = 0; i < o->datalen; i++) {
+		int c = o->data[i];
+		if (c == '"' || c == '\\')
+			printf("\\%c", c);
+		else if (c >= 32 && c < 127)
+			putchar(c);
+		else
+			printf("\\%d", c);
+	}
+	printf(o->extra > o->datalen ? "\"..." : "\"");
+}
+
+
+static void printproto(const Obj* o) {
+	const unsigned char* src = o->data;
+	unsigned len = o->datalen;
+	if (len > 0 && (src[0] == '@' || src[0] == '=')) {
+		src++; len--;
+	}
+	else
+		len = 0;  /* source is a string chunk; do not show it */
+	printf("%.*s:%lu", (int)len, (const char*)src, (unsigned long)o->extra);
+}
+
+
+/* describes an object: its type and, when possible, what it is */
+static void describe(const Snap* S, unsigned i) {
+	const Obj* o = &S->objs[i];
+	printf("%s", typename(o->tag));
+	if (isstring(o->tag)) {
+		putchar(' ');
+		printstring(o);
+	}
+	else if (isproto(o->tag)) {
+		putchar(' ');
+		printproto(o);
+	}
+	else if (isudata(o->tag) && o->extra > 0)
+		printf(" [%lu external bytes]", (unsigned long)o->extra);
+	else if (basetype(o->tag) == LUA_TFUNCTION && o->nedges > 0) {
+		const Edge* e = &S->edges[o->firstedge];  /* prototype comes first */
+		if (e->kind == SNAP_OTHER && e->target != NONE &&
+			isproto(S->objs[e->target].tag)) {
+			putchar(' ');
+			printproto(&S->objs[e->target]);
+		}
+	}
+}
+
+
+static int isname(const Obj* o) {
+	unsigned i;
+	if (o->datalen == 0 || o->extra != o->datalen ||
+		(o->data[0] >= '0' && o->data[0] <= '9'))
+		return 0;
+	for (i = 0; i < o->datalen; i++) {
+		int c = o->data[i];
+		if (!(c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+			(c >= '0' && c <= '9')))
+			return 0;
+	}
+	return 1;
+}
+
+
+static void printedge(const Snap* S, const Edge* e) {
+	switch (e->kind & ~SNAPWEAK) {
+	case ROOTEDGE: {
+		static const char* const roots[] = {
+			"?", "registry", "mainthread", "metatable", "fixed", "finalizing"
+		};
+		int kind = (int)(e->label / 256);
+		printf("%s", roots[kind <= SNAPR_FINALIZE ? kind : 0]);
+		if (kind == SNAPR_META)
+			printf("(%s)", typename((int)(e->label % 256)));
+		break;
+	}
+	case SNAP_INDEX:
+		printf("[%lu]", (unsigned long)e->label);
+		break;
+	case SNAP_FIELD: {
+		unsigned k = findobj(S, e->label);
+		if (k == NONE)
+			printf("[?]");
+		else if (isname(&S->objs[k]))
+			printf(".%.*s", (int)S->objs[k].datalen, (const char*)S->objs[k].data);
+		else {
+			putchar('[');
+			printstring(&S->objs[k]);
+			putchar(']');
+		}
+		break;
+	}
+	case SNAP_VALUE: printf("[<key>]"); break;
+	case SNAP_KEY: printf(".<key>"); break;
+	case SNAP_META: printf(".<metatable>"); break;
+	case SNAP_UPVAL: printf(".<upvalue %lu>", (unsigned long)e->label); break;
+	case SNAP_STACK: printf(".<stack %lu>", (unsigned long)e->label); break;
+	default: printf(".<ref>"); break;
+	}
+}
+
+
+/*
+** Prints how the search reached an object, from its root; the global
+** table (registry[LUA_RIDX_GLOBALS]) is shown as "_G".
+*/
+static void printpath(const Snap* S, unsigned i) {
+	unsigned path[MAXPATH];
+	int n = 0, skipped = 0;
+	while (i != rootof(S)) {
+		if (n == MAXPATH) {  /* too long? drop the middle */
+			memmove(path + MAXPATH / 2, path + MAXPATH / 2 + 1,
+				(MAXPATH / 2 - 1) * sizeof(unsigned));
+			n--;
+			skipped++;
+		}
+		path[n++] = S->objs[i].parentedge;
+		i = S->objs[i].parent;
+	}
+	while (n-- > 0) {
+		const Edge* e = &S->edges[path[n]];
+		if (e->kind == ROOTEDGE && e->label == SNAPR_REGISTRY * 256 && n > 0 &&
+			S->edges[path[n - 1]].kind == SNAP_INDEX &&
+			S->edges[path[n - 1]].label == LUA_RIDX_GLOBALS) {
+			printf("_G");
+			n--;
+			continue;
+		}
+		printedge(S, e);
+		if (n == MAXPATH / 2 && skipped > 0)
+			printf("...(%d more)...", skipped);
+	}
+}
+
+
+/* a few references from 'i' to what it retains */
+static void printsamples(const Snap* S, unsigned i, int diff) {
+	const Obj* o = &S->objs[i];
+	unsigned k, shown = 0;
+	for (k = 0; k < o->nedges && shown < 3; k++) {
+		const Edge* e = &S->edges[o->firstedge + k];
+		const Obj* t;
+		if (!isstrong(e))
+			continue;
+		t = &S->objs[e->target];
+		if (t->idom != i || amount(t) == 0 || (diff && !t->isnew))
+			continue;
+		printf("      ");
+		printedge(S, e);
+		printf(" -> ");
+		describe(S, (unsigned)e->target);
+		printf(" (%lu bytes)\n", (unsigned long)t->retained);
+		shown++;
+	}
+}
+
+
+static const Snap* sortsnap;
+
+static int byweight(const void* a, const void* b) {
+	size_t wa = amount(&sortsnap->objs[*(const unsigned*)a]);
+	size_t wb = amount(&sortsnap->objs[*(const unsigned*)b]);
+	return (wa < wb) - (wa > wb);
+}
+
+
+static void report(const Snap* S, int diff, int count) {
+	unsigned* cand = (unsigned*)xalloc(S->norder, sizeof(unsigned));
+	size_t n = 0, i;
+	for (i = 0; i + 1 < S->norder; i++) {  /* all but the virtual root */
+		unsigned v = S->order[i];
+		const Obj* o = &S->objs[v];
+		if (amount(o) > 0 && (!diff || !o->isnew) &&
+			o->maxchild < amount(o) / 10 * 9)  /* not mostly in one child? */
+			cand[n++] = v;
+	}
+	sortsnap = S;
+	qsort(cand, n, sizeof(unsigned), byweight);
+	printf("\n%s:\n", diff ? "old objects retaining new memory"
+	                       : "objects retaining memory");
+	for (i = 0; i < n && i < (size_t)count; i++) {
+		const Obj* o = &S->objs[cand[i]];
+		printf("%3lu) %lu bytes in %lu %sobjects",
+			(unsigned long)i + 1, (unsigned long)o->weight,
+			(unsigned long)o->ncounted, diff ? "new " : "");
+		if (o->external > 0)
+			printf(" plus %lu external bytes", (unsigned long)o->external);
+		printf(", retained by ");
+		describe(S, cand[i]);
+		printf(" (%lu bytes in all)\n     ", (unsigned long)o->retained);
+		printpath(S, cand[i]);
+		printf("\n");
+		printsamples(S, cand[i], diff);
+	}
+	free(cand);
+}
+
+
+typedef struct TypeStats {
+	size_t count, bytes;
+} TypeStats;
+
+/* one entry per type, plus one for external buffers */
+#define EXTSTATS	(LUA_NUMTYPES + 2)
+#define NSTATS		(EXTSTATS + 1)
+
+
+static void typestats(const Snap* S, TypeStats* st) {
+	size_t i;
+	memset(st, 0, NSTATS * sizeof(TypeStats));
+	for (i = 0; i + 1 < S->norder; i++) {
+		const Obj* o = &S->objs[S->order[i]];
+		if (basetype(o->tag) <= LUA_NUMTYPES + 1) {
+			st[basetype(o->tag)].count++;
+			st[basetype(o->tag)].bytes += o->size;
+		}
+		if (isudata(o->tag) && o->extra > 0) {
+			st[EXTSTATS].count++;
+			st[EXTSTATS].bytes += o->extra;
+		}
+	}
+}
+
+
+static void summary(const Snap* old, const Snap* S) {
+	TypeStats ost[NSTATS], st[NSTATS];
+	int t;
+	typestats(S, st);
+	if (old == NULL) {
+		printf("%-10s %12s %14s\n", "type", "count", "bytes");
+		for (t = 0; t < NSTATS; t++)
+			if (st[t].count > 0 && t != LUA_TLIGHTUSERDATA)
+				printf("%-10s %12lu %14lu\n", typenames[t],
+					(unsigned long)st[t].count, (unsigned long)st[t].bytes);
+		return;
+	}
+	typestats(old, ost);
+	printf("%-10s %12s %12s %14s %14s\n",
+		"type", "old count", "new count", "old bytes", "delta bytes");
+	for (t = 0; t < NSTATS; t++)
+		if ((st[t].count > 0 || ost[t].count > 0) && t != LUA_TLIGHTUSERDATA)
+			printf("%-10s %12lu %12lu %14lu %+14ld\n", typenames[t],
+				(unsigned long)ost[t].count, (unsigned long)st[t].count,
+				(unsigned long)ost[t].bytes,
+				(long)st[t].bytes - (long)ost[t].bytes);
+}
+
+/* }====================================================== */
+
+
+static void marknew(const Snap* old, Snap* S) {
+	size_t i;
+	for (i = 0; i + 1 < S->nobjs; i++) {
+		Obj* o = &S->objs[i];
+		unsigned k = findobj(old, o->id);
+		o->isnew = (k == NONE || old->objs[k].tag != o->tag);
+	}
+}
+
+
+int main(int argc, char** argv) {
+	Snap old, cur;
+	const char* names[2];
+	int nnames = 0, count = 20, i;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			count = atoi(argv[++i]);
+		else if (argv[i][0] != '-' && nnames < 2)
+			names[nnames++] = argv[i];
+		else
+			nnames = 3;  /* force usage message */
+	}
+	if (nnames < 1 || nnames > 2) {
+		fprintf(stderr, "usage: %s [-n count] [old.snap] new.snap\n", argv[0]);
+		return 1;
+	}
+	if (nnames == 1) {
+		readsnap(&cur, names[0]);
+		analyze(&cur, 0);
+		summary(NULL, &cur);
+		report(&cur, 0, count);
+	}
+	else {
+		readsnap(&old, names[0]);
+		readsnap(&cur, names[1]);
+		marknew(&old, &cur);
+		analyze(&old, 0);
+		analyze(&cur, 1);
+		summary(&old, &cur);
+		report(&cur, 1, count);
+	}
+	return 0;
+}
@@ -0,0 +1,86 @@
+// https://github.com/vinniefalco/LuaBridge
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <LuaBridge/detail/Stack.h>
+
+#include "lualib.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace luabridge {
+
+/**
+ * Element types of the typed arrays of the Lua "array" library.
+ */
+template<class T>
+struct TypedArrayTraits;
+
+template<>
+struct TypedArrayTraits<std::int32_t>
+{
+    static int const type = LUA_ARRAY_I32;
+};
+
+template<>
+struct TypedArrayTraits<float>
+{
+    static int const type = LUA_ARRAY_F32;
+};
+
+template<>
+struct TypedArrayTraits<double>
+{
+    static int const type = LUA_ARRAY_F64;
+};
+
+/**
+ * A view of the elements of a typed array, without copying them.
+ *
+ * The view is only valid while the array userdata is alive: keep it for
+ * the duration of the call that got it, or hold a reference to the array.
+ * Pushing a view creates a new array with a copy of the elements.
+ */
+template<class T>
+struct TypedArrayView
+{
+    T* data;
+    std::size_t size;
+
+    T* begin() const { return data; }
+    T* end() const { return data + size; }
+    T& operator[](std::size_t i) const { return data[i]; }
+};
+
+template<class T>
+struct Stack<TypedArrayView<T>>
+{
+    static void push(lua_State* L, TypedArrayView<T> const& view)
+    {
+        void* data = luaL_newarray(L, TypedArrayTraits<T>::type, view.size);
+        if (view.size > 0)
+        {
+            std::memcpy(data, view.data, view.size * sizeof(T));
+        }
+    }
+
+    static TypedArrayView<T> get(lua_State* L, int index)
+    {
+        TypedArrayView<T> view;
+        view.data = static_cast<T*>(
+            luaL_checkarray(L, index, TypedArrayTraits<T>::type, &view.size));
+        return view;
+    }
+
+    static bool isInstance(lua_State* L, int index)
+    {
+        int type;
+        return luaL_toarray(L, index, &type, nullptr) != nullptr &&
+               type == TypedArrayTraits<T>::type;
+    }
+};
+
+} // namespace luabridge
@@ -15,12 +15,13 @@ struct Stack<std::vector<T>>
 {
     static void push(lua_State* L, std::vector<T> const& vector)
     {
+        // Presize the array part, as table.new does, and store straight into
+        // it: the fresh table has no metatable, so no need for lua_settable.
         lua_createtable(L, static_cast<int>(vector.size()), 0);
-        for (std::size_t i = 0; i < vector.size(); ++i)
+        for (std::size_t i = 1; i <= vector.size(); ++i)
         {
-            lua_pushinteger(L, static_cast<lua_Integer>(i + 1));
-            Stack<T>::push(L, vector[i]);
-            lua_settable(L, -3);
+            Stack<T>::push(L, vector[i - 1]);
+            lua_rawseti(L, -2, i);
         }
     }
 
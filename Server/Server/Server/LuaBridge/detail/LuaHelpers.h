@@ -104,6 +104,22 @@ inline void rawsetfield(lua_State* L, int index, char const* key)
     lua_rawset(L, index);
 }
 
+/** Push a getter closure with n upvalues.
+
+    Getters that do not receive the lua_State always return exactly one
+    value and never call back into Lua, so when the Lua core supports
+    leaf C functions they are pushed as such and take the shorter call
+    path. Getters taking a lua_State* must use lua_pushcclosure instead.
+*/
+inline void pushgetterclosure(lua_State* L, lua_CFunction fp, int n)
+{
+#if defined(lua_pushleafcfunction)
+    lua_pushleafcclosure(L, fp, n, 1);
+#else
+    lua_pushcclosure(L, fp, n);
+#endif
+}
+
 /** Returns true if the value is a full userdata (not light).
  */
 inline bool isfulluserdata(lua_State* L, int index)
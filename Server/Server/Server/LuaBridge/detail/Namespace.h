@@ -455,7 +455,7 @@ class Namespace : public detail::Registrar
             assertStackState(); // Stack: const table (co), class table (cl), static table (st)
 
             lua_pushlightuserdata(L, value); // Stack: co, cl, st, pointer
-            lua_pushcclosure(L, &CFunc::getVariable<U>, 1); // Stack: co, cl, st, getter
+            pushgetterclosure(L, &CFunc::getVariable<U>, 1); // Stack: co, cl, st, getter
             CFunc::addGetter(L, name, -2); // Stack: co, cl, st
 
             if (isWritable)
@@ -595,7 +595,7 @@ class Namespace : public detail::Registrar
 
             typedef const U T::*mp_t;
             new (lua_newuserdata(L, sizeof(mp_t))) mp_t(mp); // Stack: co, cl, st, field ptr
-            lua_pushcclosure(L, &CFunc::getProperty<T, U>, 1); // Stack: co, cl, st, getter
+            pushgetterclosure(L, &CFunc::getProperty<T, U>, 1); // Stack: co, cl, st, getter
             lua_pushvalue(L, -1); // Stack: co, cl, st, getter, getter
             CFunc::addGetter(L, name, -5); // Stack: co, cl, st, getter
             CFunc::addGetter(L, name, -3); // Stack: co, cl, st
@@ -621,7 +621,7 @@ class Namespace : public detail::Registrar
 
             typedef TG (T::*get_t)() const;
             new (lua_newuserdata(L, sizeof(get_t))) get_t(get); // Stack: co, cl, st, funcion ptr
-            lua_pushcclosure(L, &CFunc::CallConstMember<get_t>::f, 1); // Stack: co, cl, st, getter
+            pushgetterclosure(L, &CFunc::CallConstMember<get_t>::f, 1); // Stack: co, cl, st, getter
             lua_pushvalue(L, -1); // Stack: co, cl, st, getter, getter
             CFunc::addGetter(L, name, -5); // Stack: co, cl, st, getter
             CFunc::addGetter(L, name, -3); // Stack: co, cl, st
@@ -651,6 +651,7 @@ class Namespace : public detail::Registrar
 
             typedef TG (T::*get_t)(lua_State*) const;
             new (lua_newuserdata(L, sizeof(get_t))) get_t(get); // Stack: co, cl, st, funcion ptr
+            // Not a leaf: a getter given the lua_State may call back into Lua
             lua_pushcclosure(L, &CFunc::CallConstMember<get_t>::f, 1); // Stack: co, cl, st, getter
             lua_pushvalue(L, -1); // Stack: co, cl, st, getter, getter
             CFunc::addGetter(L, name, -5); // Stack: co, cl, st, getter
@@ -1148,7 +1149,7 @@ public:
         assert(lua_istable(L, -1)); // Stack: namespace table (ns)
 
         lua_pushlightuserdata(L, value); // Stack: ns, pointer
-        lua_pushcclosure(L, &CFunc::getVariable<T>, 1); // Stack: ns, getter
+        pushgetterclosure(L, &CFunc::getVariable<T>, 1); // Stack: ns, getter
         CFunc::addGetter(L, name, -2); // Stack: ns
 
         if (isWritable)